@@ -24,6 +24,10 @@
 #include <string.h>
 #include <assert.h>
 #include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 
 static pthread_cond_t maintenance_cond = PTHREAD_COND_INITIALIZER;
 static pthread_mutex_t maintenance_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -34,51 +38,453 @@ unsigned int hashpower = HASHPOWER_DEFAULT;
 #define hashsize(n) ((uint64_t)1<<(n))
 #define hashmask(n) (hashsize(n)-1)
 
-/* Main hash table. This is where we look except during expansion. */
-static item** primary_hashtable = 0;
-
 /*
- * Previous hash table. During expansion, we look here for keys that haven't
- * been moved over to the primary yet.
+ * Resizing
+ *
+ * The table grows and shrinks one bucket at a time (linear hashing) rather
+ * than by doubling into a new table. hash_buckets is the number of buckets
+ * in use and hashpower is floor(log2(hash_buckets)). A hash value maps to
+ * bucket hv & hashmask(hashpower + 1), or to hv & hashmask(hashpower) if
+ * that bucket doesn't exist yet. Adding bucket N splits bucket
+ * N - 2^hashpower, moving over the items whose hash has bit hashpower set;
+ * removing the last bucket merges it back into that same buddy.
+ *
+ * A bucket and its buddy share their low hashpower bits and so an item
+ * lock. Changing hash_buckets by one only moves keys between those two
+ * buckets, so a split or merge needs nothing but that lock, and lookups
+ * just read hash_buckets once: no old table, no expansion checks on every
+ * access and no pausing of worker threads.
+ *
+ * Buckets live in fixed size segments reached through a directory sized
+ * for HASHPOWER_MAX, so growing allocates a segment at a time and existing
+ * buckets never move.
+ *
+ * The maintenance thread does most of the work. assoc_start_resize() checks
+ * once a second and wakes it when the table is over three quarters of its
+ * load; it then grows the table to the next power of two, so it settles at
+ * the same sizes doubling always gave. Between wakeups, an insert that finds
+ * the table over its full load splits one bucket itself if nobody else is
+ * resizing. With -o hash_shrink the table also shrinks once it falls below
+ * a quarter of its load, to the power of two that leaves it at most half
+ * full.
  */
-static item** old_hashtable = 0;
+#define ASSOC_SEGMENT_POWER 12
+#define ASSOC_SEGMENT_SIZE hashsize(ASSOC_SEGMENT_POWER)
+#define ASSOC_SEGMENT_MASK hashmask(ASSOC_SEGMENT_POWER)
+
+static void **segments = 0;
+
+/* Read without locks; only changed with maintenance_lock held. */
+static uint64_t hash_buckets = 0;
 
-/* Flag: Are we in the middle of expanding now? */
-static bool expanding = false;
+/* Never shrink below the initial size; the item locks assume at least that. */
+static uint64_t min_buckets = 0;
+
+/* Bucket count the maintenance thread is working towards, 0 when idle. */
+static uint64_t resize_target = 0;
+
+/* Set once the maintenance thread runs; the item locks exist by then. */
+static bool resize_enabled = false;
 
 /*
- * During expansion we migrate values with bucket granularity; this is how
- * far we've gotten so far. Ranges from 0 .. hashsize(hashpower - 1) - 1.
+ * Bucketized index (-o hash_index=bucketized)
+ *
+ * Instead of a pointer per bucket and a chain through h_next, each bucket
+ * is one cache line holding several (16-bit hash tag, item pointer) slots.
+ * A lookup compares the tag of every slot at once and only touches items
+ * whose tag matches, so a miss or a long bucket no longer costs one
+ * dependent cache miss per item. Slots are kept packed at the front of a
+ * bucket; when all are in use, further items go to overflow buckets chained
+ * off the bucket through next. Only the last bucket of a chain is ever
+ * partially used.
+ *
+ * The tag is the top 16 bits of the hash value. Once hashpower exceeds 16
+ * some of those bits also select the bucket, leaving 32 - hashpower bits to
+ * tell items within a bucket apart. It also means splits from there on can
+ * sort items by tag without touching them.
+ *
+ * hashpower counts buckets in both layouts, so all items of a bucket
+ * (overflow included) are still covered by one item lock, and resizing
+ * works the same way: items move between a bucket and its buddy.
  */
-static uint64_t expand_bucket = 0;
+#define ASSOC_BUCKET_SLOTS 5
+/* Grow when there are this many items per bucket on average */
+#define ASSOC_BUCKET_LOAD 3
+
+typedef struct _assoc_bucket {
+    uint16_t tags[ASSOC_BUCKET_SLOTS];
+    uint16_t used;      /* slots in use, always the first ones */
+    uint16_t pad[2];    /* tags + used + pad is one 16 byte vector */
+    item *items[ASSOC_BUCKET_SLOTS];
+    struct _assoc_bucket *next; /* overflow, only set when all slots are used */
+} assoc_bucket;
+
+#define bucketized() (settings.hash_index == HASH_INDEX_BUCKETIZED)
+#define bucket_bytes() (bucketized() ? sizeof(assoc_bucket) : sizeof(item *))
+
+static inline uint16_t bucket_tag(const uint32_t hv) {
+    return hv >> 16;
+}
+
+static inline unsigned int hash_level(const uint64_t buckets) {
+    return 63 - __builtin_clzll(buckets);
+}
+
+/* Which bucket a hash value is in right now. */
+static inline uint64_t hash_bucket(const uint32_t hv) {
+    uint64_t buckets = __atomic_load_n(&hash_buckets, __ATOMIC_ACQUIRE);
+    unsigned int level = hash_level(buckets);
+    uint64_t bucket = hv & hashmask(level + 1);
+
+    if (bucket >= buckets) {
+        bucket = hv & hashmask(level);
+    }
+    return bucket;
+}
+
+static inline item **chain_head(const uint64_t bucket) {
+    return &((item **)segments[bucket >> ASSOC_SEGMENT_POWER])[bucket & ASSOC_SEGMENT_MASK];
+}
+
+static inline assoc_bucket *bucket_head(const uint64_t bucket) {
+    return &((assoc_bucket *)segments[bucket >> ASSOC_SEGMENT_POWER])[bucket & ASSOC_SEGMENT_MASK];
+}
+
+/* Items the table holds before it wants to grow. */
+static uint64_t bucket_capacity(const uint64_t buckets) {
+    return bucketized() ? buckets * ASSOC_BUCKET_LOAD : (buckets * 3) / 2;
+}
+
+/* Smallest power of two number of buckets that holds this many items at
+ * no more than half load. Where shrinking stops. */
+static uint64_t buckets_for(const uint64_t items) {
+    uint64_t needed = bucketized() ? (items * 2 + ASSOC_BUCKET_LOAD - 1) / ASSOC_BUCKET_LOAD
+                                   : (items * 4 + 2) / 3;
+    uint64_t buckets = min_buckets;
+
+    while (buckets < needed && buckets < hashsize(HASHPOWER_MAX)) {
+        buckets *= 2;
+    }
+    return buckets;
+}
+
+static bool segment_alloc(const uint64_t segment) {
+    size_t len = ASSOC_SEGMENT_SIZE * bucket_bytes();
+    void *ptr = NULL;
+
+    if (posix_memalign(&ptr, sizeof(assoc_bucket), len) != 0) {
+        return false;
+    }
+    memset(ptr, 0, len);
+    segments[segment] = ptr;
+    STATS_LOCK();
+    stats_state.hash_bytes += len;
+    STATS_UNLOCK();
+    return true;
+}
+
+static void segment_free(const uint64_t segment) {
+    free(segments[segment]);
+    segments[segment] = NULL;
+    STATS_LOCK();
+    stats_state.hash_bytes -= ASSOC_SEGMENT_SIZE * bucket_bytes();
+    STATS_UNLOCK();
+}
+
+static assoc_bucket *bucket_overflow_alloc(void) {
+    void *ptr = NULL;
+    if (posix_memalign(&ptr, sizeof(assoc_bucket), sizeof(assoc_bucket)) != 0) {
+        /* Without a slot the item could never be found or unlinked again. */
+        fprintf(stderr, "Failed to allocate a hash overflow bucket.\n");
+        abort();
+    }
+    memset(ptr, 0, sizeof(assoc_bucket));
+    STATS_LOCK();
+    stats_state.hash_bytes += sizeof(assoc_bucket);
+    STATS_UNLOCK();
+    return ptr;
+}
+
+static void bucket_overflow_free(assoc_bucket *b) {
+    free(b);
+    STATS_LOCK();
+    stats_state.hash_bytes -= sizeof(assoc_bucket);
+    STATS_UNLOCK();
+}
+
+
+/* Slots of the bucket whose tag matches; two mask bits per slot. */
+static inline unsigned int bucket_match(const assoc_bucket *b, const uint16_t tag) {
+    unsigned int used = (1u << (b->used * 2)) - 1;
+#ifdef __SSE2__
+    __m128i tags = _mm_load_si128((const __m128i *)b->tags);
+    __m128i eq = _mm_cmpeq_epi16(tags, _mm_set1_epi16((short)tag));
+    return (unsigned int)_mm_movemask_epi8(eq) & used;
+#else
+    unsigned int mask = 0;
+    for (int i = 0; i < b->used; i++) {
+        if (b->tags[i] == tag)
+            mask |= 3u << (i * 2);
+    }
+    return mask & used;
+#endif
+}
+
+/* Returns the bucket of the chain holding the key and its slot, or NULL. */
+static assoc_bucket *bucket_find(assoc_bucket *head, const char *key, const size_t nkey, const uint32_t hv, int *slot) {
+    const uint16_t tag = bucket_tag(hv);
+    assoc_bucket *b;
+#ifdef ENABLE_DTRACE
+    int depth = 0;
+#endif
+
+    for (b = head; b != NULL; b = b->next) {
+        unsigned int mask = bucket_match(b, tag);
+        while (mask) {
+            int i = __builtin_ctz(mask) / 2;
+            item *it = b->items[i];
+            if ((nkey == it->nkey) && (memcmp(key, ITEM_key(it), nkey) == 0)) {
+                *slot = i;
+                MEMCACHED_ASSOC_FIND(key, nkey, depth);
+                return b;
+            }
+            mask &= ~(3u << (i * 2));
+#ifdef ENABLE_DTRACE
+            ++depth;
+#endif
+        }
+    }
+    MEMCACHED_ASSOC_FIND(key, nkey, depth);
+    return NULL;
+}
+
+static void bucket_insert(assoc_bucket *b, item *it, const uint16_t tag) {
+    while (b->used == ASSOC_BUCKET_SLOTS) {
+        if (b->next == NULL) {
+            b->next = bucket_overflow_alloc();
+        }
+        b = b->next;
+    }
+    b->tags[b->used] = tag;
+    b->items[b->used] = it;
+    b->used++;
+}
+
+/* Empties a slot by moving the chain's last entry into it, keeping slots
+ * packed. Frees the last overflow bucket if that leaves it empty. */
+static void bucket_remove(assoc_bucket *head, assoc_bucket *b, const int slot) {
+    assoc_bucket *last, *prev = NULL;
+
+    for (last = head; last->next != NULL; last = last->next) {
+        prev = last;
+    }
+    last->used--;
+    b->tags[slot] = last->tags[last->used];
+    b->items[slot] = last->items[last->used];
+    last->items[last->used] = NULL;
+    if (last->used == 0 && prev != NULL) {
+        prev->next = NULL;
+        bucket_overflow_free(last);
+    }
+}
+
+static void bucket_delete(const char *key, const size_t nkey, const uint32_t hv) {
+    assoc_bucket *head = bucket_head(hash_bucket(hv));
+    int slot = 0;
+    assoc_bucket *b = bucket_find(head, key, nkey, hv, &slot);
+
+    /* Note: callers don't delete things they can't find. */
+    assert(b != NULL);
+    if (b == NULL) {
+        return;
+    }
+    MEMCACHED_ASSOC_DELETE(key, nkey);
+    bucket_remove(head, b, slot);
+}
+
+/* Moves the items of bucket from with this hash bit set over to bucket to. */
+static void bucket_split(const uint64_t from, const uint64_t to, const uint32_t bit) {
+    assoc_bucket *head = bucket_head(from);
+    assoc_bucket *dst = bucket_head(to);
+    assoc_bucket *b = head;
+    int i = 0;
+
+    while (b != NULL) {
+        if (i == b->used) {
+            b = b->next;
+            i = 0;
+            continue;
+        }
+        item *it = b->items[i];
+        uint32_t hv = bit >= hashsize(16) ? (uint32_t)b->tags[i] << 16 : hash(ITEM_key(it), it->nkey);
+        if (hv & bit) {
+            bool last = b != head && b->next == NULL && b->used == 1;
+            bucket_insert(dst, it, b->tags[i]);
+            /* The slot now holds another entry, or b was freed. */
+            bucket_remove(head, b, i);
+            if (last) {
+                break;
+            }
+        } else {
+            i++;
+        }
+    }
+}
+
+/* Moves everything in bucket from over to bucket to. */
+static void bucket_merge(const uint64_t from, const uint64_t to) {
+    assoc_bucket *b = bucket_head(from);
+    assoc_bucket *dst = bucket_head(to);
+    assoc_bucket *next;
+    bool head = true;
+
+    for (; b != NULL; b = next) {
+        for (int i = 0; i < b->used; i++) {
+            bucket_insert(dst, b->items[i], b->tags[i]);
+        }
+        next = b->next;
+        if (head) {
+            memset(b, 0, sizeof(assoc_bucket));
+            head = false;
+        } else {
+            bucket_overflow_free(b);
+        }
+    }
+}
+
+static void chain_split(const uint64_t from, const uint64_t to, const uint32_t bit) {
+    item **dst = chain_head(to);
+    item *prev = NULL;
+    item *it = *chain_head(from);
+
+    while (it != NULL) {
+        item *next = ITEM_PTR(it->h_next);
+        if (hash(ITEM_key(it), it->nkey) & bit) {
+            if (prev != NULL) {
+                prev->h_next = it->h_next;
+            } else {
+                *chain_head(from) = next;
+            }
+            it->h_next = ITEM_REF(*dst);
+            *dst = it;
+        } else {
+            prev = it;
+        }
+        it = next;
+    }
+}
+
+static void chain_merge(const uint64_t from, const uint64_t to) {
+    item *last = *chain_head(to);
+
+    if (last == NULL) {
+        *chain_head(to) = *chain_head(from);
+    } else {
+        while (last->h_next) {
+            last = ITEM_PTR(last->h_next);
+        }
+        last->h_next = ITEM_REF(*chain_head(from));
+    }
+    *chain_head(from) = NULL;
+}
+
+static void assoc_update_stats(void) {
+    hashpower = hash_level(hash_buckets);
+    STATS_LOCK();
+    stats_state.hash_power_level = hashpower;
+    stats_state.hash_buckets = hash_buckets;
+    STATS_UNLOCK();
+}
+
+/* Adds a bucket by splitting its buddy. maintenance_lock must be held.
+ * Returns 1 when done, 0 if the bucket's item lock was busy and -1 if out
+ * of memory. */
+static int assoc_grow_step(void) {
+    uint64_t buckets = hash_buckets;
+    uint32_t bit = hashsize(hash_level(buckets));
+    uint64_t from = buckets - bit;
+    void *lock;
+
+    if (segments[buckets >> ASSOC_SEGMENT_POWER] == NULL &&
+        !segment_alloc(buckets >> ASSOC_SEGMENT_POWER)) {
+        return -1;
+    }
+    /* The new bucket shares this lock with the one being split. */
+    if ((lock = item_trylock(from)) == NULL) {
+        return 0;
+    }
+    if (bucketized()) {
+        bucket_split(from, buckets, bit);
+    } else {
+        chain_split(from, buckets, bit);
+    }
+    __atomic_store_n(&hash_buckets, buckets + 1, __ATOMIC_RELEASE);
+    item_trylock_unlock(lock);
+    assoc_update_stats();
+    return 1;
+}
+
+/* Merges the last bucket back into its buddy; like assoc_grow_step(). */
+static int assoc_shrink_step(void) {
+    uint64_t last = hash_buckets - 1;
+    uint64_t into = last - hashsize(hash_level(last));
+    void *lock;
+
+    if ((lock = item_trylock(last)) == NULL) {
+        return 0;
+    }
+    if (bucketized()) {
+        bucket_merge(last, into);
+    } else {
+        chain_merge(last, into);
+    }
+    __atomic_store_n(&hash_buckets, last, __ATOMIC_RELEASE);
+    item_trylock_unlock(lock);
+    /* Only lookups under that lock could reach the bucket, other than
+     * lockless_get readers, which have to be waited out. */
+    if ((last & ASSOC_SEGMENT_MASK) == 0) {
+        if (settings.lockless_get) {
+            read_epoch_synchronize();
+        }
+        segment_free(last >> ASSOC_SEGMENT_POWER);
+    }
+    assoc_update_stats();
+    return 1;
+}
 
 void assoc_init(const int hashtable_init) {
     if (hashtable_init) {
         hashpower = hashtable_init;
     }
-    primary_hashtable = calloc(hashsize(hashpower), sizeof(void *));
-    if (! primary_hashtable) {
+    assert(hashpower >= ASSOC_SEGMENT_POWER);
+    if (bucketized()) {
+        assert(sizeof(assoc_bucket) == 64);
+    }
+    segments = calloc(hashsize(HASHPOWER_MAX - ASSOC_SEGMENT_POWER), sizeof(void *));
+    if (! segments) {
         fprintf(stderr, "Failed to init hashtable.\n");
         exit(EXIT_FAILURE);
     }
-    STATS_LOCK();
-    stats_state.hash_power_level = hashpower;
-    stats_state.hash_bytes = hashsize(hashpower) * sizeof(void *);
-    STATS_UNLOCK();
+    hash_buckets = min_buckets = hashsize(hashpower);
+    for (uint64_t i = 0; i < hashsize(hashpower - ASSOC_SEGMENT_POWER); i++) {
+        if (! segment_alloc(i)) {
+            fprintf(stderr, "Failed to init hashtable.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    assoc_update_stats();
 }
 
 item *assoc_find(const char *key, const size_t nkey, const uint32_t hv) {
-    item *it;
-    uint64_t oldbucket;
+    uint64_t bucket = hash_bucket(hv);
 
-    if (expanding &&
-        (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
-    {
-        it = old_hashtable[oldbucket];
-    } else {
-        it = primary_hashtable[hv & hashmask(hashpower)];
+    if (bucketized()) {
+        int slot;
+        assoc_bucket *b = bucket_find(bucket_head(bucket), key, nkey, hv, &slot);
+        return b ? b->items[slot] : NULL;
     }
 
+    item *it = *chain_head(bucket);
     item *ret = NULL;
 #ifdef ENABLE_DTRACE
     int depth = 0;
@@ -88,7 +494,7 @@ item *assoc_find(const char *key, const size_t nkey, const uint32_t hv) {
             ret = it;
             break;
         }
-        it = it->h_next;
+        it = ITEM_PTR(it->h_next);
 #ifdef ENABLE_DTRACE
         ++depth;
 #endif
@@ -97,53 +503,51 @@ item *assoc_find(const char *key, const size_t nkey, const uint32_t hv) {
     return ret;
 }
 
-/* returns the address of the item pointer before the key.  if *item == 0,
-   the item wasn't found */
-
-static item** _hashitem_before (const char *key, const size_t nkey, const uint32_t hv) {
-    item **pos;
-    uint64_t oldbucket;
+/* returns the item holding the key, and in *prev the one chained before it
+   (NULL if it's first in the chain). NULL if the item wasn't found */
 
-    if (expanding &&
-        (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
-    {
-        pos = &old_hashtable[oldbucket];
-    } else {
-        pos = &primary_hashtable[hv & hashmask(hashpower)];
-    }
+static item *_hashitem_before (const char *key, const size_t nkey, const uint32_t hv, item **prev) {
+    item *it = *chain_head(hash_bucket(hv));
 
-    while (*pos && ((nkey != (*pos)->nkey) || memcmp(key, ITEM_key(*pos), nkey))) {
-        pos = &(*pos)->h_next;
+    *prev = NULL;
+    while (it && ((nkey != it->nkey) || memcmp(key, ITEM_key(it), nkey))) {
+        *prev = it;
+        it = ITEM_PTR(it->h_next);
     }
-    return pos;
+    return it;
 }
 
-/* grows the hashtable to the next power of 2. */
-static void assoc_expand(void) {
-    old_hashtable = primary_hashtable;
-
-    primary_hashtable = calloc(hashsize(hashpower + 1), sizeof(void *));
-    if (primary_hashtable) {
-        if (settings.verbose > 1)
-            fprintf(stderr, "Hash table expansion starting\n");
-        hashpower++;
-        expanding = true;
-        expand_bucket = 0;
-        STATS_LOCK();
-        stats_state.hash_power_level = hashpower;
-        stats_state.hash_bytes += hashsize(hashpower) * sizeof(void *);
-        stats_state.hash_is_expanding = true;
-        STATS_UNLOCK();
-    } else {
-        primary_hashtable = old_hashtable;
-        /* Bad news, but we can keep running. */
+void assoc_start_resize(uint64_t curr_items) {
+    if (pthread_mutex_trylock(&maintenance_lock) == 0) {
+        uint64_t target = 0;
+        if (!resize_enabled || resize_target != 0) {
+            /* Not running, or already on it. */
+        } else if (curr_items > bucket_capacity(hash_buckets) / 4 * 3) {
+            if (hash_buckets < hashsize(HASHPOWER_MAX)) {
+                target = hashsize(hash_level(hash_buckets) + 1);
+            }
+        } else if (settings.hash_shrink && curr_items < bucket_capacity(hash_buckets) / 4) {
+            target = buckets_for(curr_items);
+        }
+        if (target != 0 && target != hash_buckets) {
+            if (settings.verbose > 1)
+                fprintf(stderr, "Hash table resize to %llu buckets starting\n",
+                        (unsigned long long)target);
+            resize_target = target;
+            STATS_LOCK();
+            stats_state.hash_is_expanding = true;
+            STATS_UNLOCK();
+            pthread_cond_signal(&maintenance_cond);
+        }
+        pthread_mutex_unlock(&maintenance_lock);
     }
 }
 
-void assoc_start_expand(uint64_t curr_items) {
+/* An insert found the table over its load; help out unless someone's busy. */
+static void assoc_grow_inline(void) {
     if (pthread_mutex_trylock(&maintenance_lock) == 0) {
-        if (curr_items > (hashsize(hashpower) * 3) / 2 && hashpower < HASHPOWER_MAX) {
-            pthread_cond_signal(&maintenance_cond);
+        if (hash_buckets < hashsize(HASHPOWER_MAX)) {
+            assoc_grow_step();
         }
         pthread_mutex_unlock(&maintenance_lock);
     }
@@ -151,41 +555,52 @@ void assoc_start_expand(uint64_t curr_items) {
 
 /* Note: this isn't an assoc_update.  The key must not already exist to call this */
 int assoc_insert(item *it, const uint32_t hv) {
-    uint64_t oldbucket;
+    uint64_t bucket = hash_bucket(hv);
 
 //    assert(assoc_find(ITEM_key(it), it->nkey) == 0);  /* shouldn't have duplicately named things defined */
 
-    if (expanding &&
-        (oldbucket = (hv & hashmask(hashpower - 1))) >= expand_bucket)
-    {
-        it->h_next = old_hashtable[oldbucket];
-        old_hashtable[oldbucket] = it;
+    if (bucketized()) {
+        bucket_insert(bucket_head(bucket), it, bucket_tag(hv));
     } else {
-        it->h_next = primary_hashtable[hv & hashmask(hashpower)];
-        primary_hashtable[hv & hashmask(hashpower)] = it;
+        it->h_next = ITEM_REF(*chain_head(bucket));
+        *chain_head(bucket) = it;
     }
 
     MEMCACHED_ASSOC_INSERT(ITEM_key(it), it->nkey);
+    /* curr_items is only a hint here; it's read without the stats lock. */
+    if (resize_enabled && stats_state.curr_items > bucket_capacity(hash_buckets)) {
+        assoc_grow_inline();
+    }
     return 1;
 }
 
 void assoc_delete(const char *key, const size_t nkey, const uint32_t hv) {
-    item **before = _hashitem_before(key, nkey, hv);
+    if (bucketized()) {
+        bucket_delete(key, nkey, hv);
+        return;
+    }
+
+    item *before;
+    item *it = _hashitem_before(key, nkey, hv, &before);
 
-    if (*before) {
-        item *nxt;
+    if (it) {
+        item_ptr_t nxt;
         /* The DTrace probe cannot be triggered as the last instruction
          * due to possible tail-optimization by the compiler
          */
         MEMCACHED_ASSOC_DELETE(key, nkey);
-        nxt = (*before)->h_next;
-        (*before)->h_next = 0;   /* probably pointless, but whatever. */
-        *before = nxt;
+        nxt = it->h_next;
+        it->h_next = 0;   /* probably pointless, but whatever. */
+        if (before) {
+            before->h_next = nxt;
+        } else {
+            *chain_head(hash_bucket(hv)) = ITEM_PTR(nxt);
+        }
         return;
     }
     /* Note:  we never actually get here.  the callers don't delete things
        they can't find. */
-    assert(*before != 0);
+    assert(it != 0);
 }
 
 
@@ -199,64 +614,37 @@ static void *assoc_maintenance_thread(void *arg) {
     mutex_lock(&maintenance_lock);
     while (do_run_maintenance_thread) {
         int ii = 0;
-
-        /* There is only one expansion thread, so no need to global lock. */
-        for (ii = 0; ii < hash_bulk_move && expanding; ++ii) {
-            item *it, *next;
-            uint64_t bucket;
-            void *item_lock = NULL;
-
-            /* bucket = hv & hashmask(hashpower) =>the bucket of hash table
-             * is the lowest N bits of the hv, and the bucket of item_locks is
-             *  also the lowest M bits of hv, and N is greater than M.
-             *  So we can process expanding with only one item_lock. cool! */
-            if ((item_lock = item_trylock(expand_bucket))) {
-                    for (it = old_hashtable[expand_bucket]; NULL != it; it = next) {
-                        next = it->h_next;
-                        bucket = hash(ITEM_key(it), it->nkey) & hashmask(hashpower);
-                        it->h_next = primary_hashtable[bucket];
-                        primary_hashtable[bucket] = it;
-                    }
-
-                    old_hashtable[expand_bucket] = NULL;
-
-                    expand_bucket++;
-                    if (expand_bucket == hashsize(hashpower - 1)) {
-                        expanding = false;
-                        free(old_hashtable);
-                        STATS_LOCK();
-                        stats_state.hash_bytes -= hashsize(hashpower - 1) * sizeof(void *);
-                        stats_state.hash_is_expanding = false;
-                        STATS_UNLOCK();
-                        if (settings.verbose > 1)
-                            fprintf(stderr, "Hash table expansion done\n");
-                    }
-
-            } else {
-                usleep(10*1000);
+        int ret = 1;
+
+        /* Resizing only happens with maintenance_lock held, so no need for
+         * anything else global. Each step takes the one item lock it needs. */
+        for (ii = 0; ii < hash_bulk_move && resize_target != 0; ++ii) {
+            if (hash_buckets < resize_target) {
+                ret = assoc_grow_step();
+            } else if (hash_buckets > resize_target) {
+                ret = assoc_shrink_step();
             }
 
-            if (item_lock) {
-                item_trylock_unlock(item_lock);
-                item_lock = NULL;
+            if (ret == -1 || hash_buckets == resize_target) {
+                /* On -1: bad news, but we can keep running. */
+                resize_target = 0;
+                STATS_LOCK();
+                stats_state.hash_is_expanding = false;
+                STATS_UNLOCK();
+                if (settings.verbose > 1)
+                    fprintf(stderr, "Hash table resize done\n");
+            } else if (ret == 0) {
+                break;
             }
         }
 
-        if (!expanding) {
-            /* We are done expanding.. just wait for next invocation */
+        if (ret == 0) {
+            usleep(10*1000);
+        }
+
+        if (resize_target == 0) {
+            /* We are done resizing.. just wait for next invocation */
             pthread_cond_wait(&maintenance_cond, &maintenance_lock);
-            /* assoc_expand() swaps out the hash table entirely, so we need
-             * all threads to not hold any references related to the hash
-             * table while this happens.
-             * This is instead of a more complex, possibly slower algorithm to
-             * allow dynamic hash table expansion without causing significant
-             * wait times.
-             */
-            if (do_run_maintenance_thread) {
-                pause_threads(PAUSE_ALL_THREADS);
-                assoc_expand();
-                pause_threads(RESUME_ALL_THREADS);
-            }
         }
     }
     mutex_unlock(&maintenance_lock);
@@ -281,12 +669,16 @@ int start_assoc_maintenance_thread(void) {
         return -1;
     }
     thread_setname(maintenance_tid, "mc-assocmaint");
+    mutex_lock(&maintenance_lock);
+    resize_enabled = true;
+    mutex_unlock(&maintenance_lock);
     return 0;
 }
 
 void stop_assoc_maintenance_thread(void) {
     mutex_lock(&maintenance_lock);
     do_run_maintenance_thread = 0;
+    resize_enabled = false;
     pthread_cond_signal(&maintenance_cond);
     mutex_unlock(&maintenance_lock);
 
@@ -299,14 +691,42 @@ struct assoc_iterator {
     item *it;
     item *next;
     bool bucket_locked;
+    /* Bucketized index: the locked bucket's items, copied up front since
+     * unlinking one moves another into its slot. */
+    item **snapshot;
+    int snapshot_size;
+    int snapshot_len;
+    int snapshot_pos;
 };
 
+/* Copies the items of a locked bucket into the iterator. */
+static bool bucket_snapshot(struct assoc_iterator *iter, assoc_bucket *b) {
+    iter->snapshot_len = 0;
+    iter->snapshot_pos = 0;
+    for (; b != NULL; b = b->next) {
+        if (iter->snapshot_len + b->used > iter->snapshot_size) {
+            int size = iter->snapshot_size ? iter->snapshot_size * 2 : ASSOC_BUCKET_SLOTS * 4;
+            while (size < iter->snapshot_len + b->used)
+                size *= 2;
+            item **snapshot = realloc(iter->snapshot, size * sizeof(item *));
+            if (snapshot == NULL) {
+                return false;
+            }
+            iter->snapshot = snapshot;
+            iter->snapshot_size = size;
+        }
+        memcpy(&iter->snapshot[iter->snapshot_len], b->items, b->used * sizeof(item *));
+        iter->snapshot_len += b->used;
+    }
+    return true;
+}
+
 void *assoc_get_iterator(void) {
     struct assoc_iterator *iter = calloc(1, sizeof(struct assoc_iterator));
     if (iter == NULL) {
         return NULL;
     }
-    // this will hang the caller while a hash table expansion is running.
+    // this will hang the caller while a hash table resize is running.
     if (mutex_trylock(&maintenance_lock) == 0) {
         return iter;
     } else {
@@ -318,10 +738,19 @@ bool assoc_iterate(void *iterp, item **it) {
     struct assoc_iterator *iter = (struct assoc_iterator *) iterp;
     *it = NULL;
     // - if locked bucket and next, update next and return
-    if (iter->bucket_locked) {
+    if (iter->bucket_locked && bucketized()) {
+        if (iter->snapshot_pos < iter->snapshot_len) {
+            *it = iter->snapshot[iter->snapshot_pos++];
+        } else {
+            item_unlock(iter->bucket);
+            iter->bucket++;
+            iter->bucket_locked = false;
+        }
+        return true;
+    } else if (iter->bucket_locked) {
         if (iter->next != NULL) {
             iter->it = iter->next;
-            iter->next = iter->it->h_next;
+            iter->next = ITEM_PTR(iter->it->h_next);
             *it = iter->it;
         } else {
             // unlock previous bucket, if any
@@ -335,15 +764,26 @@ bool assoc_iterate(void *iterp, item **it) {
     }
 
     // - loop until we hit the end or find something.
-    if (iter->bucket != hashsize(hashpower)) {
+    // - the bucket count can't change while we hold maintenance_lock.
+    if (iter->bucket != hash_buckets) {
         // - lock next bucket
         item_lock(iter->bucket);
         iter->bucket_locked = true;
-        // - only check the primary hash table since expand is blocked.
-        iter->it = primary_hashtable[iter->bucket];
+        if (bucketized()) {
+            if (bucket_snapshot(iter, bucket_head(iter->bucket)) &&
+                iter->snapshot_len > 0) {
+                *it = iter->snapshot[iter->snapshot_pos++];
+            } else {
+                item_unlock(iter->bucket);
+                iter->bucket_locked = false;
+                iter->bucket++;
+            }
+            return true;
+        }
+        iter->it = *chain_head(iter->bucket);
         if (iter->it != NULL) {
             // - set it, next and return
-            iter->next = iter->it->h_next;
+            iter->next = ITEM_PTR(iter->it->h_next);
             *it = iter->it;
         } else {
             // - nothing found in this bucket, try next.
@@ -364,5 +804,6 @@ void assoc_iterate_final(void *iterp) {
         item_unlock(iter->bucket);
     }
     mutex_unlock(&maintenance_lock);
+    free(iter->snapshot);
     free(iter);
 }
@@ -7,7 +7,7 @@ void assoc_delete(const char *key, const size_t nkey, const uint32_t hv);
 
 int start_assoc_maintenance_thread(void);
 void stop_assoc_maintenance_thread(void);
-void assoc_start_expand(uint64_t curr_items);
+void assoc_start_resize(uint64_t curr_items);
 
 /* walk functions */
 void *assoc_get_iterator(void);
@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+"""Compare two sets of benchmark result files (see client/include/results.hpp).
+
+Each side is one or more result JSON files, a directory of them, or a glob,
+one file per trial. For every metric the script reports the mean of each
+side, the relative change, and a confidence interval on the difference of
+the means (Welch's t-interval, so the two sides may have different
+variances and trial counts). A change is flagged as a regression when the
+interval excludes zero and the change is worse than --threshold in the
+metric's bad direction. Throughput and p99 latency are gating by default;
+the other metrics are reported only.
+
+    compare_results.py baseline/ candidate/
+    compare_results.py 'base_*.json' 'cand_*.json' --threshold 0.03 --confidence 0.99
+
+Exits with 1 if any gating metric regressed, so it can fail a CI job.
+"""
+import argparse
+import glob
+import json
+import math
+import os
+import sys
+
+# (name, path into the result document, higher is better, gating)
+METRICS = [
+    ("throughput_ops", ("results", "throughput_ops"), True, True),
+    ("cache_get_p99_us", ("latency", "cache_get_us", "p99"), False, True),
+    ("cache_get_p50_us", ("latency", "cache_get_us", "p50"), False, False),
+    ("db_put_p99_us", ("latency", "db_put_us", "p99"), False, False),
+    ("miss_ratio", ("results", "miss_ratio"), False, False),
+    ("db_reads", ("results", "db_reads"), False, False),
+    ("stale_reads", ("results", "stale_reads"), False, False),
+    ("mean_process_cpu", ("telemetry", "mean_process_cpu"), False, False),
+]
+
+
+def load_trials(spec):
+    if os.path.isdir(spec):
+        paths = sorted(glob.glob(os.path.join(spec, "*.json")))
+    else:
+        paths = sorted(glob.glob(spec))
+    trials = []
+    for path in paths:
+        with open(path) as f:
+            try:
+                trials.append(json.load(f))
+            except ValueError as e:
+                print("Skipping %s: %s" % (path, e), file=sys.stderr)
+    return paths, trials
+
+
+def lookup(doc, path):
+    for key in path:
+        if not isinstance(doc, dict) or key not in doc:
+            return None
+        doc = doc[key]
+    return float(doc)
+
+
+def mean_var(values):
+    n = len(values)
+    mean = sum(values) / n
+    var = sum((v - mean) ** 2 for v in values) / (n - 1) if n > 1 else 0.0
+    return mean, var
+
+
+def betacf(a, b, x):
+    # Continued fraction for the incomplete beta function (Numerical Recipes).
+    tiny = 1e-300
+    c, d = 1.0, 1.0 - (a + b) * x / (a + 1)
+    d = 1 / (d if abs(d) > tiny else tiny)
+    h = d
+    for m in range(1, 300):
+        m2 = 2 * m
+        aa = m * (b - m) * x / ((a + m2 - 1) * (a + m2))
+        d = 1 + aa * d
+        d = 1 / (d if abs(d) > tiny else tiny)
+        c = 1 + aa / c
+        c = c if abs(c) > tiny else tiny
+        h *= d * c
+        aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1))
+        d = 1 + aa * d
+        d = 1 / (d if abs(d) > tiny else tiny)
+        c = 1 + aa / c
+        c = c if abs(c) > tiny else tiny
+        delta = d * c
+        h *= delta
+        if abs(delta - 1) < 1e-12:
+            break
+    return h
+
+
+def betainc(a, b, x):
+    if x <= 0:
+        return 0.0
+    if x >= 1:
+        return 1.0
+    front = math.exp(math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b) + a * math.log(x) + b * math.log(1 - x))
+    if x < (a + 1) / (a + b + 2):
+        return front * betacf(a, b, x) / a
+    return 1 - front * betacf(b, a, 1 - x) / b
+
+
+def t_cdf(t, df):
+    tail = 0.5 * betainc(df / 2, 0.5, df / (df + t * t))
+    return 1 - tail if t >= 0 else tail
+
+
+def t_quantile(p, df):
+    lo, hi = 0.0, 1e4
+    for _ in range(200):
+        mid = (lo + hi) / 2
+        if t_cdf(mid, df) < p:
+            lo = mid
+        else:
+            hi = mid
+    return (lo + hi) / 2
+
+
+def compare(base, cand, confidence):
+    """Difference of means with its confidence interval, or None without variance."""
+    mb, vb = mean_var(base)
+    mc, vc = mean_var(cand)
+    diff = mc - mb
+    if len(base) < 2 or len(cand) < 2:
+        return mb, mc, diff, None
+    se2 = vb / len(base) + vc / len(cand)
+    if se2 == 0:
+        return mb, mc, diff, (diff, diff)
+    df = se2 ** 2 / ((vb / len(base)) ** 2 / (len(base) - 1) + (vc / len(cand)) ** 2 / (len(cand) - 1))
+    half = t_quantile(1 - (1 - confidence) / 2, df) * math.sqrt(se2)
+    return mb, mc, diff, (diff - half, diff + half)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline")
+    parser.add_argument("candidate")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="relative change that counts as a regression (default 0.05)")
+    parser.add_argument("--confidence", type=float, default=0.95, help="interval confidence (default 0.95)")
+    args = parser.parse_args()
+
+    base_paths, base = load_trials(args.baseline)
+    cand_paths, cand = load_trials(args.candidate)
+    if not base or not cand:
+        print("No result files for %s" % (args.baseline if not base else args.candidate), file=sys.stderr)
+        return 2
+    print("baseline: %d trials, candidate: %d trials, %.0f%% intervals" %
+          (len(base), len(cand), args.confidence * 100))
+    if len(base) < 2 or len(cand) < 2:
+        print("Need at least 2 trials per side for intervals; changes are not tested", file=sys.stderr)
+
+    print("%-18s %14s %14s %9s %28s  %s" % ("metric", "baseline", "candidate", "change", "interval", "verdict"))
+    regressed = []
+    for name, path, higher_better, gating in METRICS:
+        b = [v for v in (lookup(t, path) for t in base) if v is not None]
+        c = [v for v in (lookup(t, path) for t in cand) if v is not None]
+        if not b or not c:
+            continue
+        mb, mc, diff, interval = compare(b, c, args.confidence)
+        change = diff / mb if mb != 0 else 0.0
+        worse = -change if higher_better else change
+        significant = interval is not None and (interval[0] > 0 or interval[1] < 0)
+        if not significant:
+            verdict = "no significant change" if interval is not None else "untested"
+        elif worse > args.threshold:
+            verdict = "REGRESSION" if gating else "worse"
+            if gating:
+                regressed.append(name)
+        elif worse > 0:
+            verdict = "worse, within threshold"
+        else:
+            verdict = "better"
+        interval_text = "[%.4g, %.4g]" % interval if interval is not None else "-"
+        print("%-18s %14.6g %14.6g %+8.2f%% %28s  %s" % (name, mb, mc, change * 100, interval_text, verdict))
+
+    if regressed:
+        print("Regressed: %s" % ", ".join(regressed))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -29,7 +29,7 @@ DB_VM_LOG_DIR="/home/maoziming/rocksdb/backend/build/logs"
 DB_VM_SSH="ssh -i $DB_VM_KEY $DB_VM_USER@$DB_VM_IP"
 CACHE_VM_SSH="ssh -i $DB_VM_KEY $DB_VM_USER@$CACHE_VM_IP"
 DATASETS=("IBM" "Meta" "Twitter" "Alibaba" "Tencent" "PoissonMix" "Poisson" "PoissonWrite")
-BENCHMARKS=("adaptive_bench" "invalidate_bench"  "update_bench" "ttl_bench" "stale_bench")
+BENCHMARKS=("adaptive_bench" "invalidate_bench"  "update_bench" "ttl_bench" "adaptive_ttl_bench" "stale_bench")
 DATASETS=("IBM" "Meta" "Twitter" "Alibaba" "Tencent")
 cd /home/maoziming/memcached/cache/build/
 make -j
@@ -0,0 +1,27 @@
+#!/bin/bash
+# DB reads with and without fill leases in the cache server, on one machine
+# through the loopback harness. FRESHCACHE_LEASE_MODE is read by the server
+# the harness starts.
+DATASETS=("Meta" "Twitter")
+MODES=("invalidate" "adaptive")
+LEASE_MODES=("off" "wait" "stale")
+
+DIR="/home/maoziming/memcached/cache/bench"
+cd /home/maoziming/memcached/cache/build
+make -j
+
+mkdir -p $DIR/lease
+for DATASET in "${DATASETS[@]}"; do
+    for MODE in "${MODES[@]}"; do
+        for LEASE in "${LEASE_MODES[@]}"; do
+            OUT=$DIR/lease/$DATASET\_$MODE\_$LEASE
+            FRESHCACHE_LEASE_MODE=$LEASE ./client/harness --mode=$MODE --stale-check=1 --output=$OUT.json \
+                $DATASET 100 TopKSketchTracker $OUT.log > $OUT.out 2>&1
+        done
+        echo "$DATASET $MODE"
+        for LEASE in "${LEASE_MODES[@]}"; do
+            python3 -c "import json, sys; r = json.load(open(sys.argv[1]))['results']; print('  %-6s db_reads %-10d miss_ratio %.4f stale_reads %d' % (sys.argv[2], r['db_reads'], r['miss_ratio'], r['stale_reads']))" \
+                $DIR/lease/$DATASET\_$MODE\_$LEASE.json $LEASE
+        done
+    done
+done
@@ -0,0 +1,28 @@
+#!/bin/bash
+# Repeated loopback harness runs for compare_results.py: one result file
+# per trial in OUT_DIR. Run it once per build to compare, e.g.
+#
+#   run_trials.sh base 5 --mode=adaptive Meta 100 TopKSketchTracker
+#   (rebuild)
+#   run_trials.sh cand 5 --mode=adaptive Meta 100 TopKSketchTracker
+#   python3 compare_results.py base cand
+#
+# Usage: run_trials.sh <out_dir> <trials> [harness options] <workload> [harness arguments...]
+if [ $# -lt 3 ]; then
+    echo "Usage: $0 <out_dir> <trials> [harness options] <workload> [harness arguments...]"
+    exit 1
+fi
+OUT_DIR=$1
+TRIALS=$2
+shift 2
+
+BUILD="/home/maoziming/memcached/cache/build"
+mkdir -p $OUT_DIR
+OUT_DIR=$(cd $OUT_DIR && pwd)
+cd $BUILD
+make -j
+
+for ((i = 1; i <= TRIALS; i++)); do
+    ./client/harness --output=$OUT_DIR/trial_$i.json "$@" > $OUT_DIR/trial_$i.out 2>&1
+    echo "trial $i: $(python3 -c "import json, sys; r = json.load(open(sys.argv[1]))['results']; print('%.1f ops/s, miss_ratio %.4f' % (r['throughput_ops'], r['miss_ratio']))" $OUT_DIR/trial_$i.json)"
+done
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Per-key TTLs for the TTL_EW mode, chosen when a miss is filled.
+ *
+ * The cache server never sees writes in this mode, but every fill carries
+ * the DB version of the key, so the version delta between two fills is the
+ * number of writes in between. From that the engine keeps a decayed write
+ * rate per key and, like an LM-factor heuristic, also trusts the age of the
+ * current version as a lower bound on the write interval. Assuming Poisson
+ * writes, a read at a uniformly random point of a TTL T is stale with
+ * probability ~ T / (2 * write_interval), so the staleness SLO (a target
+ * fraction of stale reads) gives
+ *
+ *     T = min(2 * slo * write_interval, max_ttl)
+ *
+ * memcached expirations are whole seconds, so a key whose T is under one
+ * second is not cached at all rather than cached for too long.
+ *
+ * Read inter-arrival times are tracked too and weight the stale-read
+ * estimate reported through GetFreshnessStats.
+ *
+ * State lives in a fixed, hashed table; keys that collide share a slot and
+ * the newcomer simply restarts the estimate.
+ */
+class AdaptiveTTL
+{
+public:
+    struct Stats
+    {
+        int32_t fills = 0;
+        int32_t bypassed = 0;            // Fills not cached to stay within the SLO.
+        float mean_ttl = 0;              // Seconds, over cached adaptive fills.
+        float estimated_stale_ratio = 0; // Expected fraction of stale reads.
+    };
+
+    explicit AdaptiveTTL(size_t num_slots = 1 << 18)
+        : slots_(num_slots)
+    {
+    }
+
+    // default_ttl is used until a key has been filled twice.
+    void Configure(bool enabled, float staleness_slo, int32_t default_ttl, int32_t max_ttl)
+    {
+        std::lock_guard<std::mutex> lock(config_mutex_);
+        slo_.store(staleness_slo > 0 ? staleness_slo : 0.01f);
+        default_ttl = std::max<int32_t>(default_ttl, MIN_TTL);
+        default_ttl_.store(default_ttl);
+        max_ttl_.store(std::max(max_ttl, default_ttl));
+        for (auto &stripe : stripes_)
+        {
+            std::lock_guard<std::mutex> stripe_lock(stripe.mutex);
+            stripe.fills = 0;
+            stripe.bypassed = 0;
+            stripe.ttl_sum = 0;
+            stripe.expected_reads = 0;
+            stripe.expected_stale_reads = 0;
+        }
+        enabled_.store(enabled, std::memory_order_release);
+    }
+
+    bool enabled() const { return enabled_.load(std::memory_order_acquire); }
+
+    void OnRead(const std::string &key)
+    {
+        double now = Now();
+        uint64_t hash = std::hash<std::string>{}(key);
+        Stripe &stripe = stripe_for(hash);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        Slot &slot = Claim(hash);
+        if (slot.last_read > 0)
+        {
+            double interval = now - slot.last_read;
+            slot.read_interval = slot.read_interval > 0 ? (1 - EWMA_WEIGHT) * slot.read_interval + EWMA_WEIGHT * interval
+                                                        : interval;
+        }
+        slot.last_read = now;
+    }
+
+    // TTL in seconds for a fill of key at the given DB version, or 0 if
+    // the fill should not be cached.
+    int32_t OnFill(const std::string &key, uint64_t version)
+    {
+        double now = Now();
+        uint64_t hash = std::hash<std::string>{}(key);
+        Stripe &stripe = stripe_for(hash);
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+        Slot &slot = Claim(hash);
+
+        double ttl = default_ttl_.load(std::memory_order_relaxed);
+        if (slot.last_fill > 0 && version >= slot.version)
+        {
+            double writes = static_cast<double>(version - slot.version);
+            slot.writes = DECAY * slot.writes + writes;
+            slot.observed = DECAY * slot.observed + (now - slot.last_fill);
+            if (writes > 0)
+                slot.version_seen = now;
+
+            double interval = slot.writes > 0 ? slot.observed / slot.writes : slot.observed;
+            interval = std::max(interval, now - slot.version_seen);
+            double slo = slo_.load(std::memory_order_relaxed);
+            ttl = std::min<double>(std::floor(2 * slo * interval), max_ttl_.load(std::memory_order_relaxed));
+
+            // Reads expected during this TTL, and how many of them are stale.
+            if (ttl >= MIN_TTL)
+            {
+                double reads = slot.read_interval > 0 ? ttl / slot.read_interval : 1;
+                stripe.expected_reads += reads;
+                stripe.expected_stale_reads += reads * std::min(1.0, ttl / (2 * interval));
+            }
+            else
+            {
+                ttl = 0;
+                stripe.bypassed++;
+            }
+        }
+        else if (slot.last_fill == 0)
+        {
+            slot.version_seen = now;
+        }
+        slot.version = version;
+        slot.last_fill = now;
+
+        stripe.fills++;
+        stripe.ttl_sum += ttl;
+        return static_cast<int32_t>(ttl);
+    }
+
+    Stats GetStats()
+    {
+        Stats stats;
+        double ttl_sum = 0, reads = 0, stale = 0;
+        for (auto &stripe : stripes_)
+        {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            stats.fills += stripe.fills;
+            stats.bypassed += stripe.bypassed;
+            ttl_sum += stripe.ttl_sum;
+            reads += stripe.expected_reads;
+            stale += stripe.expected_stale_reads;
+        }
+        if (stats.fills > stats.bypassed)
+            stats.mean_ttl = static_cast<float>(ttl_sum / (stats.fills - stats.bypassed));
+        if (reads > 0)
+            stats.estimated_stale_ratio = static_cast<float>(stale / reads);
+        return stats;
+    }
+
+private:
+    static const int32_t MIN_TTL = 1; // memcached expirations are in whole seconds.
+    static const size_t NUM_STRIPES = 256;
+    static constexpr double DECAY = 0.75;       // Per fill, for the write-rate estimate.
+    static constexpr double EWMA_WEIGHT = 0.25; // For the read inter-arrival estimate.
+
+    struct Slot
+    {
+        uint64_t tag = 0;
+        uint64_t version = 0;
+        double version_seen = 0; // When the current version was first filled.
+        double last_fill = 0;
+        double writes = 0;   // Decayed writes seen between fills ...
+        double observed = 0; // ... over this much decayed time.
+        double last_read = 0;
+        double read_interval = 0;
+    };
+
+    struct alignas(64) Stripe
+    {
+        std::mutex mutex;
+        int32_t fills = 0;
+        int32_t bypassed = 0;
+        double ttl_sum = 0;
+        double expected_reads = 0;
+        double expected_stale_reads = 0;
+    };
+
+    static double Now()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    Stripe &stripe_for(uint64_t hash) { return stripes_[(hash % slots_.size()) % NUM_STRIPES]; }
+
+    // The slot for hash, reset if another key held it. Call under the
+    // slot's stripe lock.
+    Slot &Claim(uint64_t hash)
+    {
+        Slot &slot = slots_[hash % slots_.size()];
+        uint64_t tag = hash | 1; // 0 marks an empty slot.
+        if (slot.tag != tag)
+        {
+            slot = Slot();
+            slot.tag = tag;
+        }
+        return slot;
+    }
+
+    std::vector<Slot> slots_;
+    Stripe stripes_[NUM_STRIPES];
+    std::atomic<bool> enabled_{false};
+    std::mutex config_mutex_;
+    std::atomic<float> slo_{0.01f};
+    std::atomic<int32_t> default_ttl_{MIN_TTL};
+    std::atomic<int32_t> max_ttl_{300};
+};
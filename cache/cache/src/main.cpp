@@ -10,13 +10,18 @@
 #include <iostream>
 #include <memory>
 #include "client.hpp"
+#include "versioning.hpp"
 #include <atomic>
 #include <thread>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
 #include <cassert>
-#include "thread_pool.hpp"
+#include <cstdlib>
+#include <unordered_map>
+#include "work_stealing_pool.hpp"
+#include "tracing.hpp"
+#include "adaptive_ttl.hpp"
 
 using grpc::Server;
 using grpc::ServerAsyncResponseWriter;
@@ -60,13 +65,25 @@ private:
 class CacheServiceImpl final
 {
 public:
-    CacheServiceImpl(std::shared_ptr<Channel> db_channel)
+    CacheServiceImpl(std::shared_ptr<Channel> db_channel, const std::string &memcached_address)
         : db_client_(db_channel)
     {
-        const char *config_string = "--SERVER=localhost:11211";
+        std::string config_string = "--SERVER=" + memcached_address;
 
-        pool = memcached_pool(config_string, strlen(config_string));
+        pool = memcached_pool(config_string.c_str(), config_string.size());
         assert(pool != nullptr);
+        // Versioned writes compare-and-swap against the cached item.
+        memcached_pool_behavior_set(pool, MEMCACHED_BEHAVIOR_SUPPORT_CAS, 1);
+
+        // FRESHCACHE_LEASE_MODE=off|wait|stale, FRESHCACHE_LEASE_WAIT_MS=<ms>.
+        const char *mode = getenv("FRESHCACHE_LEASE_MODE");
+        if (mode != nullptr && std::string(mode) == "off")
+            lease_mode_ = LeaseMode::OFF;
+        else if (mode != nullptr && std::string(mode) == "stale")
+            lease_mode_ = LeaseMode::STALE;
+        const char *wait_ms = getenv("FRESHCACHE_LEASE_WAIT_MS");
+        if (wait_ms != nullptr)
+            lease_wait_ = std::chrono::milliseconds(strtol(wait_ms, nullptr, 10));
     }
 
     ~CacheServiceImpl()
@@ -94,9 +111,125 @@ public:
         memcached_pool_push(pool, memc);
     }
 
-    void Run()
+    // Versioned items keep the DB version in the low 30 bits of the item
+    // flags; the top bit marks a tombstone left by a versioned invalidate,
+    // which reads treat as a miss but which still blocks older fills. The
+    // next bit says the value is compressed, and is passed back to the
+    // client untouched. Versions wrap at 2^30 and are compared as serial
+    // numbers (see versioning.hpp).
+    static const uint32_t TOMBSTONE_FLAG = 1u << 31;
+    static const uint32_t COMPRESSED_FLAG = 1u << 30;
+    static const uint32_t VERSION_MASK = COMPRESSED_FLAG - 1;
+    static const time_t TOMBSTONE_TTL = 60;
+    static const int MAX_CAS_RETRIES = 8;
+
+    enum class StoreResult
+    {
+        STORED,
+        STALE, // The cache already holds this version or a newer one.
+        FAILED,
+    };
+
+    // Store value (or a tombstone if value is null) under key unless
+    // IsStaleVersionedWrite says the cached item supersedes it. The check
+    // and the write are one gets/cas round trip, retried if another writer
+    // got in between.
+    // With replace_only, absent keys and tombstones only get a newer
+    // tombstone, matching memcached_replace for unversioned updates. In
+    // LeaseMode::STALE an invalidated value is kept in its tombstone so
+    // misses can be answered from it while one request refills the key.
+    StoreResult StoreVersioned(memcached_st *memc, const std::string &key, const std::string *value,
+                               time_t ttl, uint64_t version, bool compressed = false, bool replace_only = false)
+    {
+        uint32_t new_version = static_cast<uint32_t>(version & VERSION_MASK);
+        const char *keys[] = {key.c_str()};
+        size_t key_lengths[] = {key.size()};
+
+        for (int attempt = 0; attempt < MAX_CAS_RETRIES; attempt++)
+        {
+            memcached_return_t rc = memcached_mget(memc, keys, key_lengths, 1);
+            if (rc != MEMCACHED_SUCCESS)
+                return StoreResult::FAILED;
+
+            bool exists = false;
+            uint64_t cas = 0;
+            uint32_t flags = 0;
+            std::string stale;
+            memcached_result_st *result;
+            while ((result = memcached_fetch_result(memc, nullptr, &rc)) != nullptr)
+            {
+                exists = true;
+                cas = memcached_result_cas(result);
+                flags = memcached_result_flags(result);
+                if (value == nullptr && lease_mode_ == LeaseMode::STALE)
+                    stale.assign(memcached_result_value(result), memcached_result_length(result));
+                memcached_result_free(result);
+            }
+
+            if (exists && IsStaleVersionedWrite(flags & VERSION_MASK, (flags & TOMBSTONE_FLAG) != 0,
+                                                new_version, value == nullptr, VERSION_MASK))
+                return StoreResult::STALE;
+
+            bool tombstone = value == nullptr || (replace_only && (!exists || (flags & TOMBSTONE_FLAG)));
+            const char *data = tombstone ? stale.data() : value->data();
+            size_t data_length = tombstone ? stale.size() : value->size();
+            uint32_t new_flags = new_version;
+            if (tombstone)
+                new_flags |= TOMBSTONE_FLAG | (stale.empty() ? 0 : flags & COMPRESSED_FLAG);
+            else if (compressed)
+                new_flags |= COMPRESSED_FLAG;
+            time_t expiration = tombstone ? TOMBSTONE_TTL : ttl;
+
+            if (exists)
+                rc = memcached_cas(memc, key.c_str(), key.size(), data, data_length, expiration, new_flags, cas);
+            else
+                rc = memcached_add(memc, key.c_str(), key.size(), data, data_length, expiration, new_flags);
+
+            if (rc == MEMCACHED_SUCCESS)
+                return StoreResult::STORED;
+            // Lost the race to another writer (or the item was evicted); re-read.
+            if (rc != MEMCACHED_DATA_EXISTS && rc != MEMCACHED_NOTSTORED && rc != MEMCACHED_NOTFOUND)
+                return StoreResult::FAILED;
+        }
+        std::cerr << "Versioned store of " << key << " gave up after " << MAX_CAS_RETRIES << " attempts" << std::endl;
+        return StoreResult::FAILED;
+    }
+
+    // Concurrent misses on one key share a single DB fill. The first miss
+    // takes the lease and must call ReleaseLease once the value is stored;
+    // the others get the lease holder's result in pending and either wait
+    // up to lease_wait_ for it or, in STALE mode, answer from the tombstone.
+    enum class LeaseMode
+    {
+        OFF,
+        WAIT,
+        STALE,
+    };
+
+    bool AcquireLease(const std::string &key, std::promise<VersionedValue> &fill,
+                      std::shared_future<VersionedValue> &pending)
+    {
+        LeaseShard &shard = lease_shards_[std::hash<std::string>{}(key) % NUM_LEASE_SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.fills.find(key);
+        if (it != shard.fills.end())
+        {
+            pending = it->second;
+            return false;
+        }
+        shard.fills.emplace(key, fill.get_future().share());
+        return true;
+    }
+
+    void ReleaseLease(const std::string &key)
+    {
+        LeaseShard &shard = lease_shards_[std::hash<std::string>{}(key) % NUM_LEASE_SHARDS];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.fills.erase(key);
+    }
+
+    void Run(const std::string &server_address)
     {
-        std::string server_address("10.128.0.39:50051");
 
         ServerBuilder builder;
         builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
@@ -126,6 +259,13 @@ private:
     public:
         virtual void Proceed(bool ok) = 0;
         virtual ~CallDataBase() {}
+
+        // When HandleRpcs took this call off the CQ, for the server.queue span.
+        uint64_t dequeued_tsc_ = 0;
+
+    protected:
+        // Set from the client's metadata; non-zero for sampled requests.
+        uint64_t trace_id_ = 0;
     };
 
     // Implementations for each RPC method
@@ -149,9 +289,15 @@ private:
             }
             else if (status_ == PROCESS)
             {
+                trace_id_ = tracing::Extract(ctx_);
+                if (trace_id_ != 0)
+                    tracing::Record(trace_id_, tracing::Stage::SERVER_QUEUE, dequeued_tsc_, tracing::Now(), TraceOp());
                 // Spawn a new instance to serve new clients while we process the current one
                 CreateNewInstance();
-                ProcessRequest();
+                {
+                    tracing::ScopedSpan span(trace_id_, tracing::Stage::SERVER_HANDLE, TraceOp());
+                    ProcessRequest();
+                }
                 status_ = FINISH;
                 responder_.Finish(response_, Status::OK, this);
             }
@@ -165,6 +311,7 @@ private:
         virtual void RequestRPC() = 0;
         virtual void ProcessRequest() = 0;
         virtual void CreateNewInstance() = 0;
+        virtual tracing::Op TraceOp() const { return tracing::OP_OTHER; }
 
         typename std::remove_pointer<ServiceType>::type *service_;
         ServerCompletionQueue *cq_;
@@ -211,6 +358,8 @@ private:
             service_->RequestGet(&ctx_, &request_, &responder_, cq_, cq_, this);
         }
 
+        tracing::Op TraceOp() const override { return tracing::OP_GET; }
+
         void CreateNewInstance() override
         {
             auto *new_call = impl_->get_call_pool_.acquire();
@@ -224,35 +373,135 @@ private:
             size_t value_length = 0;
             uint32_t flags = 0;
             memcached_return_t result;
-            memcached_st *memc = impl_->create_mc();
-            value = memcached_get(memc, request_.key().c_str(), request_.key().size(), &value_length, &flags, &result);
+            memcached_st *memc;
+            {
+                tracing::ScopedSpan span(trace_id_, tracing::Stage::MEMCACHED_POOL_POP, tracing::OP_GET);
+                memc = impl_->create_mc();
+            }
+            {
+                tracing::ScopedSpan span(trace_id_, tracing::Stage::MEMCACHED_GET, tracing::OP_GET);
+                value = memcached_get(memc, request_.key().c_str(), request_.key().size(), &value_length, &flags, &result);
+            }
+            if (impl_->adaptive_ttl_.enabled())
+                impl_->adaptive_ttl_.OnRead(request_.key());
+            bool has_stale = false;
+            if (result == MEMCACHED_SUCCESS && (flags & TOMBSTONE_FLAG))
+            {
+                // Invalidated: a miss, but the tombstone stays to fence older
+                // fills and may still hold the old value.
+                has_stale = value_length > 0;
+                result = MEMCACHED_NOTFOUND;
+            }
             if (result == MEMCACHED_SUCCESS)
             {
                 impl_->cache_hits_++;
                 response_.set_value(std::string(value, value_length));
                 response_.set_success(true);
-                free(value); // Free allocated memory
+                response_.set_version(flags & VERSION_MASK);
+                response_.set_compressed((flags & COMPRESSED_FLAG) != 0);
             }
             else
             {
                 impl_->cache_miss_++;
-                std::future<std::string> fill_future = impl_->db_client_.AsyncFill(request_.key(), impl_->ttl_);
-                try
+                if (!ServeFromLease(has_stale ? value : nullptr, value_length, flags))
+                    Fill(memc);
+            }
+            free(value); // Free allocated memory
+            impl_->free_mc(memc);
+        }
+
+    private:
+        // Answer a miss without going to the DB when another request already
+        // holds the fill lease for this key. False if the caller has to fill,
+        // in which case it holds the lease unless the holder timed out.
+        bool ServeFromLease(const char *stale_value, size_t stale_length, uint32_t stale_flags)
+        {
+            if (impl_->lease_mode_ == LeaseMode::OFF)
+                return false;
+            std::shared_future<VersionedValue> pending;
+            lease_ = std::promise<VersionedValue>();
+            holds_lease_ = impl_->AcquireLease(request_.key(), lease_, pending);
+            if (!holds_lease_)
+            {
+                if (impl_->lease_mode_ == LeaseMode::STALE && stale_value != nullptr)
                 {
-                    std::string value = fill_future.get();
-                    memcached_set(memc, request_.key().c_str(), request_.key().size(), value.c_str(), value.size(), (time_t)impl_->ttl_, (uint32_t)0);
-                    response_.set_value(value);
+                    response_.set_value(std::string(stale_value, stale_length));
                     response_.set_success(true);
+                    response_.set_version(stale_flags & VERSION_MASK);
+                    response_.set_compressed((stale_flags & COMPRESSED_FLAG) != 0);
+                    return true;
                 }
-                catch (const std::exception &e)
+                if (pending.wait_for(impl_->lease_wait_) == std::future_status::ready)
                 {
-                    std::cerr << "Exception occurred: " << e.what() << std::endl;
-                    response_.set_value(std::string("Error during AsyncFill"));
-                    response_.set_success(false);
+                    try
+                    {
+                        const VersionedValue &filled = pending.get();
+                        response_.set_value(filled.value);
+                        response_.set_success(true);
+                        response_.set_version(filled.version);
+                        response_.set_compressed(filled.compressed);
+                        return true;
+                    }
+                    catch (const std::exception &e)
+                    {
+                        // The lease holder's fill failed; try our own.
+                    }
                 }
             }
-            impl_->free_mc(memc);
+            return false;
+        }
+
+        void Fill(memcached_st *memc)
+        {
+            uint64_t fill_start = trace_id_ != 0 ? tracing::Now() : 0;
+            std::future<VersionedValue> fill_future = impl_->db_client_.AsyncFill(request_.key(), impl_->ttl_, trace_id_);
+            try
+            {
+                VersionedValue filled = fill_future.get();
+                if (trace_id_ != 0)
+                    tracing::Record(trace_id_, tracing::Stage::DB_FILL, fill_start, tracing::Now(), tracing::OP_GET);
+                {
+                    tracing::ScopedSpan span(trace_id_, tracing::Stage::MEMCACHED_SET, tracing::OP_GET);
+                    // A fill that raced a newer update or invalidate is dropped here.
+                    time_t ttl = impl_->ttl_;
+                    bool cache_fill = true;
+                    if (filled.version > 0 && impl_->adaptive_ttl_.enabled())
+                    {
+                        ttl = impl_->adaptive_ttl_.OnFill(request_.key(), filled.version);
+                        cache_fill = ttl > 0; // Written too often to cache within the SLO.
+                    }
+                    if (cache_fill && filled.version > 0)
+                        impl_->StoreVersioned(memc, request_.key(), &filled.value, ttl, filled.version, filled.compressed);
+                    else if (cache_fill)
+                        memcached_set(memc, request_.key().c_str(), request_.key().size(), filled.value.c_str(), filled.value.size(), ttl,
+                                      filled.compressed ? COMPRESSED_FLAG : 0);
+                }
+                response_.set_value(filled.value);
+                response_.set_success(true);
+                response_.set_version(filled.version);
+                response_.set_compressed(filled.compressed);
+                if (holds_lease_)
+                {
+                    impl_->ReleaseLease(request_.key());
+                    lease_.set_value(std::move(filled));
+                }
+            }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Exception occurred: " << e.what() << std::endl;
+                response_.set_value(std::string("Error during AsyncFill"));
+                response_.set_success(false);
+                if (holds_lease_)
+                {
+                    impl_->ReleaseLease(request_.key());
+                    lease_.set_exception(std::current_exception());
+                }
+            }
+            holds_lease_ = false;
         }
+
+        std::promise<VersionedValue> lease_;
+        bool holds_lease_ = false;
     };
 
     class SetCallData : public CallData<CacheService::AsyncService, CacheSetRequest, CacheSetResponse>
@@ -283,6 +532,8 @@ private:
             service_->RequestSet(&ctx_, &request_, &responder_, cq_, cq_, this);
         }
 
+        tracing::Op TraceOp() const override { return tracing::OP_SET; }
+
         void CreateNewInstance() override
         {
             auto *new_call = impl_->set_call_pool_.acquire();
@@ -293,11 +544,26 @@ private:
         void ProcessRequest() override
         {
             memcached_return_t result;
-            memcached_st *memc = impl_->create_mc();
+            memcached_st *memc;
+            {
+                tracing::ScopedSpan span(trace_id_, tracing::Stage::MEMCACHED_POOL_POP, tracing::OP_SET);
+                memc = impl_->create_mc();
+            }
             time_t ttl = static_cast<time_t>(request_.ttl());
-            result = memcached_set(memc, request_.key().c_str(), request_.key().size(),
-                                   request_.value().c_str(), request_.value().size(),
-                                   ttl, (uint32_t)0);
+            if (request_.version() > 0)
+            {
+                tracing::ScopedSpan span(trace_id_, tracing::Stage::MEMCACHED_SET, tracing::OP_SET);
+                StoreResult stored = impl_->StoreVersioned(memc, request_.key(), &request_.value(), ttl, request_.version(),
+                                                           request_.compressed());
+                result = stored == StoreResult::FAILED ? MEMCACHED_FAILURE : MEMCACHED_SUCCESS;
+            }
+            else
+            {
+                tracing::ScopedSpan span(trace_id_, tracing::Stage::MEMCACHED_SET, tracing::OP_SET);
+                result = memcached_set(memc, request_.key().c_str(), request_.key().size(),
+                                       request_.value().c_str(), request_.value().size(),
+                                       ttl, request_.compressed() ? COMPRESSED_FLAG : 0);
+            }
             response_.set_success(result == MEMCACHED_SUCCESS);
             impl_->free_mc(memc);
         }
@@ -326,6 +592,7 @@ private:
         void ProcessRequest() override
         {
             impl_->ttl_ = request_.ttl();
+            impl_->adaptive_ttl_.Configure(request_.adaptive(), request_.staleness_slo(), request_.ttl(), request_.max_ttl());
             response_.set_success(true);
         }
     };
@@ -386,7 +653,15 @@ private:
         {
             memcached_return_t result;
             memcached_st *memc = impl_->create_mc();
-            result = memcached_delete(memc, request_.key().c_str(), request_.key().size(), (time_t)0);
+            if (request_.version() > 0)
+            {
+                StoreResult stored = impl_->StoreVersioned(memc, request_.key(), nullptr, 0, request_.version());
+                result = stored == StoreResult::FAILED ? MEMCACHED_FAILURE : MEMCACHED_SUCCESS;
+            }
+            else
+            {
+                result = memcached_delete(memc, request_.key().c_str(), request_.key().size(), (time_t)0);
+            }
             response_.set_success(result == MEMCACHED_SUCCESS);
             // std::cout << "Invalidate: " << request_.key() << std::endl;
             impl_->free_mc(memc);
@@ -418,9 +693,18 @@ private:
         {
             memcached_return_t result;
             memcached_st *memc = impl_->create_mc();
-            result = memcached_replace(memc, request_.key().c_str(), request_.key().size(),
-                                       request_.value().c_str(), request_.value().size(),
-                                       (time_t)0, (uint32_t)0);
+            if (request_.version() > 0)
+            {
+                StoreResult stored = impl_->StoreVersioned(memc, request_.key(), &request_.value(), 0, request_.version(),
+                                                           request_.compressed(), true);
+                result = stored == StoreResult::FAILED ? MEMCACHED_FAILURE : MEMCACHED_SUCCESS;
+            }
+            else
+            {
+                result = memcached_replace(memc, request_.key().c_str(), request_.key().size(),
+                                           request_.value().c_str(), request_.value().size(),
+                                           (time_t)0, request_.compressed() ? COMPRESSED_FLAG : 0);
+            }
             if (result == MEMCACHED_NOTFOUND)
             {
                 // The key does not exist in the cache
@@ -460,6 +744,11 @@ private:
             // Populate the response with the freshness stats
             response_.set_num_invalidates(impl_->num_invalidates_.load());
             response_.set_num_updates(impl_->num_updates_.load());
+            AdaptiveTTL::Stats ttl_stats = impl_->adaptive_ttl_.GetStats();
+            response_.set_num_adaptive_fills(ttl_stats.fills);
+            response_.set_num_adaptive_bypassed(ttl_stats.bypassed);
+            response_.set_mean_ttl(ttl_stats.mean_ttl);
+            response_.set_estimated_stale_ratio(ttl_stats.estimated_stale_ratio);
             response_.set_success(true);
         }
     };
@@ -491,7 +780,7 @@ private:
         get_freshness_stats_call->Proceed(true);
 
         size_t num_worker_threads = std::thread::hardware_concurrency();
-        ThreadPool thread_pool(num_worker_threads);
+        WorkStealingPool thread_pool(num_worker_threads);
 
         void *tag; // Uniquely identifies a request.
         bool ok;
@@ -500,15 +789,16 @@ private:
         {
             if (ok)
             {
-                // Enqueue the processing task into the ThreadPool
-                thread_pool.enqueue([tag]()
-                                    { static_cast<CallDataBase *>(tag)->Proceed(true); });
+                static_cast<CallDataBase *>(tag)->dequeued_tsc_ = tracing::Now();
+                // Hand the processing task to the pool; nobody waits on it
+                thread_pool.post([tag]()
+                                 { static_cast<CallDataBase *>(tag)->Proceed(true); });
             }
             else
             {
-                // Enqueue the cleanup task into the ThreadPool
-                thread_pool.enqueue([tag]()
-                                    { delete static_cast<CallDataBase *>(tag); });
+                // Hand the cleanup task to the pool
+                thread_pool.post([tag]()
+                                 { delete static_cast<CallDataBase *>(tag); });
             }
         }
     }
@@ -525,15 +815,25 @@ private:
     DBClient db_client_;
     memcached_pool_st *pool;
     int32_t ttl_ = 0;
+    AdaptiveTTL adaptive_ttl_;
+
+    LeaseMode lease_mode_ = LeaseMode::WAIT;
+    std::chrono::milliseconds lease_wait_{50};
+    static const size_t NUM_LEASE_SHARDS = 64;
+    struct alignas(64) LeaseShard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::shared_future<VersionedValue>> fills;
+    };
+    LeaseShard lease_shards_[NUM_LEASE_SHARDS];
     std::atomic<int32_t> cache_hits_{0};
     std::atomic<int32_t> cache_miss_{0};
     std::atomic<int32_t> num_invalidates_{0};
     std::atomic<int32_t> num_updates_{0};
 };
 
-void RunServer()
+void RunServer(const std::string &server_address, const std::string &db_address, const std::string &memcached_address)
 {
-    std::string db_address("10.128.0.33:50051");
     std::shared_ptr<Channel> channel = grpc::CreateChannel(db_address, grpc::InsecureChannelCredentials());
     if (!channel)
     {
@@ -541,8 +841,8 @@ void RunServer()
         return;
     }
 
-    CacheServiceImpl service(channel);
-    service.Run();
+    CacheServiceImpl service(channel, memcached_address);
+    service.Run(server_address);
 
     // Wait for server shutdown
     // std::cout << "Press Enter to stop the server..." << std::endl;
@@ -553,6 +853,17 @@ void RunServer()
 
 int main(int argc, char **argv)
 {
-    RunServer();
+    // Usage: server [<listen_addr>] [<db_addr>] [<memcached_addr>] [<trace_file>]
+    // Miss fills are coalesced per key; FRESHCACHE_LEASE_MODE=off|wait|stale
+    // and FRESHCACHE_LEASE_WAIT_MS tune it (see AcquireLease).
+    std::string server_address = (argc >= 2) ? argv[1] : "10.128.0.39:50051";
+    std::string db_address = (argc >= 3) ? argv[2] : "10.128.0.33:50051";
+    std::string memcached_address = (argc >= 4) ? argv[3] : "localhost:11211";
+
+    // Spans of traced requests are written out when the server is stopped.
+    if (argc >= 5)
+        tracing::DumpOnSignal(argv[4], "cache server");
+
+    RunServer(server_address, db_address, memcached_address);
     return 0;
 }
\ No newline at end of file
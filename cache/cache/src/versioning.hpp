@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Ordering rules for versioned cache writes (see StoreVersioned).
+ *
+ * Every write carries the DB version of the key. A write is dropped when
+ * the cached item already holds a newer version, or the same version as a
+ * live value. A tombstone left by the invalidate of version V only fences
+ * older versions: the fill that reads V back from the DB replaces it, so
+ * the key is cached again right away instead of after the tombstone TTL.
+ * A second tombstone of the same version is dropped.
+ *
+ * Only the low bits of a version fit in the item flags (mask), so versions
+ * wrap. They are compared as serial numbers (RFC 1982): a is newer than b
+ * if it is less than half the version space ahead of it. That holds as long
+ * as no two versions of a key in flight at once are 2^(bits-1) or more
+ * writes apart, which is 2^29 writes with the 30-bit versions used today.
+ */
+inline bool IsNewerVersion(uint32_t a, uint32_t b, uint32_t mask)
+{
+    uint32_t ahead = (a - b) & mask;
+    return ahead != 0 && ahead <= (mask >> 1);
+}
+
+inline bool IsStaleVersionedWrite(uint32_t cached_version, bool cached_tombstone,
+                                  uint32_t new_version, bool writes_tombstone, uint32_t mask)
+{
+    if (cached_version != new_version)
+        return IsNewerVersion(cached_version, new_version, mask);
+    return !cached_tombstone || writes_tombstone;
+}
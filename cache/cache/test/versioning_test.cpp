@@ -0,0 +1,114 @@
+// Checks the versioned write ordering in versioning.hpp against a model of
+// one cached item, written the way StoreVersioned writes it.
+#include "versioning.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#define CHECK(cond)                                                               \
+    do                                                                            \
+    {                                                                             \
+        if (!(cond))                                                              \
+        {                                                                         \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #cond << std::endl; \
+            failures++;                                                           \
+        }                                                                         \
+    } while (0)
+
+static int failures = 0;
+
+// The 30-bit version field of the server's item flags.
+static const uint32_t VERSION_MASK = (1u << 30) - 1;
+
+struct CachedItem
+{
+    bool exists = false;
+    uint32_t version = 0;
+    bool tombstone = false;
+    std::string value;
+
+    // A read hit: present and not a tombstone.
+    bool Cached() const { return exists && !tombstone; }
+};
+
+// Applies a versioned write (a tombstone if value is null) of a DB version,
+// masked the way StoreVersioned masks it; false if dropped.
+static bool Store(CachedItem &item, const std::string *value, uint64_t version)
+{
+    if (item.exists && IsStaleVersionedWrite(item.version, item.tombstone, version & VERSION_MASK,
+                                             value == nullptr, VERSION_MASK))
+        return false;
+    item.exists = true;
+    item.version = version & VERSION_MASK;
+    item.tombstone = value == nullptr;
+    item.value = value != nullptr ? *value : "";
+    return true;
+}
+
+int main()
+{
+    const std::string v1 = "one", v2 = "two";
+
+    {
+        // Invalidate of version 2, then the miss fill reads version 2 back.
+        CachedItem item;
+        CHECK(Store(item, &v1, 1));
+        CHECK(Store(item, nullptr, 2));
+        CHECK(!item.Cached());
+        CHECK(Store(item, &v2, 2));
+        CHECK(item.Cached());
+        CHECK(item.version == 2 && item.value == v2);
+    }
+    {
+        // The tombstone still fences fills that read an older version.
+        CachedItem item;
+        CHECK(Store(item, nullptr, 2));
+        CHECK(!Store(item, &v1, 1));
+        CHECK(!item.Cached());
+    }
+    {
+        // A live value is not rewritten by its own version, and a repeated
+        // invalidate of the same version leaves the value alone.
+        CachedItem item;
+        CHECK(Store(item, &v2, 2));
+        CHECK(!Store(item, &v1, 2));
+        CHECK(item.value == v2);
+        CHECK(Store(item, nullptr, 3));
+        CHECK(!Store(item, nullptr, 3));
+        CHECK(Store(item, &v1, 3));
+        CHECK(!Store(item, nullptr, 3));
+        CHECK(item.Cached() && item.value == v1);
+    }
+    {
+        // Newer writes always win.
+        CachedItem item;
+        CHECK(Store(item, &v2, 5));
+        CHECK(Store(item, &v1, 6));
+        CHECK(Store(item, nullptr, 7));
+        CHECK(!Store(item, &v2, 6));
+    }
+    {
+        // Versions past the flag bits wrap and keep ordering as serial
+        // numbers: the write after the last 30-bit version is newer, and
+        // one from before the wrap is older.
+        CachedItem item;
+        CHECK(Store(item, &v1, VERSION_MASK - 1));
+        CHECK(Store(item, &v2, VERSION_MASK));
+        CHECK(Store(item, nullptr, uint64_t{VERSION_MASK} + 1));
+        CHECK(!item.Cached() && item.version == 0);
+        CHECK(!Store(item, &v1, VERSION_MASK));
+        CHECK(Store(item, &v1, uint64_t{VERSION_MASK} + 1));
+        CHECK(Store(item, &v2, uint64_t{VERSION_MASK} + 2));
+        CHECK(!Store(item, &v1, VERSION_MASK - 1));
+        CHECK(item.Cached() && item.value == v2 && item.version == 1);
+    }
+
+    if (failures != 0)
+    {
+        std::cerr << failures << " check(s) failed" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "versioning_test passed" << std::endl;
+    return EXIT_SUCCESS;
+}
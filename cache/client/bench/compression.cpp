@@ -0,0 +1,148 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+#include "client.hpp"
+#include "compression.hpp"
+#include "benchmark.hpp"
+
+// Cost and benefit of value compression per value size, against a running
+// stack. For each size, the same keys are written raw and then compressed;
+// each key is written (client -> DB), read once to fill the cache (DB ->
+// cache -> memcached -> client) and read again as a hit. Reported per value:
+// bytes on the wire, memcached memory footprint, and client CPU spent in the
+// codec and overall.
+//
+// Usage: compression_bench [num_keys] [threshold] [level] [cache_addr] [db_addr] [memcached_addr]
+
+static double cpu_seconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// The memcached "bytes" stat: memory used by items, headers included.
+static long memcached_bytes(const std::string &memcached_address)
+{
+    std::string config_string = "--SERVER=" + memcached_address;
+    memcached_st *memc = memcached(config_string.c_str(), config_string.size());
+    if (memc == nullptr)
+        return -1;
+    memcached_return_t rc;
+    memcached_stat_st *stats = memcached_stat(memc, nullptr, &rc);
+    long bytes = -1;
+    if (rc == MEMCACHED_SUCCESS && stats != nullptr)
+    {
+        char *value = memcached_stat_get_value(memc, stats, "bytes", &rc);
+        if (value != nullptr)
+        {
+            bytes = std::stol(value);
+            free(value);
+        }
+    }
+    memcached_stat_free(memc, stats);
+    memcached_free(memc);
+    return bytes;
+}
+
+// Workload values are a single repeated byte, the best case; text drawn
+// from a small alphabet is closer to real payloads.
+static std::string make_value(size_t size, bool text, std::mt19937 &rng)
+{
+    if (!text)
+        return std::string(size, 'a');
+    static const char alphabet[] = "etaoinshrdlucmfw";
+    std::uniform_int_distribution<int> letter(0, sizeof(alphabet) - 2);
+    std::string value(size, ' ');
+    for (size_t i = 0; i < size; i++)
+        value[i] = alphabet[letter(rng)];
+    return value;
+}
+
+struct Round
+{
+    double put_wire = 0; // Bytes per value, client -> DB.
+    double get_wire = 0; // Bytes per value, cache -> client.
+    double memcached = 0;
+    double compress_us = 0;
+    double decompress_us = 0;
+    double cpu_us = 0; // Client process CPU per key, all three operations.
+};
+
+static Round run_round(Client &client, const std::string &prefix, const std::vector<std::string> &values,
+                       const CompressionConfig &config, const std::string &memcached_address)
+{
+    client.SetCompression(config);
+    CompressionStats &codec = compression::stats();
+    long sent_before = client.get_db_client()->GetValueBytesSent();
+    long received_before = client.get_cache_client()->GetValueBytesReceived();
+    long compress_ns = codec.compress_ns, decompress_ns = codec.decompress_ns;
+    long memcached_before = memcached_bytes(memcached_address);
+    double cpu_before = cpu_seconds();
+
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        std::string key = prefix + std::to_string(i);
+        client.Set(key, values[i], LONG_TTL, TTL_EW);
+        std::string filled = client.Get(key);
+        std::string hit = client.Get(key);
+        if (filled != values[i] || hit != values[i])
+            std::cerr << "Value mismatch for " << key << std::endl;
+    }
+
+    double n = values.size();
+    Round round;
+    round.cpu_us = (cpu_seconds() - cpu_before) * 1e6 / n;
+    round.put_wire = (client.get_db_client()->GetValueBytesSent() - sent_before) / n;
+    round.get_wire = (client.get_cache_client()->GetValueBytesReceived() - received_before) / n / 2;
+    round.memcached = (memcached_bytes(memcached_address) - memcached_before) / n;
+    round.compress_us = (codec.compress_ns - compress_ns) / 1e3 / n;
+    round.decompress_us = (codec.decompress_ns - decompress_ns) / 1e3 / n / 2;
+    return round;
+}
+
+int main(int argc, char *argv[])
+{
+    int num_keys = (argc >= 2) ? std::stoi(argv[1]) : 200;
+    CompressionConfig config;
+    config.enabled = true;
+    config.threshold = (argc >= 3) ? std::stoul(argv[2]) : config.threshold;
+    config.level = (argc >= 4) ? std::stoi(argv[3]) : config.level;
+    std::string cache_address = (argc >= 5) ? argv[4] : CACHE_ADDR;
+    std::string db_address = (argc >= 6) ? argv[5] : DB_ADDR;
+    std::string memcached_address = (argc >= 7) ? argv[6] : "localhost:11211";
+
+    Client client(cache_address, db_address, 5, nullptr, memcached_address);
+    client.SetTTL(LONG_TTL);
+
+    std::cout << "Keys: " << num_keys << ", threshold: " << config.threshold << " B, zlib level: " << config.level << std::endl;
+    std::cout << "size\tvalues\tmode\tput_wire_B\tget_wire_B\tmemcached_B\tcompress_us\tdecompress_us\tclient_cpu_us" << std::endl;
+
+    std::mt19937 rng(42);
+    const size_t sizes[] = {1 * KB, 16 * KB, 100 * KB, 1 * MB};
+    for (size_t size : sizes)
+    {
+        for (bool text : {false, true})
+        {
+            std::vector<std::string> values;
+            for (int i = 0; i < num_keys; i++)
+                values.push_back(make_value(size, text, rng));
+            for (bool compressed : {false, true})
+            {
+                CompressionConfig round_config = config;
+                round_config.enabled = compressed;
+                std::string prefix = "compression_" + std::to_string(size) + (text ? "_text_" : "_repeated_") +
+                                     (compressed ? "zlib_" : "raw_");
+                Round round = run_round(client, prefix, values, round_config, memcached_address);
+                std::cout << size << "\t" << (text ? "text" : "repeated") << "\t" << (compressed ? "zlib" : "raw")
+                          << "\t" << round.put_wire << "\t" << round.get_wire << "\t" << round.memcached
+                          << "\t" << round.compress_us << "\t" << round.decompress_us << "\t" << round.cpu_us << std::endl;
+            }
+        }
+    }
+    return 0;
+}
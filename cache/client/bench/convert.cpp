@@ -0,0 +1,38 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+
+#include "workload.hpp"
+#include "parser.hpp"
+
+// Parse a trace once and store it in the binary format of trace_file.hpp.
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <workload> <output_trace> [<num_operations>]" << std::endl;
+        return 1;
+    }
+
+    Workload *workload = Parser::make_workload(argv[1]);
+    if (workload == nullptr)
+        return 1;
+
+    // Keep raw inter-arrival times; scaling and capping happen at replay.
+    workload->scale_factor_ = 1;
+    workload->set_max_interval(std::chrono::milliseconds(std::numeric_limits<uint32_t>::max()));
+
+    auto start_time = std::chrono::high_resolution_clock::now();
+    workload->generateRequests(argc >= 4 ? std::stoi(argv[3]) : -1);
+    auto end_time = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> parse_time = end_time - start_time;
+    std::cout << "Parsed " << workload->num_operations() << " requests in " << parse_time.count() << " s" << std::endl;
+
+    if (!workload->save_trace(argv[2]))
+    {
+        std::cerr << "Failed to write " << argv[2] << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << argv[2] << std::endl;
+    return 0;
+}
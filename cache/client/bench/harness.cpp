@@ -0,0 +1,349 @@
+#include <grpcpp/grpcpp.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "benchmark.hpp"
+#include "parser.hpp"
+
+/*
+ * Runs one benchmark end to end on this machine: starts memcached, the
+ * cache server and the DB stand-in on ephemeral localhost ports, drives the
+ * workload through benchmark(), and writes the configuration and results
+ * to a JSON file (see results.hpp).
+ *
+ * Usage: harness [--option=value ...] <workload> [<scale_factor>] [<tracker>] [<log_path>] [<trace_file>] [stream]
+ *
+ * Options:
+ *   --mode=adaptive|invalidate|update|ttl|adaptive-ttl
+ *                                           freshness policy (default adaptive)
+ *   --ttl=<seconds>                         TTL for ttl mode, starting TTL for adaptive-ttl (default 1)
+ *   --staleness-slo=<fraction>              adaptive-ttl target stale-read fraction (default 0.01)
+ *   --max-ttl=<seconds>                     adaptive-ttl upper bound (default 300)
+ *   --threads=<n>                           client threads (default NUM_CPUS)
+ *   --output=<path>                         results file (default results.json)
+ *   --memcached=<path>                      memcached binary (default: memcached on PATH)
+ *   --memcached-memory=<MB>                 memcached -m (default 10000)
+ *   --server=<path> --db=<path>             defaults: next to this binary's build dir
+ *   --db-read-latency=<spec> --db-write-latency=<spec> --db-concurrency=<n>
+ *   --memcached-cpus=<list> --server-cpus=<list> --db-cpus=<list> --client-cpus=<list>
+ *                                           CPU lists such as 0-3,6
+ *   --telemetry=<spec>                      load sampler settings, e.g. interval=100ms,format=csv,perf
+ *   --trace=<prefix>                        have the server and DB write their request spans to
+ *                                           <prefix>.server.json and <prefix>.db.json on shutdown
+ *   --stale-check=0|1                       count reads older than the last acknowledged write
+ */
+
+static bool parse_cpu_list(const std::string &list, cpu_set_t &set)
+{
+    CPU_ZERO(&set);
+    std::stringstream ss(list);
+    std::string range;
+    try
+    {
+        while (std::getline(ss, range, ','))
+        {
+            size_t dash = range.find('-');
+            int lo = std::stoi(range.substr(0, dash));
+            int hi = (dash == std::string::npos) ? lo : std::stoi(range.substr(dash + 1));
+            for (int cpu = lo; cpu <= hi; cpu++)
+                CPU_SET(cpu, &set);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Invalid CPU list: " << list << std::endl;
+        return false;
+    }
+    return CPU_COUNT(&set) > 0;
+}
+
+// Ask the kernel for a free port. The port is released again before the
+// child binds it, which is fine on a quiet benchmark box.
+static int ephemeral_port()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t len = sizeof(addr);
+    if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0 || getsockname(fd, (sockaddr *)&addr, &len) != 0)
+    {
+        std::cerr << "Unable to allocate a port" << std::endl;
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+static bool wait_for_port(int port, std::chrono::seconds timeout)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (std::chrono::steady_clock::now() < deadline)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        bool up = connect(fd, (sockaddr *)&addr, sizeof(addr)) == 0;
+        close(fd);
+        if (up)
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return false;
+}
+
+class ChildProcess
+{
+public:
+    ChildProcess(const std::string &name) : name_(name) {}
+
+    ~ChildProcess() { Stop(); }
+
+    bool Start(const std::vector<std::string> &args, const std::string &cpus)
+    {
+        cpu_set_t set;
+        bool pin = !cpus.empty();
+        if (pin && !parse_cpu_list(cpus, set))
+            return false;
+
+        pid_ = fork();
+        if (pid_ < 0)
+        {
+            std::cerr << "fork failed for " << name_ << std::endl;
+            return false;
+        }
+        if (pid_ == 0)
+        {
+            // Do not outlive the harness if it is killed.
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if (pin && sched_setaffinity(0, sizeof(set), &set) != 0)
+                std::cerr << "Unable to pin " << name_ << " to CPUs " << cpus << std::endl;
+            std::vector<char *> argv;
+            for (const auto &arg : args)
+                argv.push_back(const_cast<char *>(arg.c_str()));
+            argv.push_back(nullptr);
+            execvp(argv[0], argv.data());
+            std::cerr << "exec failed for " << name_ << ": " << args[0] << std::endl;
+            _exit(127);
+        }
+        return true;
+    }
+
+    void Stop()
+    {
+        if (pid_ <= 0)
+            return;
+        kill(pid_, SIGTERM);
+        for (int i = 0; i < 50; i++)
+        {
+            if (waitpid(pid_, nullptr, WNOHANG) == pid_)
+            {
+                pid_ = -1;
+                return;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        kill(pid_, SIGKILL);
+        waitpid(pid_, nullptr, 0);
+        pid_ = -1;
+    }
+
+private:
+    std::string name_;
+    pid_t pid_ = -1;
+};
+
+static std::string binary_dir()
+{
+    char path[4096];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len <= 0)
+        return ".";
+    path[len] = '\0';
+    std::string exe(path);
+    return exe.substr(0, exe.rfind('/'));
+}
+
+int main(int argc, char *argv[])
+{
+    std::map<std::string, std::string> options = {
+        {"mode", "adaptive"},
+        {"ttl", "1"},
+        {"threads", std::to_string(NUM_CPUS)},
+        {"output", "results.json"},
+        {"memcached", "memcached"},
+        {"memcached-memory", "10000"},
+        {"server", binary_dir() + "/../cache/server"},
+        {"db", binary_dir() + "/../db/db_server"},
+        {"db-read-latency", "none"},
+        {"db-write-latency", "none"},
+        {"db-concurrency", "0"},
+        {"memcached-cpus", ""},
+        {"server-cpus", ""},
+        {"db-cpus", ""},
+        {"client-cpus", ""},
+        {"telemetry", ""},
+        {"trace", ""},
+        {"stale-check", "0"},
+        {"staleness-slo", "0.01"},
+        {"max-ttl", "300"},
+    };
+
+    // Options first, then the usual Parser arguments.
+    std::vector<char *> parser_argv = {argv[0]};
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) == 0)
+        {
+            size_t eq = arg.find('=');
+            std::string key = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+            if (eq == std::string::npos || options.find(key) == options.end())
+            {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+            options[key] = arg.substr(eq + 1);
+        }
+        else
+        {
+            parser_argv.push_back(argv[i]);
+        }
+    }
+    Parser parser(parser_argv.size(), parser_argv.data());
+    if (parser.workload == nullptr)
+        return 1;
+    if (!options["telemetry"].empty() && !TelemetryConfig::Parse(options["telemetry"], parser.telemetry))
+    {
+        std::cerr << "Bad telemetry spec: " << options["telemetry"] << std::endl;
+        return 1;
+    }
+    parser.stale_check = options["stale-check"] == "1";
+    // Written below, with the harness options as the config.
+    parser.result_path.clear();
+
+    float ew;
+    int ttl = LONG_TTL;
+    const std::string &mode = options["mode"];
+    if (mode == "adaptive")
+        ew = ADAPTIVE_EW;
+    else if (mode == "invalidate")
+        ew = INVALIDATE_EW;
+    else if (mode == "update")
+        ew = UPDATE_EW;
+    else if (mode == "ttl")
+    {
+        ew = TTL_EW;
+        ttl = std::stoi(options["ttl"]);
+    }
+    else if (mode == "adaptive-ttl")
+    {
+        ew = TTL_EW;
+        ttl = std::stoi(options["ttl"]);
+        parser.adaptive_ttl.enabled = true;
+        parser.adaptive_ttl.staleness_slo = std::stof(options["staleness-slo"]);
+        parser.adaptive_ttl.max_ttl = std::stoi(options["max-ttl"]);
+    }
+    else
+    {
+        std::cerr << "Unknown mode: " << mode << std::endl;
+        return 1;
+    }
+
+    int memcached_port = ephemeral_port();
+    int db_port = ephemeral_port();
+    int cache_port = ephemeral_port();
+    if (memcached_port < 0 || db_port < 0 || cache_port < 0)
+        return 1;
+    std::string memcached_addr = "127.0.0.1:" + std::to_string(memcached_port);
+    std::string db_addr = "127.0.0.1:" + std::to_string(db_port);
+    std::string cache_addr = "127.0.0.1:" + std::to_string(cache_port);
+
+    std::vector<std::string> memcached_args = {options["memcached"], "-l", "127.0.0.1", "-p", std::to_string(memcached_port),
+                                               "-U", "0", "-m", options["memcached-memory"]};
+    if (geteuid() == 0)
+    {
+        // memcached refuses to run as root without -u.
+        memcached_args.push_back("-u");
+        memcached_args.push_back("root");
+    }
+
+    ChildProcess memcached("memcached"), db("db_server"), server("server");
+    if (!memcached.Start(memcached_args, options["memcached-cpus"]) ||
+        !wait_for_port(memcached_port, std::chrono::seconds(10)))
+    {
+        std::cerr << "memcached did not come up on " << memcached_addr << std::endl;
+        return 1;
+    }
+    std::vector<std::string> db_args = {options["db"], db_addr, cache_addr, options["db-read-latency"],
+                                        options["db-write-latency"], options["db-concurrency"]};
+    std::vector<std::string> server_args = {options["server"], cache_addr, db_addr, memcached_addr};
+    if (!options["trace"].empty())
+    {
+        db_args.push_back("64");
+        db_args.push_back(options["trace"] + ".db.json");
+        server_args.push_back(options["trace"] + ".server.json");
+    }
+    if (!db.Start(db_args, options["db-cpus"]) ||
+        !wait_for_port(db_port, std::chrono::seconds(10)))
+    {
+        std::cerr << "db_server did not come up on " << db_addr << std::endl;
+        return 1;
+    }
+    if (!server.Start(server_args, options["server-cpus"]) ||
+        !wait_for_port(cache_port, std::chrono::seconds(10)))
+    {
+        std::cerr << "server did not come up on " << cache_addr << std::endl;
+        return 1;
+    }
+
+    if (!options["client-cpus"].empty())
+    {
+        cpu_set_t set;
+        if (!parse_cpu_list(options["client-cpus"], set) || sched_setaffinity(0, sizeof(set), &set) != 0)
+            std::cerr << "Unable to pin the client to CPUs " << options["client-cpus"] << std::endl;
+    }
+
+    int num_threads = std::stoi(options["threads"]);
+    BenchmarkResult result;
+    {
+        Client client(grpc::CreateChannel(cache_addr, grpc::InsecureChannelCredentials()),
+                      grpc::CreateChannel(db_addr, grpc::InsecureChannelCredentials()),
+                      parser.tracker, memcached_addr);
+        result = benchmark(client, ttl, ew, parser, num_threads);
+    }
+
+    std::ofstream out(options["output"]);
+    if (!out.is_open())
+    {
+        std::cerr << "Error: Unable to open " << options["output"] << std::endl;
+        return 1;
+    }
+    ResultConfig config(options.begin(), options.end());
+    for (size_t i = 1; i < parser_argv.size(); i++)
+        config.emplace_back("arg" + std::to_string(i), parser_argv[i]);
+    write_result_json(out, config, result);
+    std::cout << "Results written to " << options["output"] << std::endl;
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "thread_pool.hpp"
+#include "work_stealing_pool.hpp"
+
+// Compare ThreadPool and WorkStealingPool on the two shapes the client and
+// server use them for: one dispatcher thread handing off tiny tasks (the
+// completion-queue loops), and tasks that spawn further tasks.
+
+static void spin(int iterations)
+{
+    volatile int sink = 0;
+    for (int i = 0; i < iterations; i++)
+        sink = sink + i;
+}
+
+static void wait_for(std::atomic<long> &done, long target)
+{
+    while (done.load(std::memory_order_acquire) < target)
+        std::this_thread::yield();
+}
+
+// One external producer, num_tasks independent tasks.
+template <class Submit>
+double bench_handoff(Submit submit, long num_tasks, int work)
+{
+    std::atomic<long> done{0};
+    auto start = std::chrono::high_resolution_clock::now();
+    for (long i = 0; i < num_tasks; i++)
+    {
+        submit([&done, work]()
+               {
+                   spin(work);
+                   done.fetch_add(1, std::memory_order_release); });
+    }
+    wait_for(done, num_tasks);
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return num_tasks / elapsed.count();
+}
+
+// num_roots tasks that each fan out into fanout children from inside the pool.
+template <class Pool, class Submit>
+double bench_fanout(Pool &pool, Submit submit, long num_roots, int fanout, int work)
+{
+    std::atomic<long> done{0};
+    auto start = std::chrono::high_resolution_clock::now();
+    for (long i = 0; i < num_roots; i++)
+    {
+        submit(pool, [&pool, &done, &submit, fanout, work]()
+               {
+                   for (int c = 0; c < fanout; c++)
+                   {
+                       submit(pool, [&done, work]()
+                              {
+                                  spin(work);
+                                  done.fetch_add(1, std::memory_order_release); });
+                   }
+                   done.fetch_add(1, std::memory_order_release); });
+    }
+    long total = num_roots * (fanout + 1);
+    wait_for(done, total);
+    std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return total / elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+    int num_threads = (argc >= 2) ? std::stoi(argv[1]) : std::thread::hardware_concurrency();
+    long num_tasks = (argc >= 3) ? std::stol(argv[2]) : 1000000;
+    int work = (argc >= 4) ? std::stoi(argv[3]) : 100;
+    bool pin = (argc >= 5) && std::string(argv[4]) == "pin";
+    int fanout = 16;
+
+    std::cout << "Threads: " << num_threads << ", tasks: " << num_tasks << ", work: " << work
+              << (pin ? ", pinned" : "") << std::endl;
+
+    {
+        ThreadPool pool(num_threads);
+        double handoff = bench_handoff([&pool](auto &&f)
+                                       { pool.enqueue(std::forward<decltype(f)>(f)); },
+                                       num_tasks, work);
+        double fan = bench_fanout(
+            pool, [](ThreadPool &p, auto &&f)
+            { p.enqueue(std::forward<decltype(f)>(f)); },
+            num_tasks / (fanout + 1), fanout, work);
+        std::cout << "ThreadPool::enqueue        handoff: " << handoff << " tasks/s, fanout: " << fan << " tasks/s" << std::endl;
+    }
+
+    {
+        WorkStealingPool pool(num_threads, pin);
+        double handoff = bench_handoff([&pool](auto &&f)
+                                       { pool.enqueue(std::forward<decltype(f)>(f)); },
+                                       num_tasks, work);
+        std::cout << "WorkStealingPool::enqueue  handoff: " << handoff << " tasks/s" << std::endl;
+    }
+
+    {
+        WorkStealingPool pool(num_threads, pin);
+        double handoff = bench_handoff([&pool](auto &&f)
+                                       { pool.post(std::forward<decltype(f)>(f)); },
+                                       num_tasks, work);
+        double fan = bench_fanout(
+            pool, [](WorkStealingPool &p, auto &&f)
+            { p.post(std::forward<decltype(f)>(f)); },
+            num_tasks / (fanout + 1), fanout, work);
+        std::cout << "WorkStealingPool::post     handoff: " << handoff << " tasks/s, fanout: " << fan << " tasks/s" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,192 @@
+#include <iomanip>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.hpp"
+#include "parser.hpp"
+#include "simulator.hpp"
+
+/*
+ * Sweeps freshness policy, eviction and cache size over a workload offline
+ * (see simulator.hpp), one configuration per thread, and writes one CSV row
+ * per configuration.
+ *
+ * Usage: simulator [--option=value ...] <workload> [<scale_factor>] [<tracker>] [<log_path>] [<trace_file>]
+ *
+ * Options:
+ *   --policies=<list>     any of invalidate,update,adaptive,ttl:<seconds> (default invalidate,update,adaptive,ttl:1)
+ *   --eviction=<list>     any of lru,slru,s3fifo (default lru)
+ *   --sizes=<list>        cache sizes, in bytes with an optional K/M/G suffix or as a
+ *                         percentage of the workload footprint (default 1%,10%,50%,100%)
+ *   --threads=<n>         configurations simulated at once (default: all cores)
+ *   --warmup=0|1          fill the cache with the first 1/warmup_factor of the requests
+ *                         without measuring them, like benchmark() (default 1)
+ *   --output=<path>       CSV results (default simulation.csv)
+ */
+
+static std::vector<std::string> split(const std::string &list)
+{
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        if (!item.empty())
+            items.push_back(item);
+    }
+    return items;
+}
+
+// "64M", "1G", "4096" or "10%" of footprint.
+static bool parse_size(const std::string &spec, uint64_t footprint, uint64_t &bytes)
+{
+    try
+    {
+        size_t end;
+        double value = std::stod(spec, &end);
+        std::string suffix = spec.substr(end);
+        if (suffix == "%")
+            bytes = footprint * value / 100;
+        else if (suffix.empty())
+            bytes = value;
+        else if (suffix == "K")
+            bytes = value * 1024;
+        else if (suffix == "M")
+            bytes = value * 1024 * 1024;
+        else if (suffix == "G")
+            bytes = value * 1024 * 1024 * 1024;
+        else
+            return false;
+    }
+    catch (const std::exception &e)
+    {
+        return false;
+    }
+    return bytes > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    std::map<std::string, std::string> options = {
+        {"policies", "invalidate,update,adaptive,ttl:1"},
+        {"eviction", "lru"},
+        {"sizes", "1%,10%,50%,100%"},
+        {"threads", std::to_string(std::max(1u, std::thread::hardware_concurrency()))},
+        {"warmup", "1"},
+        {"output", "simulation.csv"},
+    };
+
+    // Options first, then the usual Parser arguments.
+    std::vector<char *> parser_argv = {argv[0]};
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) == 0)
+        {
+            size_t eq = arg.find('=');
+            std::string key = arg.substr(2, eq == std::string::npos ? std::string::npos : eq - 2);
+            if (eq == std::string::npos || options.find(key) == options.end())
+            {
+                std::cerr << "Unknown option: " << arg << std::endl;
+                return 1;
+            }
+            options[key] = arg.substr(eq + 1);
+        }
+        else
+        {
+            parser_argv.push_back(argv[i]);
+        }
+    }
+    Parser parser(parser_argv.size(), parser_argv.data());
+    if (parser.workload == nullptr)
+        return 1;
+
+    Workload *workload = parser.workload;
+    workload->init(parser.scale_factor);
+    auto load_start = std::chrono::steady_clock::now();
+    SimTrace trace(*workload);
+    size_t start = options["warmup"] == "1" ? trace.size() / warmup_factor : 0;
+    std::chrono::duration<double> load_time = std::chrono::steady_clock::now() - load_start;
+    std::cout << "Interned " << trace.num_keys() << " keys in " << load_time.count() << " s, footprint "
+              << trace.footprint() << " bytes" << std::endl;
+
+    std::vector<SimConfig> configs;
+    bool any_adaptive = false;
+    for (const std::string &policy : split(options["policies"]))
+    {
+        for (const std::string &eviction : split(options["eviction"]))
+        {
+            for (const std::string &size : split(options["sizes"]))
+            {
+                SimConfig config;
+                if (!config.ParsePolicy(policy))
+                {
+                    std::cerr << "Unknown policy: " << policy << std::endl;
+                    return 1;
+                }
+                if (!config.ParseEviction(eviction))
+                {
+                    std::cerr << "Unknown eviction: " << eviction << std::endl;
+                    return 1;
+                }
+                if (!parse_size(size, trace.footprint(), config.cache_bytes))
+                {
+                    std::cerr << "Bad cache size: " << size << std::endl;
+                    return 1;
+                }
+                any_adaptive |= config.policy == SimPolicy::ADAPTIVE;
+                configs.push_back(config);
+            }
+        }
+    }
+
+    std::vector<uint64_t> adaptive;
+    if (any_adaptive)
+    {
+        if (parser.tracker == nullptr)
+            return 1;
+        auto tracker_start = std::chrono::steady_clock::now();
+        adaptive = AdaptiveDecisions(trace, parser.tracker, start);
+        std::chrono::duration<double> tracker_time = std::chrono::steady_clock::now() - tracker_start;
+        std::cout << parser.tracker_name << " pass: " << tracker_time.count() << " s" << std::endl;
+    }
+
+    int num_threads = std::stoi(options["threads"]);
+    auto sweep_start = std::chrono::steady_clock::now();
+    std::vector<SimResult> results = Sweep(trace, configs, start, &adaptive, num_threads);
+    std::chrono::duration<double> sweep_time = std::chrono::steady_clock::now() - sweep_start;
+
+    std::ofstream out(options["output"]);
+    if (!out.is_open())
+    {
+        std::cerr << "Error: Unable to open " << options["output"] << std::endl;
+        return 1;
+    }
+    out << "policy,eviction,cache_bytes,reads,writes,hits,misses,miss_ratio,stale_reads,stale_ratio,"
+           "invalidates,updates,evictions,ghost_hits,expirations,cost,cost_per_request,seconds\n";
+    std::cout << std::left << std::setw(12) << "policy" << std::setw(8) << "evict" << std::right
+              << std::setw(14) << "cache_bytes" << std::setw(11) << "miss_ratio" << std::setw(12) << "stale_ratio"
+              << std::setw(14) << "cost" << std::setw(10) << "cost/req" << std::setw(12) << "Mreq/s" << std::endl;
+    for (const SimResult &r : results)
+    {
+        long requests = r.reads + r.writes;
+        double cost_per_request = requests > 0 ? (double)r.cost() / requests : 0;
+        std::string eviction = r.config.eviction_name();
+        out << r.config.policy_name() << "," << eviction << "," << r.config.cache_bytes << "," << r.reads << ","
+            << r.writes << "," << r.hits << "," << r.misses << "," << r.miss_ratio() << "," << r.stale_reads << ","
+            << r.stale_ratio() << "," << r.invalidates << "," << r.updates << "," << r.evictions << ","
+            << r.ghost_hits << "," << r.expirations << "," << r.cost() << "," << cost_per_request << "," << r.seconds << "\n";
+        std::cout << std::left << std::setw(12) << r.config.policy_name() << std::setw(8) << eviction << std::right
+                  << std::setw(14) << r.config.cache_bytes << std::setw(11) << std::setprecision(4) << r.miss_ratio()
+                  << std::setw(12) << r.stale_ratio() << std::setw(14) << r.cost() << std::setw(10)
+                  << cost_per_request << std::setw(12) << trace.size() / r.seconds / 1e6 << std::endl;
+    }
+    std::cout << configs.size() << " configurations in " << sweep_time.count() << " s on " << num_threads
+              << " threads; results written to " << options["output"] << std::endl;
+    return 0;
+}
@@ -29,6 +29,9 @@ int main(int argc, char *argv[])
     int ttl = LONG_TTL;
     // alpha = 1.0;
 
+    // Report how many reads returned an older version than the DB had.
+    parser.stale_check = true;
+
     // Pass the workload string to the benchmark function
     benchmark(client, ttl, ew, parser, NUM_CPUS);
 
@@ -32,6 +32,9 @@ int main(int argc, char *argv[])
     int ttl = 1;
     // alpha = 1.0;
 
+    // Staleness of the fixed TTL, to compare against adaptive_ttl_bench.
+    parser.stale_check = true;
+
     // Pass the workload string to the benchmark function
     benchmark(client, ttl, ew, parser, NUM_CPUS);
 
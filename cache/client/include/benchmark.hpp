@@ -1,6 +1,7 @@
 #pragma once
 
 #include <grpcpp/grpcpp.h>
+#include <fstream>
 #include <iostream>
 #include <memory>
 
@@ -14,12 +15,10 @@
 #include "zipf.hpp"
 #include "tqdm.hpp"
 #include "workload.hpp"
+#include "stream_workload.hpp"
 #include "parser.hpp"
 #include "load_tracker.hpp"
-
-const int C_I = 10;
-const int C_U = 46;
-const int C_M = C_I + C_U;
+#include "results.hpp"
 
 #define ASSERT(condition, message)             \
     do                                         \
@@ -50,7 +49,7 @@ void _warm_thread_db(Client &client, int start, int end, int ttl, float ew, Work
             continue;
         }
         idx += 1;
-        client.SetWarm(key, workload->get_value_from_size(value_size), ttl); // Disable invalidate
+        client.SetWarm(key, Workload::get_value_view_from_size(value_size), ttl); // Disable invalidate
     }
 }
 
@@ -60,8 +59,7 @@ void _warm_thread_cache(Client &client, int start, int end, int ttl, float ew, W
     for (int i = start; i < end; i++)
     {
         std::string key = workload->get_key(i);
-        std::string value = workload->get_value(i);
-        client.SetCache(key, value, ttl); // Need to set for both raeds and writes.
+        client.SetCache(key, workload->get_value_view(i), ttl); // Need to set for both raeds and writes.
     }
 }
 
@@ -108,7 +106,7 @@ void benchmark_thread_async(Client &client, int start_op, int end_op, int ttl, f
     {
         int i = a + start_op;
         std::string key = workload->get_key(i);
-        std::string value = workload->get_value(i);
+        std::string_view value = workload->get_value_view(i);
 
         if (workload->get_is_write(i))
         {
@@ -171,21 +169,314 @@ void benchmark_ew_tracker(Tracker *tracker, Workload *workload)
     std::cout << "gold_tracker storage: " << gold_tracker->get_storage_overhead() << std::endl;
 }
 
-void benchmark(Client &client, int ttl, float ew, Parser &parser, int num_threads = 1, bool skip_exp = false)
+// Compare per-key tracker calls against batched ones over the same request
+// stream. Reads and writes of a chunk are handed over as two batches, so
+// only the throughput (not the accuracy) of the two runs is comparable.
+// Each pass gets a fresh tracker: update() does not empty the exact ones.
+// Only this microbenchmark uses the batch calls; the request loops still
+// call the tracker per key, as SetAsync and GetAsync do.
+void benchmark_tracker_throughput(const std::string &tracker_name, Workload *workload, size_t batch_size = 256)
+{
+    int num_ops = workload->num_operations();
+
+    std::unique_ptr<Tracker> tracker(Parser::make_tracker(tracker_name));
+    if (!tracker)
+        return;
+    tracker->update(workload->get_num_keys());
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < num_ops; i++)
+    {
+        std::string key = workload->get_key(i);
+        if (workload->get_is_write(i))
+        {
+            tracker->write(key);
+            tracker->get_ew(key);
+        }
+        else
+        {
+            tracker->read(key);
+        }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> single_time = end - start;
+
+    tracker.reset(Parser::make_tracker(tracker_name));
+    tracker->update(workload->get_num_keys());
+    std::vector<std::string> reads, writes;
+    std::vector<double> ews;
+    reads.reserve(batch_size);
+    writes.reserve(batch_size);
+    start = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < num_ops; i += batch_size)
+    {
+        int chunk_end = std::min<int>(num_ops, i + batch_size);
+        reads.clear();
+        writes.clear();
+        for (int j = i; j < chunk_end; j++)
+        {
+            if (workload->get_is_write(j))
+                writes.push_back(workload->get_key(j));
+            else
+                reads.push_back(workload->get_key(j));
+        }
+        tracker->read_batch(reads);
+        tracker->write_batch(writes);
+        tracker->get_ew_batch(writes, ews);
+    }
+    end = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double> batch_time = end - start;
+
+    std::cout << "Tracker single throughput: " << num_ops / single_time.count() << " ops/s" << std::endl;
+    std::cout << "Tracker batched throughput (batch " << batch_size << "): " << num_ops / batch_time.count() << " ops/s" << std::endl;
+}
+
+// The bench targets' own run configuration, for the result file.
+ResultConfig parser_config(const Parser &parser, int num_threads)
+{
+    return {
+        {"workload", parser.workload_name},
+        {"scale_factor", std::to_string(parser.scale_factor)},
+        {"tracker", parser.tracker_name},
+        {"log_path", parser.log_path},
+        {"stream", parser.stream ? "1" : "0"},
+        {"threads", std::to_string(num_threads)},
+        {"stale_check", parser.stale_check ? "1" : "0"},
+        {"adaptive_ttl", parser.adaptive_ttl.enabled ? "1" : "0"},
+        {"staleness_slo", std::to_string(parser.adaptive_ttl.staleness_slo)},
+        {"max_ttl", std::to_string(parser.adaptive_ttl.max_ttl)},
+    };
+}
+
+BenchmarkResult report_results(Client &client, Parser &parser, long duration, int num_operations,
+                               int ttl, float ew, int num_threads)
+{
+    float mr = client.GetMR();
+    FreshnessStats stats = client.GetFreshnessStats();
+    int invalidates = stats.invalidates;
+    int updates = stats.updates;
+    int load = client.GetLoad();
+
+    BenchmarkResult result;
+    result.num_operations = num_operations;
+    result.duration_ms = duration;
+    result.miss_ratio = mr;
+    result.invalidates = invalidates;
+    result.updates = updates;
+    result.load = load;
+    result.avg_cache_latency_ms = client.GetCacheAverageLatency() / 1000.0;
+    result.avg_db_latency_ms = client.GetDBAverageLatency() / 1000.0;
+    result.adaptive_fills = stats.adaptive_fills;
+    result.adaptive_bypassed = stats.adaptive_bypassed;
+    result.mean_ttl = stats.mean_ttl;
+    result.estimated_stale_ratio = stats.estimated_stale_ratio;
+    result.stale_reads = client.GetStaleReads();
+    result.checked_reads = client.GetCheckedReads();
+    result.db_reads = client.get_db_client()->GetDBReadCount();
+    result.db_writes = client.get_db_client()->GetDBWriteCount();
+    result.ew = ew;
+    result.ttl = ttl;
+    result.workload = parser.workload->get_stats();
+    result.cache_latency = client.get_cache_client()->GetLatencyHistogram();
+    result.db_latency = client.get_db_client()->GetLatencyHistogram();
+
+    std::cout << "\nResults: " << std::endl;
+    std::cout << "Miss Ratio (MR): " << mr << std::endl;
+
+    std::cout << "Invalidates: " << invalidates << std::endl;
+    std::cout << "Updates: " << updates << std::endl;
+
+    std::cout << "Load: " << load << std::endl;
+    std::cout << "End-to-End Latency: " << duration << " ms" << std::endl;
+
+    std::cout << "Average cache latency: " << client.GetCacheAverageLatency() / 1000 << " ms" << std::endl;
+    std::cout << "Average DB latency: " << client.GetDBAverageLatency() / 1000 << " ms" << std::endl;
+    if (client.stale_check_enabled())
+        std::cout << "Stale reads: " << result.stale_reads << " of " << result.checked_reads << std::endl;
+    if (parser.adaptive_ttl.enabled)
+        std::cout << "Adaptive TTL: " << stats.adaptive_fills << " fills (" << stats.adaptive_bypassed << " not cached), mean TTL " << stats.mean_ttl
+                  << " s, estimated stale ratio " << stats.estimated_stale_ratio << std::endl;
+
+    std::string latency_message = "Average cache latency: " + std::to_string(client.GetCacheAverageLatency() / 1000.0) + " ms";
+    WRITE_TO_LOG(std::string(parser.log_path), "stats", latency_message);
+
+    latency_message = "Average DB latency: " + std::to_string(client.GetDBAverageLatency() / 1000.0) + " ms";
+    WRITE_TO_LOG(std::string(parser.log_path), "stats", latency_message);
+
+    latency_message = "End-to-End Latency: " + std::to_string(duration) + " ms";
+    WRITE_TO_LOG(std::string(parser.log_path), "stats", latency_message);
+
+    latency_message = "Num operations: " + std::to_string(num_operations);
+    WRITE_TO_LOG(std::string(parser.log_path), "stats", latency_message);
+
+    if (client.stale_check_enabled())
+    {
+        latency_message = "Stale reads: " + std::to_string(result.stale_reads) + " of " + std::to_string(result.checked_reads);
+        WRITE_TO_LOG(std::string(parser.log_path), "stats", latency_message);
+    }
+    if (parser.adaptive_ttl.enabled)
+    {
+        latency_message = "Adaptive TTL: " + std::to_string(stats.adaptive_fills) + " fills (" +
+                          std::to_string(stats.adaptive_bypassed) + " not cached), mean TTL " +
+                          std::to_string(stats.mean_ttl) + " s, estimated stale ratio " + std::to_string(stats.estimated_stale_ratio);
+        WRITE_TO_LOG(std::string(parser.log_path), "stats", latency_message);
+    }
+
+    END_COLLECTION();
+    result.telemetry = get_telemetry_summary();
+
+    if (!parser.result_path.empty())
+    {
+        std::ofstream out(parser.result_path);
+        if (out.is_open())
+        {
+            write_result_json(out, parser_config(parser, num_threads), result);
+            std::cout << "Results written to " << parser.result_path << std::endl;
+        }
+        else
+        {
+            std::cerr << "Error: Unable to open " << parser.result_path << std::endl;
+        }
+    }
+
+    // Sampled request spans (see tracing.hpp), if any were taken.
+    size_t spans = tracing::DumpChromeTrace(parser.log_path + ".trace.json", "client");
+    if (spans > 0)
+        std::cout << "Wrote " << spans << " trace spans to " << parser.log_path << ".trace.json" << std::endl;
+    return result;
+}
+
+void _stream_thread(Client &client, RequestStream &stream, int consumer, int ttl, float ew, bool warm)
+{
+    std::unique_ptr<RequestChunk> chunk;
+    while (stream.next(consumer, chunk))
+    {
+        for (const auto &r : chunk->requests)
+        {
+            std::string_view value = Workload::get_value_view_from_size(r.value_size);
+            if (warm)
+            {
+                client.SetCache(r.key, value, ttl);
+                continue;
+            }
+            if (r.is_write)
+            {
+                client.SetAsync(r.key, value, ttl, ew);
+            }
+            else
+            {
+                client.GetAsync(r.key);
+            }
+            std::this_thread::sleep_for(r.interval);
+        }
+    }
+}
+
+// Run one pass of the stream over [skip, skip + limit) with num_threads consumers.
+size_t _stream_pass(Client &client, TraceWorkload *workload, int num_threads, size_t skip, long limit, int ttl, float ew, bool warm)
+{
+    RequestStream stream(workload, num_threads);
+    stream.start(skip, limit);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t)
+    {
+        threads.emplace_back(_stream_thread, std::ref(client), std::ref(stream), t, ttl, ew, warm);
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    stream.finish();
+    return stream.num_dispatched();
+}
+
+/*
+ * Same experiment as benchmark(), but the trace is parsed in parallel and
+ * streamed to the client threads instead of being loaded up front, so the
+ * replay is bounded by the trace length on disk rather than by memory.
+ */
+BenchmarkResult benchmark_streaming(Client &client, int ttl, float ew, Parser &parser, TraceWorkload *workload, int num_threads = 1)
+{
+    workload->set_scale_factor(parser.scale_factor);
+
+    // The DB warm-up needs the last value size of every key, which the
+    // streaming pass collects without keeping the requests. The same map
+    // gives the distinct key count for the results.
+    size_t total_operations = 0;
+    {
+        RequestStream stream(workload, 1);
+        stream.start();
+        std::unique_ptr<RequestChunk> chunk;
+        while (stream.next(0, chunk))
+        {
+            for (const auto &r : chunk->requests)
+                workload->keys_to_val_size[r.key] = r.value_size;
+        }
+        stream.finish();
+        total_operations = stream.num_dispatched();
+    }
+
+    client.SetTTL(ttl, parser.adaptive_ttl);
+    std::cout << "Begin Warming: " << std::endl;
+    int num_warm_threads = NUM_CPUS;
+    int keys_per_thread = workload->keys_to_val_size.size() / num_warm_threads;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_warm_threads; ++t)
+    {
+        int start = t * keys_per_thread;
+        int end = (t == num_warm_threads - 1) ? workload->keys_to_val_size.size() : (t + 1) * keys_per_thread;
+        threads.emplace_back(_warm_thread_db, std::ref(client), start, end, ttl, ew, workload);
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    threads.clear();
+
+    size_t num_warmup_operations = total_operations / warmup_factor;
+    _stream_pass(client, workload, NUM_CPUS, 0, num_warmup_operations, ttl, ew, true);
+    std::cout << "Warming done." << std::endl;
+
+    client.StartRecord();
+    if (parser.stale_check)
+        client.EnableStaleCheck();
+    std::cout << "\nBegin Benchmarking: " << std::endl;
+    auto start_time = std::chrono::high_resolution_clock::now();
+
+    START_COLLECTION(std::string(parser.log_path), client.get_db_client(), client.get_cache_client(), parser.telemetry);
+
+    size_t num_operations = _stream_pass(client, workload, num_threads, num_warmup_operations,
+                                         total_operations - num_warmup_operations, ttl, ew, false);
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
+
+    return report_results(client, parser, duration, num_operations, ttl, ew, num_threads);
+}
+
+BenchmarkResult benchmark(Client &client, int ttl, float ew, Parser &parser, int num_threads = 1, bool skip_exp = false)
 {
     Workload *workload = parser.workload;
 
     if (skip_exp && client.get_tracker())
     {
         benchmark_ew_tracker(client.get_tracker(), workload);
+        benchmark_tracker_throughput(parser.tracker_name, workload);
     }
 
     if (skip_exp)
-        return;
+        return BenchmarkResult();
+
+    TraceWorkload *trace_workload = dynamic_cast<TraceWorkload *>(workload);
+    if (parser.stream && trace_workload != nullptr)
+    {
+        return benchmark_streaming(client, ttl, ew, parser, trace_workload, num_threads);
+    }
+    if (parser.stream)
+        std::cerr << "Streaming needs a trace workload; loading it in memory instead" << std::endl;
 
     workload->init(parser.scale_factor);
 
-    client.SetTTL(ttl);
+    client.SetTTL(ttl, parser.adaptive_ttl);
     std::cout << "Begin Warming: " << std::endl;
     _warm(client, ttl, ew, workload);
 
@@ -193,6 +484,8 @@ void benchmark(Client &client, int ttl, float ew, Parser &parser, int num_thread
     // std::this_thread::sleep_for(std::chrono::seconds(10)); // Sleep for 10 seconds
 
     client.StartRecord();
+    if (parser.stale_check)
+        client.EnableStaleCheck();
     std::cout << "\nBegin Benchmarking: " << std::endl;
     std::vector<std::thread> threads;
     int num_warmup_operations = workload->num_operations() / warmup_factor;
@@ -202,7 +495,7 @@ void benchmark(Client &client, int ttl, float ew, Parser &parser, int num_thread
 
     auto start_time = std::chrono::high_resolution_clock::now();
 
-    START_COLLECTION(std::string(parser.log_path), client.get_db_client(), client.get_cache_client());
+    START_COLLECTION(std::string(parser.log_path), client.get_db_client(), client.get_cache_client(), parser.telemetry);
 
     for (int t = 0; t < num_threads; ++t)
     {
@@ -223,35 +516,5 @@ void benchmark(Client &client, int ttl, float ew, Parser &parser, int num_thread
     // Calculate the e2e latency
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
 
-    float mr = client.GetMR();
-    std::tuple<int, int> stats = client.GetFreshnessStats();
-    int invalidates = std::get<0>(stats);
-    int updates = std::get<1>(stats);
-    int load = client.GetLoad();
-
-    std::cout << "\nResults: " << std::endl;
-    std::cout << "Miss Ratio (MR): " << mr << std::endl;
-
-    std::cout << "Invalidates: " << invalidates << std::endl;
-    std::cout << "Updates: " << updates << std::endl;
-
-    std::cout << "Load: " << load << std::endl;
-    std::cout << "End-to-End Latency: " << duration << " ms" << std::endl;
-
-    std::cout << "Average cache latency: " << client.GetCacheAverageLatency() / 1000 << " ms" << std::endl;
-    std::cout << "Average DB latency: " << client.GetDBAverageLatency() / 1000 << " ms" << std::endl;
-
-    std::string latency_message = "Average cache latency: " + std::to_string(client.GetCacheAverageLatency() / 1000.0) + " ms";
-    WRITE_TO_LOG(std::string(parser.log_path), "stats", latency_message);
-
-    latency_message = "Average DB latency: " + std::to_string(client.GetDBAverageLatency() / 1000.0) + " ms";
-    WRITE_TO_LOG(std::string(parser.log_path), "stats", latency_message);
-
-    latency_message = "End-to-End Latency: " + std::to_string(duration) + " ms";
-    WRITE_TO_LOG(std::string(parser.log_path), "stats", latency_message);
-
-    latency_message = "Num operations: " + std::to_string(num_operations);
-    WRITE_TO_LOG(std::string(parser.log_path), "stats", latency_message);
-
-    END_COLLECTION();
+    return report_results(client, parser, duration, num_operations, ttl, ew, num_threads);
 }
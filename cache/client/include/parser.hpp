@@ -14,6 +14,7 @@
 #include "zipf.hpp"
 #include "tqdm.hpp"
 #include "workload.hpp"
+#include "telemetry.hpp"
 
 class Parser
 {
@@ -23,13 +24,23 @@ public:
     Workload *workload;
     int scale_factor;
     std::string log_path;
+    std::string workload_name;
+    std::string tracker_name;
+    // Structured results of benchmark(); empty to skip. Defaults to <log_path>.json.
+    std::string result_path;
+    bool stream = false;
+    TelemetryConfig telemetry;
+    // Count stale cache reads during the run; set by the bench, not from argv.
+    bool stale_check = false;
+    // Per-key TTLs in TTL_EW mode; set by the bench, not from argv.
+    AdaptiveTTLConfig adaptive_ttl;
 
     // Constructor that takes argc and argv
     Parser(int argc, char *argv[])
     {
         if (argc < 2)
         {
-            std::cerr << "Usage: " << argv[0] << " <workload> [<scale_factor>] [<tracker>] [<log_papth>]" << std::endl;
+            std::cerr << "Usage: " << argv[0] << " <workload> [<scale_factor>] [<tracker>] [<log_papth>] [<trace_file>] [stream|load] [<telemetry_spec>]" << std::endl;
             return;
         }
 
@@ -38,78 +49,98 @@ public:
         std::string tracker_str = (argc >= 4) ? argv[3] : "TopKSketchTracker"; // Default tracker
 
         log_path = (argc >= 5) ? argv[4] : "test.log";
+        result_path = log_path + ".json";
+        workload_name = workload_str;
+        tracker_name = tracker_str;
 
         // Initialize tracker based on input
+        tracker = make_tracker(tracker_str);
+        if (tracker == nullptr)
+            std::cerr << "Tracker unrecognized: " << tracker_str << std::endl;
+
+        // Initialize workload based on input
+        workload = make_workload(workload_str);
+        if (workload != nullptr && argc >= 6)
+            workload->set_trace_path(argv[5]);
+        // Parse trace workloads on the fly instead of loading them up front.
+        stream = (argc >= 7) && std::string(argv[6]) == "stream";
+        // e.g. "interval=100ms,format=csv,net=lo,disk=nvme0n1,perf"
+        TelemetryConfig telemetry_config;
+        if (argc >= 8 && TelemetryConfig::Parse(argv[7], telemetry_config))
+            telemetry = telemetry_config;
+        else if (argc >= 8)
+            std::cerr << "Bad telemetry spec, using defaults: " << argv[7] << std::endl;
+    }
+
+    static Tracker *make_tracker(const std::string &tracker_str)
+    {
         if (tracker_str == "EveryKeyTracker")
         {
-            tracker = new EveryKeyTracker();
+            return new EveryKeyTracker();
         }
         else if (tracker_str == "TopKSketchTracker")
         {
-            tracker = new TopKSketchTracker();
+            return new TopKSketchTracker();
         }
         else if (tracker_str == "MinSketchTracker")
         {
-            tracker = new MinSketchTracker();
+            return new MinSketchTracker();
         }
         else if (tracker_str == "ExactRWTracker")
         {
-            tracker = new ExactRWTracker();
+            return new ExactRWTracker();
         }
         else if (tracker_str == "MinSketchConsTracker")
         {
-            tracker = new MinSketchConsTracker();
+            return new MinSketchConsTracker();
         }
         else if (tracker_str == "TopKSketchSampleTracker")
         {
-            tracker = new TopKSketchSampleTracker();
-        }
-        else
-        {
-            std::cerr << "Tracker unrecognized: " << tracker_str << std::endl;
+            return new TopKSketchSampleTracker();
         }
+        return nullptr;
+    }
 
-        // Initialize workload based on input
+    static Workload *make_workload(const std::string &workload_str)
+    {
         if (workload_str == "Poisson")
         {
-            workload = new PoissonWorkload();
+            return new PoissonWorkload();
         }
         else if (workload_str == "Meta")
         {
-            workload = new MetaWorkload();
+            return new MetaWorkload();
         }
         else if (workload_str == "PoissonMix")
         {
-            workload = new PoissonMixWorkload();
+            return new PoissonMixWorkload();
         }
         else if (workload_str == "PoissonWrite")
         {
-            workload = new PoissonWriteWorkload();
+            return new PoissonWriteWorkload();
         }
         else if (workload_str == "Twitter")
         {
-            workload = new TwitterWorkload();
+            return new TwitterWorkload();
         }
         else if (workload_str == "Tencent")
         {
-            workload = new TencentWorkload();
+            return new TencentWorkload();
         }
         else if (workload_str == "IBM")
         {
-            workload = new IBMWorkload();
+            return new IBMWorkload();
         }
         else if (workload_str == "Alibaba")
         {
-            workload = new AlibabaWorkload();
+            return new AlibabaWorkload();
         }
         else if (workload_str == "WikiCDN")
         {
             std::cerr << "WikiCDN trace has No write" << std::endl;
-            workload = new WikiCDNWorkload();
-        }
-        else
-        {
-            std::cerr << "Unrecognized workload: " << workload_str << std::endl;
+            return new WikiCDNWorkload();
         }
+        std::cerr << "Unrecognized workload: " << workload_str << std::endl;
+        return nullptr;
     }
 };
\ No newline at end of file
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "histogram.hpp"
+#include "telemetry.hpp"
+#include "workload.hpp"
+
+/*
+ * Structured benchmark results. Every run writes one JSON document:
+ *
+ *   config     how the run was set up, as strings, plus ew and cache_ttl
+ *   workload   what Workload::report_stats prints
+ *   results    counters and averages, one number each
+ *   latency    histograms of client-observed cache Get and DB Put latency
+ *   telemetry  aggregate of the load sampler over the measured phase
+ *
+ * bench/compare_results.py compares sets of these files across trials.
+ */
+struct BenchmarkResult
+{
+    long num_operations = 0;
+    long duration_ms = 0;
+    float miss_ratio = 0;
+    int invalidates = 0;
+    int updates = 0;
+    int load = 0;
+    long db_reads = 0;
+    long db_writes = 0;
+    double avg_cache_latency_ms = 0;
+    double avg_db_latency_ms = 0;
+    long stale_reads = 0;   // Only with parser.stale_check.
+    long checked_reads = 0;
+    int adaptive_fills = 0; // Only with parser.adaptive_ttl.
+    int adaptive_bypassed = 0;
+    float mean_ttl = 0;
+    float estimated_stale_ratio = 0;
+
+    float ew = 0;
+    int ttl = 0;
+    WorkloadStats workload;
+    LatencyHistogram cache_latency; // Microseconds.
+    LatencyHistogram db_latency;
+    TelemetrySummary telemetry;
+
+    double throughput() const { return duration_ms > 0 ? num_operations * 1000.0 / duration_ms : 0; }
+};
+
+// Run configuration as (name, value) pairs.
+typedef std::vector<std::pair<std::string, std::string>> ResultConfig;
+
+inline std::string json_string(const std::string &s)
+{
+    std::string out = "\"";
+    for (char c : s)
+    {
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        default:
+            if ((unsigned char)c < 0x20)
+            {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            }
+            else
+            {
+                out += c;
+            }
+        }
+    }
+    return out + "\"";
+}
+
+inline void write_histogram_json(std::ostream &out, const LatencyHistogram &histogram, const std::string &indent)
+{
+    out << "{\n";
+    out << indent << "  \"count\": " << histogram.count() << ",\n";
+    out << indent << "  \"mean\": " << histogram.mean() << ",\n";
+    out << indent << "  \"min\": " << histogram.min() << ",\n";
+    out << indent << "  \"p50\": " << histogram.Percentile(0.5) << ",\n";
+    out << indent << "  \"p90\": " << histogram.Percentile(0.9) << ",\n";
+    out << indent << "  \"p99\": " << histogram.Percentile(0.99) << ",\n";
+    out << indent << "  \"p999\": " << histogram.Percentile(0.999) << ",\n";
+    out << indent << "  \"max\": " << histogram.max() << ",\n";
+    // [lower bound, count] of the non-empty buckets.
+    out << indent << "  \"buckets\": [";
+    bool first = true;
+    for (const auto &[lower, count] : histogram.Buckets())
+    {
+        out << (first ? "" : ", ") << "[" << lower << ", " << count << "]";
+        first = false;
+    }
+    out << "]\n";
+    out << indent << "}";
+}
+
+inline void write_result_json(std::ostream &out, const ResultConfig &config, const BenchmarkResult &result)
+{
+    out << "{\n";
+    out << "  \"config\": {\n";
+    for (const auto &[key, value] : config)
+        out << "    " << json_string(key) << ": " << json_string(value) << ",\n";
+    out << "    \"ew\": " << result.ew << ",\n";
+    out << "    \"cache_ttl\": " << result.ttl << "\n";
+    out << "  },\n";
+
+    const WorkloadStats &w = result.workload;
+    out << "  \"workload\": {\n";
+    out << "    \"num_operations\": " << w.num_operations << ",\n";
+    out << "    \"num_keys\": " << w.num_keys << ",\n";
+    out << "    \"read_ratio\": " << w.read_ratio << ",\n";
+    out << "    \"average_value_size\": " << w.average_value_size << ",\n";
+    out << "    \"min_value_size\": " << w.min_value_size << ",\n";
+    out << "    \"max_value_size\": " << w.max_value_size << ",\n";
+    out << "    \"average_interval_ms\": " << w.average_interval_ms << ",\n";
+    out << "    \"min_interval_ms\": " << w.min_interval_ms << ",\n";
+    out << "    \"max_interval_ms\": " << w.max_interval_ms << ",\n";
+    out << "    \"scale_factor\": " << w.scale_factor << "\n";
+    out << "  },\n";
+
+    out << "  \"results\": {\n";
+    out << "    \"num_operations\": " << result.num_operations << ",\n";
+    out << "    \"duration_ms\": " << result.duration_ms << ",\n";
+    out << "    \"throughput_ops\": " << result.throughput() << ",\n";
+    out << "    \"miss_ratio\": " << result.miss_ratio << ",\n";
+    out << "    \"invalidates\": " << result.invalidates << ",\n";
+    out << "    \"updates\": " << result.updates << ",\n";
+    out << "    \"load\": " << result.load << ",\n";
+    out << "    \"db_reads\": " << result.db_reads << ",\n";
+    out << "    \"db_writes\": " << result.db_writes << ",\n";
+    out << "    \"avg_cache_latency_ms\": " << result.avg_cache_latency_ms << ",\n";
+    out << "    \"avg_db_latency_ms\": " << result.avg_db_latency_ms << ",\n";
+    out << "    \"stale_reads\": " << result.stale_reads << ",\n";
+    out << "    \"checked_reads\": " << result.checked_reads << ",\n";
+    out << "    \"adaptive_fills\": " << result.adaptive_fills << ",\n";
+    out << "    \"adaptive_bypassed\": " << result.adaptive_bypassed << ",\n";
+    out << "    \"mean_ttl\": " << result.mean_ttl << ",\n";
+    out << "    \"estimated_stale_ratio\": " << result.estimated_stale_ratio << "\n";
+    out << "  },\n";
+
+    out << "  \"latency\": {\n";
+    out << "    \"cache_get_us\": ";
+    write_histogram_json(out, result.cache_latency, "    ");
+    out << ",\n";
+    out << "    \"db_put_us\": ";
+    write_histogram_json(out, result.db_latency, "    ");
+    out << "\n";
+    out << "  },\n";
+
+    const TelemetrySummary &t = result.telemetry;
+    out << "  \"telemetry\": {\n";
+    out << "    \"samples\": " << t.samples << ",\n";
+    out << "    \"seconds\": " << t.seconds << ",\n";
+    out << "    \"mean_cpu_util\": " << t.mean_cpu_util << ",\n";
+    out << "    \"max_cpu_util\": " << t.max_cpu_util << ",\n";
+    out << "    \"mean_process_cpu\": " << t.mean_process_cpu << ",\n";
+    out << "    \"net_recv_bytes\": " << t.net_recv_bytes << ",\n";
+    out << "    \"net_send_bytes\": " << t.net_send_bytes << ",\n";
+    out << "    \"disk_read_bytes\": " << t.disk_read_bytes << ",\n";
+    out << "    \"disk_write_bytes\": " << t.disk_write_bytes << ",\n";
+    out << "    \"cycles\": " << t.cycles << ",\n";
+    out << "    \"llc_misses\": " << t.llc_misses << "\n";
+    out << "  }\n";
+    out << "}\n";
+}
@@ -0,0 +1,565 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "policy.hpp"
+#include "client.hpp"
+#include "thread_pool.hpp"
+#include "workload.hpp"
+
+/*
+ * Offline, trace-driven model of the cache and its freshness policies.
+ *
+ * Replays a Workload against a byte-bounded LRU, segmented LRU or S3-FIFO
+ * standing in for memcached and applies the same per-write policy the DB fans out
+ * (invalidate, update, adaptive via a Tracker, or TTL). The result is the
+ * miss ratio, the fraction of stale reads and the C_I/C_U/C_M cost, with
+ * no servers involved. The model is idealized. Invalidates and updates land
+ * before the next request, so only the TTL policy serves stale data. Races
+ * between fills and writes, which the real setup versions away, are not
+ * modeled.
+ *
+ * The requests are read in place (a mapped trace is not copied). Cache
+ * state is per configuration, so Sweep() runs configurations on separate
+ * threads. An adaptive write's decision depends only on the request
+ * stream, so the Tracker pass runs once (AdaptiveDecisions) and every
+ * cache size reuses it.
+ */
+
+// Bytes charged per cached item on top of key and value, about a memcached
+// item header.
+const uint32_t SIM_ITEM_OVERHEAD = 48;
+
+enum class SimPolicy
+{
+    INVALIDATE,
+    UPDATE,
+    ADAPTIVE,
+    TTL,
+};
+
+enum class SimEviction
+{
+    LRU,
+    SLRU,
+    S3FIFO,
+};
+
+struct SimConfig
+{
+    SimPolicy policy = SimPolicy::ADAPTIVE;
+    int ttl = LONG_TTL; // Seconds, TTL policy only.
+    SimEviction eviction = SimEviction::LRU;
+    uint64_t cache_bytes = 0;
+
+    std::string eviction_name() const
+    {
+        switch (eviction)
+        {
+        case SimEviction::LRU:
+            return "lru";
+        case SimEviction::SLRU:
+            return "slru";
+        case SimEviction::S3FIFO:
+            return "s3fifo";
+        }
+        return "";
+    }
+
+    // "lru", "slru" or "s3fifo".
+    bool ParseEviction(const std::string &spec)
+    {
+        if (spec == "lru")
+            eviction = SimEviction::LRU;
+        else if (spec == "slru")
+            eviction = SimEviction::SLRU;
+        else if (spec == "s3fifo")
+            eviction = SimEviction::S3FIFO;
+        else
+            return false;
+        return true;
+    }
+
+    std::string policy_name() const
+    {
+        switch (policy)
+        {
+        case SimPolicy::INVALIDATE:
+            return "invalidate";
+        case SimPolicy::UPDATE:
+            return "update";
+        case SimPolicy::ADAPTIVE:
+            return "adaptive";
+        case SimPolicy::TTL:
+            return "ttl:" + std::to_string(ttl);
+        }
+        return "";
+    }
+
+    // e.g. "invalidate", "adaptive", "ttl:5". Sets policy and ttl.
+    bool ParsePolicy(const std::string &spec)
+    {
+        if (spec == "invalidate")
+            policy = SimPolicy::INVALIDATE;
+        else if (spec == "update")
+            policy = SimPolicy::UPDATE;
+        else if (spec == "adaptive")
+            policy = SimPolicy::ADAPTIVE;
+        else if (spec == "ttl" || spec.rfind("ttl:", 0) == 0)
+        {
+            policy = SimPolicy::TTL;
+            try
+            {
+                ttl = spec.size() > 4 ? std::stoi(spec.substr(4)) : 1;
+            }
+            catch (const std::exception &e)
+            {
+                return false;
+            }
+        }
+        else
+            return false;
+        return true;
+    }
+};
+
+struct SimResult
+{
+    SimConfig config;
+    long reads = 0;
+    long writes = 0;
+    long hits = 0;
+    long misses = 0;
+    long stale_reads = 0;
+    long invalidates = 0;
+    long updates = 0;
+    long evictions = 0;
+    long ghost_hits = 0; // S3-FIFO only.
+    long expirations = 0;
+    double seconds = 0;
+
+    double miss_ratio() const { return reads > 0 ? (double)misses / reads : 0; }
+    double stale_ratio() const { return reads > 0 ? (double)stale_reads / reads : 0; }
+    long cost() const { return C_I * invalidates + C_U * updates + C_M * misses; }
+};
+
+// Interned view of a workload's requests. The workload must outlive it and
+// already be init()'ed.
+class SimTrace
+{
+public:
+    explicit SimTrace(const Workload &workload)
+        : workload_(workload), mapped_(workload.get_trace())
+    {
+        size_t n = workload.num_operations();
+        if (mapped_ != nullptr)
+        {
+            keys_.reserve(mapped_->num_keys());
+            for (size_t id = 0; id < mapped_->num_keys(); id++)
+                keys_.emplace_back(mapped_->key_by_id(id));
+        }
+        else
+        {
+            std::unordered_map<std::string_view, uint32_t> ids;
+            key_ids_.resize(n);
+            for (size_t i = 0; i < n; i++)
+            {
+                auto [it, inserted] = ids.emplace(workload.get_key_view(i), keys_.size());
+                if (inserted)
+                    keys_.emplace_back(it->first);
+                key_ids_[i] = it->second;
+            }
+        }
+
+        // The footprint counts every key once, at its largest value.
+        std::vector<uint32_t> max_size(keys_.size(), 0);
+        for (size_t i = 0; i < n; i++)
+            max_size[key_id(i)] = std::max<uint32_t>(max_size[key_id(i)], value_size(i));
+        for (size_t id = 0; id < keys_.size(); id++)
+            footprint_ += item_bytes(id, max_size[id]);
+    }
+
+    size_t size() const { return workload_.num_operations(); }
+    size_t num_keys() const { return keys_.size(); }
+    const std::string &key(uint32_t id) const { return keys_[id]; }
+
+    uint32_t key_id(size_t i) const { return mapped_ ? mapped_->key_id(i) : key_ids_[i]; }
+    bool is_write(size_t i) const { return workload_.get_is_write(i); }
+    uint32_t value_size(size_t i) const { return workload_.get_value_size_of(i); }
+    // Scaled and capped, as the benchmark sleeps between requests.
+    int64_t interval_ms(size_t i) const { return workload_.get_interval(i).count(); }
+
+    // Bytes a cached item of this key takes.
+    uint64_t item_bytes(uint32_t id, uint32_t value_size) const
+    {
+        return value_size + keys_[id].size() + SIM_ITEM_OVERHEAD;
+    }
+
+    // Bytes to cache every key.
+    uint64_t footprint() const { return footprint_; }
+
+private:
+    const Workload &workload_;
+    const MappedTrace *mapped_;
+    std::vector<uint32_t> key_ids_; // Generated workloads only.
+    std::vector<std::string> keys_;
+    uint64_t footprint_ = 0;
+};
+
+// Bit i is set when the adaptive policy invalidates (rather than updates)
+// on write i. Feeds the tracker, sized to the workload as the tracker
+// benchmarks do, the measured requests in order with the same calls
+// Client::GetAsync and Client::SetAsync make.
+inline std::vector<uint64_t> AdaptiveDecisions(const SimTrace &trace, Tracker *tracker, size_t start)
+{
+    std::vector<uint64_t> invalidate((trace.size() + 63) / 64, 0);
+    tracker->update(trace.num_keys());
+    for (size_t i = start; i < trace.size(); i++)
+    {
+        const std::string &key = trace.key(trace.key_id(i));
+        if (!trace.is_write(i))
+        {
+            tracker->read(key);
+            continue;
+        }
+        tracker->write(key);
+        if (prefer_invalidate(tracker->get_ew(key)))
+            invalidate[i / 64] |= (uint64_t)1 << (i % 64);
+    }
+    return invalidate;
+}
+
+/*
+ * Byte-bounded LRU over dense key ids. Each key is a node in an intrusive
+ * list kept in one flat array, so a request touches one cache line for the
+ * key plus its list neighbours. Nodes also hold the key's DB version.
+ * Segmented mode splits the capacity into probation and protected lists
+ * (SLRU): new items enter probation, a hit there promotes to protected, and
+ * protected overflow is demoted back to probation. Victims come from the
+ * tail of probation first.
+ *
+ * S3-FIFO mode follows memcached's -o eviction_policy=s3fifo: probation is
+ * the small FIFO and protected the main FIFO, and hits only count up to 2
+ * (memcached's FETCHED and ACTIVE flags). On eviction the small queue's
+ * tail moves to main if hit twice, else leaves a ghost entry; main's tail
+ * gets another round if hit twice, dropping back to one hit. A key with a
+ * ghost entry younger than the number of cached items is inserted into
+ * main.
+ */
+class SimCache
+{
+public:
+    // Share of the capacity the protected segment may hold.
+    static constexpr double PROTECTED_SHARE = 0.8;
+    // Share of the capacity for S3-FIFO's small queue, memcached's default
+    // hot_lru_pct.
+    static constexpr double SMALL_SHARE = 0.2;
+
+    SimCache(size_t num_keys, uint64_t capacity, SimEviction eviction)
+        : capacity_(capacity), protected_capacity_(eviction == SimEviction::SLRU ? capacity * PROTECTED_SHARE : 0),
+          small_capacity_(capacity * SMALL_SHARE), eviction_(eviction), nodes_(num_keys + NUM_SEGMENTS),
+          num_keys_(num_keys)
+    {
+        for (int s = 0; s < NUM_SEGMENTS; s++)
+        {
+            uint32_t head = num_keys + s;
+            nodes_[head].prev = nodes_[head].next = head;
+        }
+    }
+
+    bool contains(uint32_t id) const { return nodes_[id].segment != ABSENT; }
+    uint32_t version(uint32_t id) const { return nodes_[id].version; }
+    int64_t expires(uint32_t id) const { return nodes_[id].expires; }
+    long evictions() const { return evictions_; }
+    long ghost_hits() const { return ghost_hits_; }
+
+    // Writes land in the DB whether or not the key is cached.
+    uint32_t db_version(uint32_t id) const { return nodes_[id].db_version; }
+    uint32_t write(uint32_t id) { return ++nodes_[id].db_version; }
+
+    // Pull a key's node into cache ahead of its request.
+    void prefetch(uint32_t id) const { __builtin_prefetch(&nodes_[id]); }
+
+    // A hit: move to the front, promoting out of probation when segmented.
+    // S3-FIFO only counts it.
+    void touch(uint32_t id)
+    {
+        if (eviction_ == SimEviction::S3FIFO)
+        {
+            nodes_[id].hits = std::min(nodes_[id].hits + 1, 2);
+            return;
+        }
+        unlink(id);
+        if (eviction_ == SimEviction::SLRU && nodes_[id].segment == PROBATION)
+        {
+            segment_bytes_[PROBATION] -= nodes_[id].bytes;
+            push_front(id, PROTECTED);
+            while (segment_bytes_[PROTECTED] > protected_capacity_)
+            {
+                uint32_t demoted = nodes_[head(PROTECTED)].prev;
+                unlink(demoted);
+                segment_bytes_[PROTECTED] -= nodes_[demoted].bytes;
+                push_front(demoted, PROBATION);
+            }
+        }
+        else
+        {
+            push_front(id, nodes_[id].segment);
+        }
+    }
+
+    // Items larger than the whole cache are not stored.
+    void insert(uint32_t id, uint64_t bytes, uint32_t version, int64_t expires)
+    {
+        if (contains(id))
+            erase(id);
+        if (bytes > capacity_)
+            return;
+        Node &node = nodes_[id];
+        node.bytes = bytes;
+        node.version = version;
+        node.expires = expires;
+        node.hits = 0;
+        Segment segment = PROBATION;
+        if (eviction_ == SimEviction::S3FIFO && node.ghost != 0 && ghost_clock_ - node.ghost <= cached_items_)
+        {
+            segment = PROTECTED;
+            ghost_hits_++;
+        }
+        node.ghost = 0;
+        push_front(id, segment);
+        evict();
+    }
+
+    // An update in place; the item moves to the front like a memcached replace.
+    void replace(uint32_t id, uint64_t bytes, uint32_t version)
+    {
+        Node &node = nodes_[id];
+        Segment segment = node.segment;
+        segment_bytes_[segment] += bytes - node.bytes;
+        node.bytes = bytes;
+        node.version = version;
+        unlink(id);
+        push_front(id, segment);
+        if (bytes > capacity_)
+            erase(id);
+        evict();
+    }
+
+    void erase(uint32_t id)
+    {
+        unlink(id);
+        segment_bytes_[nodes_[id].segment] -= nodes_[id].bytes;
+        nodes_[id].segment = ABSENT;
+        cached_items_--;
+    }
+
+private:
+    enum Segment : uint8_t
+    {
+        PROBATION = 0,
+        PROTECTED = 1,
+        ABSENT = 2,
+    };
+    static const int NUM_SEGMENTS = 2;
+
+    struct Node
+    {
+        uint32_t prev = 0;
+        uint32_t next = 0;
+        uint32_t bytes = 0;
+        uint32_t version = 0;
+        uint32_t db_version = 0;
+        Segment segment = ABSENT;
+        uint8_t hits = 0;   // S3-FIFO only, up to 2.
+        uint64_t ghost = 0; // S3-FIFO: ghost_clock_ when evicted from small, 0 none.
+        int64_t expires = 0; // ms, 0 never.
+    };
+
+    uint32_t head(Segment segment) const { return num_keys_ + segment; }
+
+    void unlink(uint32_t id)
+    {
+        Node &node = nodes_[id];
+        nodes_[node.prev].next = node.next;
+        nodes_[node.next].prev = node.prev;
+    }
+
+    void push_front(uint32_t id, Segment segment)
+    {
+        uint32_t h = head(segment);
+        Node &node = nodes_[id];
+        node.prev = h;
+        node.next = nodes_[h].next;
+        nodes_[nodes_[h].next].prev = id;
+        nodes_[h].next = id;
+        if (node.segment == ABSENT)
+            cached_items_++;
+        if (node.segment != segment)
+            segment_bytes_[segment] += node.bytes;
+        node.segment = segment;
+    }
+
+    bool empty(Segment segment) const { return nodes_[head(segment)].prev == head(segment); }
+
+    void evict()
+    {
+        if (eviction_ == SimEviction::S3FIFO)
+        {
+            evict_s3fifo();
+            return;
+        }
+        while (segment_bytes_[PROBATION] + segment_bytes_[PROTECTED] > capacity_)
+        {
+            Segment from = nodes_[head(PROBATION)].prev != head(PROBATION) ? PROBATION : PROTECTED;
+            erase(nodes_[head(from)].prev);
+            evictions_++;
+        }
+    }
+
+    // Every step either evicts or takes a hit off an item, so this ends.
+    void evict_s3fifo()
+    {
+        while (segment_bytes_[PROBATION] + segment_bytes_[PROTECTED] > capacity_)
+        {
+            Segment from = segment_bytes_[PROBATION] > small_capacity_ || empty(PROTECTED) ? PROBATION : PROTECTED;
+            uint32_t victim = nodes_[head(from)].prev;
+            Node &node = nodes_[victim];
+            if (node.hits >= 2)
+            {
+                node.hits = 1;
+                unlink(victim);
+                if (from == PROBATION)
+                    segment_bytes_[PROBATION] -= node.bytes;
+                push_front(victim, PROTECTED);
+                continue;
+            }
+            erase(victim);
+            evictions_++;
+            if (from == PROBATION)
+                node.ghost = ++ghost_clock_;
+        }
+    }
+
+    uint64_t capacity_;
+    uint64_t protected_capacity_;
+    uint64_t small_capacity_;
+    SimEviction eviction_;
+    std::vector<Node> nodes_;
+    uint64_t segment_bytes_[NUM_SEGMENTS + 1] = {0, 0, 0};
+    size_t num_keys_;
+    uint64_t cached_items_ = 0;
+    uint64_t ghost_clock_ = 0;
+    long evictions_ = 0;
+    long ghost_hits_ = 0;
+};
+
+/*
+ * Replay one configuration. Requests before start only fill the cache, as
+ * the benchmark's warm phase does. adaptive is AdaptiveDecisions() and is
+ * only read by the adaptive policy.
+ */
+const size_t PREFETCH_DISTANCE = 8;
+
+inline SimResult Simulate(const SimTrace &trace, const SimConfig &config, size_t start,
+                          const std::vector<uint64_t> *adaptive)
+{
+    auto begin = std::chrono::steady_clock::now();
+    SimResult result;
+    result.config = config;
+    SimCache cache(trace.num_keys(), config.cache_bytes, config.eviction);
+    int64_t ttl_ms = config.policy == SimPolicy::TTL ? config.ttl * 1000LL : 0;
+    int64_t now = 0;
+
+    for (size_t i = 0; i < trace.size(); i++)
+    {
+        if (i + PREFETCH_DISTANCE < trace.size())
+            cache.prefetch(trace.key_id(i + PREFETCH_DISTANCE));
+        now += trace.interval_ms(i);
+        uint32_t id = trace.key_id(i);
+        uint64_t bytes = trace.item_bytes(id, trace.value_size(i));
+        int64_t expires = ttl_ms > 0 ? now + ttl_ms : 0;
+
+        if (i < start)
+        {
+            cache.insert(id, bytes, cache.db_version(id), expires);
+            continue;
+        }
+
+        if (trace.is_write(i))
+        {
+            result.writes++;
+            uint32_t version = cache.write(id);
+            bool invalidate;
+            switch (config.policy)
+            {
+            case SimPolicy::TTL:
+                continue;
+            case SimPolicy::ADAPTIVE:
+                invalidate = ((*adaptive)[i / 64] >> (i % 64)) & 1;
+                break;
+            default:
+                invalidate = config.policy == SimPolicy::INVALIDATE;
+            }
+            if (invalidate)
+            {
+                result.invalidates++;
+                if (cache.contains(id))
+                    cache.erase(id);
+            }
+            else
+            {
+                result.updates++;
+                if (cache.contains(id))
+                    cache.replace(id, bytes, version);
+            }
+            continue;
+        }
+
+        result.reads++;
+        if (cache.contains(id) && cache.expires(id) != 0 && now >= cache.expires(id))
+        {
+            result.expirations++;
+            cache.erase(id);
+        }
+        if (cache.contains(id))
+        {
+            result.hits++;
+            if (cache.version(id) != cache.db_version(id))
+                result.stale_reads++;
+            cache.touch(id);
+        }
+        else
+        {
+            result.misses++;
+            cache.insert(id, bytes, cache.db_version(id), expires);
+        }
+    }
+
+    result.evictions = cache.evictions();
+    result.ghost_hits = cache.ghost_hits();
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return result;
+}
+
+// Run every configuration, num_threads at a time. Results keep the order of configs.
+inline std::vector<SimResult> Sweep(const SimTrace &trace, const std::vector<SimConfig> &configs, size_t start,
+                                    const std::vector<uint64_t> *adaptive, int num_threads)
+{
+    ThreadPool pool(std::max(1, num_threads));
+    std::vector<std::future<SimResult>> futures;
+    for (const SimConfig &config : configs)
+        futures.push_back(pool.enqueue([&trace, config, start, adaptive]()
+                                       { return Simulate(trace, config, start, adaptive); }));
+    std::vector<SimResult> results;
+    for (auto &future : futures)
+        results.push_back(future.get());
+    return results;
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "workload.hpp"
+
+/*
+ * Bounded single-producer/single-consumer ring. Capacity is rounded up to a
+ * power of two; push/pop spin briefly and then sleep while full/empty.
+ */
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(size_t capacity)
+    {
+        size_t cap = 1;
+        while (cap < capacity)
+            cap <<= 1;
+        slots_.resize(cap);
+        mask_ = cap - 1;
+    }
+
+    bool try_push(T &item)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == slots_.size())
+            return false;
+        slots_[tail & mask_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &item)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+            return false;
+        item = std::move(slots_[head & mask_]);
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    void push(T &item)
+    {
+        for (int spins = 0; !try_push(item); spins++)
+            backoff(spins);
+    }
+
+    // Blocks until an item arrives; false once the ring is closed and drained.
+    bool pop(T &item)
+    {
+        for (int spins = 0;; spins++)
+        {
+            if (try_pop(item))
+                return true;
+            if (closed_.load(std::memory_order_acquire))
+                return try_pop(item);
+            backoff(spins);
+        }
+    }
+
+    void close() { closed_.store(true, std::memory_order_release); }
+
+private:
+    static void backoff(int spins)
+    {
+        if (spins < 64)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    std::vector<T> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) std::atomic<bool> closed_{false};
+};
+
+struct stream_request
+{
+    std::chrono::milliseconds interval;
+    bool is_write;
+    std::string key;
+    int value_size;
+};
+
+struct RequestChunk
+{
+    size_t first_op; // Index of the first request in the replayed stream.
+    std::vector<stream_request> requests;
+};
+
+/*
+ * Streams a TraceWorkload without materializing it. Parser threads each
+ * take whole files (in order, round robin) and cut them into chunks on a
+ * per-file ring; a dispatcher drains the file rings in file order, turns
+ * timestamps into scaled intervals, and deals chunks round robin onto one
+ * SPSC ring per consumer. Memory is bounded by the ring sizes, not by the
+ * trace length.
+ *
+ * Usage: start(), then each consumer thread calls next(id, chunk) until it
+ * returns false; finish() joins the pipeline.
+ */
+class RequestStream
+{
+public:
+    RequestStream(TraceWorkload *workload, int num_consumers,
+                  int num_parsers = std::max(1u, std::thread::hardware_concurrency() / 2),
+                  size_t chunk_size = 4096, size_t ring_chunks = 8)
+        : workload_(workload), num_consumers_(num_consumers), num_parsers_(num_parsers),
+          chunk_size_(chunk_size), ring_chunks_(ring_chunks)
+    {
+    }
+
+    // Consumers must have drained their rings (next() returned false).
+    ~RequestStream()
+    {
+        finish();
+    }
+
+    /* Replay requests [skip, skip + limit) of the trace; limit -1 means the workload's own cap. */
+    void start(size_t skip = 0, long limit = -1)
+    {
+        files_ = workload_->trace_files();
+        file_rings_.clear();
+        for (size_t f = 0; f < files_.size(); f++)
+            file_rings_.emplace_back(new SpscRing<std::unique_ptr<RequestChunk>>(ring_chunks_));
+        consumer_rings_.clear();
+        for (int c = 0; c < num_consumers_; c++)
+            consumer_rings_.emplace_back(new SpscRing<std::unique_ptr<RequestChunk>>(ring_chunks_));
+
+        skip_ = skip;
+        limit_ = (limit < 0) ? workload_->max_operations() : limit;
+        next_file_ = 0;
+        stop_ = false;
+
+        for (int p = 0; p < num_parsers_; p++)
+            threads_.emplace_back(&RequestStream::parse_files, this);
+        threads_.emplace_back(&RequestStream::dispatch, this);
+    }
+
+    bool next(int consumer, std::unique_ptr<RequestChunk> &chunk)
+    {
+        return consumer_rings_[consumer]->pop(chunk);
+    }
+
+    void finish()
+    {
+        for (auto &thread : threads_)
+            thread.join();
+        threads_.clear();
+    }
+
+    size_t num_dispatched() const { return dispatched_; }
+
+private:
+    // Parsed requests still carry the raw timestamp in interval; dispatch() converts it.
+    void parse_files()
+    {
+        for (;;)
+        {
+            size_t f = next_file_.fetch_add(1);
+            if (f >= files_.size())
+                return;
+            auto &ring = *file_rings_[f];
+
+            std::ifstream file(files_[f]);
+            if (!file.is_open())
+                std::cerr << "Error: Unable to open file " << files_[f] << std::endl;
+            std::string line;
+            for (int h = 0; h < workload_->header_lines(); h++)
+                std::getline(file, line);
+
+            TraceWorkload::trace_op op;
+            auto chunk = std::make_unique<RequestChunk>();
+            chunk->requests.reserve(chunk_size_);
+            while (!stop_ && std::getline(file, line))
+            {
+                if (!workload_->try_parse_line(line, op))
+                    continue;
+                chunk->requests.push_back({op.op_time, op.is_write, std::move(op.key), op.value_size});
+                if (chunk->requests.size() == chunk_size_)
+                {
+                    ring.push(chunk);
+                    chunk = std::make_unique<RequestChunk>();
+                    chunk->requests.reserve(chunk_size_);
+                }
+            }
+            if (!chunk->requests.empty())
+                ring.push(chunk);
+            ring.close();
+        }
+    }
+
+    void dispatch()
+    {
+        size_t seen = 0;
+        size_t end = skip_ + limit_;
+        int consumer = 0;
+        std::chrono::milliseconds last_op_time{0};
+        std::unique_ptr<RequestChunk> in;
+        auto out = std::make_unique<RequestChunk>();
+        out->first_op = 0;
+
+        for (size_t f = 0; f < files_.size() && seen < end; f++)
+        {
+            while (seen < end && file_rings_[f]->pop(in))
+            {
+                for (auto &r : in->requests)
+                {
+                    std::chrono::milliseconds op_time = r.interval;
+                    r.interval = (last_op_time.count() == 0) ? std::chrono::milliseconds(0)
+                                                             : workload_->scale_interval(op_time - last_op_time);
+                    last_op_time = op_time;
+
+                    if (seen++ < skip_)
+                        continue;
+                    if (out->requests.empty())
+                        out->first_op = seen - 1 - skip_;
+                    out->requests.push_back(std::move(r));
+                    if (out->requests.size() == chunk_size_)
+                    {
+                        consumer_rings_[consumer]->push(out);
+                        consumer = (consumer + 1) % num_consumers_;
+                        out = std::make_unique<RequestChunk>();
+                    }
+                    if (seen >= end)
+                        break;
+                }
+            }
+        }
+        if (!out->requests.empty())
+            consumer_rings_[consumer]->push(out);
+        dispatched_ = (seen > skip_) ? seen - skip_ : 0;
+
+        // Stop the parsers and drain what they still push, so none of them
+        // stays blocked on a full file ring.
+        stop_ = true;
+        for (auto &ring : consumer_rings_)
+            ring->close();
+        size_t started = std::min(next_file_.load(), files_.size());
+        for (size_t f = 0; f < started; f++)
+            while (file_rings_[f]->pop(in))
+                ;
+    }
+
+    TraceWorkload *workload_;
+    int num_consumers_;
+    int num_parsers_;
+    size_t chunk_size_;
+    size_t ring_chunks_;
+
+    std::vector<std::string> files_;
+    std::vector<std::unique_ptr<SpscRing<std::unique_ptr<RequestChunk>>>> file_rings_;
+    std::vector<std::unique_ptr<SpscRing<std::unique_ptr<RequestChunk>>>> consumer_rings_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> next_file_{0};
+    std::atomic<bool> stop_{false};
+    size_t skip_ = 0;
+    size_t limit_ = 0;
+    std::atomic<size_t> dispatched_{0};
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Preprocessed, columnar request trace.
+ *
+ * Layout (all integers little endian, every column 64-byte aligned):
+ *   TraceHeader
+ *   uint32_t key_ids[num_requests]       interned key of each request
+ *   uint32_t deltas[num_requests]        ms since the previous request, unscaled
+ *   uint32_t value_sizes[num_requests]
+ *   uint64_t write_bitmap[(num_requests + 63) / 64]
+ *   uint64_t key_offsets[num_keys + 1]   into key_data
+ *   char     key_data[key_bytes]
+ *
+ * Produced once by TraceWriter (see bench/convert.cpp), then mmap'ed by
+ * MappedTrace so workloads index it in place instead of re-parsing CSVs.
+ */
+
+const char TRACE_MAGIC[8] = {'F', 'C', 'T', 'R', 'A', 'C', 'E', '\0'};
+const uint32_t TRACE_VERSION = 1;
+
+struct TraceHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t num_requests;
+    uint64_t num_keys;
+    uint64_t key_bytes;
+    uint64_t key_ids_off;
+    uint64_t deltas_off;
+    uint64_t value_sizes_off;
+    uint64_t write_bitmap_off;
+    uint64_t key_offsets_off;
+    uint64_t key_data_off;
+    uint64_t file_size;
+};
+
+class TraceWriter
+{
+public:
+    void add(const std::string &key, uint32_t delta_ms, bool is_write, uint32_t value_size)
+    {
+        auto it = key_ids_.find(key);
+        uint32_t id;
+        if (it == key_ids_.end())
+        {
+            id = key_offsets_.size();
+            key_ids_.emplace(key, id);
+            key_offsets_.push_back(key_data_.size());
+            key_data_.append(key);
+        }
+        else
+        {
+            id = it->second;
+        }
+
+        if (requests_ % 64 == 0)
+            write_bitmap_.push_back(0);
+        if (is_write)
+            write_bitmap_.back() |= (uint64_t)1 << (requests_ % 64);
+
+        ids_.push_back(id);
+        deltas_.push_back(delta_ms);
+        value_sizes_.push_back(value_size);
+        requests_++;
+    }
+
+    bool write(const std::string &path)
+    {
+        TraceHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        header.version = TRACE_VERSION;
+        header.num_requests = requests_;
+        header.num_keys = key_offsets_.size();
+        header.key_bytes = key_data_.size();
+
+        std::vector<uint64_t> offsets = key_offsets_;
+        offsets.push_back(key_data_.size());
+
+        uint64_t off = align(sizeof(TraceHeader));
+        header.key_ids_off = off;
+        off = align(off + ids_.size() * sizeof(uint32_t));
+        header.deltas_off = off;
+        off = align(off + deltas_.size() * sizeof(uint32_t));
+        header.value_sizes_off = off;
+        off = align(off + value_sizes_.size() * sizeof(uint32_t));
+        header.write_bitmap_off = off;
+        off = align(off + write_bitmap_.size() * sizeof(uint64_t));
+        header.key_offsets_off = off;
+        off = align(off + offsets.size() * sizeof(uint64_t));
+        header.key_data_off = off;
+        header.file_size = off + key_data_.size();
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+        {
+            std::cerr << "Error: Unable to open trace file " << path << " for writing" << std::endl;
+            return false;
+        }
+        write_at(out, 0, &header, sizeof(header));
+        write_at(out, header.key_ids_off, ids_.data(), ids_.size() * sizeof(uint32_t));
+        write_at(out, header.deltas_off, deltas_.data(), deltas_.size() * sizeof(uint32_t));
+        write_at(out, header.value_sizes_off, value_sizes_.data(), value_sizes_.size() * sizeof(uint32_t));
+        write_at(out, header.write_bitmap_off, write_bitmap_.data(), write_bitmap_.size() * sizeof(uint64_t));
+        write_at(out, header.key_offsets_off, offsets.data(), offsets.size() * sizeof(uint64_t));
+        write_at(out, header.key_data_off, key_data_.data(), key_data_.size());
+        return out.good();
+    }
+
+private:
+    static uint64_t align(uint64_t off) { return (off + 63) & ~(uint64_t)63; }
+
+    static void write_at(std::ofstream &out, uint64_t off, const void *data, size_t len)
+    {
+        // Pad up to the column offset.
+        static const char zeros[64] = {0};
+        while ((uint64_t)out.tellp() < off)
+            out.write(zeros, std::min<uint64_t>(sizeof(zeros), off - out.tellp()));
+        out.write(static_cast<const char *>(data), len);
+    }
+
+    uint64_t requests_ = 0;
+    std::unordered_map<std::string, uint32_t> key_ids_;
+    std::vector<uint64_t> key_offsets_;
+    std::string key_data_;
+    std::vector<uint32_t> ids_;
+    std::vector<uint32_t> deltas_;
+    std::vector<uint32_t> value_sizes_;
+    std::vector<uint64_t> write_bitmap_;
+};
+
+class MappedTrace
+{
+public:
+    MappedTrace() = default;
+    MappedTrace(const MappedTrace &) = delete;
+    MappedTrace &operator=(const MappedTrace &) = delete;
+
+    ~MappedTrace()
+    {
+        if (base_ != nullptr)
+            munmap(base_, size_);
+    }
+
+    bool open(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            std::cerr << "Error: Unable to open trace file " << path << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TraceHeader))
+        {
+            std::cerr << "Error: Trace file " << path << " is truncated" << std::endl;
+            close(fd);
+            return false;
+        }
+        size_ = st.st_size;
+        void *base = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+        {
+            std::cerr << "Error: Unable to mmap trace file " << path << std::endl;
+            return false;
+        }
+        base_ = static_cast<char *>(base);
+        madvise(base_, size_, MADV_WILLNEED);
+
+        header_ = reinterpret_cast<const TraceHeader *>(base_);
+        if (memcmp(header_->magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+            header_->version != TRACE_VERSION || header_->file_size != size_)
+        {
+            std::cerr << "Error: " << path << " is not a version " << TRACE_VERSION << " trace file" << std::endl;
+            munmap(base_, size_);
+            base_ = nullptr;
+            return false;
+        }
+
+        key_ids_ = reinterpret_cast<const uint32_t *>(base_ + header_->key_ids_off);
+        deltas_ = reinterpret_cast<const uint32_t *>(base_ + header_->deltas_off);
+        value_sizes_ = reinterpret_cast<const uint32_t *>(base_ + header_->value_sizes_off);
+        write_bitmap_ = reinterpret_cast<const uint64_t *>(base_ + header_->write_bitmap_off);
+        key_offsets_ = reinterpret_cast<const uint64_t *>(base_ + header_->key_offsets_off);
+        key_data_ = base_ + header_->key_data_off;
+        return true;
+    }
+
+    size_t size() const { return header_->num_requests; }
+    size_t num_keys() const { return header_->num_keys; }
+
+    uint32_t key_id(size_t i) const { return key_ids_[i]; }
+    uint32_t delta_ms(size_t i) const { return deltas_[i]; }
+    uint32_t value_size(size_t i) const { return value_sizes_[i]; }
+    bool is_write(size_t i) const { return (write_bitmap_[i / 64] >> (i % 64)) & 1; }
+
+    std::string_view key_by_id(uint32_t id) const
+    {
+        return std::string_view(key_data_ + key_offsets_[id], key_offsets_[id + 1] - key_offsets_[id]);
+    }
+
+    std::string_view key(size_t i) const { return key_by_id(key_ids_[i]); }
+
+private:
+    char *base_ = nullptr;
+    size_t size_ = 0;
+    const TraceHeader *header_ = nullptr;
+    const uint32_t *key_ids_ = nullptr;
+    const uint32_t *deltas_ = nullptr;
+    const uint32_t *value_sizes_ = nullptr;
+    const uint64_t *write_bitmap_ = nullptr;
+    const uint64_t *key_offsets_ = nullptr;
+    const char *key_data_ = nullptr;
+};
@@ -7,14 +7,18 @@
 #include <random>
 #include <chrono>
 #include <fstream>
+#include <filesystem>
+#include <sstream>
 #include "zipf.hpp"
 #include "policy.hpp"
 #include "client.hpp"
 #include "zipf.hpp"
 #include "tqdm.hpp"
+#include "trace_file.hpp"
 
 const int KB = 1000;
 const int MB = 1000 * KB;
+const int MAX_VALUE_SIZE = 1 * MB;
 
 struct request
 {
@@ -24,6 +28,21 @@ struct request
     int value_size;
 };
 
+// What Workload::report_stats prints, for result files.
+struct WorkloadStats
+{
+    long num_operations = 0;
+    long num_keys = 0;
+    double read_ratio = 0;
+    double average_value_size = 0; // Bytes.
+    size_t min_value_size = 0;
+    size_t max_value_size = 0;
+    double average_interval_ms = 0;
+    int min_interval_ms = 0;
+    int max_interval_ms = 0;
+    int scale_factor = 0;
+};
+
 bool contains_letters(const std::string &str)
 {
     for (char ch : str)
@@ -43,9 +62,9 @@ public:
 
     void init(int scale_factor)
     {
-        if (scale_factor != -1)
-            scale_factor_ = scale_factor;
-        generateRequests(); // Calls the derived class's generateRequests method
+        set_scale_factor(scale_factor);
+        if (trace_path_.empty() || !load_trace(trace_path_))
+            generateRequests(); // Calls the derived class's generateRequests method
         report_stats();
     }
 
@@ -54,39 +73,92 @@ public:
     {
         // num_operations_ = 50000000 / 10;
         num_operations_ = 20000000;
-        generateRequests(num_operations_); // Calls the derived class's generateRequests method
+        if (trace_path_.empty() || !load_trace(trace_path_))
+            generateRequests(num_operations_); // Calls the derived class's generateRequests method
         report_stats();
     }
 
     virtual void generateRequests(int num_ops = -1) = 0;
 
+    // -1 keeps the workload's default.
+    void set_scale_factor(int scale_factor)
+    {
+        if (scale_factor != -1)
+            scale_factor_ = scale_factor;
+    }
+
     virtual ~Workload() = default;
 
-    std::string get_key(int i) const
+    /* Replay a preprocessed trace (see trace_file.hpp) instead of generating requests. */
+    void set_trace_path(const std::string &path)
     {
-#ifdef DEBUG
-        assert(i < intervals_.size());
-#endif
-        return intervals_[i].key;
+        trace_path_ = path;
     }
 
-    int get_num_keys()
+    bool load_trace(const std::string &path)
     {
-        // Cache the results.
-        if (num_distinct_keys != -1)
-            return num_distinct_keys;
+        auto start = std::chrono::high_resolution_clock::now();
+        auto trace = std::make_unique<MappedTrace>();
+        if (!trace->open(path))
+            return false;
 
-        std::unordered_set<std::string> unique_keys;
+        // Warming needs the last value size of every key.
+        std::vector<uint32_t> last_size(trace->num_keys());
+        for (size_t i = 0; i < trace->size(); i++)
+            last_size[trace->key_id(i)] = trace->value_size(i);
+        keys_to_val_size.clear();
+        keys_to_val_size.reserve(trace->num_keys());
+        for (size_t id = 0; id < trace->num_keys(); id++)
+            keys_to_val_size.emplace(std::string(trace->key_by_id(id)), last_size[id]);
 
-        // Iterate over the intervals and add keys to the unordered_set
-        for (const auto &req : intervals_)
+        intervals_.clear();
+        intervals_.shrink_to_fit();
+        trace_ = std::move(trace);
+
+        auto end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> elapsed = end - start;
+        std::cout << "Loaded trace " << path << " in " << elapsed.count() << " ms" << std::endl;
+        return true;
+    }
+
+    /*
+     * Write the generated requests as a binary trace. Intervals are stored
+     * as they are, so generate with scale factor 1 and no interval cap
+     * (see bench/convert.cpp) to keep the raw inter-arrival times.
+     */
+    bool save_trace(const std::string &path)
+    {
+        TraceWriter writer;
+        for (int i = 0; i < num_operations(); i++)
         {
-            unique_keys.insert(req.key);
+            int64_t delta = get_interval(i).count();
+            writer.add(get_key(i),
+                       static_cast<uint32_t>(std::min<int64_t>(delta, std::numeric_limits<uint32_t>::max())),
+                       get_is_write(i), get_value_size_of(i));
         }
+        return writer.write(path);
+    }
+
+    std::string get_key(int i) const
+    {
+        return std::string(get_key_view(i));
+    }
+
+    std::string_view get_key_view(int i) const
+    {
+        if (trace_)
+            return trace_->key(i);
+#ifdef DEBUG
+        assert(i < intervals_.size());
+#endif
+        return intervals_[i].key;
+    }
 
-        num_distinct_keys = unique_keys.size();
-        // The size of the unordered_set will give the number of distinct keys
-        return unique_keys.size();
+    // Every way of filling a workload (generating, loading a trace, the
+    // streaming pass) records each key's value size, so this is a lookup.
+    int get_num_keys() const
+    {
+        return keys_to_val_size.size();
     }
 
     std::string get_value_from_size(int value_size)
@@ -99,15 +171,39 @@ public:
 
     std::string get_value(int i) const
     {
+#ifdef DEBUG
+        assert(get_value_size_of(i) > 0);
+#endif
+        return std::string(get_value_size_of(i), 'a');
+    }
+
+    // Values are runs of 'a', so every request slices one shared buffer
+    // instead of building a fresh string.
+    static std::string_view get_value_view_from_size(int value_size)
+    {
+        static const std::string value_buffer(MAX_VALUE_SIZE, 'a');
+        return std::string_view(value_buffer.data(), std::min(value_size, MAX_VALUE_SIZE));
+    }
+
+    std::string_view get_value_view(int i) const
+    {
+        return get_value_view_from_size(get_value_size_of(i));
+    }
+
+    int get_value_size_of(int i) const
+    {
+        if (trace_)
+            return trace_->value_size(i);
 #ifdef DEBUG
         assert(i < intervals_.size());
-        assert(intervals_[i].value_size > 0);
 #endif
-        return std::string(intervals_[i].value_size, 'a');
+        return intervals_[i].value_size;
     }
 
     bool get_is_write(int i) const
     {
+        if (trace_)
+            return trace_->is_write(i);
 #ifdef DEBUG
         assert(i < intervals_.size());
 #endif
@@ -116,53 +212,61 @@ public:
 
     std::chrono::milliseconds get_interval(int i) const
     {
+        if (trace_)
+            return scale_interval(std::chrono::milliseconds(trace_->delta_ms(i)));
 #ifdef DEBUG
         assert(i < intervals_.size());
 #endif
         return intervals_[i].interval;
     }
 
-    int num_operations()
+    int num_operations() const
+    {
+        return trace_ ? trace_->size() : intervals_.size();
+    }
+
+    // The mapped trace when replaying one (see load_trace), else nullptr.
+    const MappedTrace *get_trace() const
     {
-        return intervals_.size();
+        return trace_.get();
     }
 
     double get_read_write_ratio() const
     {
         int write_count = 0;
-        for (const auto &r : intervals_)
+        for (int i = 0; i < num_operations(); i++)
         {
-            if (r.is_write)
+            if (get_is_write(i))
             {
                 write_count++;
             }
         }
-        int read_count = intervals_.size() - write_count;
-        return static_cast<double>(read_count) / intervals_.size();
+        int read_count = num_operations() - write_count;
+        return static_cast<double>(read_count) / num_operations();
     }
 
     double get_average_interval() const
     {
-        if (intervals_.empty())
+        if (num_operations() == 0)
             return 0.0;
 
         size_t total_size = 0;
-        for (const auto &r : intervals_)
+        for (int i = 0; i < num_operations(); i++)
         {
-            total_size += r.interval.count();
+            total_size += get_interval(i).count();
         }
-        return static_cast<double>(total_size) / intervals_.size();
+        return static_cast<double>(total_size) / num_operations();
     }
 
     int get_min_interval() const
     {
-        if (intervals_.empty())
+        if (num_operations() == 0)
             return 0;
 
         int min_time = std::numeric_limits<int>::max();
-        for (const auto &r : intervals_)
+        for (int i = 0; i < num_operations(); i++)
         {
-            int interval_time = r.interval.count();
+            int interval_time = get_interval(i).count();
             if (interval_time < min_time)
                 min_time = interval_time;
         }
@@ -171,13 +275,13 @@ public:
 
     int get_max_interval() const
     {
-        if (intervals_.empty())
+        if (num_operations() == 0)
             return 0;
 
         int max_time = 0;
-        for (const auto &r : intervals_)
+        for (int i = 0; i < num_operations(); i++)
         {
-            int interval_time = r.interval.count();
+            int interval_time = get_interval(i).count();
             if (interval_time > max_time)
                 max_time = interval_time;
         }
@@ -186,26 +290,26 @@ public:
 
     double get_average_value_size() const
     {
-        if (intervals_.empty())
+        if (num_operations() == 0)
             return 0.0;
 
         int64_t total_size = 0;
-        for (const auto &r : intervals_)
+        for (int i = 0; i < num_operations(); i++)
         {
-            total_size += r.value_size;
+            total_size += get_value_size_of(i);
         }
-        return static_cast<double>(total_size) / intervals_.size();
+        return static_cast<double>(total_size) / num_operations();
     }
 
     size_t get_min_value_size() const
     {
-        if (intervals_.empty())
+        if (num_operations() == 0)
             return 0;
 
         size_t min_size = std::numeric_limits<size_t>::max();
-        for (const auto &r : intervals_)
+        for (int i = 0; i < num_operations(); i++)
         {
-            size_t value_size = r.value_size;
+            size_t value_size = get_value_size_of(i);
             if (value_size < min_size)
                 min_size = value_size;
         }
@@ -214,34 +318,53 @@ public:
 
     size_t get_max_value_size() const
     {
-        if (intervals_.empty())
+        if (num_operations() == 0)
             return 0;
 
         size_t max_size = 0;
-        for (const auto &r : intervals_)
+        for (int i = 0; i < num_operations(); i++)
         {
-            size_t value_size = r.value_size;
+            size_t value_size = get_value_size_of(i);
             if (value_size > max_size)
                 max_size = value_size;
         }
         return max_size;
     }
 
+    WorkloadStats get_stats()
+    {
+        WorkloadStats stats;
+        stats.num_operations = num_operations();
+        stats.scale_factor = scale_factor_;
+        stats.num_keys = get_num_keys();
+        if (stats.num_operations == 0)
+            return stats;
+        stats.read_ratio = get_read_write_ratio();
+        stats.average_value_size = get_average_value_size();
+        stats.min_value_size = get_min_value_size();
+        stats.max_value_size = get_max_value_size();
+        stats.average_interval_ms = get_average_interval();
+        stats.min_interval_ms = get_min_interval();
+        stats.max_interval_ms = get_max_interval();
+        return stats;
+    }
+
     void report_stats()
     {
-        std::cout << "Total requests: " << intervals_.size() << std::endl;
-        std::cout << "Total number of distinct keys: " << get_num_keys() << std::endl;
-        std::cout << "Read Ratio: " << get_read_write_ratio() << std::endl;
+        WorkloadStats stats = get_stats();
+        std::cout << "Total requests: " << stats.num_operations << std::endl;
+        std::cout << "Total number of distinct keys: " << stats.num_keys << std::endl;
+        std::cout << "Read Ratio: " << stats.read_ratio << std::endl;
 
         // Report value size stats
-        std::cout << "Average Value Size: " << get_average_value_size() << " bytes" << std::endl;
-        std::cout << "Min Value Size: " << get_min_value_size() << " bytes" << std::endl;
-        std::cout << "Max Value Size: " << get_max_value_size() << " bytes" << std::endl;
+        std::cout << "Average Value Size: " << stats.average_value_size << " bytes" << std::endl;
+        std::cout << "Min Value Size: " << stats.min_value_size << " bytes" << std::endl;
+        std::cout << "Max Value Size: " << stats.max_value_size << " bytes" << std::endl;
 
         // Report interval stats
-        std::cout << "Average Interval: " << get_average_interval() << " ms" << std::endl;
-        std::cout << "Min Interval: " << get_min_interval() << " ms" << std::endl;
-        std::cout << "Max Interval: " << get_max_interval() << " ms" << std::endl;
+        std::cout << "Average Interval: " << stats.average_interval_ms << " ms" << std::endl;
+        std::cout << "Min Interval: " << stats.min_interval_ms << " ms" << std::endl;
+        std::cout << "Max Interval: " << stats.max_interval_ms << " ms" << std::endl;
 
         std::cout << "Scale factor: " << scale_factor_ << std::endl;
     }
@@ -252,24 +375,35 @@ public:
     {
         std::chrono::milliseconds interval = (last_op_time.count() == 0)
                                                  ? std::chrono::milliseconds(0)
-                                                 : std::max(std::chrono::milliseconds(0),
-                                                            std::min(std::chrono::milliseconds((op_time - last_op_time).count() / scale_factor_),
-                                                                     std::chrono::milliseconds(max_interval_)));
+                                                 : scale_interval(op_time - last_op_time);
 
         last_op_time = op_time;
         return interval;
     }
 
+    // Apply the scale factor and the interval cap to a raw inter-arrival time.
+    std::chrono::milliseconds scale_interval(std::chrono::milliseconds delta) const
+    {
+        return std::max(std::chrono::milliseconds(0),
+                        std::min(std::chrono::milliseconds(delta.count() / scale_factor_), max_interval_));
+    }
+
     int get_value_size(int value_size)
     {
-        return std::max(1, std::min(1000000, value_size));
+        return std::max(1, std::min(MAX_VALUE_SIZE, value_size));
+    }
+
+    void set_max_interval(std::chrono::milliseconds max_interval)
+    {
+        max_interval_ = max_interval;
     }
 
-    int num_distinct_keys = -1;
     int scale_factor_ = 1; // Will be modified.
 
 protected:
     std::vector<request> intervals_;
+    std::unique_ptr<MappedTrace> trace_;
+    std::string trace_path_;
     std::chrono::milliseconds last_op_time{0};
     std::chrono::milliseconds max_interval_{1000};
     int num_operations_ = 200000;
@@ -314,7 +448,7 @@ private:
         if (alpha > 1.0)
         {
             FastZipf zipf_gen(alpha, num_keys - 1); // 0-indexed: -1
-            distribution_values = zipf_gen.generate_zipf(num_operations_);
+            distribution_values = zipf_gen.generate_zipf_parallel(num_operations_);
         }
         else
         {
@@ -364,7 +498,7 @@ class PoissonMixWorkload : public PoissonWorkload
         if (alpha > 1.0)
         {
             FastZipf zipf_gen(alpha, num_keys - 1); // 0-indexed: -1
-            distribution_values = zipf_gen.generate_zipf(num_operations_);
+            distribution_values = zipf_gen.generate_zipf_parallel(num_operations_);
         }
         else
         {
@@ -424,7 +558,7 @@ private:
         if (alpha > 1.0)
         {
             FastZipf zipf_gen(alpha, num_keys - 1); // 0-indexed: -1
-            distribution_values = zipf_gen.generate_zipf(num_operations_);
+            distribution_values = zipf_gen.generate_zipf_parallel(num_operations_);
         }
         else
         {
@@ -461,450 +595,380 @@ private:
     }
 };
 
-class MetaWorkload : public Workload
+/*
+ * Workloads replayed from trace files. Subclasses list their files and
+ * parse one line at a time, so the same parser serves both the in-memory
+ * generateRequests() and the parallel RequestStream (stream_workload.hpp).
+ */
+class TraceWorkload : public Workload
 {
-private:
+public:
+    struct trace_op
+    {
+        std::chrono::milliseconds op_time;
+        bool is_write;
+        std::string key;
+        int value_size;
+    };
+
+    // Files in replay order.
+    virtual std::vector<std::string> trace_files() = 0;
+
+    // Lines to skip at the top of every file.
+    virtual int header_lines() const { return 0; }
+
+    // Parse one line; false if the line is not a request to replay.
+    virtual bool parse_line(const std::string &line, trace_op &op) = 0;
+
+    // parse_line, with a malformed line (a number that does not parse)
+    // reported and skipped instead of ending the replay.
+    bool try_parse_line(const std::string &line, trace_op &op)
+    {
+        try
+        {
+            return parse_line(line, op);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Skipping malformed trace line (" << e.what() << "): " << line << std::endl;
+            return false;
+        }
+    }
+
+    int max_operations() const { return num_operations_; }
+
     void generateRequests(int num_ops = -1) override
     {
         if (num_ops != -1)
             num_operations_ = num_ops;
 
-        std::string directory_path = file_name_;
         int i = 0;
-
-        for (const auto &file_path : getSortedFiles(directory_path))
+        trace_op op;
+        for (const auto &file_path : trace_files())
         {
             std::ifstream file(file_path);
+            if (!file.is_open())
+            {
+                std::cerr << "Error: Unable to open file " << file_path << std::endl;
+                continue;
+            }
             std::string line;
-            std::getline(file, line); // Skip header line
+            for (int h = 0; h < header_lines(); h++)
+                std::getline(file, line);
 
-            while (std::getline(file, line))
+            while (i < num_operations_ && std::getline(file, line))
             {
-                std::istringstream ss(line);
-                std::string token;
+                if (!try_parse_line(line, op))
+                    continue;
 
-                // Parse fields
-                std::getline(ss, token, ','); // op_time
-                std::chrono::milliseconds op_time(std::stoll(token) * 1000);
+                request r;
+                r.interval = get_interval(op.op_time);
+                r.is_write = op.is_write;
+                r.key = std::move(op.key);
+                r.value_size = op.value_size;
+                keys_to_val_size[r.key] = r.value_size;
+                intervals_.push_back(std::move(r));
+                i += 1;
+            }
+        }
+    }
+};
 
-                std::getline(ss, token, ','); // key
-                std::string key = token;
+class MetaWorkload : public TraceWorkload
+{
+public:
+    MetaWorkload()
+    {
+        num_operations_ = 500000;
+    }
 
-                std::getline(ss, token, ','); // key_size
-                int key_size = std::stoi(token);
+    std::vector<std::string> trace_files() override
+    {
+        return getSortedFiles(file_name_);
+    }
 
-                std::getline(ss, token, ','); // op
-                bool is_write = (token.find("SET") != std::string::npos || token.find("SET_LEASE") != std::string::npos);
+    int header_lines() const override { return 1; }
 
-                std::getline(ss, token, ','); // op_count (not used)
-                std::getline(ss, token, ','); // size
-                int val_size = std::stoi(token);
-                if (i >= num_operations_)
-                {
-                    break;
-                }
-                request r;
-                r.interval = get_interval(op_time);
-                r.is_write = is_write;
-                r.key = key;
-                r.value_size = get_value_size(val_size + key_size);
+    bool parse_line(const std::string &line, trace_op &op) override
+    {
+        std::istringstream ss(line);
+        std::string token;
 
-                intervals_.push_back(r);
-                keys_to_val_size[key] = r.value_size;
-                i += 1;
-            }
-        }
+        // Parse fields
+        std::getline(ss, token, ','); // op_time
+        op.op_time = std::chrono::milliseconds(std::stoll(token) * 1000);
+
+        std::getline(ss, op.key, ','); // key
+
+        std::getline(ss, token, ','); // key_size
+        int key_size = std::stoi(token);
+
+        std::getline(ss, token, ','); // op
+        op.is_write = (token.find("SET") != std::string::npos || token.find("SET_LEASE") != std::string::npos);
+
+        std::getline(ss, token, ','); // op_count (not used)
+        std::getline(ss, token, ','); // size
+        int val_size = std::stoi(token);
+
+        op.value_size = get_value_size(val_size + key_size);
+        return true;
     }
 
 private:
     std::string file_name_ = "/home/maoziming/memcached/cache/dataset/Meta/data";
-    int num_operations_ = 500000;
 };
 
-class TwitterWorkload : public Workload
+class TwitterWorkload : public TraceWorkload
 {
 public:
     TwitterWorkload()
     {
         scale_factor_ = 3;
+        num_operations_ = 500000;
     }
 
-private:
-    void generateRequests(int num_ops = -1) override
+    std::vector<std::string> trace_files() override
     {
+        return getSortedFiles(file_name_);
+    }
 
-        if (num_ops != -1)
-            num_operations_ = num_ops;
+    bool parse_line(const std::string &line, trace_op &op) override
+    {
+        try
+        {
+            std::istringstream ss(line);
+            std::string token;
+            std::string key, op_name;
 
-        std::string directory_path = file_name_;
-        int i = 0;
+            // Parse fields from CSV
+            std::getline(ss, token, ','); // op_time
+            op.op_time = std::chrono::milliseconds(std::stoll(token) * 1000);
+            int key_size, value_size = 0;
 
-        for (const auto &entry : getSortedFiles(directory_path))
-        {
-            std::string file_path = entry;
-            if (std::filesystem::is_regular_file(file_path))
+            // Collect the key which may contain letters and commas
+            std::getline(ss, key, ',');
+            while (ss.peek() != EOF)
             {
-                std::ifstream file(file_path);
-                std::string line;
+                std::string next_token;
+                std::getline(ss, next_token, ',');
 
-                while (std::getline(file, line))
+                // Check if the next token contains letters
+                if (contains_letters(next_token))
                 {
-                    try
-                    {
-                        std::istringstream ss(line);
-                        std::string token;
-                        std::string key, op;
-                        std::chrono::milliseconds op_time(0);
-                        int ttl = 0;
-
-                        // Parse fields from CSV
-                        std::getline(ss, token, ','); // op_time
-                        op_time = std::chrono::milliseconds(std::stoll(token) * 1000);
-                        int key_size, value_size = 0;
-
-                        // Collect the key which may contain letters and commas
-                        std::getline(ss, key, ',');
-                        while (ss.peek() != EOF)
-                        {
-                            std::string next_token;
-                            std::getline(ss, next_token, ',');
-
-                            // Check if the next token contains letters
-                            if (contains_letters(next_token))
-                            {
-                                // Invalid argument during parsing: stoi
-                                // 49,Pi7rYUYmkQ0YjUG-C7Qm--SzguSz1SEzK1SzgfqqK,OzugOuffOESgOguSgzf---Kgg,67,1225,623,get,0
-                                key += "," + next_token; // Append the next token to the key
-                            }
-                            else
-                            {
-                                // If the next token doesn't contain letters, break and move to key_size
-                                token = next_token;
-                                break;
-                            }
-                        }
-                        // std::getline(ss, token, ','); // key_size
-                        key_size = std::stoi(token);
-                        std::getline(ss, token, ','); // Value_size
-                        value_size = std::stoi(token);
-                        std::getline(ss, token, ','); // misc4 (ignored)
-                        std::getline(ss, op, ',');    // op (get/set)
-
-                        std::getline(ss, token, ','); // ttl
-                        ttl = std::stoi(token);
-
-                        if (i >= num_operations_)
-                        {
-                            break;
-                        }
-
-                        request r;
-                        r.interval = get_interval(op_time);
-                        r.is_write = (op != "get" && op != "gets");
-                        r.key = key;
-                        std::string value = std::string(key_size + value_size, 'a');
-                        r.value_size = get_value_size(key_size + value_size);
-                        i += 1;
-                        intervals_.push_back(r);
-                        keys_to_val_size[key] = r.value_size;
-                    }
-                    catch (const std::invalid_argument &e)
-                    {
-                        std::cerr << "Invalid argument during parsing: " << e.what() << std::endl;
-                        std::cerr << line << std::endl;
-                    }
-                    catch (const std::out_of_range &e)
-                    {
-                        std::cerr << "Out of range error during parsing: " << e.what() << std::endl;
-                        std::cerr << line << std::endl;
-                    }
-                    catch (const std::exception &e)
-                    {
-                        std::cerr << "An error occurred: " << e.what() << std::endl;
-                        std::cerr << line << std::endl;
-                    }
+                    // Invalid argument during parsing: stoi
+                    // 49,Pi7rYUYmkQ0YjUG-C7Qm--SzguSz1SEzK1SzgfqqK,OzugOuffOESgOguSgzf---Kgg,67,1225,623,get,0
+                    key += "," + next_token; // Append the next token to the key
+                }
+                else
+                {
+                    // If the next token doesn't contain letters, break and move to key_size
+                    token = next_token;
+                    break;
                 }
             }
+            key_size = std::stoi(token);
+            std::getline(ss, token, ','); // Value_size
+            value_size = std::stoi(token);
+            std::getline(ss, token, ','); // misc4 (ignored)
+            std::getline(ss, op_name, ','); // op (get/set)
+
+            std::getline(ss, token, ','); // ttl (unused, but must parse)
+            std::stoi(token);
+
+            op.is_write = (op_name != "get" && op_name != "gets");
+            op.key = std::move(key);
+            op.value_size = get_value_size(key_size + value_size);
+            return true;
+        }
+        catch (const std::invalid_argument &e)
+        {
+            std::cerr << "Invalid argument during parsing: " << e.what() << std::endl;
+            std::cerr << line << std::endl;
+        }
+        catch (const std::out_of_range &e)
+        {
+            std::cerr << "Out of range error during parsing: " << e.what() << std::endl;
+            std::cerr << line << std::endl;
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "An error occurred: " << e.what() << std::endl;
+            std::cerr << line << std::endl;
         }
+        return false;
     }
 
 private:
     std::string file_name_ = "/home/maoziming/memcached/cache/dataset/Twitter/2020Mar";
-    int num_operations_ = 500000;
 };
 
-class IBMWorkload : public Workload
+class IBMWorkload : public TraceWorkload
 {
 public:
     IBMWorkload()
     {
         max_interval_ = std::chrono::milliseconds{200};
         scale_factor_ = 200;
+        num_operations_ = 300000;
     }
 
-private:
     // Problem: ObjectStoreTrace object size is quite big. 100s MB.
-    void generateRequests(int num_ops = -1) override
+    std::vector<std::string> trace_files() override
     {
-        if (num_ops != -1)
-            num_operations_ = num_ops;
+        return getSortedFiles(file_name_);
+    }
 
-        std::string directory_path = file_name_;
+    bool parse_line(const std::string &line, trace_op &op) override
+    {
+        std::istringstream ss(line);
+        std::string token;
+        std::string request_type;
 
-        int i = 0;
+        // Parse fields from trace line
+        std::getline(ss, token, ' '); // op_time (in milliseconds)
+        op.op_time = std::chrono::milliseconds(std::stoll(token));
 
-        for (const auto &entry : getSortedFiles(directory_path))
-        {
-            std::string file_path = entry;
-            if (std::filesystem::is_regular_file(file_path))
-            {
-                std::ifstream file(file_path);
-                std::string line;
+        std::getline(ss, request_type, ' '); // request_type
+        std::getline(ss, op.key, ' ');       // object_id
 
-                while (std::getline(file, line))
-                {
-                    std::istringstream ss(line);
-                    std::string token;
-                    std::string request_type, object_id;
-                    std::chrono::milliseconds op_time(0);
-                    int64_t size = 0, offset_begin = 0, offset_end = 0;
-
-                    // Parse fields from trace line
-                    std::getline(ss, token, ' '); // op_time (in milliseconds)
-                    op_time = std::chrono::milliseconds(std::stoll(token));
-
-                    std::getline(ss, request_type, ' '); // request_type
-                    std::getline(ss, object_id, ' ');    // object_id
-
-                    if (request_type == "REST.PUT.OBJECT" || request_type == "REST.GET.OBJECT")
-                    {
-                        std::getline(ss, token, ' '); // size
-                        size = std::stoll(token);
-                    }
-                    else
-                    {
-                        continue;
-                    }
-
-                    if (i >= num_operations_)
-                    {
-                        break;
-                    }
-
-                    request r;
-                    r.interval = get_interval(op_time);
-                    ;
-                    r.is_write = (request_type == "REST.PUT.OBJECT");
-                    r.key = object_id;
-                    r.value_size = get_value_size(size);
-                    i += 1;
-                    intervals_.push_back(r);
-                    keys_to_val_size[object_id] = r.value_size;
-                }
-            }
-        }
+        if (request_type != "REST.PUT.OBJECT" && request_type != "REST.GET.OBJECT")
+            return false;
+
+        std::getline(ss, token, ' '); // size
+        op.value_size = get_value_size(std::stoll(token));
+        op.is_write = (request_type == "REST.PUT.OBJECT");
+        return true;
     }
 
 private:
     std::string file_name_ = "/home/maoziming/memcached/cache/dataset/IBM/data";
-    int num_operations_ = 300000;
 };
 
-class TencentWorkload : public Workload
+class TencentWorkload : public TraceWorkload
 {
     // Reference: https://github.com/1a1a11a/libCacheSim/blob/develop/libCacheSim/bin/dep/cpp/tencent.h
-private:
-    void generateRequests(int num_ops = -1) override
+public:
+    TencentWorkload()
     {
-        if (num_ops != -1)
-            num_operations_ = num_ops;
+        num_operations_ = 100000; // Limit number of operations to process
+    }
 
-        std::string directory_path = file_name_;
-        int i = 0;
+    std::vector<std::string> trace_files() override
+    {
+        return getSortedFiles(file_name_);
+    }
 
-        for (const auto &entry : getSortedFiles(directory_path))
-        {
-            std::string file_path = entry;
-            if (std::filesystem::is_regular_file(file_path))
-            {
-                std::ifstream file(file_path);
-                std::string line;
+    bool parse_line(const std::string &line, trace_op &op) override
+    {
+        std::istringstream ss(line);
+        std::string token, lba, namespace_id;
 
-                while (std::getline(file, line))
-                {
-                    // std::cout << line << std::endl;
-                    std::istringstream ss(line);
-                    std::string token;
-                    std::chrono::milliseconds op_time(0);
-                    int size = 0, is_write = 0;
-                    std::string lba, namespace_id;
-                    // Parse fields from trace line
-                    std::getline(ss, token, ',');                                  // timestamp (in seconds)
-                    op_time = std::chrono::milliseconds(std::stoll(token) * 1000); // Convert to milliseconds
-
-                    std::getline(ss, token, ','); // lba
-                    lba = token;
-
-                    std::getline(ss, token, ','); // size (multiplied by 512)
-                    size = std::stoi(token) * 1012;
-
-                    std::getline(ss, token, ','); // is_write (0 for read, 1 for write)
-                    is_write = std::stoi(token);
-
-                    std::getline(ss, token, ','); // namespace_id
-                    namespace_id = token;
-
-                    if (i >= num_operations_)
-                    {
-                        break;
-                    }
-
-                    request r;
-                    r.interval = get_interval(op_time);
-                    r.is_write = (is_write == 1);
-                    r.key = lba + "_" + namespace_id; // lba + namespace as key
-                    r.value_size = get_value_size(size);
-
-                    i += 1;
-                    intervals_.push_back(r);
-                    keys_to_val_size[r.key] = size;
-                }
-            }
-        }
+        // Parse fields from trace line
+        std::getline(ss, token, ',');                                     // timestamp (in seconds)
+        op.op_time = std::chrono::milliseconds(std::stoll(token) * 1000); // Convert to milliseconds
+
+        std::getline(ss, lba, ','); // lba
+
+        std::getline(ss, token, ','); // size (multiplied by 512)
+        int size = std::stoi(token) * 1012;
+
+        std::getline(ss, token, ','); // is_write (0 for read, 1 for write)
+        op.is_write = (std::stoi(token) == 1);
+
+        std::getline(ss, namespace_id, ','); // namespace_id
+
+        op.key = lba + "_" + namespace_id; // lba + namespace as key
+        op.value_size = get_value_size(size);
+        return true;
     }
+
+private:
     std::string file_name_ = "/home/maoziming/memcached/cache/dataset/Tencent/cbs_trace1/atc_2020_trace/trace_ori";
-    int num_operations_ = 100000; // Limit number of operations to process
 };
 
-class AlibabaWorkload : public Workload
+class AlibabaWorkload : public TraceWorkload
 {
-private:
-    void generateRequests(int num_ops = -1) override
+public:
+    AlibabaWorkload()
     {
-        if (num_ops != -1)
-            num_operations_ = num_ops;
-        int i = 0;
+        num_operations_ = 100000;
+    }
 
-        // Open the trace file
-        std::ifstream file(file_name_);
-        if (!file.is_open())
-        {
-            std::cerr << "Error: Unable to open file " << file_name_ << std::endl;
-            return;
-        }
+    std::vector<std::string> trace_files() override
+    {
+        return {file_name_};
+    }
 
-        std::string line;
-        while (std::getline(file, line) && i < num_operations_)
-        {
-            std::istringstream ss(line);
-            std::string token;
-            request r;
-            std::chrono::milliseconds op_time(0);
-            uint32_t device_id = 0;
-            char opcode = 'R';
-            uint64_t offset = 0;
-            uint32_t length = 0;
-            uint64_t timestamp = 0;
-
-            // Parse the CSV fields
-            std::getline(ss, token, ','); // device_id
-            device_id = std::stoul(token);
-
-            std::getline(ss, token, ','); // opcode
-            opcode = token[0];
-
-            std::getline(ss, token, ','); // offset
-            offset = std::stoull(token);
-
-            std::getline(ss, token, ','); // length
-            length = std::stoul(token);
-
-            std::getline(ss, token, ','); // timestamp
-            timestamp = std::stoull(token);
-            // Timestamp of this operation received by server, in microseconds
-            op_time = std::chrono::milliseconds(timestamp / 1000); // Convert to milliseconds
-
-            // Set the request details
-            r.key = std::to_string(device_id) + "_" + std::to_string(offset);
-            r.value_size = get_value_size(length); // Dummy value
-            r.is_write = (opcode == 'W');
-            r.interval = get_interval(op_time);
-
-            // Add the request to the intervals
-            intervals_.push_back(r);
-            keys_to_val_size[r.key] = r.value_size;
+    bool parse_line(const std::string &line, trace_op &op) override
+    {
+        std::istringstream ss(line);
+        std::string token;
 
-            i += 1;
-        }
-        file.close();
+        // Parse the CSV fields
+        std::getline(ss, token, ','); // device_id
+        uint32_t device_id = std::stoul(token);
+
+        std::getline(ss, token, ','); // opcode
+        char opcode = token[0];
+
+        std::getline(ss, token, ','); // offset
+        uint64_t offset = std::stoull(token);
+
+        std::getline(ss, token, ','); // length
+        uint32_t length = std::stoul(token);
+
+        std::getline(ss, token, ','); // timestamp
+        // Timestamp of this operation received by server, in microseconds
+        uint64_t timestamp = std::stoull(token);
+        op.op_time = std::chrono::milliseconds(timestamp / 1000); // Convert to milliseconds
+
+        op.key = std::to_string(device_id) + "_" + std::to_string(offset);
+        op.value_size = get_value_size(length);
+        op.is_write = (opcode == 'W');
+        return true;
     }
 
+private:
     std::string file_name_ = "/home/maoziming/memcached/cache/dataset/Alibaba/alibaba_block_traces_2020/io_traces.csv";
-    int num_operations_ = 100000;
 };
 
-class WikiCDNWorkload : public Workload
+class WikiCDNWorkload : public TraceWorkload
 {
     // Reference: /home/maoziming/memcached/cache/dataset/WikiCDN
-private:
-    void generateRequests(int num_ops = -1) override
+public:
+    WikiCDNWorkload()
     {
-        if (num_ops != -1)
-            num_operations_ = num_ops;
+        num_operations_ = 1000; // Limit number of operations to process
+    }
 
-        std::string directory_path = file_name_;
-        int i = 0;
+    std::vector<std::string> trace_files() override
+    {
+        return getSortedFiles(file_name_);
+    }
 
-        for (const auto &entry : getSortedFiles(directory_path))
-        {
-            std::string file_path = entry;
-            if (std::filesystem::is_regular_file(file_path))
-            {
-                std::ifstream file(file_path);
-                std::string line;
-                std::getline(file, line); // header
+    int header_lines() const override { return 1; }
 
-                while (std::getline(file, line))
-                {
-                    std::istringstream ss(line);
-                    // std::cout << line << std::endl;
-                    std::string token;
-                    std::chrono::milliseconds op_time(0);
-                    int64_t response_size = 0;
-                    double time_firstbyte = 0.0;
-                    int64_t hashed_host_path_query = 0;
-                    int relative_unix = 0;
-
-                    // Parse fields from trace line
-                    std::getline(ss, token, '\t');                                // relative_unix (in seconds)
-                    op_time = std::chrono::milliseconds(std::stoi(token) * 1000); // Convert to milliseconds
-
-                    std::getline(ss, token, '\t'); // hashed_host_path_query
-                    hashed_host_path_query = std::stoll(token);
-
-                    std::getline(ss, token, '\t'); // response_size
-                    response_size = std::stoll(token);
-
-                    std::getline(ss, token, '\t'); // time_firstbyte
-                    time_firstbyte = std::stod(token);
-
-                    if (i >= num_operations_)
-                    {
-                        break;
-                    }
-
-                    request r;
-                    r.interval = get_interval(op_time);
-                    r.key = std::to_string(hashed_host_path_query); // Use hashed host path query as key
-                    r.value_size = get_value_size(response_size);
-
-                    i += 1;
-                    intervals_.push_back(r);
-                    keys_to_val_size[r.key] = response_size;
-                }
-            }
-        }
+    bool parse_line(const std::string &line, trace_op &op) override
+    {
+        std::istringstream ss(line);
+        std::string token;
+
+        // Parse fields from trace line
+        std::getline(ss, token, '\t');                                   // relative_unix (in seconds)
+        op.op_time = std::chrono::milliseconds(std::stoi(token) * 1000); // Convert to milliseconds
+
+        std::getline(ss, token, '\t'); // hashed_host_path_query
+        op.key = std::to_string(std::stoll(token));
+
+        std::getline(ss, token, '\t'); // response_size
+        op.value_size = get_value_size(std::stoll(token));
+
+        std::getline(ss, token, '\t'); // time_firstbyte (not used)
+
+        op.is_write = false; // The trace has no writes.
+        return true;
     }
+
+private:
     std::string file_name_ = "/home/maoziming/memcached/cache/dataset/WikiCDN";
-    int num_operations_ = 1000; // Limit number of operations to process
-};
\ No newline at end of file
+};
@@ -1,38 +1,30 @@
 #pragma once
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <random>
+#include <thread>
 #include <vector>
 
+/*
+ * Zipf sampler over ranks [1, n] using Vose's alias method: O(n) setup,
+ * then O(1) per sample (one uniform index, one uniform coin).
+ * Samples are reproducible from the seed. With n < 1 there are no ranks,
+ * and every sample is 0 (a one-key workload asks for n = 0).
+ */
 class FastZipf
 {
 public:
-    FastZipf(double alpha, int n) : alpha(alpha), n(n)
+    FastZipf(double alpha, int n, uint64_t seed = std::default_random_engine::default_seed)
+        : alpha(alpha), n(std::max(n, 0)), seed_(seed), generator(seed)
     {
-        // Precompute the normalization constant
-        zeta_n = 0.0;
-        for (int i = 1; i <= n; i++)
-        {
-            zeta_n += 1.0 / std::pow(i, alpha);
-        }
+        build_alias_table();
     }
 
     int zipf()
     {
-        double sum_prob = 0.0;
-        double rand_val = uniform_dist(generator) * zeta_n;
-
-        for (int i = 1; i <= n; i++)
-        {
-            sum_prob += 1.0 / std::pow(i, alpha);
-            if (sum_prob >= rand_val)
-            {
-                return i;
-            }
-        }
-
-        // In case of numerical precision issues, return n
-        return n;
+        return sample(generator);
     }
 
     std::vector<int> generate_zipf(int num_operations)
@@ -46,10 +38,107 @@ public:
         return results;
     }
 
+    /*
+     * Fill num_operations samples using num_threads threads. The output is
+     * cut into fixed blocks, each drawn from its own engine seeded with
+     * (seed, block index), so the result depends only on the seed and not
+     * on the thread count.
+     */
+    std::vector<int> generate_zipf_parallel(int num_operations, int num_threads = std::thread::hardware_concurrency())
+    {
+        std::vector<int> results(num_operations);
+        int num_blocks = (num_operations + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        num_threads = std::max(1, std::min(num_threads, num_blocks));
+
+        auto worker = [&](int t)
+        {
+            for (int b = t; b < num_blocks; b += num_threads)
+            {
+                std::seed_seq seq{static_cast<uint32_t>(seed_), static_cast<uint32_t>(seed_ >> 32), static_cast<uint32_t>(b)};
+                std::mt19937_64 engine(seq);
+                int end = std::min(num_operations, (b + 1) * BLOCK_SIZE);
+                for (int i = b * BLOCK_SIZE; i < end; i++)
+                    results[i] = sample(engine);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (int t = 1; t < num_threads; t++)
+            threads.emplace_back(worker, t);
+        worker(0);
+        for (auto &thread : threads)
+            thread.join();
+        return results;
+    }
+
 private:
+    static const int BLOCK_SIZE = 1 << 16;
+
+    void build_alias_table()
+    {
+        prob_.assign(n, 0.0);
+        alias_.assign(n, 0);
+        if (n == 0)
+            return;
+
+        std::vector<double> scaled(n);
+        double zeta_n = 0.0;
+        for (int i = 0; i < n; i++)
+        {
+            scaled[i] = 1.0 / std::pow(i + 1, alpha);
+            zeta_n += scaled[i];
+        }
+        for (int i = 0; i < n; i++)
+            scaled[i] *= n / zeta_n;
+
+        std::vector<int> small, large;
+        small.reserve(n);
+        large.reserve(n);
+        for (int i = n - 1; i >= 0; i--)
+        {
+            if (scaled[i] < 1.0)
+                small.push_back(i);
+            else
+                large.push_back(i);
+        }
+
+        while (!small.empty() && !large.empty())
+        {
+            int s = small.back();
+            int l = large.back();
+            small.pop_back();
+            large.pop_back();
+
+            prob_[s] = scaled[s];
+            alias_[s] = l;
+            scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+            if (scaled[l] < 1.0)
+                small.push_back(l);
+            else
+                large.push_back(l);
+        }
+        // Whatever is left is 1.0 up to rounding error.
+        for (int l : large)
+            prob_[l] = 1.0;
+        for (int s : small)
+            prob_[s] = 1.0;
+    }
+
+    template <typename Engine>
+    int sample(Engine &engine) const
+    {
+        if (n == 0)
+            return 0;
+        std::uniform_int_distribution<int> column(0, n - 1);
+        std::uniform_real_distribution<double> coin(0.0, 1.0);
+        int i = column(engine);
+        return (coin(engine) < prob_[i] ? i : alias_[i]) + 1;
+    }
+
     double alpha;
     int n;
-    double zeta_n;
+    uint64_t seed_;
     std::default_random_engine generator;
-    std::uniform_real_distribution<double> uniform_dist{0.0, 1.0};
-};
\ No newline at end of file
+    std::vector<double> prob_;
+    std::vector<int> alias_;
+};
@@ -4,7 +4,9 @@
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <pthread.h>
 #include <grpcpp/grpcpp.h>
 #include "policy.hpp"
 #include <myproto/cache_service.pb.h>
@@ -16,7 +18,10 @@
 #include <condition_variable>
 // #include <mutex>
 #include <future>
-#include "thread_pool.hpp"
+#include "work_stealing_pool.hpp"
+#include "tracing.hpp"
+#include "compression.hpp"
+#include "histogram.hpp"
 
 #define ASSERT(condition, message)             \
     do                                         \
@@ -74,6 +79,117 @@ const int TTL_EW = -2;
 const int INVALIDATE_EW = -3;
 const int UPDATE_EW = -4;
 
+// Cost of an invalidate, an update, and a miss, in the same units.
+const int C_I = 10;
+const int C_U = 46;
+const int C_M = C_I + C_U;
+
+// Adaptive freshness: invalidate when pushing every write as an update is
+// expected to cost more than one invalidate plus the miss it causes. An ew
+// of -1 means the key has not been read since its last write.
+inline bool prefer_invalidate(float ew)
+{
+    return ew == -1 || C_U * ew > C_I + C_M;
+}
+
+// TTL_EW mode: have the cache server pick each key's TTL at fill time from
+// its observed write and read rates, keeping the expected fraction of stale
+// reads near staleness_slo. The fixed TTL is the starting point.
+struct AdaptiveTTLConfig
+{
+    bool enabled = false;
+    float staleness_slo = 0.01f;
+    int32_t max_ttl = 300; // Seconds.
+};
+
+// Invalidates and updates applied by the cache server, plus how the
+// adaptive TTL engine did if it was enabled.
+struct FreshnessStats
+{
+    int invalidates = 0;
+    int updates = 0;
+    int adaptive_fills = 0;
+    int adaptive_bypassed = 0; // Fills left uncached to meet the SLO.
+    float mean_ttl = 0;
+    float estimated_stale_ratio = 0;
+};
+
+// A value read from the DB or the cache together with the per-key version
+// the DB assigned to the write that produced it; 0 means unversioned.
+struct VersionedValue
+{
+    std::string value;
+    uint64_t version = 0;
+    bool compressed = false; // value is still encoded; see compression.hpp.
+};
+
+// The plain value, decompressed if its writer compressed it. Only the
+// reading client calls this; servers pass encoded values through.
+inline std::string decoded_value(VersionedValue &&versioned)
+{
+    if (!versioned.compressed)
+        return std::move(versioned.value);
+    std::string value;
+    if (!compression::Decompress(versioned.value, value))
+    {
+        std::cerr << "Corrupt compressed value" << std::endl;
+        value.clear();
+    }
+    return value;
+}
+
+// Staleness check for benchmarks: remembers the latest version the DB
+// acknowledged for each key, and counts cache reads that return an older
+// version than the one acknowledged before the read was issued.
+class VersionTracker
+{
+public:
+    uint64_t Latest(const std::string &key)
+    {
+        Shard &shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.versions.find(key);
+        return it == shard.versions.end() ? 0 : it->second;
+    }
+
+    void OnWrite(const std::string &key, uint64_t version)
+    {
+        Shard &shard = shard_for(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        uint64_t &latest = shard.versions[key];
+        if (version > latest)
+            latest = version;
+    }
+
+    void OnRead(uint64_t expected, uint64_t got)
+    {
+        checked_reads_++;
+        if (got < expected)
+            stale_reads_++;
+    }
+
+    long stale_reads() const { return stale_reads_.load(); }
+    long checked_reads() const { return checked_reads_.load(); }
+
+private:
+    static const size_t NUM_SHARDS = 64;
+
+    struct alignas(64) Shard
+    {
+        std::mutex mutex;
+        std::unordered_map<std::string, uint64_t> versions;
+    };
+
+    Shard &shard_for(const std::string &key)
+    {
+        return shards_[std::hash<std::string>{}(key) % NUM_SHARDS];
+    }
+
+    Shard shards_[NUM_SHARDS];
+    std::atomic<long> stale_reads_{0};
+    std::atomic<long> checked_reads_{0};
+};
+
 // #define USE_RPC_LIMIT
 
 // #ifdef USE_RPC_LIMIT
@@ -108,7 +224,7 @@ public:
     }
 
     // Modified AsyncGet to return a std::future
-    std::future<std::string> AsyncGet(const std::string &key)
+    std::future<VersionedValue> AsyncGet(const std::string &key, uint64_t trace_id = 0)
     {
         // std::cout << "AsyncGet starts" << std::endl;
         // {
@@ -126,15 +242,16 @@ public:
         AsyncClientCall *call = new AsyncClientCall;
         call->call_type = AsyncClientCall::CallType::GET;
         call->key = key;
-        call->get_promise = std::make_shared<std::promise<std::string>>();
+        call->get_promise = std::make_shared<std::promise<VersionedValue>>();
         // call->start_time = std::chrono::steady_clock::now();
 
         // Get the future from the promise
-        std::future<std::string> result_future = call->get_promise->get_future();
+        std::future<VersionedValue> result_future = call->get_promise->get_future();
 
         // Start the asynchronous RPC
         // std::cout << "AsyncGet sent" << std::endl;
-        call->get_response_reader = stub_->AsyncGet(&call->context, request, &cq_);
+        tracing::Inject(call->context, trace_id);
+        call->get_response_reader = get_stub()->AsyncGet(&call->context, request, &cq_);
 
         // Request that, upon completion of the RPC, "call" be updated
         call->get_response_reader->Finish(&call->get_reply, &call->status, (void *)call);
@@ -148,12 +265,12 @@ public:
         try
         {
             // std::cout << "Get starts AsyncGet" << std::endl;
-            std::future<std::string> result_future = AsyncGet(key);
+            std::future<VersionedValue> result_future = AsyncGet(key);
 
             // Wait for the result for a limited time
             if (result_future.wait_for(timeout_duration) == std::future_status::ready)
             {
-                std::string result = result_future.get(); // Get the result if it's ready
+                std::string result = decoded_value(result_future.get()); // Get the result if it's ready
                 if (result.empty())
                 {
                     std::cerr << "DB Key not found" << std::endl;
@@ -173,7 +290,12 @@ public:
         }
     }
 
-    std::string Get(const std::string &key)
+    std::string Get(const std::string &key, uint64_t trace_id = 0)
+    {
+        return decoded_value(GetVersioned(key, trace_id));
+    }
+
+    VersionedValue GetVersioned(const std::string &key, uint64_t trace_id = 0)
     {
         const int max_retries = 3;                             // Maximum number of retries
         const std::chrono::milliseconds initial_timeout(2000); // Initial timeout duration of 2 seconds
@@ -185,14 +307,14 @@ public:
             try
             {
                 // std::cout << "Get starts AsyncGet, attempt: " << (attempt + 1) << std::endl;
-                std::future<std::string> result_future = AsyncGet(key);
+                std::future<VersionedValue> result_future = AsyncGet(key, trace_id);
                 // std::cout << "AsyncGet(key) finishes" << key << std::endl;
 
                 // Wait for the result with the current timeout
                 if (result_future.wait_for(timeout_duration) == std::future_status::ready)
                 {
-                    std::string result = result_future.get(); // Retrieve the result
-                    if (result.empty())
+                    VersionedValue result = result_future.get(); // Retrieve the result
+                    if (result.value.empty())
                     {
                         std::cerr << "DB Key not found." << std::endl;
                     }
@@ -215,7 +337,7 @@ public:
         }
 
         std::cerr << "Failed to get the result after " << max_retries << " attempts." << std::endl;
-        return ""; // Return an empty string if all retries fail
+        return VersionedValue(); // Return an empty value if all retries fail
     }
 
     memcached_st *create_mc(memcached_pool_st *pool)
@@ -236,24 +358,26 @@ public:
         memcached_pool_push(pool, memc);
     }
 
-    std::future<std::string> AsyncFill(const std::string &key, int ttl)
+    std::future<VersionedValue> AsyncFill(const std::string &key, int ttl, uint64_t trace_id = 0)
     {
         ++current_rpcs;
-        auto promise = std::make_shared<std::promise<std::string>>();
-        std::future<std::string> result_future = promise->get_future();
+        auto promise = std::make_shared<std::promise<VersionedValue>>();
+        std::future<VersionedValue> result_future = promise->get_future();
 
-        std::thread([this, key, ttl, promise]()
+        std::thread([this, key, ttl, promise, trace_id]()
                     {
                         try
                         {
-                            std::string db_value = Get(key);
-                            if (!db_value.empty())
+                            VersionedValue db_value = GetVersioned(key, trace_id);
+                            if (!db_value.value.empty())
                             {
-                                promise->set_value(db_value);
+                                promise->set_value(std::move(db_value));
                             }
                             else
                             {
-                                promise->set_value("DB Key not found.");
+                                // Carries the version of a deleted key, so the marker
+                                // cannot overwrite a newer value.
+                                promise->set_value(VersionedValue{"DB Key not found.", db_value.version});
                                 std::cerr << "Async: DB Key not found." << std::endl;
                             }
                         }
@@ -265,12 +389,17 @@ public:
         return result_future;
     }
 
-    std::future<bool> AsyncPut(const std::string &key, const std::string &value, float ew)
+    std::future<bool> AsyncPut(const std::string &key, std::string_view value, float ew)
     {
         ++current_rpcs;
         DBPutRequest request;
         request.set_key(key);
-        request.set_value(value);
+        std::string encoded;
+        bool compressed = compression::Compress(value, compression_, encoded);
+        std::string_view payload = compressed ? std::string_view(encoded) : value;
+        request.set_value(payload.data(), payload.size());
+        request.set_compressed(compressed);
+        value_bytes_sent_ += payload.size();
 
         if (tracker_ && ew == ADAPTIVE_EW)
         {
@@ -300,7 +429,7 @@ public:
         return result_future; // Return the future immediately
     }
 
-    bool Put(const std::string &key, const std::string &value, float ew)
+    bool Put(const std::string &key, std::string_view value, float ew)
     {
         try
         {
@@ -315,7 +444,7 @@ public:
     }
 
     // Modified PutWarm method using AsyncPut
-    bool PutWarm(const std::string &key, const std::string &value)
+    bool PutWarm(const std::string &key, std::string_view value)
     {
         // Reuse AsyncPut with a fixed ew
         return Put(key, value, TTL_EW);
@@ -372,7 +501,7 @@ public:
         call->load_promise = std::make_shared<std::promise<int>>();
 
         std::future<int> result_future = call->load_promise->get_future();
-        call->get_load_response_reader = stub_->AsyncGetLoad(&call->context, request, &cq_);
+        call->get_load_response_reader = get_stub()->AsyncGetLoad(&call->context, request, &cq_);
         call->get_load_response_reader->Finish(&call->get_load_reply, &call->status, (void *)call);
 
         return result_future; // Return the future immediately
@@ -517,6 +646,24 @@ public:
         tracker_ = tracker;
     }
 
+    // Acknowledged Put versions are reported to version_tracker.
+    void SetVersionTracker(VersionTracker *version_tracker)
+    {
+        version_tracker_ = version_tracker;
+    }
+
+    // Puts from now on compress values as config says.
+    void SetCompression(const CompressionConfig &config)
+    {
+        compression_ = config;
+    }
+
+    // Value bytes put on the wire by Puts, after compression.
+    long GetValueBytesSent() const
+    {
+        return value_bytes_sent_.load();
+    }
+
     double GetAverageLatency()
     {
         std::lock_guard<std::mutex> lock(latency_mutex_);
@@ -535,6 +682,16 @@ public:
         return static_cast<double>(total_latency) / latencies_.size();
     }
 
+    // Put latencies in microseconds.
+    LatencyHistogram GetLatencyHistogram()
+    {
+        std::lock_guard<std::mutex> lock(latency_mutex_);
+        LatencyHistogram histogram;
+        for (long latency : latencies_)
+            histogram.Record(latency);
+        return histogram;
+    }
+
     int get_current_rpcs() { return current_rpcs.load(); }
 
 private:
@@ -565,6 +722,9 @@ private:
     }
 
     Tracker *tracker_ = nullptr;
+    VersionTracker *version_tracker_ = nullptr;
+    CompressionConfig compression_;
+    std::atomic<long> value_bytes_sent_{0};
     // std::mutex mutex_;
     std::condition_variable cv_;
     std::atomic<int> current_rpcs{0};
@@ -591,7 +751,7 @@ private:
         // For Get RPC
         DBGetResponse get_reply;
         std::unique_ptr<grpc::ClientAsyncResponseReader<DBGetResponse>> get_response_reader;
-        std::shared_ptr<std::promise<std::string>> get_promise;
+        std::shared_ptr<std::promise<VersionedValue>> get_promise;
 
         // For Put RPC
         DBPutResponse put_reply;
@@ -632,6 +792,7 @@ private:
     {
         void *got_tag;
         bool ok = false;
+        pthread_setname_np(pthread_self(), "db-cq"); // Picked up by TelemetrySampler.
 
         while (cq_.Next(&got_tag, &ok))
         {
@@ -657,14 +818,17 @@ private:
                 case AsyncClientCall::CallType::GET:
                     if (call->get_reply.found())
                     {
-                        call->get_promise->set_value(call->get_reply.value());
+                        call->get_promise->set_value(VersionedValue{call->get_reply.value(), call->get_reply.version(),
+                                                                    call->get_reply.compressed()});
                     }
                     else
                     {
-                        call->get_promise->set_value("");
+                        call->get_promise->set_value(VersionedValue{"", call->get_reply.version()});
                     }
                     break;
                 case AsyncClientCall::CallType::PUT:
+                    if (version_tracker_)
+                        version_tracker_->OnWrite(call->key, call->put_reply.version());
                     call->put_promise->set_value(call->put_reply.success());
                     break;
                 case AsyncClientCall::CallType::DELETE:
@@ -786,6 +950,14 @@ public:
         call->key = key;
         call->get_promise = std::make_shared<std::promise<std::string>>();
         call->start_time = std::chrono::steady_clock::now();
+        if (version_tracker_)
+            call->expected_version = version_tracker_->Latest(key);
+        call->trace_id = tracing::StartTrace();
+        if (call->trace_id != 0)
+        {
+            tracing::Inject(call->context, call->trace_id);
+            call->trace_start = tracing::Now();
+        }
 
         // Get the future from the promise
         std::future<std::string> result_future = call->get_promise->get_future();
@@ -800,7 +972,8 @@ public:
     }
 
     // Asynchronous Set method returning a future
-    std::future<bool> SetAsync(const std::string &key, const std::string &value, int ttl)
+    // A non-zero version is only stored if it is newer than the cached one.
+    std::future<bool> SetAsync(const std::string &key, std::string_view value, int ttl, uint64_t version = 0)
     {
         // {
         // #ifdef USE_RPC_LIMIT
@@ -814,8 +987,13 @@ public:
         // Build the request
         CacheSetRequest request;
         request.set_key(key);
-        request.set_value(value);
+        std::string encoded;
+        bool compressed = compression::Compress(value, compression_, encoded);
+        std::string_view payload = compressed ? std::string_view(encoded) : value;
+        request.set_value(payload.data(), payload.size());
+        request.set_compressed(compressed);
         request.set_ttl(ttl);
+        request.set_version(version);
 
         // Call object to store RPC data
         AsyncClientCall *call = new AsyncClientCall;
@@ -823,6 +1001,12 @@ public:
         call->key = key;
         call->set_promise = std::make_shared<std::promise<bool>>();
         // call->start_time = std::chrono::steady_clock::now();
+        call->trace_id = tracing::StartTrace();
+        if (call->trace_id != 0)
+        {
+            tracing::Inject(call->context, call->trace_id);
+            call->trace_start = tracing::Now();
+        }
 
         // Get the future from the promise
         std::future<bool> result_future = call->set_promise->get_future();
@@ -834,8 +1018,9 @@ public:
         return result_future;
     }
 
-    // Asynchronous Invalidate method returning a future
-    std::future<bool> InvalidateAsync(const std::string &key)
+    // Asynchronous Invalidate method returning a future. A non-zero version
+    // leaves a tombstone in the cache so older fills cannot resurrect the key.
+    std::future<bool> InvalidateAsync(const std::string &key, uint64_t version = 0)
     {
         // {
         // #ifdef USE_RPC_LIMIT
@@ -849,6 +1034,7 @@ public:
         // Build the request
         CacheInvalidateRequest request;
         request.set_key(key);
+        request.set_version(version);
 
         // Call object to store RPC data
         AsyncClientCall *call = new AsyncClientCall;
@@ -867,8 +1053,11 @@ public:
         return result_future;
     }
 
-    // Asynchronous Update method returning a future
-    std::future<bool> UpdateAsync(const std::string &key, const std::string &value, int ttl)
+    // Asynchronous Update method returning a future. A non-zero version is
+    // only applied over an older cached version. value is forwarded as is,
+    // so compressed says whether its writer compressed it.
+    std::future<bool> UpdateAsync(const std::string &key, const std::string &value, int ttl, uint64_t version = 0,
+                                  bool compressed = false)
     {
         // {
         // #ifdef USE_RPC_LIMIT
@@ -883,6 +1072,8 @@ public:
         CacheUpdateRequest request;
         request.set_key(key);
         request.set_value(value);
+        request.set_version(version);
+        request.set_compressed(compressed);
 
         // Call object to store RPC data
         AsyncClientCall *call = new AsyncClientCall;
@@ -902,7 +1093,7 @@ public:
     }
 
     // Asynchronous SetTTL method returning a future
-    std::future<bool> SetTTLAsync(int32_t ttl)
+    std::future<bool> SetTTLAsync(int32_t ttl, const AdaptiveTTLConfig &adaptive = AdaptiveTTLConfig())
     {
         // {
         // #ifdef USE_RPC_LIMIT
@@ -916,6 +1107,9 @@ public:
         // Build the request
         CacheSetTTLRequest request;
         request.set_ttl(ttl);
+        request.set_adaptive(adaptive.enabled);
+        request.set_staleness_slo(adaptive.staleness_slo);
+        request.set_max_ttl(adaptive.max_ttl);
 
         // Call object to store RPC data
         AsyncClientCall *call = new AsyncClientCall;
@@ -964,7 +1158,7 @@ public:
         return result_future;
     }
 
-    std::future<std::tuple<int, int>> GetFreshnessStatsAsync()
+    std::future<FreshnessStats> GetFreshnessStatsAsync()
     {
         // {
         // #ifdef USE_RPC_LIMIT
@@ -981,11 +1175,11 @@ public:
         // Call object to store RPC data
         AsyncClientCall *call = new AsyncClientCall;
         call->call_type = AsyncClientCall::CallType::GETFRESHNESSSTATS;
-        call->get_freshness_stats_promise = std::make_shared<std::promise<std::tuple<int, int>>>();
+        call->get_freshness_stats_promise = std::make_shared<std::promise<FreshnessStats>>();
         // call->start_time = std::chrono::steady_clock::now();
 
         // Get the future from the promise
-        std::future<std::tuple<int, int>> result_future = call->get_freshness_stats_promise->get_future();
+        std::future<FreshnessStats> result_future = call->get_freshness_stats_promise->get_future();
 
         // Start the asynchronous RPC
         call->get_freshness_stats_response_reader = get_stub()->AsyncGetFreshnessStats(&call->context, request, &cq_);
@@ -1010,7 +1204,7 @@ public:
     }
 
     // Synchronous Set method that waits for the result
-    bool Set(const std::string &key, const std::string &value, int ttl)
+    bool Set(const std::string &key, std::string_view value, int ttl)
     {
         try
         {
@@ -1055,11 +1249,11 @@ public:
     }
 
     // Synchronous SetTTL method that waits for the result
-    bool SetTTL(int32_t ttl)
+    bool SetTTL(int32_t ttl, const AdaptiveTTLConfig &adaptive = AdaptiveTTLConfig())
     {
         try
         {
-            std::future<bool> result_future = SetTTLAsync(ttl);
+            std::future<bool> result_future = SetTTLAsync(ttl, adaptive);
             return result_future.get(); // Wait for the result
         }
         catch (const std::exception &e)
@@ -1084,17 +1278,20 @@ public:
         }
     }
 
-    std::tuple<int, int> GetFreshnessStats()
+    FreshnessStats GetFreshnessStats()
     {
         try
         {
-            std::future<std::tuple<int, int>> result_future = GetFreshnessStatsAsync();
+            std::future<FreshnessStats> result_future = GetFreshnessStatsAsync();
             return result_future.get(); // Wait for the result
         }
         catch (const std::exception &e)
         {
             std::cerr << "GetFreshnessStats failed: " << e.what() << std::endl;
-            return std::make_tuple(-1, -1); // Return error values
+            FreshnessStats stats; // Return error values
+            stats.invalidates = -1;
+            stats.updates = -1;
+            return stats;
         }
     }
 
@@ -1109,6 +1306,24 @@ public:
         return tracker_;
     }
 
+    // Completed Gets are checked against version_tracker.
+    void SetVersionTracker(VersionTracker *version_tracker)
+    {
+        version_tracker_ = version_tracker;
+    }
+
+    // Sets from now on compress values as config says.
+    void SetCompression(const CompressionConfig &config)
+    {
+        compression_ = config;
+    }
+
+    // Value bytes received by Gets, before decompression.
+    long GetValueBytesReceived() const
+    {
+        return value_bytes_received_.load();
+    }
+
     int get_current_rpcs() { return current_rpcs.load(); }
     // Function to calculate average latency
     double GetAverageLatency()
@@ -1129,6 +1344,16 @@ public:
         return static_cast<double>(total_latency) / latencies_.size();
     }
 
+    // Get latencies in microseconds.
+    LatencyHistogram GetLatencyHistogram()
+    {
+        std::lock_guard<std::mutex> lock(latency_mutex_);
+        LatencyHistogram histogram;
+        for (long latency : latencies_)
+            histogram.Record(latency);
+        return histogram;
+    }
+
 private:
     // Struct to keep state and data information for the asynchronous calls
 
@@ -1159,6 +1384,7 @@ private:
         CacheGetResponse get_reply;
         std::unique_ptr<grpc::ClientAsyncResponseReader<CacheGetResponse>> get_response_reader;
         std::shared_ptr<std::promise<std::string>> get_promise;
+        uint64_t expected_version = 0; // Latest acknowledged write when the Get was sent.
 
         // For SetAsync
         CacheSetResponse set_reply;
@@ -1188,9 +1414,13 @@ private:
         // For GetFreshnessStats
         CacheGetFreshnessStatsResponse get_freshness_stats_reply;
         std::unique_ptr<grpc::ClientAsyncResponseReader<CacheGetFreshnessStatsResponse>> get_freshness_stats_response_reader;
-        std::shared_ptr<std::promise<std::tuple<int, int>>> get_freshness_stats_promise;
+        std::shared_ptr<std::promise<FreshnessStats>> get_freshness_stats_promise;
         std::chrono::steady_clock::time_point start_time;
 
+        // Non-zero when this request is sampled for tracing.
+        uint64_t trace_id = 0;
+        uint64_t trace_start = 0;
+
         grpc::ClientContext context;
         grpc::Status status;
     };
@@ -1199,6 +1429,9 @@ private:
     grpc::CompletionQueue cq_;
     std::thread cq_thread_;
 
+    CompressionConfig compression_;
+    std::atomic<long> value_bytes_received_{0};
+
 #ifdef USE_RPC_LIMIT
     std::mutex mutex_;
     std::condition_variable cv_;
@@ -1227,6 +1460,7 @@ private:
     }
 
     Tracker *tracker_ = nullptr;
+    VersionTracker *version_tracker_ = nullptr;
 
     // std::queue<std::function<void()>> task_queue;
     // std::mutex task_mutex;
@@ -1269,9 +1503,10 @@ private:
     {
         void *got_tag;
         bool ok = false;
+        pthread_setname_np(pthread_self(), "cache-cq");
 
         size_t num_worker_threads = std::thread::hardware_concurrency() * 2;
-        ThreadPool thread_pool(num_worker_threads);
+        WorkStealingPool thread_pool(num_worker_threads);
 
         while (cq_.Next(&got_tag, &ok))
         {
@@ -1287,9 +1522,21 @@ private:
                 }
             }
 
+            uint64_t dequeued = 0;
+            tracing::Op op = call->call_type == AsyncClientCall::CallType::GET   ? tracing::OP_GET
+                             : call->call_type == AsyncClientCall::CallType::SET ? tracing::OP_SET
+                                                                                 : tracing::OP_OTHER;
+            if (call->trace_id != 0)
+            {
+                dequeued = tracing::Now();
+                tracing::Record(call->trace_id, tracing::Stage::CLIENT_RPC, call->trace_start, dequeued, op);
+            }
+
             // Offload the status check and promise handling to a worker thread
-            thread_pool.enqueue([call, ok, this]() mutable
+            thread_pool.post([call, ok, this, dequeued, op]() mutable
                                 {
+                if (call->trace_id != 0)
+                    tracing::Record(call->trace_id, tracing::Stage::CLIENT_DISPATCH, dequeued, tracing::Now(), op);
                 try
                 {
                     if (call->status.ok())
@@ -1299,7 +1546,11 @@ private:
                         switch (call->call_type)
                         {
                         case AsyncClientCall::CallType::GET:
-                            call->get_promise->set_value(call->get_reply.value());
+                            if (version_tracker_)
+                                version_tracker_->OnRead(call->expected_version, call->get_reply.version());
+                            value_bytes_received_ += call->get_reply.value().size();
+                            call->get_promise->set_value(decoded_value(VersionedValue{
+                                std::move(*call->get_reply.mutable_value()), call->get_reply.version(), call->get_reply.compressed()}));
                             break;
                         case AsyncClientCall::CallType::SET:
                             call->set_promise->set_value(call->set_reply.success());
@@ -1317,9 +1568,15 @@ private:
                             call->get_mr_promise->set_value(call->get_mr_reply.mr());
                             break;
                         case AsyncClientCall::CallType::GETFRESHNESSSTATS:
-                            int invalidates = call->get_freshness_stats_reply.num_invalidates();
-                            int updates = call->get_freshness_stats_reply.num_updates();
-                            call->get_freshness_stats_promise->set_value(std::make_tuple(invalidates, updates));
+                            FreshnessStats stats;
+                            const auto &reply = call->get_freshness_stats_reply;
+                            stats.invalidates = reply.num_invalidates();
+                            stats.updates = reply.num_updates();
+                            stats.adaptive_fills = reply.num_adaptive_fills();
+                            stats.adaptive_bypassed = reply.num_adaptive_bypassed();
+                            stats.mean_ttl = reply.mean_ttl();
+                            stats.estimated_stale_ratio = reply.estimated_stale_ratio();
+                            call->get_freshness_stats_promise->set_value(stats);
                             break;
                         }
                     }
@@ -1408,7 +1665,8 @@ public:
         memcached_pool_push(pool, memc);
     }
 
-    Client(std::string cache_address, std::string db_address, int num_connections, Tracker *tracker)
+    Client(std::string cache_address, std::string db_address, int num_connections, Tracker *tracker,
+           const std::string &memcached_address = "localhost:11211")
         : cache_client_(new CacheClient(cache_address, num_connections)),
           db_client_(new DBClient(db_address, num_connections))
     {
@@ -1418,14 +1676,14 @@ public:
             db_client_->SetTracker(tracker);
         }
         // memc = create_mc();
-        const char *config_string =
-            "--SERVER=localhost:11211";
+        std::string config_string = "--SERVER=" + memcached_address;
 
-        pool = memcached_pool(config_string, strlen(config_string));
+        pool = memcached_pool(config_string.c_str(), config_string.size());
         assert(pool != nullptr);
     }
 
-    Client(std::shared_ptr<Channel> cache_channel, std::shared_ptr<Channel> db_channel, Tracker *tracker)
+    Client(std::shared_ptr<Channel> cache_channel, std::shared_ptr<Channel> db_channel, Tracker *tracker,
+           const std::string &memcached_address = "localhost:11211")
         : cache_client_(new CacheClient(cache_channel)),
           db_client_(new DBClient(db_channel))
     {
@@ -1435,10 +1693,9 @@ public:
             db_client_->SetTracker(tracker);
         }
         // memc = create_mc();
-        const char *config_string =
-            "--SERVER=localhost:11211";
+        std::string config_string = "--SERVER=" + memcached_address;
 
-        pool = memcached_pool(config_string, strlen(config_string));
+        pool = memcached_pool(config_string.c_str(), config_string.size());
         assert(pool != nullptr);
     }
 
@@ -1462,14 +1719,14 @@ public:
         return db_client_->Get(key);
     }
 
-    void SetAsync(const std::string &key, const std::string &value, int ttl, float ew)
+    void SetAsync(const std::string &key, std::string_view value, int ttl, float ew)
     {
         if (get_tracker())
             get_tracker()->write(key);
         db_client_->AsyncPut(key, value, ew);
     }
 
-    bool Set(const std::string &key, const std::string &value, int ttl, float ew)
+    bool Set(const std::string &key, std::string_view value, int ttl, float ew)
     {
         if (get_tracker())
             get_tracker()->write(key);
@@ -1486,7 +1743,7 @@ public:
         return true;
     }
 
-    bool SetWarm(const std::string &key, const std::string &value, int ttl)
+    bool SetWarm(const std::string &key, std::string_view value, int ttl)
     {
         // Call Put method on DBClient to store data
         bool db_result = db_client_->PutWarm(key, value);
@@ -1499,11 +1756,11 @@ public:
         return true;
     }
 
-    void SetTTL(const int32_t &ttl)
+    void SetTTL(const int32_t &ttl, const AdaptiveTTLConfig &adaptive = AdaptiveTTLConfig())
     {
         ttl_ = ttl;
 
-        cache_client_->SetTTL(ttl);
+        cache_client_->SetTTL(ttl, adaptive);
     }
 
     float GetMR(void)
@@ -1511,7 +1768,7 @@ public:
         return cache_client_->GetMR();
     }
 
-    std::tuple<int, int> GetFreshnessStats(void)
+    FreshnessStats GetFreshnessStats(void)
     {
         return cache_client_->GetFreshnessStats();
     }
@@ -1526,7 +1783,7 @@ public:
         return db_client_->StartRecord();
     }
 
-    bool SetCache(const std::string &key, const std::string &value, int ttl)
+    bool SetCache(const std::string &key, std::string_view value, int ttl)
     {
         return cache_client_->Set(key, value, ttl);
     }
@@ -1556,9 +1813,45 @@ public:
         return db_client_->GetAverageLatency();
     }
 
+    // Count cache reads that return a version older than the latest write
+    // the DB had acknowledged when the read was sent. Only writes from now
+    // on are tracked, so enable it after warm-up.
+    void EnableStaleCheck(void)
+    {
+        if (!version_tracker_)
+            version_tracker_.reset(new VersionTracker());
+        db_client_->SetVersionTracker(version_tracker_.get());
+        cache_client_->SetVersionTracker(version_tracker_.get());
+    }
+
+    bool stale_check_enabled(void) const
+    {
+        return version_tracker_ != nullptr;
+    }
+
+    // Compress values over config.threshold once, when they are written;
+    // they stay compressed in the DB and memcached and are decompressed
+    // when read back here.
+    void SetCompression(const CompressionConfig &config)
+    {
+        db_client_->SetCompression(config);
+        cache_client_->SetCompression(config);
+    }
+
+    long GetStaleReads(void) const
+    {
+        return version_tracker_ ? version_tracker_->stale_reads() : 0;
+    }
+
+    long GetCheckedReads(void) const
+    {
+        return version_tracker_ ? version_tracker_->checked_reads() : 0;
+    }
+
 private:
     DBClient *db_client_;
     CacheClient *cache_client_;
+    std::unique_ptr<VersionTracker> version_tracker_;
     int32_t ttl_;
     memcached_pool_st *pool;
 };
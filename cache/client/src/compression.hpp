@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <zlib.h>
+
+// Optional value compression. A value is compressed once, by the client that
+// writes it, and travels compressed through every hop (client -> DB, DB ->
+// cache update, cache -> memcached, cache -> client) with a flag alongside
+// it: the compressed field in the protos and COMPRESSED_FLAG in the memcached
+// item flags. Only the reading client decompresses.
+//
+// Encoded values are a 4-byte little-endian raw length followed by a zlib
+// stream, so decompression needs a single allocation. The length is capped
+// at MAX_RAW_LENGTH, so a corrupt prefix can't ask for more than that.
+struct CompressionConfig
+{
+    bool enabled = false;
+    size_t threshold = 1024; // Values smaller than this are sent raw.
+    int level = 1;           // zlib level; 1 is the cheapest.
+};
+
+// Process-wide counters for the compression benchmark.
+struct CompressionStats
+{
+    std::atomic<long> compressed{0};
+    std::atomic<long> skipped{0}; // Over the threshold but did not shrink.
+    std::atomic<long> raw_bytes{0};
+    std::atomic<long> encoded_bytes{0};
+    std::atomic<long> compress_ns{0};
+    std::atomic<long> decompressed{0};
+    std::atomic<long> decompress_ns{0};
+};
+
+namespace compression
+{
+    // memcached's default item size limit, above the largest workload value
+    // (MAX_VALUE_SIZE). Larger values are sent raw.
+    constexpr uint32_t MAX_RAW_LENGTH = 1 << 20;
+
+    inline CompressionStats &stats()
+    {
+        static CompressionStats instance;
+        return instance;
+    }
+
+    inline long ElapsedNs(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Encodes value into out if config asks for it and it pays off; false
+    // means value should be sent as is.
+    inline bool Compress(std::string_view value, const CompressionConfig &config, std::string &out)
+    {
+        if (!config.enabled || value.size() < config.threshold || value.size() > MAX_RAW_LENGTH)
+            return false;
+        auto start = std::chrono::steady_clock::now();
+        uLongf bound = compressBound(value.size());
+        out.resize(4 + bound);
+        uint32_t raw_length = static_cast<uint32_t>(value.size());
+        for (int i = 0; i < 4; i++)
+            out[i] = static_cast<char>((raw_length >> (8 * i)) & 0xff);
+        int rc = compress2(reinterpret_cast<Bytef *>(&out[4]), &bound,
+                           reinterpret_cast<const Bytef *>(value.data()), value.size(), config.level);
+        CompressionStats &s = stats();
+        if (rc != Z_OK || 4 + bound >= value.size())
+        {
+            s.skipped++;
+            s.compress_ns += ElapsedNs(start);
+            return false;
+        }
+        out.resize(4 + bound);
+        s.compressed++;
+        s.raw_bytes += value.size();
+        s.encoded_bytes += out.size();
+        s.compress_ns += ElapsedNs(start);
+        return true;
+    }
+
+    // Decodes an encoded value into out; false if it is corrupt or claims
+    // to be longer than MAX_RAW_LENGTH.
+    inline bool Decompress(const std::string &encoded, std::string &out)
+    {
+        if (encoded.size() < 4)
+            return false;
+        auto start = std::chrono::steady_clock::now();
+        uint32_t raw_length = 0;
+        for (int i = 0; i < 4; i++)
+            raw_length |= static_cast<uint32_t>(static_cast<unsigned char>(encoded[i])) << (8 * i);
+        if (raw_length > MAX_RAW_LENGTH)
+            return false;
+        out.resize(raw_length);
+        uLongf length = raw_length;
+        int rc = uncompress(reinterpret_cast<Bytef *>(&out[0]), &length,
+                            reinterpret_cast<const Bytef *>(encoded.data() + 4), encoded.size() - 4);
+        stats().decompressed++;
+        stats().decompress_ns += ElapsedNs(start);
+        return rc == Z_OK && length == raw_length;
+    }
+}
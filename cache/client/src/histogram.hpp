@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Log-linear latency histogram in the style of HdrHistogram: values below
+// 2 * SUB_BUCKETS get a bucket each, and every power of two above that is
+// split into SUB_BUCKETS equal buckets, so percentiles are within ~3% of
+// the recorded value at any magnitude. Not thread safe; the clients fill one
+// from their latency vectors under their own lock.
+class LatencyHistogram
+{
+public:
+    void Record(uint64_t value, uint64_t count = 1)
+    {
+        size_t index = Index(value);
+        if (index >= counts_.size())
+            counts_.resize(index + 1, 0);
+        counts_[index] += count;
+        if (count_ == 0 || value < min_)
+            min_ = value;
+        max_ = std::max(max_, value);
+        count_ += count;
+        sum_ += static_cast<double>(value) * count;
+    }
+
+    void Merge(const LatencyHistogram &other)
+    {
+        if (other.count_ == 0)
+            return;
+        if (other.counts_.size() > counts_.size())
+            counts_.resize(other.counts_.size(), 0);
+        for (size_t i = 0; i < other.counts_.size(); i++)
+            counts_[i] += other.counts_[i];
+        min_ = count_ == 0 ? other.min_ : std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+        count_ += other.count_;
+        sum_ += other.sum_;
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t min() const { return min_; }
+    uint64_t max() const { return max_; }
+    double mean() const { return count_ > 0 ? sum_ / count_ : 0; }
+
+    // Smallest bucket upper bound covering a fraction p of the values,
+    // clamped to the largest value seen.
+    uint64_t Percentile(double p) const
+    {
+        if (count_ == 0)
+            return 0;
+        uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * count_)));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); i++)
+        {
+            seen += counts_[i];
+            if (seen >= rank)
+                return std::min(UpperBound(i), max_);
+        }
+        return max_;
+    }
+
+    // (lower bound, count) of every non-empty bucket, in order.
+    std::vector<std::pair<uint64_t, uint64_t>> Buckets() const
+    {
+        std::vector<std::pair<uint64_t, uint64_t>> buckets;
+        for (size_t i = 0; i < counts_.size(); i++)
+        {
+            if (counts_[i] > 0)
+                buckets.emplace_back(LowerBound(i), counts_[i]);
+        }
+        return buckets;
+    }
+
+private:
+    static const int SUB_BUCKET_BITS = 5;
+    static const uint64_t SUB_BUCKETS = 1ull << SUB_BUCKET_BITS;
+
+    static size_t Index(uint64_t value)
+    {
+        if (value < 2 * SUB_BUCKETS)
+            return static_cast<size_t>(value);
+        int shift = (63 - __builtin_clzll(value)) - SUB_BUCKET_BITS;
+        return static_cast<size_t>(shift * SUB_BUCKETS + (value >> shift));
+    }
+
+    static uint64_t LowerBound(size_t index)
+    {
+        if (index < 2 * SUB_BUCKETS)
+            return index;
+        uint64_t shift = index / SUB_BUCKETS - 1;
+        return (index % SUB_BUCKETS + SUB_BUCKETS) << shift;
+    }
+
+    static uint64_t UpperBound(size_t index)
+    {
+        return LowerBound(index + 1) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_ = 0;
+    uint64_t min_ = 0;
+    uint64_t max_ = 0;
+    double sum_ = 0;
+};
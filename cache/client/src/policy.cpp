@@ -2,6 +2,87 @@
 #include <iostream>
 #include <shared_mutex> // C++17
 #include <mutex>
+#include <chrono>
+
+// How many keys ahead of the current one a batch prefetches sketch counters.
+static const size_t PREFETCH_DISTANCE = 4;
+
+// Hash every key of a batch up front, outside of the tracker lock.
+static std::vector<size_t> hash_keys(const std::vector<std::string> &keys)
+{
+    std::vector<size_t> hashes;
+    hashes.reserve(keys.size());
+    for (const auto &key : keys)
+        hashes.push_back(hashKey(key));
+    return hashes;
+}
+
+// Ratio of writes to reads reported by the sketch trackers; -1 asks for an invalidate.
+static double sketch_ew(int write_count, int read_count)
+{
+    if (read_count == 0 || write_count == 0)
+        return -1;
+    return static_cast<double>(write_count) / static_cast<double>(read_count);
+}
+
+static double elapsed_ms(std::chrono::high_resolution_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> latency = std::chrono::high_resolution_clock::now() - start;
+    return latency.count();
+}
+
+// The two sketch kinds behind one interface for the batch helpers below.
+static void sketch_add(TopKSketch &sketch, const std::string &key, size_t h) { sketch.increment(key, h); }
+static void sketch_add(CountMinSketch &sketch, const std::string &, size_t h) { sketch.increment_hashed(h); }
+static int sketch_count(const TopKSketch &sketch, const std::string &key, size_t h) { return sketch.getCount(key, h); }
+static int sketch_count(const CountMinSketch &sketch, const std::string &, size_t h) { return sketch.estimate_hashed(h); }
+
+// Counts a batch of keys into one sketch of a tracker. Keys are hashed before
+// taking the lock, counters are prefetched a few keys ahead, and the latency
+// totals are updated before the lock is released, as in the per-key calls.
+template <typename Sketch>
+static void sketch_add_batch(std::shared_mutex &mutex, Sketch &sketch, const std::vector<std::string> &keys,
+                             double &latency_ms, size_t &calls)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<size_t> hashes = hash_keys(keys);
+    std::unique_lock lock(mutex);
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        if (i + PREFETCH_DISTANCE < keys.size())
+            sketch.prefetch(hashes[i + PREFETCH_DISTANCE]);
+        sketch_add(sketch, keys[i], hashes[i]);
+    }
+    latency_ms += elapsed_ms(start);
+    calls += keys.size();
+}
+
+// get_ew for a batch of keys from a tracker's write and read sketches. The
+// lookups share the lock; the latency totals are updated under it exclusively.
+template <typename Sketch>
+static void sketch_ew_batch(std::shared_mutex &mutex, const Sketch &write_sketch, const Sketch &read_sketch,
+                            const std::vector<std::string> &keys, std::vector<double> &ews,
+                            double &latency_ms, size_t &calls)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<size_t> hashes = hash_keys(keys);
+    ews.resize(keys.size());
+    {
+        std::shared_lock lock(mutex);
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            if (i + PREFETCH_DISTANCE < keys.size())
+            {
+                write_sketch.prefetch(hashes[i + PREFETCH_DISTANCE]);
+                read_sketch.prefetch(hashes[i + PREFETCH_DISTANCE]);
+            }
+            ews[i] = sketch_ew(sketch_count(write_sketch, keys[i], hashes[i]), sketch_count(read_sketch, keys[i], hashes[i]));
+        }
+    }
+    std::unique_lock lock(mutex);
+    latency_ms += elapsed_ms(start);
+    calls += keys.size();
+}
 
 void EveryKeyTracker::write(const std::string &key)
 {
@@ -71,6 +152,51 @@ size_t EveryKeyTracker::get_storage_overhead(void) const
     return overhead;
 }
 
+void EveryKeyTracker::write_batch(const std::vector<std::string> &keys)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    std::unique_lock lock(mutex_);
+    for (const auto &key : keys)
+        data_[key].numWrites += 1;
+    write_latency_ += elapsed_ms(start);
+    write_count_ += keys.size();
+}
+
+void EveryKeyTracker::read_batch(const std::vector<std::string> &keys)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    std::unique_lock lock(mutex_);
+    for (const auto &key : keys)
+    {
+        auto &entry = data_[key];
+        if (entry.numSamples == 0)
+        {
+            entry.expectedWrites = entry.numWrites;
+            entry.numSamples += 1;
+            entry.numWrites = 0;
+        }
+        else if (entry.numWrites > 0)
+        {
+            entry.expectedWrites = (entry.expectedWrites * entry.numSamples + entry.numWrites) / (entry.numSamples + 1);
+            entry.numSamples += 1;
+            entry.numWrites = 0;
+        }
+    }
+    read_latency_ += elapsed_ms(start);
+    read_count_ += keys.size();
+}
+
+void EveryKeyTracker::get_ew_batch(const std::vector<std::string> &keys, std::vector<double> &ews)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    ews.resize(keys.size());
+    std::unique_lock lock(mutex_);
+    for (size_t i = 0; i < keys.size(); ++i)
+        ews[i] = data_[keys[i]].expectedWrites;
+    get_ew_latency_ += elapsed_ms(start);
+    get_ew_count_ += keys.size();
+}
+
 void TopKSketchTracker::write(const std::string &key)
 {
     // std::cout << "Tracker write: " << key << std::endl;
@@ -131,6 +257,21 @@ size_t TopKSketchTracker::get_storage_overhead(void) const
     return read_sketch_.get_storage_overhead() + write_sketch_.get_storage_overhead();
 }
 
+void TopKSketchTracker::write_batch(const std::vector<std::string> &keys)
+{
+    sketch_add_batch(mutex_, write_sketch_, keys, write_latency_, write_count_);
+}
+
+void TopKSketchTracker::read_batch(const std::vector<std::string> &keys)
+{
+    sketch_add_batch(mutex_, read_sketch_, keys, read_latency_, read_count_);
+}
+
+void TopKSketchTracker::get_ew_batch(const std::vector<std::string> &keys, std::vector<double> &ews)
+{
+    sketch_ew_batch(mutex_, write_sketch_, read_sketch_, keys, ews, get_ew_latency_, get_ew_count_);
+}
+
 void MinSketchTracker::write(const std::string &key)
 {
     auto start = std::chrono::high_resolution_clock::now();
@@ -188,6 +329,21 @@ size_t MinSketchTracker::get_storage_overhead(void) const
     return read_sketch_.get_storage_overhead() + write_sketch_.get_storage_overhead();
 }
 
+void MinSketchTracker::write_batch(const std::vector<std::string> &keys)
+{
+    sketch_add_batch(mutex_, write_sketch_, keys, write_latency_, write_count_);
+}
+
+void MinSketchTracker::read_batch(const std::vector<std::string> &keys)
+{
+    sketch_add_batch(mutex_, read_sketch_, keys, read_latency_, read_count_);
+}
+
+void MinSketchTracker::get_ew_batch(const std::vector<std::string> &keys, std::vector<double> &ews)
+{
+    sketch_ew_batch(mutex_, write_sketch_, read_sketch_, keys, ews, get_ew_latency_, get_ew_count_);
+}
+
 void ExactRWTracker::write(const std::string &key)
 {
     auto start = std::chrono::high_resolution_clock::now();
@@ -242,6 +398,43 @@ size_t ExactRWTracker::get_storage_overhead(void) const
     return overhead;
 }
 
+void ExactRWTracker::write_batch(const std::vector<std::string> &keys)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    std::unique_lock lock(mutex_);
+    for (const auto &key : keys)
+        data_[key].numWrites += 1;
+    write_latency_ += elapsed_ms(start);
+    write_count_ += keys.size();
+}
+
+void ExactRWTracker::read_batch(const std::vector<std::string> &keys)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    std::unique_lock lock(mutex_);
+    for (const auto &key : keys)
+        data_[key].numReads += 1;
+    read_latency_ += elapsed_ms(start);
+    read_count_ += keys.size();
+}
+
+void ExactRWTracker::get_ew_batch(const std::vector<std::string> &keys, std::vector<double> &ews)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    ews.resize(keys.size());
+    std::unique_lock lock(mutex_);
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        auto &entry = data_[keys[i]];
+        if (entry.numReads == 0 || entry.numWrites == 0)
+            ews[i] = -1;
+        else
+            ews[i] = entry.numWrites / entry.numReads;
+    }
+    get_ew_latency_ += elapsed_ms(start);
+    get_ew_count_ += keys.size();
+}
+
 void TopKSketchSampleTracker::write(const std::string &key)
 {
     // std::cout << "Tracker write: " << key << std::endl;
@@ -299,4 +492,19 @@ size_t TopKSketchSampleTracker::get_storage_overhead(void) const
 {
     std::shared_lock lock(mutex_);
     return read_sketch_.get_storage_overhead() + write_sketch_.get_storage_overhead();
-}
\ No newline at end of file
+}
+
+void TopKSketchSampleTracker::write_batch(const std::vector<std::string> &keys)
+{
+    sketch_add_batch(mutex_, write_sketch_, keys, write_latency_, write_count_);
+}
+
+void TopKSketchSampleTracker::read_batch(const std::vector<std::string> &keys)
+{
+    sketch_add_batch(mutex_, read_sketch_, keys, read_latency_, read_count_);
+}
+
+void TopKSketchSampleTracker::get_ew_batch(const std::vector<std::string> &keys, std::vector<double> &ews)
+{
+    sketch_ew_batch(mutex_, write_sketch_, read_sketch_, keys, ews, get_ew_latency_, get_ew_count_);
+}
@@ -23,11 +23,32 @@
 class Tracker
 {
 public:
+    virtual ~Tracker() = default;
     virtual void write(const std::string &key) = 0;
     virtual void read(const std::string &key) = 0;
     virtual double get_ew(const std::string &key) = 0;
     virtual size_t get_storage_overhead(void) const = 0;
     virtual void update(int num_keys) = 0;
+
+    // Batched variants: implementations hash each key once and take the
+    // lock once per batch. The defaults fall back to the per-key calls.
+    virtual void write_batch(const std::vector<std::string> &keys)
+    {
+        for (const auto &key : keys)
+            write(key);
+    }
+    virtual void read_batch(const std::vector<std::string> &keys)
+    {
+        for (const auto &key : keys)
+            read(key);
+    }
+    virtual void get_ew_batch(const std::vector<std::string> &keys, std::vector<double> &ews)
+    {
+        ews.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i)
+            ews[i] = get_ew(keys[i]);
+    }
+
     // New method to report average latencies
     void report_latencies() const
     {
@@ -68,6 +89,9 @@ public:
     void read(const std::string &key) override;
     double get_ew(const std::string &key) override;
     size_t get_storage_overhead(void) const override;
+    void write_batch(const std::vector<std::string> &keys) override;
+    void read_batch(const std::vector<std::string> &keys) override;
+    void get_ew_batch(const std::vector<std::string> &keys, std::vector<double> &ews) override;
     void update(int num_keys) override {};
 
 private:
@@ -88,6 +112,14 @@ hashFunction(const std::string &key, size_t seed)
     return hasher(key) + seed;
 }
 
+// Base hash of a key; row i of a sketch uses hashKey(key) + i, which is
+// what hashFunction(key, i) computes, without rehashing the string per row.
+inline size_t
+hashKey(const std::string &key)
+{
+    return std::hash<std::string>{}(key);
+}
+
 class CountMinSketch
 {
 public:
@@ -114,14 +146,21 @@ public:
     // Increment the count for a key
     void increment(const std::string &key, int count = 1)
     {
-        int min_idx = 0;
+        increment_hashed(hashKey(key), count);
+    }
+
+    void increment_hashed(size_t h, int count = 1)
+    {
+        size_t min_row = 0;
+        size_t min_idx = 0;
         int min_count = 1e9;
         for (size_t i = 0; i < depth_; ++i)
         {
-            size_t idx = hashFunction(key, i) % width_;
+            size_t idx = (h + i) % width_;
             if (sketch_[i][idx] < min_count)
             {
-                min_idx = i;
+                min_row = i;
+                min_idx = idx;
                 min_count = sketch_[i][idx];
             }
             if (!conservative_)
@@ -129,31 +168,48 @@ public:
         }
 
         if (conservative_)
-            sketch_[min_idx][min_count] += count;
+            sketch_[min_row][min_idx] += count;
     }
 
     void decrement(const std::string &key, int count = 1)
+    {
+        decrement_hashed(hashKey(key), count);
+    }
+
+    void decrement_hashed(size_t h, int count = 1)
     {
         assert(!conservative_);
         for (size_t i = 0; i < depth_; ++i)
         {
-            size_t idx = hashFunction(key, i) % width_;
+            size_t idx = (h + i) % width_;
             sketch_[i][idx] -= count;
         }
     }
 
     // Estimate the count for a key
     int estimate(const std::string &key) const
+    {
+        return estimate_hashed(hashKey(key));
+    }
+
+    int estimate_hashed(size_t h) const
     {
         int minCount = std::numeric_limits<int>::max();
         for (size_t i = 0; i < depth_; ++i)
         {
-            size_t idx = hashFunction(key, i) % width_;
+            size_t idx = (h + i) % width_;
             minCount = std::min(minCount, sketch_[i][idx]);
         }
         return minCount;
     }
 
+    // Pull the counters of a key into cache ahead of a batched update.
+    void prefetch(size_t h) const
+    {
+        for (size_t i = 0; i < depth_; ++i)
+            __builtin_prefetch(&sketch_[i][(h + i) % width_]);
+    }
+
     size_t get_storage_overhead() const
     {
         return sizeof(sketch_) + (depth_ * width_ * sizeof(int));
@@ -275,16 +331,23 @@ public:
 
     // Increment the count for a key
     void increment(const std::string &key)
+    {
+        increment(key, hashKey(key));
+    }
+
+    // Same as above with the key's hashKey() already computed.
+    void increment(const std::string &key, size_t h)
     {
         // Hot key - only increment topK
-        if (topKMap_.find(key) != topKMap_.end())
+        auto it = topKMap_.find(key);
+        if (it != topKMap_.end())
         {
-            topKMap_[key] += 1;
+            it->second += 1;
         }
         else if (minHeap_.size() < k_)
         {
-            int count = countMinSketch_.estimate(key);
-            countMinSketch_.decrement(key, count);
+            int count = countMinSketch_.estimate_hashed(h);
+            countMinSketch_.decrement_hashed(h, count);
 
             count += 1;
             topKMap_[key] = count;
@@ -292,7 +355,7 @@ public:
         }
         else
         {
-            int count = countMinSketch_.estimate(key);
+            int count = countMinSketch_.estimate_hashed(h);
             /* Count >= minHeap top */
             if (count >= minHeap_.top().first)
             {
@@ -304,7 +367,7 @@ public:
                 countMinSketch_.increment(minKey, minKeycount);
 
                 // Insert the new key
-                countMinSketch_.decrement(key, count);
+                countMinSketch_.decrement_hashed(h, count);
                 count += 1;
                 topKMap_[key] = count;
                 minHeap_.emplace(count, key);
@@ -312,13 +375,18 @@ public:
             /* Count < minheap top. */
             else
             {
-                countMinSketch_.increment(key);
+                countMinSketch_.increment_hashed(h);
             }
         }
     }
 
     // Get the count for a key (returns -1 if not found in the top K)
     int getCount(const std::string &key) const
+    {
+        return getCount(key, hashKey(key));
+    }
+
+    int getCount(const std::string &key, size_t h) const
     {
         auto it = topKMap_.find(key);
         if (it != topKMap_.end())
@@ -328,10 +396,15 @@ public:
         // Not in the top K
         // Get it from countMin.
         if (!negative_)
-            return countMinSketch_.estimate(key);
+            return countMinSketch_.estimate_hashed(h);
         return 0;
     }
 
+    void prefetch(size_t h) const
+    {
+        countMinSketch_.prefetch(h);
+    }
+
     size_t get_storage_overhead() const
     {
         // std::cout << "countMinSketch: " << countMinSketch_.get_storage_overhead();
@@ -384,6 +457,9 @@ public:
     void read(const std::string &key) override;
     double get_ew(const std::string &key) override;
     size_t get_storage_overhead(void) const override;
+    void write_batch(const std::vector<std::string> &keys) override;
+    void read_batch(const std::vector<std::string> &keys) override;
+    void get_ew_batch(const std::vector<std::string> &keys, std::vector<double> &ews) override;
 
     std::string is_in_topK(std::string key) override
     {
@@ -413,6 +489,9 @@ public:
     void read(const std::string &key) override;
     double get_ew(const std::string &key) override;
     size_t get_storage_overhead(void) const override;
+    void write_batch(const std::vector<std::string> &keys) override;
+    void read_batch(const std::vector<std::string> &keys) override;
+    void get_ew_batch(const std::vector<std::string> &keys, std::vector<double> &ews) override;
 
 private:
     mutable std::shared_mutex mutex_; // Mutex to protect read/write access
@@ -446,6 +525,9 @@ public:
     void read(const std::string &key) override;
     double get_ew(const std::string &key) override;
     size_t get_storage_overhead(void) const override;
+    void write_batch(const std::vector<std::string> &keys) override;
+    void read_batch(const std::vector<std::string> &keys) override;
+    void get_ew_batch(const std::vector<std::string> &keys, std::vector<double> &ews) override;
     void update(int num_keys) override {};
 
 private:
@@ -473,6 +555,9 @@ public:
     void read(const std::string &key) override;
     double get_ew(const std::string &key) override;
     size_t get_storage_overhead(void) const override;
+    void write_batch(const std::vector<std::string> &keys) override;
+    void read_batch(const std::vector<std::string> &keys) override;
+    void get_ew_batch(const std::vector<std::string> &keys, std::vector<double> &ews) override;
 
     std::string is_in_topK(std::string key) override
     {
@@ -0,0 +1,739 @@
+#include "telemetry.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+#include "client.hpp"
+
+namespace
+{
+
+    // Splits on sep, dropping empty pieces.
+    std::vector<std::string> split(const std::string &s, char sep)
+    {
+        std::vector<std::string> out;
+        size_t begin = 0;
+        while (begin <= s.size())
+        {
+            size_t end = s.find(sep, begin);
+            if (end == std::string::npos)
+                end = s.size();
+            if (end > begin)
+                out.push_back(s.substr(begin, end - begin));
+            begin = end + 1;
+        }
+        return out;
+    }
+
+    bool matches(const std::vector<std::string> &names, std::string_view name)
+    {
+        for (const std::string &n : names)
+        {
+            if (n == "*" || n == name)
+                return true;
+        }
+        return false;
+    }
+
+    // Cursor over a /proc buffer; replaces the istringstream parsing.
+    struct Scanner
+    {
+        const char *p;
+        const char *end;
+
+        explicit Scanner(std::string_view s) : p(s.data()), end(s.data() + s.size()) {}
+
+        bool done() const { return p >= end; }
+
+        void skip_spaces()
+        {
+            while (p < end && (*p == ' ' || *p == '\t'))
+                ++p;
+        }
+
+        uint64_t number()
+        {
+            skip_spaces();
+            uint64_t value = 0;
+            while (p < end && *p >= '0' && *p <= '9')
+                value = value * 10 + (*p++ - '0');
+            return value;
+        }
+
+        std::string_view word()
+        {
+            skip_spaces();
+            const char *begin = p;
+            while (p < end && *p != ' ' && *p != '\t' && *p != '\n')
+                ++p;
+            return std::string_view(begin, p - begin);
+        }
+
+        void next_line()
+        {
+            while (p < end && *p != '\n')
+                ++p;
+            if (p < end)
+                ++p;
+        }
+    };
+
+    // utime + stime from a /proc/<pid>/stat or /proc/<pid>/task/<tid>/stat
+    // line. The comm field may contain spaces, so start after the last ')'.
+    uint64_t parse_stat_ticks(std::string_view stat, std::string *name = nullptr)
+    {
+        size_t open = stat.find('(');
+        size_t close = stat.rfind(')');
+        if (open == std::string_view::npos || close == std::string_view::npos || close < open)
+            return 0;
+        if (name != nullptr)
+            name->assign(stat.substr(open + 1, close - open - 1));
+
+        // Fields after comm: state(3) ... utime(14) stime(15).
+        Scanner s(stat.substr(close + 1));
+        s.word(); // state
+        for (int field = 4; field < 14; field++)
+            s.word();
+        uint64_t utime = s.number();
+        uint64_t stime = s.number();
+        return utime + stime;
+    }
+
+    uint64_t now_realtime_ns()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+    }
+
+    std::string format_time(uint64_t timestamp_ns)
+    {
+        std::time_t seconds = timestamp_ns / 1000000000ull;
+        char buffer[30];
+        strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M:%S", std::localtime(&seconds));
+        return std::string(buffer);
+    }
+
+    int open_perf_counter(int tid, uint32_t type, uint64_t config)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return syscall(SYS_perf_event_open, &attr, tid, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+
+    uint64_t read_perf_counter(int fd)
+    {
+        uint64_t value = 0;
+        if (fd < 0 || pread(fd, &value, sizeof(value), 0) != sizeof(value))
+            return 0;
+        return value;
+    }
+
+    void write_all(int fd, const std::string &data)
+    {
+        size_t done = 0;
+        while (done < data.size())
+        {
+            ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                std::cerr << "Error: telemetry write failed: " << strerror(errno) << std::endl;
+                return;
+            }
+            done += n;
+        }
+    }
+
+    float percent(uint64_t part, uint64_t total)
+    {
+        return total == 0 ? 0.0f : float(double(part) / double(total) * 100);
+    }
+
+} // namespace
+
+bool TelemetryConfig::Parse(const std::string &spec, TelemetryConfig &config)
+{
+    for (const std::string &item : split(spec, ','))
+    {
+        size_t eq = item.find('=');
+        std::string key = item.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : item.substr(eq + 1);
+
+        if (key == "perf")
+        {
+            config.perf_counters = value.empty() || value == "1" || value == "on";
+            continue;
+        }
+        if (value.empty())
+            return false;
+
+        if (key == "interval")
+        {
+            // <n>us, <n>ms or <n>s; a bare number is milliseconds.
+            char *unit;
+            double n = strtod(value.c_str(), &unit);
+            double us;
+            if (strcmp(unit, "us") == 0)
+                us = n;
+            else if (strcmp(unit, "ms") == 0 || *unit == '\0')
+                us = n * 1000;
+            else if (strcmp(unit, "s") == 0)
+                us = n * 1000000;
+            else
+                return false;
+            if (us < 1000)
+                return false;
+            config.interval = std::chrono::microseconds((long long)us);
+        }
+        else if (key == "format")
+        {
+            if (value == "text")
+                config.format = TelemetryFormat::TEXT;
+            else if (value == "csv")
+                config.format = TelemetryFormat::CSV;
+            else if (value == "binary")
+                config.format = TelemetryFormat::BINARY;
+            else
+                return false;
+        }
+        else if (key == "net")
+            config.interfaces = split(value, '+');
+        else if (key == "disk")
+            config.devices = split(value, '+');
+        else if (key == "threads")
+            config.thread_prefixes = split(value, '+');
+        else if (key == "ring")
+        {
+            config.ring_capacity = strtoul(value.c_str(), nullptr, 10);
+            if (config.ring_capacity < 2)
+                return false;
+        }
+        else
+            return false;
+    }
+    return true;
+}
+
+ProcFile::ProcFile(const std::string &path)
+    : fd_(open(path.c_str(), O_RDONLY | O_CLOEXEC)), buffer_(4096)
+{
+}
+
+ProcFile::~ProcFile()
+{
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+ProcFile::ProcFile(ProcFile &&other) noexcept
+    : fd_(other.fd_), buffer_(std::move(other.buffer_))
+{
+    other.fd_ = -1;
+}
+
+ProcFile &ProcFile::operator=(ProcFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        if (fd_ >= 0)
+            close(fd_);
+        fd_ = other.fd_;
+        buffer_ = std::move(other.buffer_);
+        other.fd_ = -1;
+    }
+    return *this;
+}
+
+std::string_view ProcFile::read()
+{
+    if (fd_ < 0)
+        return std::string_view();
+    for (;;)
+    {
+        ssize_t n = pread(fd_, buffer_.data(), buffer_.size(), 0);
+        if (n < 0)
+            return std::string_view();
+        // A full buffer may mean a truncated file; grow and read again.
+        if ((size_t)n < buffer_.size())
+            return std::string_view(buffer_.data(), n);
+        buffer_.resize(buffer_.size() * 2);
+    }
+}
+
+TelemetrySampler::TelemetrySampler(const std::string &path, const TelemetryConfig &config,
+                                   DBClient *db_client, CacheClient *cache_client)
+    : path_(path), config_(config), db_client_(db_client), cache_client_(cache_client),
+      stat_file_("/proc/stat"), self_stat_file_("/proc/self/stat"),
+      net_file_("/proc/net/dev"), disk_file_("/proc/diskstats"),
+      perf_ok_(config.perf_counters), ticks_per_second_(sysconf(_SC_CLK_TCK)),
+      ring_(config.ring_capacity)
+{
+    // Pick up new threads about once a second.
+    auto per_second = std::chrono::seconds(1) / config_.interval;
+    rescan_every_ = per_second > 1 ? per_second : 1;
+
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+    if (config_.format != TelemetryFormat::TEXT)
+        flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    out_fd_ = open(path_.c_str(), flags, 0644);
+    if (out_fd_ < 0)
+        std::cerr << "Error: Could not open log file " << path_ << std::endl;
+
+    if (config_.format == TelemetryFormat::TEXT)
+        return;
+
+    std::string thread_path = path_ + ".threads";
+    thread_out_fd_ = open(thread_path.c_str(), flags, 0644);
+    if (thread_out_fd_ < 0)
+        std::cerr << "Error: Could not open log file " << thread_path << std::endl;
+
+    if (config_.format == TelemetryFormat::CSV)
+    {
+        pending_ = "timestamp_ns,elapsed_ns,cpu_util,usr,sys,idle,iowait,steal,process_cpu,"
+                   "net_recv_bytes,net_send_bytes,disk_read_bytes,disk_write_bytes,"
+                   "cycles,llc_misses,db_rpcs,cache_rpcs\n";
+        pending_threads_ = "timestamp_ns,tid,name,cpu,cycles,llc_misses\n";
+    }
+    else
+    {
+        TelemetryFileHeader header;
+        memcpy(header.magic, "FCTELEM1", sizeof(header.magic));
+        header.sample_size = sizeof(TelemetrySample);
+        header.thread_sample_size = sizeof(ThreadSample);
+        header.interval_us = config_.interval.count();
+        pending_.append(reinterpret_cast<const char *>(&header), sizeof(header));
+        pending_threads_.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+}
+
+TelemetrySampler::~TelemetrySampler()
+{
+    Stop();
+    for (auto &entry : threads_)
+        CloseThread(entry.second);
+    if (out_fd_ >= 0)
+        close(out_fd_);
+    if (thread_out_fd_ >= 0)
+        close(thread_out_fd_);
+}
+
+void TelemetrySampler::Start()
+{
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stop_ = false;
+    }
+    thread_ = std::thread(&TelemetrySampler::Run, this);
+}
+
+void TelemetrySampler::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        stop_ = true;
+    }
+    stop_cv_.notify_all();
+    if (thread_.joinable())
+        thread_.join();
+}
+
+std::vector<TelemetrySample> TelemetrySampler::Recent(size_t max_samples) const
+{
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    size_t count = std::min<uint64_t>({max_samples, written_, ring_.size()});
+    std::vector<TelemetrySample> out;
+    out.reserve(count);
+    for (uint64_t i = written_ - count; i < written_; i++)
+        out.push_back(ring_[i % ring_.size()]);
+    return out;
+}
+
+TelemetrySummary TelemetrySampler::Summary() const
+{
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    TelemetrySummary summary = summary_;
+    if (summary.samples > 0)
+    {
+        summary.mean_cpu_util /= summary.samples;
+        summary.mean_process_cpu /= summary.samples;
+    }
+    return summary;
+}
+
+void TelemetrySampler::Run()
+{
+    RescanThreads();
+    ReadCounters(previous_);
+    previous_time_ = std::chrono::steady_clock::now();
+
+    // Deadlines advance by a fixed step so sampling cost does not add drift.
+    auto deadline = previous_time_;
+    std::vector<ThreadSample> threads;
+    for (;;)
+    {
+        deadline += config_.interval;
+        {
+            std::unique_lock<std::mutex> lock(stop_mutex_);
+            if (stop_cv_.wait_until(lock, deadline, [this]()
+                                    { return stop_; }))
+                break;
+        }
+
+        if (++samples_since_rescan_ >= rescan_every_)
+        {
+            samples_since_rescan_ = 0;
+            RescanThreads();
+        }
+
+        TelemetrySample sample;
+        TakeSample(sample, threads);
+        Write(sample, threads);
+
+        // Write out half a ring at a time, and at least once a second.
+        if (written_ - flushed_ >= std::max<size_t>(1, ring_.size() / 2) || samples_since_rescan_ == 0)
+            Flush();
+    }
+    Flush();
+}
+
+void TelemetrySampler::ReadCounters(Counters &counters)
+{
+    {
+        Scanner s(stat_file_.read());
+        if (s.word() == "cpu")
+        {
+            counters.cpu.user = s.number();
+            counters.cpu.nice = s.number();
+            counters.cpu.system = s.number();
+            counters.cpu.idle = s.number();
+            counters.cpu.iowait = s.number();
+            counters.cpu.irq = s.number();
+            counters.cpu.softirq = s.number();
+            counters.cpu.steal = s.number();
+        }
+    }
+
+    counters.process_ticks = parse_stat_ticks(self_stat_file_.read());
+
+    {
+        // Two header lines, then "iface: rx_bytes ... (8 rx fields) tx_bytes ...".
+        counters.net_recv = counters.net_send = 0;
+        Scanner s(net_file_.read());
+        s.next_line();
+        s.next_line();
+        while (!s.done())
+        {
+            s.skip_spaces();
+            const char *begin = s.p;
+            while (s.p < s.end && *s.p != ':' && *s.p != '\n')
+                ++s.p;
+            std::string_view iface(begin, s.p - begin);
+            if (s.p < s.end && *s.p == ':')
+                ++s.p;
+            uint64_t recv = s.number();
+            for (int i = 0; i < 7; i++)
+                s.number();
+            uint64_t send = s.number();
+            if (matches(config_.interfaces, iface))
+            {
+                counters.net_recv += recv;
+                counters.net_send += send;
+            }
+            s.next_line();
+        }
+    }
+
+    {
+        // "major minor name reads merged sectors_read ms writes merged sectors_written ..."
+        counters.disk_read = counters.disk_write = 0;
+        Scanner s(disk_file_.read());
+        while (!s.done())
+        {
+            s.number();
+            s.number();
+            std::string_view device = s.word();
+            s.number();
+            s.number();
+            uint64_t sectors_read = s.number();
+            s.number();
+            s.number();
+            s.number();
+            uint64_t sectors_written = s.number();
+            if (matches(config_.devices, device))
+            {
+                counters.disk_read += sectors_read * 512;
+                counters.disk_write += sectors_written * 512;
+            }
+            s.next_line();
+        }
+    }
+}
+
+bool TelemetrySampler::TrackThread(const std::string &name) const
+{
+    for (const std::string &prefix : config_.thread_prefixes)
+    {
+        if (prefix == "*" || name.compare(0, prefix.size(), prefix) == 0)
+            return true;
+    }
+    return false;
+}
+
+void TelemetrySampler::CloseThread(TrackedThread &thread)
+{
+    if (thread.cycles_fd >= 0)
+        close(thread.cycles_fd);
+    if (thread.llc_fd >= 0)
+        close(thread.llc_fd);
+    thread.cycles_fd = thread.llc_fd = -1;
+}
+
+void TelemetrySampler::RescanThreads()
+{
+    DIR *dir = opendir("/proc/self/task");
+    if (dir == nullptr)
+        return;
+
+    for (auto &entry : threads_)
+        entry.second.seen = false;
+
+    while (struct dirent *entry = readdir(dir))
+    {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9')
+            continue;
+        int tid = atoi(entry->d_name);
+
+        auto it = threads_.find(tid);
+        if (it != threads_.end())
+        {
+            // Threads name themselves after they start; re-check the name.
+            TrackedThread &thread = it->second;
+            thread.seen = true;
+            std::string name;
+            thread.ticks = parse_stat_ticks(thread.stat.read(), &name);
+            if (name != thread.name)
+            {
+                thread.name = name;
+                thread.reported = TrackThread(name);
+            }
+            continue;
+        }
+
+        TrackedThread thread;
+        thread.stat = ProcFile(std::string("/proc/self/task/") + entry->d_name + "/stat");
+        if (!thread.stat.is_open())
+            continue;
+        thread.ticks = parse_stat_ticks(thread.stat.read(), &thread.name);
+        thread.reported = TrackThread(thread.name);
+        thread.seen = true;
+
+        // Counters are per thread: a counter opened for the process only
+        // follows threads created after it.
+        if (perf_ok_)
+        {
+            thread.cycles_fd = open_perf_counter(tid, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+            thread.llc_fd = open_perf_counter(tid, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+            if (thread.cycles_fd < 0 || thread.llc_fd < 0)
+            {
+                std::cerr << "perf_event_open failed (" << strerror(errno)
+                          << "); sampling without hardware counters" << std::endl;
+                CloseThread(thread);
+                perf_ok_ = false;
+                for (auto &other : threads_)
+                    CloseThread(other.second);
+            }
+            thread.cycles = read_perf_counter(thread.cycles_fd);
+            thread.llc_misses = read_perf_counter(thread.llc_fd);
+        }
+        threads_.emplace(tid, std::move(thread));
+    }
+    closedir(dir);
+
+    for (auto it = threads_.begin(); it != threads_.end();)
+    {
+        if (it->second.seen)
+        {
+            ++it;
+            continue;
+        }
+        CloseThread(it->second);
+        it = threads_.erase(it);
+    }
+}
+
+void TelemetrySampler::TakeSample(TelemetrySample &sample, std::vector<ThreadSample> &threads)
+{
+    Counters current;
+    ReadCounters(current);
+    auto now = std::chrono::steady_clock::now();
+    double elapsed_s = std::chrono::duration<double>(now - previous_time_).count();
+    double elapsed_ticks = elapsed_s * ticks_per_second_;
+
+    memset(&sample, 0, sizeof(sample));
+    sample.timestamp_ns = now_realtime_ns();
+    sample.elapsed_ns = uint64_t(elapsed_s * 1e9);
+
+    const CPUTimes &a = previous_.cpu;
+    const CPUTimes &b = current.cpu;
+    uint64_t total = b.Total() - a.Total();
+    uint64_t idle = (b.idle + b.iowait) - (a.idle + a.iowait);
+    sample.cpu_util = percent(total - idle, total);
+    sample.usr = percent(b.user - a.user, total);
+    sample.sys = percent(b.system - a.system, total);
+    sample.idle = percent(b.idle - a.idle, total);
+    sample.iowait = percent(b.iowait - a.iowait, total);
+    sample.steal = percent(b.steal - a.steal, total);
+    sample.process_cpu = elapsed_ticks > 0 ? float((current.process_ticks - previous_.process_ticks) / elapsed_ticks * 100) : 0;
+
+    sample.net_recv_bytes = current.net_recv - previous_.net_recv;
+    sample.net_send_bytes = current.net_send - previous_.net_send;
+    sample.disk_read_bytes = current.disk_read - previous_.disk_read;
+    sample.disk_write_bytes = current.disk_write - previous_.disk_write;
+    sample.db_rpcs = db_client_ != nullptr ? db_client_->get_current_rpcs() : 0;
+    sample.cache_rpcs = cache_client_ != nullptr ? cache_client_->get_current_rpcs() : 0;
+
+    threads.clear();
+    for (auto &entry : threads_)
+    {
+        TrackedThread &thread = entry.second;
+        uint64_t cycles = 0, llc_misses = 0;
+        if (perf_ok_)
+        {
+            uint64_t c = read_perf_counter(thread.cycles_fd);
+            uint64_t m = read_perf_counter(thread.llc_fd);
+            cycles = c - thread.cycles;
+            llc_misses = m - thread.llc_misses;
+            thread.cycles = c;
+            thread.llc_misses = m;
+            sample.cycles += cycles;
+            sample.llc_misses += llc_misses;
+        }
+        if (!thread.reported)
+            continue;
+
+        uint64_t ticks = parse_stat_ticks(thread.stat.read());
+        ThreadSample t;
+        memset(&t, 0, sizeof(t));
+        t.timestamp_ns = sample.timestamp_ns;
+        t.tid = entry.first;
+        strncpy(t.name, thread.name.c_str(), sizeof(t.name) - 1);
+        t.cpu = elapsed_ticks > 0 ? float((ticks - thread.ticks) / elapsed_ticks * 100) : 0;
+        t.cycles = cycles;
+        t.llc_misses = llc_misses;
+        thread.ticks = ticks;
+        threads.push_back(t);
+    }
+
+    // Same smoothing LogCPULoad used for get_cpu_load().
+    cpu_load_.store(cpu_load_.load(std::memory_order_relaxed) * 0.5 + sample.cpu_util / 100 * 0.5,
+                    std::memory_order_relaxed);
+
+    previous_ = current;
+    previous_time_ = now;
+}
+
+void TelemetrySampler::Write(const TelemetrySample &sample, const std::vector<ThreadSample> &threads)
+{
+    {
+        std::lock_guard<std::mutex> lock(ring_mutex_);
+        ring_[written_ % ring_.size()] = sample;
+        ++written_;
+        summary_.samples++;
+        summary_.seconds += sample.elapsed_ns / 1e9;
+        summary_.mean_cpu_util += sample.cpu_util;
+        summary_.max_cpu_util = std::max<double>(summary_.max_cpu_util, sample.cpu_util);
+        summary_.mean_process_cpu += sample.process_cpu;
+        summary_.net_recv_bytes += sample.net_recv_bytes;
+        summary_.net_send_bytes += sample.net_send_bytes;
+        summary_.disk_read_bytes += sample.disk_read_bytes;
+        summary_.disk_write_bytes += sample.disk_write_bytes;
+        summary_.cycles += sample.cycles;
+        summary_.llc_misses += sample.llc_misses;
+    }
+
+    char line[512];
+    switch (config_.format)
+    {
+    case TelemetryFormat::TEXT:
+    {
+        int n = snprintf(line, sizeof(line),
+                         "%s - CPU Utilization: %g%% | usr: %g%%, sys: %g%%, idle: %g%%, iowait: %g%%, steal: %g%% | "
+                         "Network recv: %llu bytes, send: %llu bytes | Disk read: %llu bytes, write: %llu bytes, "
+                         "DB current_rpcs: %d, Cache current_rpcs: %d | Process CPU: %g%%",
+                         format_time(sample.timestamp_ns).c_str(), sample.cpu_util, sample.usr, sample.sys,
+                         sample.idle, sample.iowait, sample.steal,
+                         (unsigned long long)sample.net_recv_bytes, (unsigned long long)sample.net_send_bytes,
+                         (unsigned long long)sample.disk_read_bytes, (unsigned long long)sample.disk_write_bytes,
+                         sample.db_rpcs, sample.cache_rpcs, sample.process_cpu);
+        pending_.append(line, std::min<size_t>(n, sizeof(line) - 1));
+        if (perf_ok_)
+        {
+            n = snprintf(line, sizeof(line), ", cycles: %llu, LLC misses: %llu",
+                         (unsigned long long)sample.cycles, (unsigned long long)sample.llc_misses);
+            pending_.append(line, std::min<size_t>(n, sizeof(line) - 1));
+        }
+        for (size_t i = 0; i < threads.size(); i++)
+        {
+            n = snprintf(line, sizeof(line), "%s%s[%d]: %g%%", i == 0 ? " | Threads: " : ", ",
+                         threads[i].name, threads[i].tid, threads[i].cpu);
+            pending_.append(line, std::min<size_t>(n, sizeof(line) - 1));
+        }
+        pending_ += '\n';
+        break;
+    }
+    case TelemetryFormat::CSV:
+    {
+        int n = snprintf(line, sizeof(line), "%llu,%llu,%g,%g,%g,%g,%g,%g,%g,%llu,%llu,%llu,%llu,%llu,%llu,%d,%d\n",
+                         (unsigned long long)sample.timestamp_ns, (unsigned long long)sample.elapsed_ns,
+                         sample.cpu_util, sample.usr, sample.sys, sample.idle, sample.iowait, sample.steal,
+                         sample.process_cpu,
+                         (unsigned long long)sample.net_recv_bytes, (unsigned long long)sample.net_send_bytes,
+                         (unsigned long long)sample.disk_read_bytes, (unsigned long long)sample.disk_write_bytes,
+                         (unsigned long long)sample.cycles, (unsigned long long)sample.llc_misses,
+                         sample.db_rpcs, sample.cache_rpcs);
+        pending_.append(line, std::min<size_t>(n, sizeof(line) - 1));
+        for (const ThreadSample &t : threads)
+        {
+            n = snprintf(line, sizeof(line), "%llu,%d,%s,%g,%llu,%llu\n",
+                         (unsigned long long)t.timestamp_ns, t.tid, t.name, t.cpu,
+                         (unsigned long long)t.cycles, (unsigned long long)t.llc_misses);
+            pending_threads_.append(line, std::min<size_t>(n, sizeof(line) - 1));
+        }
+        break;
+    }
+    case TelemetryFormat::BINARY:
+        pending_.append(reinterpret_cast<const char *>(&sample), sizeof(sample));
+        pending_threads_.append(reinterpret_cast<const char *>(threads.data()),
+                                threads.size() * sizeof(ThreadSample));
+        break;
+    }
+}
+
+void TelemetrySampler::Flush()
+{
+    if (out_fd_ >= 0)
+        write_all(out_fd_, pending_);
+    if (thread_out_fd_ >= 0)
+        write_all(thread_out_fd_, pending_threads_);
+    pending_.clear();
+    pending_threads_.clear();
+    flushed_ = written_;
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+class DBClient;
+class CacheClient;
+
+enum class TelemetryFormat
+{
+    TEXT,   // The one-line-per-sample log that plot/test.py parses.
+    CSV,
+    BINARY, // Raw TelemetrySample / ThreadSample records after a TelemetryFileHeader.
+};
+
+struct TelemetryConfig
+{
+    std::chrono::microseconds interval{std::chrono::seconds(1)};
+    TelemetryFormat format = TelemetryFormat::TEXT;
+    // Interfaces from /proc/net/dev and devices from /proc/diskstats to sum up;
+    // "*" matches every entry.
+    std::vector<std::string> interfaces = {"ens4", "lo"};
+    std::vector<std::string> devices = {"sda"};
+    // Threads whose name starts with one of these prefixes get their own CPU
+    // column; "*" samples every thread of the process.
+    std::vector<std::string> thread_prefixes = {"db-cq", "cache-cq", "wsp-", "pool-"};
+    // Count cycles and LLC misses with perf_event_open.
+    bool perf_counters = false;
+    // Samples kept in memory; half a ring is written out at a time.
+    size_t ring_capacity = 256;
+
+    // Parses "interval=100ms,format=csv,net=lo+ens4,disk=sda,threads=*,perf,ring=1024".
+    // Unset keys keep their defaults. Returns false on a malformed spec.
+    static bool Parse(const std::string &spec, TelemetryConfig &config);
+};
+
+#pragma pack(push, 1)
+struct TelemetryFileHeader
+{
+    char magic[8]; // "FCTELEM1"
+    uint32_t sample_size;
+    uint32_t thread_sample_size;
+    uint64_t interval_us;
+};
+
+struct TelemetrySample
+{
+    uint64_t timestamp_ns; // CLOCK_REALTIME
+    uint64_t elapsed_ns;   // Since the previous sample.
+    float cpu_util, usr, sys, idle, iowait, steal; // Percent of all CPUs.
+    float process_cpu;                             // Percent of one CPU.
+    uint64_t net_recv_bytes, net_send_bytes;
+    uint64_t disk_read_bytes, disk_write_bytes;
+    uint64_t cycles, llc_misses; // Process-wide, 0 without perf counters.
+    int32_t db_rpcs, cache_rpcs;
+};
+
+struct ThreadSample
+{
+    uint64_t timestamp_ns;
+    int32_t tid;
+    char name[16];
+    float cpu; // Percent of one CPU.
+    uint64_t cycles, llc_misses;
+};
+#pragma pack(pop)
+
+// Whole-run aggregate of the samples, for result files.
+struct TelemetrySummary
+{
+    uint64_t samples = 0;
+    double seconds = 0;
+    double mean_cpu_util = 0, max_cpu_util = 0; // Percent of all CPUs.
+    double mean_process_cpu = 0;                // Percent of one CPU.
+    uint64_t net_recv_bytes = 0, net_send_bytes = 0;
+    uint64_t disk_read_bytes = 0, disk_write_bytes = 0;
+    uint64_t cycles = 0, llc_misses = 0;
+};
+
+// /proc file opened once and re-read with pread from offset 0, so a sample
+// costs one syscall per file instead of an open/read/close round trip.
+class ProcFile
+{
+public:
+    ProcFile() = default;
+    explicit ProcFile(const std::string &path);
+    ~ProcFile();
+
+    ProcFile(ProcFile &&other) noexcept;
+    ProcFile &operator=(ProcFile &&other) noexcept;
+    ProcFile(const ProcFile &) = delete;
+    ProcFile &operator=(const ProcFile &) = delete;
+
+    bool is_open() const { return fd_ >= 0; }
+
+    // Whole file contents; valid until the next read(). Empty on error.
+    std::string_view read();
+
+private:
+    int fd_ = -1;
+    std::vector<char> buffer_;
+};
+
+// Background sampler for system, process and per-thread load. Samples land
+// in a ring; the sampler thread writes half a ring at a time through one
+// descriptor, so logging does not reopen the output file for every line.
+class TelemetrySampler
+{
+public:
+    TelemetrySampler(const std::string &path, const TelemetryConfig &config,
+                     DBClient *db_client, CacheClient *cache_client);
+    ~TelemetrySampler();
+
+    void Start();
+    void Stop();
+
+    // Moving average of the machine-wide CPU utilization, in [0, 1].
+    double cpu_load() const { return cpu_load_.load(std::memory_order_relaxed); }
+
+    // Up to max_samples of the most recent samples, oldest first.
+    std::vector<TelemetrySample> Recent(size_t max_samples) const;
+
+    // Every sample taken so far, aggregated.
+    TelemetrySummary Summary() const;
+
+private:
+    struct CPUTimes
+    {
+        uint64_t user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+
+        uint64_t Total() const { return user + nice + system + idle + iowait + irq + softirq + steal; }
+    };
+
+    struct Counters
+    {
+        CPUTimes cpu;
+        uint64_t process_ticks = 0;
+        uint64_t net_recv = 0, net_send = 0;
+        uint64_t disk_read = 0, disk_write = 0;
+    };
+
+    struct TrackedThread
+    {
+        ProcFile stat;
+        std::string name;
+        uint64_t ticks = 0;
+        int cycles_fd = -1;
+        int llc_fd = -1;
+        uint64_t cycles = 0, llc_misses = 0;
+        bool reported = false; // Matches thread_prefixes.
+        bool seen = false;
+    };
+
+    void Run();
+    void TakeSample(TelemetrySample &sample, std::vector<ThreadSample> &threads);
+    void ReadCounters(Counters &counters);
+    void RescanThreads();
+    void CloseThread(TrackedThread &thread);
+    bool TrackThread(const std::string &name) const;
+    void Write(const TelemetrySample &sample, const std::vector<ThreadSample> &threads);
+    void Flush();
+
+    std::string path_;
+    TelemetryConfig config_;
+    DBClient *db_client_;
+    CacheClient *cache_client_;
+
+    ProcFile stat_file_, self_stat_file_, net_file_, disk_file_;
+    std::map<int, TrackedThread> threads_;
+    bool perf_ok_;
+    long ticks_per_second_;
+
+    Counters previous_;
+    std::chrono::steady_clock::time_point previous_time_;
+    size_t samples_since_rescan_ = 0;
+    size_t rescan_every_ = 1;
+
+    // Ring of samples. Only the sampler thread writes; Recent() reads under
+    // ring_mutex_.
+    mutable std::mutex ring_mutex_;
+    std::vector<TelemetrySample> ring_;
+    TelemetrySummary summary_; // Sums until Summary() averages them.
+    uint64_t written_ = 0;
+    uint64_t flushed_ = 0;
+    std::string pending_;         // Encoded samples not yet written.
+    std::string pending_threads_; // Same for the thread file (CSV and BINARY).
+    int out_fd_ = -1;
+    int thread_out_fd_ = -1;
+
+    std::atomic<double> cpu_load_{0};
+
+    std::thread thread_;
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;
+    bool stop_ = false;
+};
@@ -1,11 +1,15 @@
 #include "thread_pool.hpp"
 
+#include <pthread.h>
+
 #include <stdexcept>
+#include <string>
 
 // Constructor definition
 ThreadPool::ThreadPool(size_t num_threads) : stop_(false) {
   for (size_t i = 0; i < num_threads; ++i) {
-    workers_.emplace_back([this]() {
+    workers_.emplace_back([this, i]() {
+      pthread_setname_np(pthread_self(), ("pool-" + std::to_string(i)).c_str());
       for (;;) {
         std::function<void()> task;
 
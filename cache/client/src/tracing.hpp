@@ -0,0 +1,382 @@
+#pragma once
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <grpcpp/grpcpp.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Sampled per-request tracing. The client picks 1 in sample_rate requests
+// and sends the trace id in gRPC metadata; the cache server and the DB pick
+// it up and record the stages they run for that request. Spans are fixed-size
+// records with raw TSC timestamps kept in a per-process ring, converted to
+// wall-clock time when the ring is dumped as Chrome trace JSON. Dumps from
+// different processes on one host line up and can be merged by concatenating
+// their traceEvents arrays.
+namespace tracing
+{
+
+    enum class Stage : uint16_t
+    {
+        CLIENT_RPC,        // Client: request sent -> reply dequeued from the CQ.
+        CLIENT_DISPATCH,   // Client: reply dequeued -> picked up by a pool worker.
+        SERVER_QUEUE,      // Server: CQ -> handler running on the pool.
+        SERVER_HANDLE,     // Server: whole handler.
+        MEMCACHED_POOL_POP,
+        MEMCACHED_GET,
+        MEMCACHED_SET,
+        DB_FILL,           // Server: miss fill round trip to the DB.
+        DB_HANDLE,         // DB: request handled, including modelled latency.
+    };
+
+    inline const char *StageName(Stage stage)
+    {
+        switch (stage)
+        {
+        case Stage::CLIENT_RPC:
+            return "client.rpc";
+        case Stage::CLIENT_DISPATCH:
+            return "client.dispatch";
+        case Stage::SERVER_QUEUE:
+            return "server.queue";
+        case Stage::SERVER_HANDLE:
+            return "server.handle";
+        case Stage::MEMCACHED_POOL_POP:
+            return "memcached.pool_pop";
+        case Stage::MEMCACHED_GET:
+            return "memcached.get";
+        case Stage::MEMCACHED_SET:
+            return "memcached.set";
+        case Stage::DB_FILL:
+            return "db.fill";
+        case Stage::DB_HANDLE:
+            return "db.handle";
+        }
+        return "unknown";
+    }
+
+    enum Op : uint16_t
+    {
+        OP_GET,
+        OP_SET,
+        OP_OTHER,
+    };
+
+    inline const char *OpName(uint16_t op)
+    {
+        return op == OP_GET ? "get" : op == OP_SET ? "set"
+                                                   : "other";
+    }
+
+    constexpr const char *METADATA_KEY = "fc-trace-id";
+
+    struct Span
+    {
+        uint64_t trace_id;
+        uint64_t start; // TSC
+        uint64_t end;   // TSC
+        uint32_t tid;
+        Stage stage;
+        uint16_t op; // Op
+    };
+    static_assert(sizeof(Span) == 32, "Span is meant to be 32 bytes");
+
+    inline uint64_t Now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+    inline uint32_t ThreadId()
+    {
+        static thread_local uint32_t tid = (uint32_t)syscall(SYS_gettid);
+        return tid;
+    }
+
+    // Multi-producer ring; old spans are overwritten. Each slot carries the
+    // index it was last written for, so a dump skips slots that are being
+    // rewritten.
+    class SpanRing
+    {
+    public:
+        static const size_t CAPACITY = 1 << 16;
+
+        static SpanRing &Instance()
+        {
+            static SpanRing ring;
+            return ring;
+        }
+
+        void Record(const Span &span)
+        {
+            uint64_t index = head_.fetch_add(1, std::memory_order_relaxed);
+            Slot &slot = slots_[index & (CAPACITY - 1)];
+            slot.seq.store(0, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.span = span;
+            slot.seq.store(index + 1, std::memory_order_release);
+        }
+
+        std::vector<Span> Snapshot() const
+        {
+            std::vector<Span> spans;
+            uint64_t head = head_.load(std::memory_order_acquire);
+            uint64_t begin = head > CAPACITY ? head - CAPACITY : 0;
+            spans.reserve(head - begin);
+            for (uint64_t i = begin; i < head; i++)
+            {
+                const Slot &slot = slots_[i & (CAPACITY - 1)];
+                if (slot.seq.load(std::memory_order_acquire) != i + 1)
+                    continue;
+                Span span = slot.span;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.seq.load(std::memory_order_relaxed) == i + 1)
+                    spans.push_back(span);
+            }
+            return spans;
+        }
+
+        uint64_t size() const { return head_.load(std::memory_order_relaxed); }
+
+    private:
+        struct Slot
+        {
+            std::atomic<uint64_t> seq{0};
+            Span span;
+        };
+
+        SpanRing() : slots_(new Slot[CAPACITY]) {}
+
+        alignas(64) std::atomic<uint64_t> head_{0};
+        std::unique_ptr<Slot[]> slots_;
+    };
+
+    // Maps TSC readings to wall-clock time. The reference point is taken the
+    // first time tracing is used; the rate is measured at dump time.
+    struct Clock
+    {
+        uint64_t tsc0;
+        std::chrono::steady_clock::time_point steady0;
+        int64_t realtime0_ns;
+
+        static Clock &Instance()
+        {
+            static Clock clock;
+            return clock;
+        }
+
+        double NsPerTick() const
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            auto elapsed = std::chrono::steady_clock::now() - steady0;
+            if (elapsed < std::chrono::milliseconds(10))
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10) - elapsed);
+                elapsed = std::chrono::steady_clock::now() - steady0;
+            }
+            uint64_t ticks = Now() - tsc0;
+            return std::chrono::duration<double, std::nano>(elapsed).count() / ticks;
+#else
+            return 1.0;
+#endif
+        }
+
+    private:
+        Clock()
+            : tsc0(Now()), steady0(std::chrono::steady_clock::now()),
+              realtime0_ns(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::system_clock::now().time_since_epoch())
+                               .count())
+        {
+        }
+    };
+
+    inline std::atomic<uint32_t> &SampleRateRef()
+    {
+        // FRESHCACHE_TRACE_SAMPLE=<n> traces 1 in n requests; 0 turns tracing off.
+        static std::atomic<uint32_t> rate([]()
+                                          {
+                                              const char *env = getenv("FRESHCACHE_TRACE_SAMPLE");
+                                              return env != nullptr ? (uint32_t)strtoul(env, nullptr, 10) : 1000u; }());
+        return rate;
+    }
+
+    inline void SetSampleRate(uint32_t rate) { SampleRateRef().store(rate, std::memory_order_relaxed); }
+
+    // Decides whether to trace the next request. Returns a new trace id, or 0
+    // for the unsampled majority; the fast path is one thread-local decrement.
+    inline uint64_t StartTrace()
+    {
+        static thread_local uint32_t countdown = 0;
+        static thread_local uint64_t state = 0;
+        if (countdown > 1)
+        {
+            --countdown;
+            return 0;
+        }
+        uint32_t rate = SampleRateRef().load(std::memory_order_relaxed);
+        if (rate == 0)
+        {
+            countdown = UINT32_MAX;
+            return 0;
+        }
+        if (state == 0)
+        {
+            // Per-thread seed; also staggers the threads' sampling phase.
+            state = Now() ^ (uint64_t(getpid()) << 32) ^ ThreadId();
+            Clock::Instance();
+            countdown = 1 + state % rate;
+            if (countdown > 1)
+                return 0;
+        }
+        countdown = rate;
+        // splitmix64
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        z ^= z >> 31;
+        return z != 0 ? z : 1;
+    }
+
+    inline void Record(uint64_t trace_id, Stage stage, uint64_t start, uint64_t end, uint16_t op = OP_OTHER)
+    {
+        SpanRing::Instance().Record(Span{trace_id, start, end, ThreadId(), stage, op});
+    }
+
+    // Records [construction, destruction) when trace_id is non-zero.
+    class ScopedSpan
+    {
+    public:
+        ScopedSpan(uint64_t trace_id, Stage stage, uint16_t op = OP_OTHER)
+            : trace_id_(trace_id), start_(trace_id != 0 ? Now() : 0), stage_(stage), op_(op)
+        {
+        }
+
+        ~ScopedSpan()
+        {
+            if (trace_id_ != 0)
+                Record(trace_id_, stage_, start_, Now(), op_);
+        }
+
+        ScopedSpan(const ScopedSpan &) = delete;
+        ScopedSpan &operator=(const ScopedSpan &) = delete;
+
+    private:
+        uint64_t trace_id_;
+        uint64_t start_;
+        Stage stage_;
+        uint16_t op_;
+    };
+
+    inline void Inject(grpc::ClientContext &context, uint64_t trace_id)
+    {
+        if (trace_id == 0)
+            return;
+        char buffer[17];
+        snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long)trace_id);
+        context.AddMetadata(METADATA_KEY, buffer);
+        Clock::Instance();
+    }
+
+    // Trace id sent by the caller, or 0.
+    inline uint64_t Extract(const grpc::ServerContext &context)
+    {
+        const auto &metadata = context.client_metadata();
+        if (metadata.empty())
+            return 0;
+        auto it = metadata.find(METADATA_KEY);
+        if (it == metadata.end())
+            return 0;
+        std::string value(it->second.data(), it->second.size());
+        Clock::Instance();
+        return strtoull(value.c_str(), nullptr, 16);
+    }
+
+    // Writes every span still in the ring as Chrome trace JSON ("X" events,
+    // microsecond timestamps). Returns the number of spans written.
+    inline size_t DumpChromeTrace(const std::string &path, const std::string &process_name)
+    {
+        std::vector<Span> spans = SpanRing::Instance().Snapshot();
+        if (spans.empty())
+            return 0;
+
+        const Clock &clock = Clock::Instance();
+        double ns_per_tick = clock.NsPerTick();
+        auto to_us = [&](uint64_t tsc)
+        {
+            double offset_ns = (int64_t)(tsc - clock.tsc0) * ns_per_tick;
+            return (clock.realtime0_ns + offset_ns) / 1000.0;
+        };
+
+        std::ofstream out(path);
+        if (!out.is_open())
+        {
+            std::cerr << "Error: Could not open trace file " << path << std::endl;
+            return 0;
+        }
+        int pid = getpid();
+        out.precision(3);
+        out << std::fixed;
+        out << "{\"traceEvents\":[\n";
+        out << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << pid
+            << ",\"args\":{\"name\":\"" << process_name << "\"}}";
+        char id[17];
+        for (const Span &span : spans)
+        {
+            snprintf(id, sizeof(id), "%016llx", (unsigned long long)span.trace_id);
+            double ts = to_us(span.start);
+            double dur = span.end > span.start ? (span.end - span.start) * ns_per_tick / 1000.0 : 0;
+            out << ",\n{\"ph\":\"X\",\"cat\":\"freshcache\",\"name\":\"" << StageName(span.stage)
+                << "\",\"pid\":" << pid << ",\"tid\":" << span.tid << ",\"ts\":" << ts
+                << ",\"dur\":" << dur << ",\"args\":{\"trace_id\":\"" << id << "\",\"op\":\"" << OpName(span.op) << "\"}}";
+        }
+        out << "\n],\"displayTimeUnit\":\"ns\"}\n";
+        return spans.size();
+    }
+
+    // For long-running servers: dump the ring when SIGTERM or SIGINT arrives,
+    // then die of the signal as before. Call from main before starting any
+    // other thread so every thread inherits the blocked mask.
+    inline void DumpOnSignal(const std::string &path, const std::string &process_name)
+    {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGTERM);
+        sigaddset(&set, SIGINT);
+        pthread_sigmask(SIG_BLOCK, &set, nullptr);
+        std::thread([set, path, process_name]()
+                    {
+                        int sig = 0;
+                        while (sigwait(&set, &sig) != 0)
+                            ;
+                        size_t n = DumpChromeTrace(path, process_name);
+                        std::cerr << "Wrote " << n << " spans to " << path << std::endl;
+                        signal(sig, SIG_DFL);
+                        pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
+                        raise(sig); })
+            .detach();
+    }
+
+} // namespace tracing
@@ -0,0 +1,152 @@
+#include "work_stealing_pool.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <iostream>
+#include <string>
+
+thread_local WorkStealingPool *WorkStealingPool::current_pool_ = nullptr;
+thread_local size_t WorkStealingPool::current_index_ = 0;
+
+WorkStealingPool::WorkStealingPool(size_t num_threads, bool pin_threads) {
+  if (num_threads == 0) num_threads = 1;
+  for (size_t i = 0; i < num_threads; ++i) queues_.emplace_back(new Worker());
+  for (size_t i = 0; i < num_threads; ++i) {
+    workers_.emplace_back([this, i, pin_threads]() {
+      pthread_setname_np(pthread_self(), ("wsp-" + std::to_string(i)).c_str());
+      if (pin_threads) pin_to_cpu(i);
+      worker_loop(i);
+    });
+  }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_ = true;
+  }
+  sleep_cv_.notify_all();
+  for (std::thread &worker : workers_) worker.join();
+
+  // Workers only exit once they find no work, but free anything a racing
+  // post() may have left behind.
+  for (auto &queue : queues_) {
+    Task *node;
+    while (queue->deque.pop(node)) delete node;
+  }
+}
+
+void WorkStealingPool::post_task(Task &&task) {
+  if (current_pool_ == this) {
+    // Posted from one of our workers: keep it local.
+    queues_[current_index_]->deque.push(new Task(std::move(task)));
+  } else {
+    size_t n = queues_.size();
+    size_t start = next_inbox_.fetch_add(1, std::memory_order_relaxed);
+    bool queued = false;
+    for (size_t k = 0; k < n && !queued; ++k)
+      queued = queues_[(start + k) % n]->inbox.try_push(std::move(task));
+    if (!queued) {
+      std::lock_guard<std::mutex> lock(overflow_mutex_);
+      overflow_.push_back(std::move(task));
+      overflow_size_.fetch_add(1, std::memory_order_release);
+    }
+  }
+  wake_one();
+}
+
+void WorkStealingPool::wake_one() {
+  // Pairs with the sleepers_ increment in worker_loop: either the worker sees
+  // the new task before it waits, or we see the sleeper and notify it.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleepers_.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    sleep_cv_.notify_one();
+  }
+}
+
+bool WorkStealingPool::find_task(size_t index, Task &task) {
+  Worker &self = *queues_[index];
+  Task *node;
+  if (self.deque.pop(node)) {
+    task = std::move(*node);
+    delete node;
+    return true;
+  }
+  if (self.inbox.try_pop(task)) return true;
+
+  if (overflow_size_.load(std::memory_order_acquire) > 0) {
+    std::lock_guard<std::mutex> lock(overflow_mutex_);
+    if (!overflow_.empty()) {
+      task = std::move(overflow_.front());
+      overflow_.pop_front();
+      overflow_size_.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+  }
+
+  size_t n = queues_.size();
+  for (size_t k = 1; k < n; ++k) {
+    Worker &victim = *queues_[(index + k) % n];
+    if (victim.deque.steal(node)) {
+      task = std::move(*node);
+      delete node;
+      return true;
+    }
+    if (victim.inbox.try_pop(task)) return true;
+  }
+  return false;
+}
+
+bool WorkStealingPool::has_work() const {
+  if (overflow_size_.load(std::memory_order_acquire) > 0) return true;
+  for (const auto &queue : queues_)
+    if (!queue->deque.empty() || !queue->inbox.empty()) return true;
+  return false;
+}
+
+void WorkStealingPool::worker_loop(size_t index) {
+  current_pool_ = this;
+  current_index_ = index;
+
+  Task task;
+  for (;;) {
+    bool found = false;
+    for (int spins = 0; spins < SPIN_ROUNDS && !found; ++spins) {
+      found = find_task(index, task);
+      if (!found) std::this_thread::yield();
+    }
+    if (found) {
+      task();
+      task.reset();
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    sleepers_.fetch_add(1, std::memory_order_seq_cst);
+    sleep_cv_.wait(lock, [this]() { return stop_ || has_work(); });
+    sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    if (stop_ && !has_work()) return;
+  }
+}
+
+void WorkStealingPool::pin_to_cpu(size_t index) {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0 || CPU_COUNT(&allowed) == 0) return;
+
+  // Pick the (index mod count)-th allowed CPU.
+  size_t target = index % CPU_COUNT(&allowed);
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, &allowed)) continue;
+    if (target-- == 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        std::cerr << "Failed to pin worker " << index << " to CPU " << cpu << std::endl;
+      return;
+    }
+  }
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Move-only void() callable. Callables up to INLINE_SIZE bytes (a lambda
+// capturing a few pointers, a packaged_task) are stored in place, so
+// posting them does not allocate.
+class Task {
+ public:
+  static constexpr size_t INLINE_SIZE = 48;
+
+  Task() = default;
+
+  template <class F, class = typename std::enable_if<
+                         !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+  Task(F &&f) {
+    using Fn = typename std::decay<F>::type;
+    if constexpr (sizeof(Fn) <= INLINE_SIZE && alignof(Fn) <= alignof(std::max_align_t) &&
+                  std::is_nothrow_move_constructible<Fn>::value) {
+      new (storage_) Fn(std::forward<F>(f));
+      ops_ = &inline_ops<Fn>;
+    } else {
+      *reinterpret_cast<Fn **>(storage_) = new Fn(std::forward<F>(f));
+      ops_ = &heap_ops<Fn>;
+    }
+  }
+
+  Task(Task &&other) noexcept { take(other); }
+
+  Task &operator=(Task &&other) noexcept {
+    if (this != &other) {
+      reset();
+      take(other);
+    }
+    return *this;
+  }
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+
+  ~Task() { reset(); }
+
+  explicit operator bool() const { return ops_ != nullptr; }
+
+  void operator()() { ops_->invoke(storage_); }
+
+  void reset() {
+    if (ops_ != nullptr) {
+      ops_->destroy(storage_);
+      ops_ = nullptr;
+    }
+  }
+
+ private:
+  struct Ops {
+    void (*invoke)(void *);
+    void (*move)(void *dst, void *src);  // Leaves src destroyed.
+    void (*destroy)(void *);
+  };
+
+  template <class Fn>
+  static constexpr Ops inline_ops = {
+      [](void *p) { (*static_cast<Fn *>(p))(); },
+      [](void *dst, void *src) {
+        new (dst) Fn(std::move(*static_cast<Fn *>(src)));
+        static_cast<Fn *>(src)->~Fn();
+      },
+      [](void *p) { static_cast<Fn *>(p)->~Fn(); }};
+
+  template <class Fn>
+  static constexpr Ops heap_ops = {
+      [](void *p) { (**static_cast<Fn **>(p))(); },
+      [](void *dst, void *src) { *static_cast<Fn **>(dst) = *static_cast<Fn **>(src); },
+      [](void *p) { delete *static_cast<Fn **>(p); }};
+
+  void take(Task &other) {
+    ops_ = other.ops_;
+    if (ops_ != nullptr) {
+      ops_->move(storage_, other.storage_);
+      other.ops_ = nullptr;
+    }
+  }
+
+  alignas(std::max_align_t) unsigned char storage_[INLINE_SIZE];
+  const Ops *ops_ = nullptr;
+};
+
+// Chase-Lev work-stealing deque (Le et al., "Correct and Efficient
+// Work-Stealing for Weak Memory Models"). The owner pushes and pops at the
+// bottom; any thread may steal from the top. T must be trivially copyable
+// (the pool stores Task pointers). Outgrown arrays are kept until the deque
+// is destroyed because a thief may still be reading them.
+template <class T>
+class ChaseLevDeque {
+ public:
+  explicit ChaseLevDeque(size_t capacity = 256);
+
+  void push(T item);     // Owner only.
+  bool pop(T &item);     // Owner only.
+  bool steal(T &item);   // Any thread.
+  bool empty() const;
+
+ private:
+  struct Array {
+    explicit Array(size_t capacity) : mask(capacity - 1), slots(new std::atomic<T>[capacity]) {}
+    size_t capacity() const { return mask + 1; }
+    T get(int64_t i) const { return slots[i & mask].load(std::memory_order_relaxed); }
+    void put(int64_t i, T item) { slots[i & mask].store(item, std::memory_order_relaxed); }
+
+    size_t mask;
+    std::unique_ptr<std::atomic<T>[]> slots;
+  };
+
+  Array *grow(Array *array, int64_t top, int64_t bottom);
+
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  std::atomic<Array *> array_;
+  std::vector<std::unique_ptr<Array>> arrays_;  // Owner only.
+};
+
+// Bounded multi-producer/multi-consumer queue (Vyukov). Each cell carries a
+// sequence number that hands it between producers and consumers, so T does
+// not need to be trivially copyable.
+template <class T>
+class MpmcQueue {
+ public:
+  explicit MpmcQueue(size_t capacity);
+
+  bool try_push(T &&item);
+  bool try_pop(T &item);
+  bool empty() const;
+
+ private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    T value;
+  };
+
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> enqueue_pos_{0};
+  alignas(64) std::atomic<size_t> dequeue_pos_{0};
+};
+
+// Thread pool with one Chase-Lev deque per worker plus a bounded inbox per
+// worker for tasks posted from outside the pool. Tasks posted by a worker go
+// to its own deque (LIFO); idle workers drain their inbox and then steal from
+// the other workers' deques and inboxes before parking.
+class WorkStealingPool {
+ public:
+  // pin_threads binds worker i to the i-th CPU of the process affinity mask.
+  explicit WorkStealingPool(size_t num_threads, bool pin_threads = false);
+  ~WorkStealingPool();
+
+  WorkStealingPool(const WorkStealingPool &) = delete;
+  WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+  // Run f on some worker; no future, no result.
+  template <class F>
+  void post(F &&f);
+
+  // Same contract as ThreadPool::enqueue.
+  template <class F, class... Args>
+  auto enqueue(F &&f, Args &&...args)
+      -> std::future<typename std::result_of<F(Args...)>::type>;
+
+  size_t size() const { return workers_.size(); }
+
+ private:
+  static const size_t INBOX_CAPACITY = 4096;
+  static const int SPIN_ROUNDS = 64;
+
+  struct Worker {
+    ChaseLevDeque<Task *> deque;
+    MpmcQueue<Task> inbox{INBOX_CAPACITY};
+  };
+
+  void post_task(Task &&task);
+  void worker_loop(size_t index);
+  bool find_task(size_t index, Task &task);
+  bool has_work() const;
+  void wake_one();
+  void pin_to_cpu(size_t index);
+
+  std::vector<std::unique_ptr<Worker>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> next_inbox_{0};
+
+  // Used only when every inbox is full.
+  std::mutex overflow_mutex_;
+  std::deque<Task> overflow_;
+  std::atomic<size_t> overflow_size_{0};
+
+  // Parking.
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_;
+  std::atomic<int> sleepers_{0};
+  std::atomic<bool> stop_{false};
+
+  static thread_local WorkStealingPool *current_pool_;
+  static thread_local size_t current_index_;
+};
+
+// Include template definitions
+#include "work_stealing_pool.tpp"
@@ -0,0 +1,154 @@
+// work_stealing_pool.tpp
+#include <functional>
+#include <stdexcept>
+
+template <class T>
+ChaseLevDeque<T>::ChaseLevDeque(size_t capacity) {
+  size_t cap = 1;
+  while (cap < capacity) cap <<= 1;
+  arrays_.emplace_back(new Array(cap));
+  array_.store(arrays_.back().get(), std::memory_order_relaxed);
+}
+
+template <class T>
+void ChaseLevDeque<T>::push(T item) {
+  int64_t b = bottom_.load(std::memory_order_relaxed);
+  int64_t t = top_.load(std::memory_order_acquire);
+  Array *a = array_.load(std::memory_order_relaxed);
+  if (b - t > (int64_t)a->capacity() - 1) a = grow(a, t, b);
+  a->put(b, item);
+  bottom_.store(b + 1, std::memory_order_release);
+}
+
+template <class T>
+bool ChaseLevDeque<T>::pop(T &item) {
+  int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+  Array *a = array_.load(std::memory_order_relaxed);
+  bottom_.store(b, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t t = top_.load(std::memory_order_relaxed);
+
+  if (t > b) {
+    // Empty.
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return false;
+  }
+  item = a->get(b);
+  if (t == b) {
+    // Last item: race the thieves for it.
+    bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                            std::memory_order_relaxed);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return won;
+  }
+  return true;
+}
+
+template <class T>
+bool ChaseLevDeque<T>::steal(T &item) {
+  int64_t t = top_.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t b = bottom_.load(std::memory_order_acquire);
+  if (t >= b) return false;
+
+  Array *a = array_.load(std::memory_order_acquire);
+  item = a->get(t);
+  return top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed);
+}
+
+template <class T>
+bool ChaseLevDeque<T>::empty() const {
+  int64_t b = bottom_.load(std::memory_order_relaxed);
+  int64_t t = top_.load(std::memory_order_relaxed);
+  return t >= b;
+}
+
+template <class T>
+typename ChaseLevDeque<T>::Array *ChaseLevDeque<T>::grow(Array *array, int64_t top,
+                                                          int64_t bottom) {
+  Array *bigger = new Array(array->capacity() * 2);
+  for (int64_t i = top; i < bottom; ++i) bigger->put(i, array->get(i));
+  arrays_.emplace_back(bigger);
+  array_.store(bigger, std::memory_order_release);
+  return bigger;
+}
+
+template <class T>
+MpmcQueue<T>::MpmcQueue(size_t capacity) {
+  size_t cap = 1;
+  while (cap < capacity) cap <<= 1;
+  cells_.reset(new Cell[cap]);
+  mask_ = cap - 1;
+  for (size_t i = 0; i < cap; ++i) cells_[i].seq.store(i, std::memory_order_relaxed);
+}
+
+template <class T>
+bool MpmcQueue<T>::try_push(T &&item) {
+  size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+  Cell *cell;
+  for (;;) {
+    cell = &cells_[pos & mask_];
+    size_t seq = cell->seq.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+    if (diff == 0) {
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      return false;  // Full.
+    } else {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  cell->value = std::move(item);
+  cell->seq.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+template <class T>
+bool MpmcQueue<T>::try_pop(T &item) {
+  size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+  Cell *cell;
+  for (;;) {
+    cell = &cells_[pos & mask_];
+    size_t seq = cell->seq.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      return false;  // Empty.
+    } else {
+      pos = dequeue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+  item = std::move(cell->value);
+  cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+  return true;
+}
+
+template <class T>
+bool MpmcQueue<T>::empty() const {
+  size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+  size_t seq = cells_[pos & mask_].seq.load(std::memory_order_acquire);
+  return (intptr_t)seq - (intptr_t)(pos + 1) < 0;
+}
+
+template <class F>
+void WorkStealingPool::post(F &&f) {
+  post_task(Task(std::forward<F>(f)));
+}
+
+template <class F, class... Args>
+auto WorkStealingPool::enqueue(F &&f, Args &&...args)
+    -> std::future<typename std::result_of<F(Args...)>::type> {
+  using return_type = typename std::result_of<F(Args...)>::type;
+
+  std::packaged_task<return_type()> task(
+      std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+  std::future<return_type> res = task.get_future();
+
+  // Don't allow enqueueing after stopping the pool
+  if (stop_) throw std::runtime_error("enqueue on stopped WorkStealingPool");
+
+  post(std::move(task));
+  return res;
+}
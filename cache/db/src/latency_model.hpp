@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Service-time distribution injected in front of every DB response.
+ * Specs (all times in microseconds):
+ *   none                    no added latency
+ *   const:<us>
+ *   uniform:<lo>:<hi>
+ *   exp:<mean>
+ *   lognormal:<median>:<sigma>
+ */
+class LatencyModel
+{
+public:
+    LatencyModel() = default;
+
+    static bool Parse(const std::string &spec, LatencyModel &model)
+    {
+        std::vector<double> params;
+        std::stringstream ss(spec);
+        std::string name, token;
+        std::getline(ss, name, ':');
+        try
+        {
+            while (std::getline(ss, token, ':'))
+                params.push_back(std::stod(token));
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "Invalid latency spec: " << spec << std::endl;
+            return false;
+        }
+
+        model = LatencyModel();
+        if (name == "none" && params.empty())
+            model.kind_ = NONE;
+        else if (name == "const" && params.size() == 1)
+            model.kind_ = CONST;
+        else if (name == "uniform" && params.size() == 2 && params[0] <= params[1])
+            model.kind_ = UNIFORM;
+        else if (name == "exp" && params.size() == 1 && params[0] > 0)
+            model.kind_ = EXP;
+        else if (name == "lognormal" && params.size() == 2 && params[0] > 0)
+            model.kind_ = LOGNORMAL;
+        else
+        {
+            std::cerr << "Invalid latency spec: " << spec << std::endl;
+            return false;
+        }
+        model.params_ = params;
+        return true;
+    }
+
+    std::chrono::microseconds Sample() const
+    {
+        thread_local std::mt19937_64 rng(std::random_device{}());
+        double us = 0;
+        switch (kind_)
+        {
+        case NONE:
+            break;
+        case CONST:
+            us = params_[0];
+            break;
+        case UNIFORM:
+            us = std::uniform_real_distribution<double>(params_[0], params_[1])(rng);
+            break;
+        case EXP:
+            us = std::exponential_distribution<double>(1.0 / params_[0])(rng);
+            break;
+        case LOGNORMAL:
+            us = std::lognormal_distribution<double>(std::log(params_[0]), params_[1])(rng);
+            break;
+        }
+        return std::chrono::microseconds(static_cast<int64_t>(std::max(0.0, us)));
+    }
+
+    bool enabled() const { return kind_ != NONE; }
+
+private:
+    enum Kind
+    {
+        NONE,
+        CONST,
+        UNIFORM,
+        EXP,
+        LOGNORMAL
+    };
+
+    Kind kind_ = NONE;
+    std::vector<double> params_;
+};
@@ -0,0 +1,511 @@
+#include <grpcpp/grpcpp.h>
+#include <grpcpp/alarm.h>
+#include <myproto/cache_service.pb.h>
+#include <myproto/cache_service.grpc.pb.h>
+#include <myproto/db_service.grpc.pb.h>
+#include <myproto/db_service.pb.h>
+
+#include <iostream>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <mutex>
+#include "client.hpp"
+#include "work_stealing_pool.hpp"
+#include "store.hpp"
+#include "latency_model.hpp"
+#include "tracing.hpp"
+
+using grpc::Server;
+using grpc::ServerAsyncResponseWriter;
+using grpc::ServerBuilder;
+using grpc::ServerCompletionQueue;
+using grpc::ServerContext;
+using grpc::Status;
+
+/*
+ * In-memory stand-in for the RocksDB-backed DBService, for running the
+ * whole freshness pipeline on one machine. Writes fan out to the cache
+ * server according to their ew exactly like the real backend: TTL_EW
+ * leaves the cache alone, INVALIDATE_EW/UPDATE_EW force one action, and
+ * any other value picks one through prefer_invalidate().
+ *
+ * Every response is delayed by a sample from the read or write latency
+ * model, and at most max_concurrency requests are served at once; the
+ * rest queue in arrival order.
+ */
+class DBServiceImpl final
+{
+public:
+    struct Options
+    {
+        std::string listen_address = "10.128.0.33:50051";
+        std::string cache_address = "10.128.0.39:50051";
+        LatencyModel read_latency;
+        LatencyModel write_latency;
+        int max_concurrency = 0; // 0 means unlimited
+        size_t num_shards = 64;
+    };
+
+    DBServiceImpl(const Options &options)
+        : options_(options), store_(options.num_shards),
+          cache_client_(grpc::CreateChannel(options.cache_address, grpc::InsecureChannelCredentials()))
+    {
+    }
+
+    ~DBServiceImpl()
+    {
+        Shutdown();
+    }
+
+    void Run()
+    {
+        ServerBuilder builder;
+        builder.AddListeningPort(options_.listen_address, grpc::InsecureServerCredentials());
+        builder.RegisterService(&async_service_);
+
+        cq_ = builder.AddCompletionQueue();
+
+        server_ = builder.BuildAndStart();
+        if (!server_)
+        {
+            std::cerr << "Failed to listen on " << options_.listen_address << std::endl;
+            return;
+        }
+        std::cout << "DB stand-in listening on " << options_.listen_address
+                  << ", fanning out to " << options_.cache_address << std::endl;
+
+        HandleRpcs();
+    }
+
+    void Shutdown()
+    {
+        if (server_)
+        {
+            server_->Shutdown();
+            cq_->Shutdown();
+            server_.reset();
+        }
+    }
+
+private:
+    class CallDataBase
+    {
+    public:
+        virtual void Proceed(bool ok) = 0;
+        virtual void Serve() = 0;
+        virtual ~CallDataBase() {}
+    };
+
+    template <typename RequestType, typename ResponseType>
+    class CallData : public CallDataBase
+    {
+    public:
+        CallData(DBService::AsyncService *service, ServerCompletionQueue *cq, DBServiceImpl *impl)
+            : service_(service), cq_(cq), responder_(&ctx_), status_(CREATE), impl_(impl)
+        {
+        }
+
+        void Proceed(bool ok) override
+        {
+            if (status_ == CREATE)
+            {
+                status_ = PROCESS;
+                RequestRPC();
+            }
+            else if (status_ == PROCESS)
+            {
+                trace_id_ = tracing::Extract(ctx_);
+                trace_start_ = trace_id_ != 0 ? tracing::Now() : 0;
+                CreateNewInstance();
+                if (impl_->AcquireSlot(this))
+                    Serve();
+            }
+            else if (status_ == DELAYED)
+            {
+                Respond();
+            }
+            else
+            {
+                delete this;
+            }
+        }
+
+        // Runs with a concurrency slot held.
+        void Serve() override
+        {
+            ProcessRequest();
+            const LatencyModel &model = IsWrite() ? impl_->options_.write_latency : impl_->options_.read_latency;
+            std::chrono::microseconds delay = model.Sample();
+            if (delay.count() > 0)
+            {
+                status_ = DELAYED;
+                alarm_.Set(cq_, std::chrono::system_clock::now() + delay, this);
+            }
+            else
+            {
+                Respond();
+            }
+        }
+
+    protected:
+        virtual void RequestRPC() = 0;
+        virtual void ProcessRequest() = 0;
+        virtual void CreateNewInstance() = 0;
+        virtual bool IsWrite() const { return false; }
+
+        void Respond()
+        {
+            // Once Finish is called another thread may delete this call.
+            DBServiceImpl *impl = impl_;
+            if (trace_id_ != 0)
+                tracing::Record(trace_id_, tracing::Stage::DB_HANDLE, trace_start_, tracing::Now(),
+                                IsWrite() ? tracing::OP_SET : tracing::OP_GET);
+            status_ = FINISH;
+            responder_.Finish(response_, Status::OK, this);
+            impl->ReleaseSlot();
+        }
+
+        DBService::AsyncService *service_;
+        ServerCompletionQueue *cq_;
+        ServerContext ctx_;
+        RequestType request_;
+        ResponseType response_;
+        ServerAsyncResponseWriter<ResponseType> responder_;
+        grpc::Alarm alarm_;
+        enum CallStatus
+        {
+            CREATE,
+            PROCESS,
+            DELAYED,
+            FINISH
+        };
+        CallStatus status_;
+        DBServiceImpl *impl_;
+        uint64_t trace_id_ = 0;
+        uint64_t trace_start_ = 0;
+    };
+
+    class GetCallData : public CallData<DBGetRequest, DBGetResponse>
+    {
+    public:
+        using CallData::CallData;
+
+    protected:
+        void RequestRPC() override
+        {
+            service_->RequestGet(&ctx_, &request_, &responder_, cq_, cq_, this);
+        }
+
+        void CreateNewInstance() override
+        {
+            (new GetCallData(service_, cq_, impl_))->Proceed(true);
+        }
+
+        void ProcessRequest() override
+        {
+            std::string value;
+            uint64_t version;
+            bool compressed = false;
+            bool found = impl_->store_.Get(request_.key(), value, version, compressed);
+            response_.set_value(std::move(value));
+            response_.set_found(found);
+            response_.set_version(version);
+            response_.set_compressed(compressed);
+            impl_->read_count_++;
+        }
+    };
+
+    class PutCallData : public CallData<DBPutRequest, DBPutResponse>
+    {
+    public:
+        using CallData::CallData;
+
+    protected:
+        void RequestRPC() override
+        {
+            service_->RequestPut(&ctx_, &request_, &responder_, cq_, cq_, this);
+        }
+
+        void CreateNewInstance() override
+        {
+            (new PutCallData(service_, cq_, impl_))->Proceed(true);
+        }
+
+        bool IsWrite() const override { return true; }
+
+        void ProcessRequest() override
+        {
+            uint64_t version = impl_->store_.Put(request_.key(), request_.value(), request_.compressed());
+            impl_->write_count_++;
+            impl_->FanOut(request_.key(), request_.value(), request_.ew(), version, request_.compressed());
+            response_.set_success(true);
+            response_.set_version(version);
+        }
+    };
+
+    class DeleteCallData : public CallData<DBDeleteRequest, DBDeleteResponse>
+    {
+    public:
+        using CallData::CallData;
+
+    protected:
+        void RequestRPC() override
+        {
+            service_->RequestDelete(&ctx_, &request_, &responder_, cq_, cq_, this);
+        }
+
+        void CreateNewInstance() override
+        {
+            (new DeleteCallData(service_, cq_, impl_))->Proceed(true);
+        }
+
+        bool IsWrite() const override { return true; }
+
+        void ProcessRequest() override
+        {
+            uint64_t version = 0;
+            bool erased = impl_->store_.Delete(request_.key(), version);
+            impl_->write_count_++;
+            if (erased)
+                impl_->FanOut(request_.key(), std::string(), INVALIDATE_EW, version);
+            response_.set_success(erased);
+        }
+    };
+
+    class GetLoadCallData : public CallData<DBGetLoadRequest, DBGetLoadResponse>
+    {
+    public:
+        using CallData::CallData;
+
+    protected:
+        void RequestRPC() override
+        {
+            service_->RequestGetLoad(&ctx_, &request_, &responder_, cq_, cq_, this);
+        }
+
+        void CreateNewInstance() override
+        {
+            (new GetLoadCallData(service_, cq_, impl_))->Proceed(true);
+        }
+
+        void ProcessRequest() override
+        {
+            // Requests served plus invalidates/updates sent since StartRecord.
+            response_.set_load(impl_->read_count_ + impl_->write_count_ + impl_->num_invalidates_ + impl_->num_updates_);
+            response_.set_success(true);
+        }
+    };
+
+    class GetReadCountCallData : public CallData<DBGetReadCountRequest, DBGetReadCountResponse>
+    {
+    public:
+        using CallData::CallData;
+
+    protected:
+        void RequestRPC() override
+        {
+            service_->RequestGetReadCount(&ctx_, &request_, &responder_, cq_, cq_, this);
+        }
+
+        void CreateNewInstance() override
+        {
+            (new GetReadCountCallData(service_, cq_, impl_))->Proceed(true);
+        }
+
+        void ProcessRequest() override
+        {
+            response_.set_read_count(impl_->read_count_.load());
+            response_.set_success(true);
+        }
+    };
+
+    class GetWriteCountCallData : public CallData<DBGetWriteCountRequest, DBGetWriteCountResponse>
+    {
+    public:
+        using CallData::CallData;
+
+    protected:
+        void RequestRPC() override
+        {
+            service_->RequestGetWriteCount(&ctx_, &request_, &responder_, cq_, cq_, this);
+        }
+
+        void CreateNewInstance() override
+        {
+            (new GetWriteCountCallData(service_, cq_, impl_))->Proceed(true);
+        }
+
+        void ProcessRequest() override
+        {
+            response_.set_write_count(impl_->write_count_.load());
+            response_.set_success(true);
+        }
+    };
+
+    class StartRecordCallData : public CallData<DBStartRecordRequest, DBStartRecordResponse>
+    {
+    public:
+        using CallData::CallData;
+
+    protected:
+        void RequestRPC() override
+        {
+            service_->RequestStartRecord(&ctx_, &request_, &responder_, cq_, cq_, this);
+        }
+
+        void CreateNewInstance() override
+        {
+            (new StartRecordCallData(service_, cq_, impl_))->Proceed(true);
+        }
+
+        void ProcessRequest() override
+        {
+            // Warm-up traffic is not part of the measurement.
+            impl_->read_count_ = 0;
+            impl_->write_count_ = 0;
+            impl_->num_invalidates_ = 0;
+            impl_->num_updates_ = 0;
+            response_.set_success(true);
+        }
+    };
+
+    // The write's version travels with the invalidate/update so the cache
+    // can drop fan-outs and fills that arrive out of order. Compressed
+    // values are forwarded as the client encoded them.
+    void FanOut(const std::string &key, const std::string &value, float ew, uint64_t version, bool compressed = false)
+    {
+        if (ew == TTL_EW)
+            return;
+
+        bool invalidate = (ew == INVALIDATE_EW) || (ew != UPDATE_EW && prefer_invalidate(ew));
+        if (invalidate)
+        {
+            cache_client_.InvalidateAsync(key, version);
+            num_invalidates_++;
+        }
+        else
+        {
+            cache_client_.UpdateAsync(key, value, LONG_TTL, version, compressed);
+            num_updates_++;
+        }
+    }
+
+    // True if the caller may serve now; otherwise it is queued and served
+    // when a slot frees up.
+    bool AcquireSlot(CallDataBase *call)
+    {
+        if (options_.max_concurrency <= 0)
+            return true;
+        std::lock_guard<std::mutex> lock(admission_mutex_);
+        if (in_flight_ < options_.max_concurrency)
+        {
+            in_flight_++;
+            return true;
+        }
+        waiting_.push_back(call);
+        return false;
+    }
+
+    void ReleaseSlot()
+    {
+        if (options_.max_concurrency <= 0)
+            return;
+        CallDataBase *next = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(admission_mutex_);
+            if (waiting_.empty())
+            {
+                in_flight_--;
+                return;
+            }
+            // Hand the slot straight to the oldest waiter.
+            next = waiting_.front();
+            waiting_.pop_front();
+        }
+        thread_pool_->post([next]()
+                           { next->Serve(); });
+    }
+
+    void HandleRpcs()
+    {
+        size_t num_worker_threads = std::thread::hardware_concurrency();
+        thread_pool_.reset(new WorkStealingPool(num_worker_threads));
+
+        (new GetCallData(&async_service_, cq_.get(), this))->Proceed(true);
+        (new PutCallData(&async_service_, cq_.get(), this))->Proceed(true);
+        (new DeleteCallData(&async_service_, cq_.get(), this))->Proceed(true);
+        (new GetLoadCallData(&async_service_, cq_.get(), this))->Proceed(true);
+        (new GetReadCountCallData(&async_service_, cq_.get(), this))->Proceed(true);
+        (new GetWriteCountCallData(&async_service_, cq_.get(), this))->Proceed(true);
+        (new StartRecordCallData(&async_service_, cq_.get(), this))->Proceed(true);
+
+        void *tag; // Uniquely identifies a request.
+        bool ok;
+
+        while (cq_->Next(&tag, &ok))
+        {
+            if (ok)
+            {
+                thread_pool_->post([tag]()
+                                   { static_cast<CallDataBase *>(tag)->Proceed(true); });
+            }
+            else
+            {
+                thread_pool_->post([tag]()
+                                   { delete static_cast<CallDataBase *>(tag); });
+            }
+        }
+        thread_pool_.reset();
+    }
+
+    Options options_;
+    ShardedStore store_;
+    CacheClient cache_client_;
+
+    std::unique_ptr<ServerCompletionQueue> cq_;
+    DBService::AsyncService async_service_;
+    std::unique_ptr<Server> server_;
+    std::unique_ptr<WorkStealingPool> thread_pool_;
+
+    /* Admission control */
+    std::mutex admission_mutex_;
+    std::deque<CallDataBase *> waiting_;
+    int in_flight_ = 0;
+
+    std::atomic<int64_t> read_count_{0};
+    std::atomic<int64_t> write_count_{0};
+    std::atomic<int32_t> num_invalidates_{0};
+    std::atomic<int32_t> num_updates_{0};
+};
+
+int main(int argc, char **argv)
+{
+    DBServiceImpl::Options options;
+    if (argc >= 2 && std::string(argv[1]) == "--help")
+    {
+        std::cerr << "Usage: " << argv[0]
+                  << " [<listen_addr>] [<cache_addr>] [<read_latency>] [<write_latency>] [<max_concurrency>] [<num_shards>] [<trace_file>]" << std::endl;
+        std::cerr << "Latency specs: none | const:US | uniform:LO:HI | exp:MEAN | lognormal:MEDIAN:SIGMA" << std::endl;
+        return 0;
+    }
+    if (argc >= 2)
+        options.listen_address = argv[1];
+    if (argc >= 3)
+        options.cache_address = argv[2];
+    if (argc >= 4 && !LatencyModel::Parse(argv[3], options.read_latency))
+        return 1;
+    if (argc >= 5 && !LatencyModel::Parse(argv[4], options.write_latency))
+        return 1;
+    if (argc >= 6)
+        options.max_concurrency = std::stoi(argv[5]);
+    if (argc >= 7)
+        options.num_shards = std::stoul(argv[6]);
+    if (argc >= 8)
+        tracing::DumpOnSignal(argv[7], "db");
+
+    DBServiceImpl service(options);
+    service.Run();
+    return 0;
+}
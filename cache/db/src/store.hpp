@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// In-memory key/value store split into independently locked shards, so
+// concurrent Gets and Puts on different keys rarely contend. Every write
+// bumps a per-key version; deletes keep the key as a tombstone so a later
+// Put continues from the deleted version instead of restarting at 1.
+class ShardedStore
+{
+public:
+    explicit ShardedStore(size_t num_shards)
+    {
+        if (num_shards == 0)
+            num_shards = 1;
+        for (size_t i = 0; i < num_shards; i++)
+            shards_.emplace_back(new Shard());
+    }
+
+    // Returns false for absent and deleted keys; version is set either way
+    // (0 if the key was never written). compressed says how the writer
+    // encoded value; the store never looks inside it.
+    bool Get(const std::string &key, std::string &value, uint64_t &version, bool &compressed)
+    {
+        Shard &shard = shard_for(key);
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end())
+        {
+            version = 0;
+            return false;
+        }
+        version = it->second.version;
+        if (it->second.deleted)
+            return false;
+        value = it->second.value;
+        compressed = it->second.compressed;
+        return true;
+    }
+
+    // Returns the version assigned to this write.
+    uint64_t Put(const std::string &key, const std::string &value, bool compressed = false)
+    {
+        Shard &shard = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        Entry &entry = shard.map[key];
+        entry.value = value;
+        entry.compressed = compressed;
+        if (entry.deleted)
+        {
+            entry.deleted = false;
+            shard.tombstones--;
+        }
+        return ++entry.version;
+    }
+
+    // On success, version is the version of the tombstone left behind.
+    bool Delete(const std::string &key, uint64_t &version)
+    {
+        Shard &shard = shard_for(key);
+        std::unique_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end() || it->second.deleted)
+            return false;
+        it->second.value.clear();
+        it->second.value.shrink_to_fit();
+        it->second.deleted = true;
+        version = ++it->second.version;
+        shard.tombstones++;
+        return true;
+    }
+
+    // Live keys only.
+    size_t size()
+    {
+        size_t total = 0;
+        for (auto &shard : shards_)
+        {
+            std::shared_lock<std::shared_mutex> lock(shard->mutex);
+            total += shard->map.size() - shard->tombstones;
+        }
+        return total;
+    }
+
+private:
+    struct Entry
+    {
+        std::string value;
+        uint64_t version = 0;
+        bool deleted = false;
+        bool compressed = false;
+    };
+
+    struct alignas(64) Shard
+    {
+        std::shared_mutex mutex;
+        std::unordered_map<std::string, Entry> map;
+        size_t tombstones = 0;
+    };
+
+    Shard &shard_for(const std::string &key)
+    {
+        return *shards_[std::hash<std::string>{}(key) % shards_.size()];
+    }
+
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
@@ -0,0 +1,141 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Compares the chained and bucketized hash index layouts of assoc.c
+ * (-o hash_index=...) without the rest of the server.
+ *
+ * Items are laid out in one large block, one per slab-sized chunk, and the
+ * table is sized to where a running server would have expanded it to for
+ * that many items: 1.5 items per bucket for chained, 3 for bucketized.
+ * Reports ns per insert, per hit, per miss and per delete, single
+ * threaded.
+ *
+ * From a configured source tree:
+ *   cc -O2 -DHAVE_CONFIG_H -I. -o hash_index_bench devtools/hash_index_bench.c assoc.c \
+ *       globals.c hash.c jenkins_hash.c murmur3_hash.c -lpthread -levent
+ *   ./hash_index_bench chained 100000000
+ *   ./hash_index_bench bucketized 100000000
+ *
+ * Needs about num_keys * (chunk size + 16) bytes; 100M keys at the default
+ * 96 byte chunk is ~11GB.
+ */
+#include "memcached.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* assoc.c's hooks into the rest of the server; only resizing uses them. */
+void STATS_LOCK(void) {}
+void STATS_UNLOCK(void) {}
+void item_lock(uint32_t hv) {}
+void item_unlock(uint32_t hv) {}
+void *item_trylock(uint32_t hv) { return NULL; }
+void item_trylock_unlock(void *arg) {}
+void thread_setname(pthread_t thread, const char *name) {}
+void read_epoch_synchronize(void) {}
+
+#define KEY_LEN 14 /* "k:" + 12 digits */
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void make_key(char *buf, char prefix, uint64_t n) {
+    buf[0] = prefix;
+    buf[1] = ':';
+    for (int i = KEY_LEN - 1; i >= 2; i--) {
+        buf[i] = '0' + n % 10;
+        n /= 10;
+    }
+}
+
+static uint64_t rng_state = 88172645463325252ULL;
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s chained|bucketized <num_keys> [<lookups>] [<chunk_size>]\n", argv[0]);
+        return 1;
+    }
+    bool bucketized = strcmp(argv[1], "bucketized") == 0;
+    if (!bucketized && strcmp(argv[1], "chained") != 0) {
+        fprintf(stderr, "Unknown hash index: %s\n", argv[1]);
+        return 1;
+    }
+    uint64_t num_keys = strtoull(argv[2], NULL, 10);
+    uint64_t lookups = argc > 3 ? strtoull(argv[3], NULL, 10) : 10000000;
+    size_t chunk = argc > 4 ? strtoul(argv[4], NULL, 10) : 96;
+    if (num_keys == 0 || chunk < sizeof(item) + KEY_LEN + 1) {
+        fprintf(stderr, "Bad key count or chunk size\n");
+        return 1;
+    }
+
+    settings.hash_index = bucketized ? HASH_INDEX_BUCKETIZED : HASH_INDEX_CHAINED;
+    hash_init(MURMUR3_HASH);
+
+    /* Where expansion would have left the table. */
+    int power = HASHPOWER_DEFAULT;
+    while (power < HASHPOWER_MAX &&
+           num_keys > (bucketized ? ((uint64_t)1 << power) * 3 : ((uint64_t)1 << power) * 3 / 2)) {
+        power++;
+    }
+    assoc_init(power);
+
+    char *slab = calloc(num_keys, chunk);
+    if (slab == NULL) {
+        fprintf(stderr, "Can't allocate %llu items\n", (unsigned long long)num_keys);
+        return 1;
+    }
+
+    char key[KEY_LEN];
+    double start = now_ns();
+    for (uint64_t i = 0; i < num_keys; i++) {
+        item *it = (item *)(slab + i * chunk);
+        it->nkey = KEY_LEN;
+        make_key(ITEM_key(it), 'k', i);
+        assoc_insert(it, hash(ITEM_key(it), KEY_LEN));
+    }
+    double insert_ns = (now_ns() - start) / num_keys;
+
+    uint64_t found = 0;
+    start = now_ns();
+    for (uint64_t i = 0; i < lookups; i++) {
+        make_key(key, 'k', rng() % num_keys);
+        found += assoc_find(key, KEY_LEN, hash(key, KEY_LEN)) != NULL;
+    }
+    double hit_ns = (now_ns() - start) / lookups;
+
+    uint64_t missed = 0;
+    start = now_ns();
+    for (uint64_t i = 0; i < lookups; i++) {
+        make_key(key, 'm', rng() % num_keys);
+        missed += assoc_find(key, KEY_LEN, hash(key, KEY_LEN)) == NULL;
+    }
+    double miss_ns = (now_ns() - start) / lookups;
+
+    /* Every other key, so buckets shrink but stay populated. */
+    start = now_ns();
+    for (uint64_t i = 0; i < num_keys; i += 2) {
+        make_key(key, 'k', i);
+        assoc_delete(key, KEY_LEN, hash(key, KEY_LEN));
+    }
+    double delete_ns = (now_ns() - start) / ((num_keys + 1) / 2);
+
+    printf("index=%s keys=%llu hashpower=%d hash_bytes=%llu\n", argv[1], (unsigned long long)num_keys,
+           power, (unsigned long long)stats_state.hash_bytes);
+    printf("insert_ns=%.1f hit_ns=%.1f miss_ns=%.1f delete_ns=%.1f\n", insert_ns, hit_ns, miss_ns, delete_ns);
+    if (found != lookups || missed != lookups) {
+        fprintf(stderr, "Lookups went wrong: %llu hits, %llu misses of %llu\n", (unsigned long long)found,
+                (unsigned long long)missed, (unsigned long long)lookups);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Hammers a single key with pipelined gets from a growing number of client
+ * threads, to see how GET hits scale when every request lands on the same
+ * item (and so the same item lock). Compare a server started with and
+ * without -o lockless_get, with -t at least as large as the thread count.
+ *
+ * Each client thread has its own connection and keeps a batch of gets in
+ * flight. Thread counts double from 1 up to max_threads; each step runs for
+ * the given number of seconds and reports gets per second.
+ *
+ *   cc -O2 -o hot_get_bench devtools/hot_get_bench.c -lpthread
+ *   memcached -t 64 -o lockless_get &
+ *   ./hot_get_bench 127.0.0.1 11211 64 5
+ */
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define KEY "hotkey"
+#define VALUE "0123456789abcdef0123456789abcdef"
+#define PIPELINE 32
+
+static const char *host;
+static const char *port;
+static volatile bool running;
+
+static int connect_server(void) {
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *ai;
+    int fd = -1;
+    int one = 1;
+
+    if (getaddrinfo(host, port, &hints, &ai) != 0) {
+        return -1;
+    }
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd != -1 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(ai);
+    if (fd != -1) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static bool write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Reads until count complete responses ("...END\r\n") have arrived. */
+static bool read_responses(int fd, char *buf, size_t size, int count) {
+    static const char end[] = "END\r\n";
+    size_t matched = 0;
+
+    while (count > 0) {
+        ssize_t n = read(fd, buf, size);
+        if (n <= 0) {
+            return false;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] == end[matched]) {
+                if (++matched == sizeof(end) - 1) {
+                    matched = 0;
+                    count--;
+                }
+            } else {
+                matched = buf[i] == end[0];
+            }
+        }
+    }
+    return true;
+}
+
+static void *client_thread(void *arg) {
+    uint64_t *gets = arg;
+    char req[PIPELINE * sizeof("get " KEY "\r\n")];
+    char buf[65536];
+    size_t reqlen = 0;
+    int fd;
+
+    if ((fd = connect_server()) == -1) {
+        fprintf(stderr, "Can't connect to %s:%s\n", host, port);
+        exit(1);
+    }
+    for (int i = 0; i < PIPELINE; i++) {
+        memcpy(req + reqlen, "get " KEY "\r\n", sizeof("get " KEY "\r\n") - 1);
+        reqlen += sizeof("get " KEY "\r\n") - 1;
+    }
+
+    while (running) {
+        if (!write_all(fd, req, reqlen) || !read_responses(fd, buf, sizeof(buf), PIPELINE)) {
+            fprintf(stderr, "Connection lost\n");
+            exit(1);
+        }
+        *gets += PIPELINE;
+    }
+    close(fd);
+    return NULL;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <host> <port> [<max_threads>] [<seconds>]\n", argv[0]);
+        return 1;
+    }
+    host = argv[1];
+    port = argv[2];
+    int max_threads = argc > 3 ? atoi(argv[3]) : 64;
+    int seconds = argc > 4 ? atoi(argv[4]) : 5;
+    if (max_threads < 1 || seconds < 1) {
+        fprintf(stderr, "Bad thread count or duration\n");
+        return 1;
+    }
+
+    /* Store the key and fetch it twice, so it's active before timing. */
+    int fd = connect_server();
+    char buf[1024];
+    if (fd == -1) {
+        fprintf(stderr, "Can't connect to %s:%s\n", host, port);
+        return 1;
+    }
+    const char *set = "set " KEY " 0 0 32\r\n" VALUE "\r\n";
+    if (!write_all(fd, set, strlen(set)) || read(fd, buf, sizeof(buf)) <= 0 ||
+        strncmp(buf, "STORED", 6) != 0) {
+        fprintf(stderr, "Couldn't store " KEY "\n");
+        return 1;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (!write_all(fd, "get " KEY "\r\n", sizeof("get " KEY "\r\n") - 1) ||
+            !read_responses(fd, buf, sizeof(buf), 1)) {
+            fprintf(stderr, "Couldn't fetch " KEY "\n");
+            return 1;
+        }
+    }
+    close(fd);
+
+    pthread_t *tids = calloc(max_threads, sizeof(pthread_t));
+    uint64_t *gets = calloc(max_threads, 64); /* a cache line per counter */
+    printf("threads gets/s\n");
+    for (int nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        memset(gets, 0, max_threads * 64);
+        running = true;
+        double start = now();
+        for (int i = 0; i < nthreads; i++) {
+            pthread_create(&tids[i], NULL, client_thread, &gets[i * 8]);
+        }
+        sleep(seconds);
+        running = false;
+        for (int i = 0; i < nthreads; i++) {
+            pthread_join(tids[i], NULL);
+        }
+        double elapsed = now() - start;
+        uint64_t total = 0;
+        for (int i = 0; i < nthreads; i++) {
+            total += gets[i * 8];
+        }
+        printf("%7d %.0f\n", nthreads, total / elapsed);
+        fflush(stdout);
+    }
+    free(tids);
+    free(gets);
+    return 0;
+}
@@ -0,0 +1,191 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Pipelined sets from a growing number of client threads, to see how item
+ * allocation scales. Each thread keeps overwriting its own set of keys, so
+ * every set allocates a chunk and frees the one it replaces, all in the
+ * same slab class. Compare a server started with and without
+ * -o slab_magazines, with -t at least as large as the thread count.
+ *
+ * Thread counts double from 1 up to max_threads; each step runs for the
+ * given number of seconds and reports sets per second.
+ *
+ *   cc -O2 -o set_bench devtools/set_bench.c -lpthread
+ *   memcached -t 32 -m 1024 -o slab_magazines &
+ *   ./set_bench 127.0.0.1 11211 32 5 100
+ */
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PIPELINE 32
+#define KEYS_PER_THREAD 10000
+
+static const char *host;
+static const char *port;
+static int value_size;
+static volatile bool running;
+
+typedef struct {
+    uint64_t sets;
+    int id;
+} __attribute__((aligned(64))) client; /* a cache line each */
+
+static int connect_server(void) {
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *ai;
+    int fd = -1;
+    int one = 1;
+
+    if (getaddrinfo(host, port, &hints, &ai) != 0) {
+        return -1;
+    }
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd != -1 && connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(ai);
+    if (fd != -1) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static bool write_all(int fd, const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n <= 0) {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+/* Reads until count "STORED\r\n" lines have arrived. Anything else (a
+ * SERVER_ERROR when out of memory) is a failure. */
+static bool read_stored(int fd, char *buf, size_t size, int count) {
+    static const char stored[] = "STORED\r\n";
+    size_t matched = 0;
+
+    while (count > 0) {
+        ssize_t n = read(fd, buf, size);
+        if (n <= 0) {
+            return false;
+        }
+        for (ssize_t i = 0; i < n; i++) {
+            if (buf[i] != stored[matched]) {
+                fprintf(stderr, "Set failed: %.*s\n", (int)(n - i), buf + i);
+                return false;
+            }
+            if (++matched == sizeof(stored) - 1) {
+                matched = 0;
+                count--;
+            }
+        }
+    }
+    return true;
+}
+
+static void *client_thread(void *arg) {
+    client *cl = arg;
+    size_t reqsize = PIPELINE * (64 + value_size + 2);
+    char *req = malloc(reqsize);
+    char *value = malloc(value_size);
+    char buf[4096];
+    unsigned int next = 0;
+    int fd;
+
+    if (req == NULL || value == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    if ((fd = connect_server()) == -1) {
+        fprintf(stderr, "Can't connect to %s:%s\n", host, port);
+        exit(1);
+    }
+    memset(value, 'v', value_size);
+
+    while (running) {
+        size_t reqlen = 0;
+        for (int i = 0; i < PIPELINE; i++) {
+            reqlen += snprintf(req + reqlen, reqsize - reqlen, "set bench:%d:%u 0 0 %d\r\n",
+                               cl->id, next, value_size);
+            memcpy(req + reqlen, value, value_size);
+            reqlen += value_size;
+            memcpy(req + reqlen, "\r\n", 2);
+            reqlen += 2;
+            next = (next + 1) % KEYS_PER_THREAD;
+        }
+        if (!write_all(fd, req, reqlen) || !read_stored(fd, buf, sizeof(buf), PIPELINE)) {
+            fprintf(stderr, "Connection lost\n");
+            exit(1);
+        }
+        cl->sets += PIPELINE;
+    }
+    close(fd);
+    free(req);
+    free(value);
+    return NULL;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s <host> <port> [<max_threads>] [<seconds>] [<value_size>]\n", argv[0]);
+        return 1;
+    }
+    host = argv[1];
+    port = argv[2];
+    int max_threads = argc > 3 ? atoi(argv[3]) : 32;
+    int seconds = argc > 4 ? atoi(argv[4]) : 5;
+    value_size = argc > 5 ? atoi(argv[5]) : 100;
+    if (max_threads < 1 || seconds < 1 || value_size < 1) {
+        fprintf(stderr, "Bad thread count, duration or value size\n");
+        return 1;
+    }
+
+    pthread_t *tids = calloc(max_threads, sizeof(pthread_t));
+    client *clients = calloc(max_threads, sizeof(client));
+    printf("threads sets/s\n");
+    for (int nthreads = 1; nthreads <= max_threads; nthreads *= 2) {
+        running = true;
+        double start = now();
+        for (int i = 0; i < nthreads; i++) {
+            clients[i].id = i;
+            clients[i].sets = 0;
+            pthread_create(&tids[i], NULL, client_thread, &clients[i]);
+        }
+        sleep(seconds);
+        running = false;
+        for (int i = 0; i < nthreads; i++) {
+            pthread_join(tids[i], NULL);
+        }
+        double elapsed = now() - start;
+        uint64_t total = 0;
+        for (int i = 0; i < nthreads; i++) {
+            total += clients[i].sets;
+        }
+        printf("%7d %.0f\n", nthreads, total / elapsed);
+        fflush(stdout);
+    }
+    free(tids);
+    free(clients);
+    return 0;
+}
@@ -0,0 +1,284 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * Hot key detection and thread-local response replicas. See hotkeys.h.
+ *
+ * Detection is a Space-Saving sketch per worker thread: a fixed set of
+ * counters, where an unseen key takes over the smallest one. One in
+ * HOTKEY_SAMPLE_RATE hits is counted, and counts halve every
+ * HOTKEY_WINDOW samples, so keys that cool off fall out again.
+ */
+#include "memcached.h"
+#include "hotkeys.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define HOTKEY_COUNTERS 32
+#define HOTKEY_REPLICAS 8
+#define HOTKEY_SAMPLE_RATE 16
+#define HOTKEY_WINDOW 1024
+/* Hot once a key holds about 1/64th of a thread's hits. */
+#define HOTKEY_MIN_COUNT (HOTKEY_WINDOW / 64)
+
+typedef struct {
+    uint32_t hv;
+    uint32_t count;
+    uint8_t nkey;
+    char key[KEY_MAX_LENGTH];
+} hotkey_counter;
+
+/* The full response for a key: "VALUE <key> <flags> <bytes>\r\n<data>\r\n" */
+typedef struct {
+    uint32_t hv;
+    unsigned int stamp;
+    rel_time_t exptime;
+    rel_time_t time;       /* item's last access time, for flush_all */
+    rel_time_t created;
+    uint8_t slabs_clsid;
+    uint8_t nkey;
+    int len;               /* 0 if the slot is free */
+    char resp[WRITE_BUFFER_SIZE];
+} hotkey_replica;
+
+typedef struct _hotkeys {
+    struct _hotkeys *next;
+    pthread_mutex_t lock;  /* counters, which stats readers look at */
+    unsigned int countdown;
+    unsigned int samples;
+    hotkey_counter counters[HOTKEY_COUNTERS];
+    hotkey_replica replicas[HOTKEY_REPLICAS]; /* only touched by the owner */
+    int nreplicas;
+} hotkeys;
+
+unsigned int *hotkey_stamps = NULL;
+static hotkeys *hotkeys_head = NULL;
+static pthread_mutex_t hotkeys_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void hotkeys_init(void) {
+    hotkey_stamps = calloc(1 << HOTKEY_STAMP_POWER, sizeof(unsigned int));
+    if (hotkey_stamps == NULL) {
+        fprintf(stderr, "Failed to allocate hot key stamps\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void *hotkeys_thread_create(void) {
+    hotkeys *h = calloc(1, sizeof(hotkeys));
+    if (h == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&h->lock, NULL);
+    h->countdown = HOTKEY_SAMPLE_RATE;
+
+    pthread_mutex_lock(&hotkeys_lock);
+    h->next = hotkeys_head;
+    hotkeys_head = h;
+    pthread_mutex_unlock(&hotkeys_lock);
+    return h;
+}
+
+static inline bool replica_matches(hotkey_replica *r, const char *key, const size_t nkey) {
+    /* The key sits right after "VALUE ". */
+    return r->len != 0 && r->nkey == nkey && memcmp(r->resp + 6, key, nkey) == 0;
+}
+
+static void replica_drop(hotkeys *h, hotkey_replica *r) {
+    r->len = 0;
+    h->nreplicas--;
+}
+
+/* Serves a GET from this thread's replica of the key, if there's a valid
+ * one. Returns the replicated item's slabs_clsid for hit stats, or 0 if
+ * the caller has to look the key up. */
+int hotkey_get(LIBEVENT_THREAD *t, const char *key, const size_t nkey, mc_resp *resp) {
+    hotkeys *h = t->hotkeys;
+    rel_time_t oldest_live = settings.oldest_live;
+
+    if (h->nreplicas == 0) {
+        return 0;
+    }
+    for (int i = 0; i < HOTKEY_REPLICAS; i++) {
+        hotkey_replica *r = &h->replicas[i];
+        if (!replica_matches(r, key, nkey)) {
+            continue;
+        }
+        /* Changed, expired or flushed since it was copied. Also let a GET
+         * through to the item now and then so it keeps its LRU position. */
+        if (__atomic_load_n(&hotkey_stamps[r->hv & HOTKEY_STAMP_MASK], __ATOMIC_ACQUIRE) != r->stamp
+            || (r->exptime != 0 && r->exptime <= current_time)
+            || (r->time <= oldest_live && oldest_live <= current_time)
+            || current_time - r->created >= ITEM_UPDATE_INTERVAL) {
+            replica_drop(h, r);
+            return 0;
+        }
+        memcpy(resp->wbuf, r->resp, r->len);
+        resp_add_iov(resp, resp->wbuf, r->len);
+        return r->slabs_clsid;
+    }
+    return 0;
+}
+
+/* Copies a hot item's response into a free (or the oldest) replica slot.
+ * The stamp is read under the item lock, so it matches what's copied. */
+static void replica_create(hotkeys *h, const uint32_t hv, item *it,
+                           const char *hdr, const int hdrlen) {
+    hotkey_replica *r = NULL;
+
+    if ((it->it_flags & (ITEM_CHUNKED|ITEM_HDR)) != 0 ||
+        hdrlen + it->nbytes > WRITE_BUFFER_SIZE) {
+        return;
+    }
+    for (int i = 0; i < HOTKEY_REPLICAS; i++) {
+        hotkey_replica *s = &h->replicas[i];
+        if (s->len == 0) {
+            r = s;
+            break;
+        }
+        if (r == NULL || s->created < r->created) {
+            r = s;
+        }
+    }
+    if (r->len != 0) {
+        replica_drop(h, r);
+    }
+
+    item_lock(hv);
+    if (it->it_flags & ITEM_LINKED) {
+        r->hv = hv;
+        r->stamp = __atomic_load_n(&hotkey_stamps[hv & HOTKEY_STAMP_MASK], __ATOMIC_ACQUIRE);
+        r->exptime = it->exptime;
+        r->time = it->time;
+        r->created = current_time;
+        r->slabs_clsid = it->slabs_clsid;
+        r->nkey = it->nkey;
+        memcpy(r->resp, hdr, hdrlen);
+        memcpy(r->resp + hdrlen, ITEM_data(it), it->nbytes);
+        r->len = hdrlen + it->nbytes;
+        h->nreplicas++;
+    }
+    item_unlock(hv);
+}
+
+/* Counts a sampled GET hit and replicates the key if it turned hot. hdr is
+ * the response line already rendered for the hit. */
+void hotkey_sample(LIBEVENT_THREAD *t, const char *key, const size_t nkey, item *it,
+                   const char *hdr, const int hdrlen) {
+    hotkeys *h = t->hotkeys;
+    hotkey_counter *c = NULL;
+    hotkey_counter *min = NULL;
+    bool hot;
+
+    if (--h->countdown != 0) {
+        return;
+    }
+    h->countdown = HOTKEY_SAMPLE_RATE;
+
+    uint32_t hv = hash(key, nkey);
+    pthread_mutex_lock(&h->lock);
+    for (int i = 0; i < HOTKEY_COUNTERS; i++) {
+        hotkey_counter *s = &h->counters[i];
+        if (s->hv == hv && s->nkey == nkey && memcmp(s->key, key, nkey) == 0) {
+            c = s;
+            break;
+        }
+        if (min == NULL || s->count < min->count) {
+            min = s;
+        }
+    }
+    if (c == NULL) {
+        /* Space-Saving: inherit the evicted count as the error bound. */
+        c = min;
+        c->hv = hv;
+        c->nkey = nkey;
+        memcpy(c->key, key, nkey);
+    }
+    c->count++;
+    hot = c->count >= HOTKEY_MIN_COUNT;
+
+    if (++h->samples >= HOTKEY_WINDOW) {
+        h->samples = 0;
+        for (int i = 0; i < HOTKEY_COUNTERS; i++) {
+            h->counters[i].count /= 2;
+        }
+    }
+    pthread_mutex_unlock(&h->lock);
+
+    if (hot) {
+        for (int i = 0; i < HOTKEY_REPLICAS; i++) {
+            if (replica_matches(&h->replicas[i], key, nkey)) {
+                return;
+            }
+        }
+        replica_create(h, hv, it, hdr, hdrlen);
+    }
+}
+
+typedef struct {
+    uint32_t count;
+    int threads;
+    uint8_t nkey;
+    char key[KEY_MAX_LENGTH];
+} hotkey_stat;
+
+static int hotkey_stat_cmp(const void *a, const void *b) {
+    const hotkey_stat *x = a;
+    const hotkey_stat *y = b;
+    return x->count < y->count ? 1 : (x->count > y->count ? -1 : 0);
+}
+
+/* Lists the keys any worker currently considers hot, hottest first, with
+ * an estimate of their GETs per window summed over workers. */
+void hotkeys_stats(ADD_STAT add_stats, void *c) {
+    char key_str[STAT_KEY_LEN];
+    char val_str[STAT_VAL_LEN];
+    int klen = 0, vlen = 0;
+    hotkey_stat *hs;
+    int nhs = 0;
+
+    if (hotkey_stamps == NULL) {
+        APPEND_STAT("hotkeys_status", "disabled", "");
+        add_stats(NULL, 0, NULL, 0, c);
+        return;
+    }
+
+    hs = calloc(settings.num_threads * HOTKEY_COUNTERS, sizeof(hotkey_stat));
+    if (hs == NULL) {
+        add_stats(NULL, 0, NULL, 0, c);
+        return;
+    }
+    pthread_mutex_lock(&hotkeys_lock);
+    for (hotkeys *h = hotkeys_head; h != NULL; h = h->next) {
+        pthread_mutex_lock(&h->lock);
+        for (int i = 0; i < HOTKEY_COUNTERS; i++) {
+            hotkey_counter *hc = &h->counters[i];
+            int x;
+            if (hc->count < HOTKEY_MIN_COUNT) {
+                continue;
+            }
+            for (x = 0; x < nhs; x++) {
+                if (hs[x].nkey == hc->nkey && memcmp(hs[x].key, hc->key, hc->nkey) == 0) {
+                    break;
+                }
+            }
+            if (x == nhs) {
+                hs[x].nkey = hc->nkey;
+                memcpy(hs[x].key, hc->key, hc->nkey);
+                nhs++;
+            }
+            hs[x].count += hc->count;
+            hs[x].threads++;
+        }
+        pthread_mutex_unlock(&h->lock);
+    }
+    pthread_mutex_unlock(&hotkeys_lock);
+
+    qsort(hs, nhs, sizeof(hotkey_stat), hotkey_stat_cmp);
+    for (int i = 0; i < nhs; i++) {
+        klen = snprintf(key_str, STAT_KEY_LEN, "%d:key", i);
+        add_stats(key_str, klen, hs[i].key, hs[i].nkey, c);
+        APPEND_NUM_STAT(i, "gets", "%u", hs[i].count * HOTKEY_SAMPLE_RATE);
+        APPEND_NUM_STAT(i, "threads", "%d", hs[i].threads);
+    }
+    free(hs);
+
+    add_stats(NULL, 0, NULL, 0, c);
+}
@@ -0,0 +1,36 @@
+#ifndef HOTKEYS_H
+#define HOTKEYS_H
+
+/* Hot key replication (-o hot_keys).
+ *
+ * Each worker samples its GET hits into a small heavy-hitter sketch. Keys
+ * that take a large enough share of a worker's hits get a thread-local
+ * copy of their rendered response, so further GETs for them are answered
+ * without touching the item, its lock or the LRU.
+ *
+ * Copies are checked against a table of stamps indexed by hash value,
+ * bumped whenever an item is linked, unlinked or changed in place under
+ * its item lock. A copy whose stamp moved is dropped.
+ */
+
+#define HOTKEY_STAMP_POWER 16
+#define HOTKEY_STAMP_MASK ((1 << HOTKEY_STAMP_POWER) - 1)
+
+extern unsigned int *hotkey_stamps;
+
+/* Call with the item lock for hv held, after changing what a GET for any
+ * key with that hash would return. */
+static inline void hotkey_invalidate(const uint32_t hv) {
+    if (hotkey_stamps != NULL) {
+        __atomic_add_fetch(&hotkey_stamps[hv & HOTKEY_STAMP_MASK], 1, __ATOMIC_RELEASE);
+    }
+}
+
+void hotkeys_init(void);
+void *hotkeys_thread_create(void);
+int hotkey_get(LIBEVENT_THREAD *t, const char *key, const size_t nkey, mc_resp *resp);
+void hotkey_sample(LIBEVENT_THREAD *t, const char *key, const size_t nkey, item *it,
+                   const char *hdr, const int hdrlen);
+void hotkeys_stats(ADD_STAT add_stats, void *c);
+
+#endif
@@ -24,6 +24,8 @@
 /* Forward Declarations */
 static void item_link_q(item *it);
 static void item_unlink_q(item *it);
+static int s3fifo_evict(const int id);
+static bool s3fifo_ghost_take(const uint32_t hv);
 
 static unsigned int lru_type_map[4] = {HOT_LRU, WARM_LRU, COLD_LRU, TEMP_LRU};
 
@@ -49,6 +51,9 @@ typedef struct {
     uint64_t hits_to_cold;
     uint64_t hits_to_temp;
     uint64_t mem_requested;
+    uint64_t lru_lock_waits; /* contended acquisitions of this LRU's lock */
+    uint64_t lru_lock_wait_ns; /* and the time spent waiting on them */
+    uint64_t ghost_hits; /* new items sent straight to S3-FIFO's main queue */
     rel_time_t evicted_time;
 } itemstats_t;
 
@@ -65,10 +70,49 @@ static volatile int do_run_lru_maintainer_thread = 0;
 static pthread_mutex_t lru_maintainer_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t cas_id_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* With lockless_get, freed items wait here until no reader can still be
+ * looking at them (see read_epoch_* in thread.c). New frees collect on
+ * deferred_pending; a full batch moves to deferred_waiting, tagged with the
+ * epoch it closed, and goes back to the slabs once that epoch has passed.
+ * Linked through it->next, which is unused once an item is off the LRU;
+ * h_next stays intact for readers still walking a chain. */
+#define ITEM_DEFER_BATCH 64
+static pthread_mutex_t deferred_lock = PTHREAD_MUTEX_INITIALIZER;
+static item *deferred_pending = NULL;
+static item *deferred_waiting = NULL;
+static uint64_t deferred_epoch = 0;
+static unsigned int deferred_count = 0;
+
+static inline uint64_t lru_lock_clock(void) {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+#endif
+}
+
+/* Takes an LRU lock. Contended acquisitions are timed and counted against
+ * that LRU once the lock is held. */
+void lru_lock(const unsigned int id) {
+    uint64_t start;
+
+    if (pthread_mutex_trylock(&lru_locks[id]) == 0) {
+        return;
+    }
+    start = lru_lock_clock();
+    pthread_mutex_lock(&lru_locks[id]);
+    itemstats[id].lru_lock_waits++;
+    itemstats[id].lru_lock_wait_ns += lru_lock_clock() - start;
+}
+
 void item_stats_reset(void) {
     int i;
     for (i = 0; i < LARGEST_ID; i++) {
-        pthread_mutex_lock(&lru_locks[i]);
+        lru_lock(i);
         memset(&itemstats[i], 0, sizeof(itemstats_t));
         pthread_mutex_unlock(&lru_locks[i]);
     }
@@ -82,6 +126,8 @@ void do_item_stats_add_crawl(const int i, const uint64_t reclaimed,
     itemstats[i].crawler_items_checked += checked;
 }
 
+/* Per worker thread log of LRU moves (COLD to WARM promotions), applied
+ * by the LRU maintainer so workers don't take LRU locks for them. */
 typedef struct _lru_bump_buf {
     struct _lru_bump_buf *prev;
     struct _lru_bump_buf *next;
@@ -175,12 +221,23 @@ item *do_item_alloc_pull(const size_t ntotal, const unsigned int id) {
      */
     for (i = 0; i < 10; i++) {
         /* Try to reclaim memory first */
-        if (!settings.lru_segmented) {
+        if (!settings.lru_segmented && settings.eviction_policy == EVICTION_LRU) {
             lru_pull_tail(id, COLD_LRU, 0, 0, 0, NULL);
         }
         it = slabs_alloc(ntotal, id, 0);
 
+        if (it == NULL && settings.lockless_get) {
+            item_reclaim_deferred();
+            it = slabs_alloc(ntotal, id, 0);
+        }
+
         if (it == NULL) {
+            if (settings.eviction_policy == EVICTION_S3FIFO) {
+                if (s3fifo_evict(id) <= 0) {
+                    break;
+                }
+                continue;
+            }
             // We send '0' in for "total_bytes" as this routine is always
             // pulling to evict, or forcing HOT -> COLD migration.
             // As of this writing, total_bytes isn't at all used with COLD_LRU.
@@ -197,7 +254,7 @@ item *do_item_alloc_pull(const size_t ntotal, const unsigned int id) {
     }
 
     if (i > 0) {
-        pthread_mutex_lock(&lru_locks[id]);
+        lru_lock(id);
         itemstats[id].direct_reclaims += i;
         pthread_mutex_unlock(&lru_locks[id]);
     }
@@ -299,7 +356,7 @@ item *do_item_alloc(const char *key, const size_t nkey, const client_flags_t fla
     }
 
     if (it == NULL) {
-        pthread_mutex_lock(&lru_locks[id]);
+        lru_lock(id);
         itemstats[id].outofmemory++;
         pthread_mutex_unlock(&lru_locks[id]);
         return NULL;
@@ -319,6 +376,9 @@ item *do_item_alloc(const char *key, const size_t nkey, const client_flags_t fla
         id |= TEMP_LRU;
     } else if (settings.lru_segmented) {
         id |= HOT_LRU;
+    } else if (settings.eviction_policy == EVICTION_S3FIFO) {
+        /* S3-FIFO's small queue */
+        id |= HOT_LRU;
     } else {
         /* There is only COLD in compat-mode */
         id |= COLD_LRU;
@@ -363,9 +423,46 @@ void item_free(item *it) {
     /* so slab size changer can tell later if item is already free or not */
     clsid = ITEM_clsid(it);
     DEBUG_REFCNT(it, 'F');
+    if (settings.lockless_get) {
+        bool reclaim;
+        pthread_mutex_lock(&deferred_lock);
+        it->next = ITEM_REF(deferred_pending);
+        deferred_pending = it;
+        reclaim = ++deferred_count >= ITEM_DEFER_BATCH;
+        pthread_mutex_unlock(&deferred_lock);
+        if (reclaim) {
+            item_reclaim_deferred();
+        }
+        return;
+    }
     slabs_free(it, ntotal, clsid);
 }
 
+/* Returns deferred items to the slabs once no reader can see them anymore.
+ * Called on frees, on allocation failures and from the clock. */
+void item_reclaim_deferred(void) {
+    item *done = NULL;
+
+    pthread_mutex_lock(&deferred_lock);
+    if (deferred_waiting != NULL && read_epoch_passed(deferred_epoch)) {
+        done = deferred_waiting;
+        deferred_waiting = NULL;
+    }
+    if (deferred_waiting == NULL && deferred_pending != NULL) {
+        deferred_waiting = deferred_pending;
+        deferred_epoch = read_epoch_advance();
+        deferred_pending = NULL;
+        deferred_count = 0;
+    }
+    pthread_mutex_unlock(&deferred_lock);
+
+    while (done != NULL) {
+        item *next = ITEM_PTR(done->next);
+        slabs_free(done, ITEM_ntotal(done), ITEM_clsid(done));
+        done = next;
+    }
+}
+
 /**
  * Returns true if an item will fit in the cache (its size does not exceed
  * the maximum for a cache entry.)
@@ -419,8 +516,8 @@ static void do_item_link_q(item *it) { /* item is the new head */
     assert(it != *head);
     assert((*head && *tail) || (*head == 0 && *tail == 0));
     it->prev = 0;
-    it->next = *head;
-    if (it->next) it->next->prev = it;
+    it->next = ITEM_REF(*head);
+    if (*head) (*head)->prev = ITEM_REF(it);
     *head = it;
     if (*tail == 0) *tail = it;
     sizes[it->slabs_clsid]++;
@@ -438,18 +535,25 @@ static void do_item_link_q(item *it) { /* item is the new head */
 }
 
 static void item_link_q(item *it) {
-    pthread_mutex_lock(&lru_locks[it->slabs_clsid]);
+    lru_lock(it->slabs_clsid);
     do_item_link_q(it);
     pthread_mutex_unlock(&lru_locks[it->slabs_clsid]);
 }
 
 static void item_link_q_warm(item *it) {
-    pthread_mutex_lock(&lru_locks[it->slabs_clsid]);
+    lru_lock(it->slabs_clsid);
     do_item_link_q(it);
     itemstats[it->slabs_clsid].moves_to_warm++;
     pthread_mutex_unlock(&lru_locks[it->slabs_clsid]);
 }
 
+static void item_link_q_ghost(item *it) {
+    lru_lock(it->slabs_clsid);
+    do_item_link_q(it);
+    itemstats[it->slabs_clsid].ghost_hits++;
+    pthread_mutex_unlock(&lru_locks[it->slabs_clsid]);
+}
+
 static void do_item_unlink_q(item *it) {
     item **head, **tail;
     head = &heads[it->slabs_clsid];
@@ -457,17 +561,17 @@ static void do_item_unlink_q(item *it) {
 
     if (*head == it) {
         assert(it->prev == 0);
-        *head = it->next;
+        *head = ITEM_PTR(it->next);
     }
     if (*tail == it) {
         assert(it->next == 0);
-        *tail = it->prev;
+        *tail = ITEM_PTR(it->prev);
     }
-    assert(it->next != it);
-    assert(it->prev != it);
+    assert(ITEM_PTR(it->next) != it);
+    assert(ITEM_PTR(it->prev) != it);
 
-    if (it->next) it->next->prev = it->prev;
-    if (it->prev) it->prev->next = it->next;
+    if (it->next) ITEM_PTR(it->next)->prev = it->prev;
+    if (it->prev) ITEM_PTR(it->prev)->next = it->next;
     sizes[it->slabs_clsid]--;
 #ifdef EXTSTORE
     if (it->it_flags & ITEM_HDR) {
@@ -483,7 +587,7 @@ static void do_item_unlink_q(item *it) {
 }
 
 static void item_unlink_q(item *it) {
-    pthread_mutex_lock(&lru_locks[it->slabs_clsid]);
+    lru_lock(it->slabs_clsid);
     do_item_unlink_q(it);
     pthread_mutex_unlock(&lru_locks[it->slabs_clsid]);
 }
@@ -503,7 +607,15 @@ int do_item_link(item *it, const uint32_t hv, const uint64_t cas) {
     /* Allocate a new CAS ID on link. */
     ITEM_set_cas(it, cas);
     assoc_insert(it, hv);
-    item_link_q(it);
+    hotkey_invalidate(hv);
+    /* Keys evicted from S3-FIFO's small queue not long ago skip it. */
+    if (settings.eviction_policy == EVICTION_S3FIFO && ITEM_lruid(it) == HOT_LRU
+            && s3fifo_ghost_take(hv)) {
+        it->slabs_clsid = ITEM_clsid(it) | COLD_LRU;
+        item_link_q_ghost(it);
+    } else {
+        item_link_q(it);
+    }
     refcount_incr(it);
     item_stats_sizes_add(it);
 
@@ -520,6 +632,7 @@ void do_item_unlink(item *it, const uint32_t hv) {
         STATS_UNLOCK();
         item_stats_sizes_remove(it);
         assoc_delete(ITEM_key(it), it->nkey, hv);
+        hotkey_invalidate(hv);
         item_unlink_q(it);
         do_item_remove(it);
     }
@@ -536,6 +649,7 @@ void do_item_unlink_nolock(item *it, const uint32_t hv) {
         STATS_UNLOCK();
         item_stats_sizes_remove(it);
         assoc_delete(ITEM_key(it), it->nkey, hv);
+        hotkey_invalidate(hv);
         do_item_unlink_q(it);
         do_item_remove(it);
     }
@@ -555,8 +669,14 @@ void do_item_remove(item *it) {
 void do_item_update(item *it) {
     MEMCACHED_ITEM_UPDATE(ITEM_key(it), it->nkey, it->nbytes);
 
+    /* S3-FIFO only moves items as they reach a queue's tail. */
+    if (settings.eviction_policy == EVICTION_S3FIFO) {
+        assert((it->it_flags & ITEM_SLABBED) == 0);
+        if ((it->it_flags & ITEM_LINKED) != 0) {
+            it->time = current_time;
+        }
     /* Hits to COLD_LRU immediately move to WARM. */
-    if (settings.lru_segmented) {
+    } else if (settings.lru_segmented) {
         assert((it->it_flags & ITEM_SLABBED) == 0);
         if ((it->it_flags & ITEM_LINKED) != 0) {
             if (ITEM_lruid(it) == COLD_LRU && (it->it_flags & ITEM_ACTIVE)) {
@@ -601,10 +721,10 @@ void item_flush_expired(void) {
          * back until we hit an item older than the oldest_live time.
          * The oldest_live checking will auto-expire the remaining items.
          */
-        pthread_mutex_lock(&lru_locks[i]);
+        lru_lock(i);
         for (iter = heads[i]; iter != NULL; iter = next) {
             void *hold_lock = NULL;
-            next = iter->next;
+            next = ITEM_PTR(iter->next);
             if (iter->time == 0 && iter->nkey == 0 && iter->it_flags == 1) {
                 continue; // crawler item.
             }
@@ -654,7 +774,7 @@ char *item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, u
     unsigned int id = slabs_clsid;
     id |= COLD_LRU;
 
-    pthread_mutex_lock(&lru_locks[id]);
+    lru_lock(id);
     it = heads[id];
 
     buffer = malloc((size_t)memlimit);
@@ -668,7 +788,7 @@ char *item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, u
         assert(it->nkey <= KEY_MAX_LENGTH);
         // protect from printing binary keys.
         if ((it->nbytes == 0 && it->nkey == 0) || (it->it_flags & ITEM_KEY_BINARY)) {
-            it = it->next;
+            it = ITEM_PTR(it->next);
             continue;
         }
         /* Copy the key since it may not be null-terminated in the struct */
@@ -683,7 +803,7 @@ char *item_cachedump(const unsigned int slabs_clsid, const unsigned int limit, u
         memcpy(buffer + bufcurr, temp, len);
         bufcurr += len;
         shown++;
-        it = it->next;
+        it = ITEM_PTR(it->next);
     }
 
     memcpy(buffer + bufcurr, "END\r\n", 6);
@@ -704,20 +824,20 @@ void fill_item_stats_automove(item_stats_automove *am) {
 
         // outofmemory records into HOT
         int i = n | HOT_LRU;
-        pthread_mutex_lock(&lru_locks[i]);
+        lru_lock(i);
         cur->outofmemory = itemstats[i].outofmemory;
         pthread_mutex_unlock(&lru_locks[i]);
 
         // evictions and tail age are from COLD
         i = n | COLD_LRU;
-        pthread_mutex_lock(&lru_locks[i]);
+        lru_lock(i);
         cur->evicted = itemstats[i].evicted;
         if (!tails[i]) {
             cur->age = 0;
         } else if (tails[i]->nbytes == 0 && tails[i]->nkey == 0 && tails[i]->it_flags == 1) {
             /* it's a crawler, check previous entry */
             if (tails[i]->prev) {
-               cur->age = current_time - tails[i]->prev->time;
+               cur->age = current_time - ITEM_PTR(tails[i]->prev)->time;
             } else {
                cur->age = 0;
             }
@@ -737,7 +857,7 @@ void item_stats_totals(ADD_STAT add_stats, void *c) {
         int i;
         for (x = 0; x < 4; x++) {
             i = n | lru_type_map[x];
-            pthread_mutex_lock(&lru_locks[i]);
+            lru_lock(i);
             totals.evicted += itemstats[i].evicted;
             totals.reclaimed += itemstats[i].reclaimed;
             totals.expired_unfetched += itemstats[i].expired_unfetched;
@@ -750,6 +870,9 @@ void item_stats_totals(ADD_STAT add_stats, void *c) {
             totals.moves_to_warm += itemstats[i].moves_to_warm;
             totals.moves_within_lru += itemstats[i].moves_within_lru;
             totals.direct_reclaims += itemstats[i].direct_reclaims;
+            totals.lru_lock_waits += itemstats[i].lru_lock_waits;
+            totals.lru_lock_wait_ns += itemstats[i].lru_lock_wait_ns;
+            totals.ghost_hits += itemstats[i].ghost_hits;
             pthread_mutex_unlock(&lru_locks[i]);
         }
     }
@@ -757,7 +880,7 @@ void item_stats_totals(ADD_STAT add_stats, void *c) {
                 (unsigned long long)totals.expired_unfetched);
     APPEND_STAT("evicted_unfetched", "%llu",
                 (unsigned long long)totals.evicted_unfetched);
-    if (settings.lru_maintainer_thread) {
+    if (settings.lru_maintainer_thread || settings.eviction_policy == EVICTION_S3FIFO) {
         APPEND_STAT("evicted_active", "%llu",
                     (unsigned long long)totals.evicted_active);
     }
@@ -771,7 +894,15 @@ void item_stats_totals(ADD_STAT add_stats, void *c) {
                 (unsigned long long)totals.crawler_items_checked);
     APPEND_STAT("lrutail_reflocked", "%llu",
                 (unsigned long long)totals.lrutail_reflocked);
-    if (settings.lru_maintainer_thread) {
+    APPEND_STAT("lru_lock_waits", "%llu",
+                (unsigned long long)totals.lru_lock_waits);
+    APPEND_STAT("lru_lock_wait_us", "%llu",
+                (unsigned long long)totals.lru_lock_wait_ns / 1000);
+    if (settings.eviction_policy == EVICTION_S3FIFO) {
+        APPEND_STAT("ghost_hits", "%llu",
+                    (unsigned long long)totals.ghost_hits);
+    }
+    if (settings.lru_maintainer_thread || settings.eviction_policy == EVICTION_S3FIFO) {
         APPEND_STAT("moves_to_cold", "%llu",
                     (unsigned long long)totals.moves_to_cold);
         APPEND_STAT("moves_to_warm", "%llu",
@@ -805,7 +936,7 @@ void item_stats(ADD_STAT add_stats, void *c) {
         int klen = 0, vlen = 0;
         for (x = 0; x < 4; x++) {
             i = n | lru_type_map[x];
-            pthread_mutex_lock(&lru_locks[i]);
+            lru_lock(i);
             totals.evicted += itemstats[i].evicted;
             totals.evicted_nonzero += itemstats[i].evicted_nonzero;
             totals.reclaimed += itemstats[i].reclaimed;
@@ -821,6 +952,9 @@ void item_stats(ADD_STAT add_stats, void *c) {
             totals.moves_to_warm += itemstats[i].moves_to_warm;
             totals.moves_within_lru += itemstats[i].moves_within_lru;
             totals.direct_reclaims += itemstats[i].direct_reclaims;
+            totals.lru_lock_waits += itemstats[i].lru_lock_waits;
+            totals.lru_lock_wait_ns += itemstats[i].lru_lock_wait_ns;
+            totals.ghost_hits += itemstats[i].ghost_hits;
             totals.mem_requested += sizes_bytes[i];
             size += sizes[i];
             lru_size_map[x] = sizes[i];
@@ -852,7 +986,7 @@ void item_stats(ADD_STAT add_stats, void *c) {
         if (size == 0)
             continue;
         APPEND_NUM_FMT_STAT(fmt, n, "number", "%u", size);
-        if (settings.lru_maintainer_thread) {
+        if (settings.lru_maintainer_thread || settings.eviction_policy == EVICTION_S3FIFO) {
             APPEND_NUM_FMT_STAT(fmt, n, "number_hot", "%u", lru_size_map[0]);
             APPEND_NUM_FMT_STAT(fmt, n, "number_warm", "%u", lru_size_map[1]);
             APPEND_NUM_FMT_STAT(fmt, n, "number_cold", "%u", lru_size_map[2]);
@@ -880,7 +1014,7 @@ void item_stats(ADD_STAT add_stats, void *c) {
                             "%llu", (unsigned long long)totals.expired_unfetched);
         APPEND_NUM_FMT_STAT(fmt, n, "evicted_unfetched",
                             "%llu", (unsigned long long)totals.evicted_unfetched);
-        if (settings.lru_maintainer_thread) {
+        if (settings.lru_maintainer_thread || settings.eviction_policy == EVICTION_S3FIFO) {
             APPEND_NUM_FMT_STAT(fmt, n, "evicted_active",
                                 "%llu", (unsigned long long)totals.evicted_active);
         }
@@ -890,7 +1024,15 @@ void item_stats(ADD_STAT add_stats, void *c) {
                             "%llu", (unsigned long long)totals.crawler_items_checked);
         APPEND_NUM_FMT_STAT(fmt, n, "lrutail_reflocked",
                             "%llu", (unsigned long long)totals.lrutail_reflocked);
-        if (settings.lru_maintainer_thread) {
+        APPEND_NUM_FMT_STAT(fmt, n, "lru_lock_waits",
+                            "%llu", (unsigned long long)totals.lru_lock_waits);
+        APPEND_NUM_FMT_STAT(fmt, n, "lru_lock_wait_us",
+                            "%llu", (unsigned long long)totals.lru_lock_wait_ns / 1000);
+        if (settings.eviction_policy == EVICTION_S3FIFO) {
+            APPEND_NUM_FMT_STAT(fmt, n, "ghost_hits",
+                                "%llu", (unsigned long long)totals.ghost_hits);
+        }
+        if (settings.lru_maintainer_thread || settings.eviction_policy == EVICTION_S3FIFO) {
             APPEND_NUM_FMT_STAT(fmt, n, "moves_to_cold",
                                 "%llu", (unsigned long long)totals.moves_to_cold);
             APPEND_NUM_FMT_STAT(fmt, n, "moves_to_warm",
@@ -976,6 +1118,176 @@ void item_stats_sizes(ADD_STAT add_stats, void *c) {
     add_stats(NULL, 0, NULL, 0, c);
 }
 
+/* Candidate class sizes the planner considers. More distinct sizes than this
+ * get merged into neighbouring groups. */
+#define SIZES_PLAN_POINTS 512
+
+typedef struct {
+    uint32_t size;   /* chunk size a class ending here would have */
+    uint64_t count;  /* items above the previous point, up to size */
+    uint64_t bytes;  /* estimated total size of those items */
+} sizes_plan_point;
+
+/* Plans slab class sizes for the items in the size histogram: as many
+ * classes as there are now below slab_chunk_max, placed to waste the least
+ * memory rounding items up to their chunk size. Item sizes are only known
+ * to 32 bytes, so each is taken as the middle of its histogram bucket.
+ *
+ * It only plans: the result is a slab_sizes list to restart with, along
+ * with the waste it'd save. Moving a running cache onto it would need the
+ * new classes in spare ids above power_largest, size lookup that copes with
+ * ids out of size order, and the rebalancer draining old pages into them;
+ * none of that is done here. */
+void item_stats_sizes_plan(ADD_STAT add_stats, void *c) {
+    sizes_plan_point *pts = NULL;
+    uint64_t *dp = NULL;
+    uint16_t *choice = NULL;
+    uint64_t items = 0, waste_current = 0;
+    uint32_t min_size = settings.chunk_size;
+    int nclasses = 0, nplanned, npts = 0, last_bucket;
+
+    if (stats_sizes_hist == NULL) {
+        APPEND_STAT("sizes_status", "disabled", "");
+        add_stats(NULL, 0, NULL, 0, c);
+        return;
+    }
+
+    if (min_size % CHUNK_ALIGN_BYTES)
+        min_size += CHUNK_ALIGN_BYTES - (min_size % CHUNK_ALIGN_BYTES);
+    while (POWER_SMALLEST + nclasses < MAX_NUMBER_OF_SLAB_CLASSES - 1 &&
+           slabs_size(POWER_SMALLEST + nclasses) != 0 &&
+           slabs_size(POWER_SMALLEST + nclasses) < settings.slab_chunk_size_max) {
+        nclasses++;
+    }
+    /* Larger items are chunked, the plan doesn't change anything for them. */
+    last_bucket = settings.slab_chunk_size_max / 32;
+    if (last_bucket >= stats_sizes_buckets)
+        last_bucket = stats_sizes_buckets - 1;
+
+    pts = calloc(last_bucket + 1, sizeof(sizes_plan_point));
+    if (pts == NULL)
+        goto error;
+
+    /* One point per size seen, with what the current classes waste on it. */
+    for (int b = 1; b <= last_bucket; b++) {
+        unsigned int n = stats_sizes_hist[b];
+        uint32_t mid = b * 32 - 16;
+        uint32_t size = b * 32 < min_size ? min_size : b * 32;
+        if (n == 0)
+            continue;
+        if (npts == 0 || pts[npts-1].size != size) {
+            pts[npts++].size = size;
+        }
+        pts[npts-1].count += n;
+        pts[npts-1].bytes += (uint64_t)n * mid;
+        items += n;
+        waste_current += (uint64_t)n * (slabs_size(slabs_clsid(mid)) - mid);
+    }
+
+    if (npts > SIZES_PLAN_POINTS) {
+        int group = (npts + SIZES_PLAN_POINTS - 1) / SIZES_PLAN_POINTS;
+        int merged = 0;
+        for (int i = 0; i < npts; i++) {
+            sizes_plan_point p = pts[i];
+            sizes_plan_point *m = &pts[i / group];
+            if (i % group == 0) {
+                merged++;
+                m->count = 0;
+                m->bytes = 0;
+            }
+            m->count += p.count;
+            m->bytes += p.bytes;
+            m->size = p.size;
+        }
+        npts = merged;
+    }
+    nplanned = nclasses > npts ? npts : nclasses;
+
+    /* dp[k][i]: least waste for the first i points in k classes, the last
+     * one ending at point i. choice[k][i] is where that last class starts. */
+    if (npts > 0) {
+        dp = calloc((size_t)(nplanned + 1) * (npts + 1), sizeof(uint64_t));
+        choice = calloc((size_t)(nplanned + 1) * (npts + 1), sizeof(uint16_t));
+        if (dp == NULL || choice == NULL)
+            goto error;
+    }
+#define PLAN_IDX(k, i) ((size_t)(k) * (npts + 1) + (i))
+    for (int i = 1; i <= npts; i++) {
+        /* Turn counts and bytes into prefix sums over points 1..i. */
+        pts[i-1].count += i > 1 ? pts[i-2].count : 0;
+        pts[i-1].bytes += i > 1 ? pts[i-2].bytes : 0;
+        dp[PLAN_IDX(1, i)] = pts[i-1].size * pts[i-1].count - pts[i-1].bytes;
+        choice[PLAN_IDX(1, i)] = 1;
+    }
+    for (int k = 2; k <= nplanned; k++) {
+        for (int i = k; i <= npts; i++) {
+            uint64_t best = UINT64_MAX;
+            for (int j = k; j <= i; j++) {
+                uint64_t count = pts[i-1].count - pts[j-2].count;
+                uint64_t bytes = pts[i-1].bytes - pts[j-2].bytes;
+                uint64_t cost = dp[PLAN_IDX(k-1, j-1)] + pts[i-1].size * count - bytes;
+                if (cost < best) {
+                    best = cost;
+                    choice[PLAN_IDX(k, i)] = j;
+                }
+            }
+            dp[PLAN_IDX(k, i)] = best;
+        }
+    }
+
+    {
+        uint32_t sizes[MAX_NUMBER_OF_SLAB_CLASSES];
+        char list[MAX_NUMBER_OF_SLAB_CLASSES * 12];
+        uint64_t waste_planned = npts ? dp[PLAN_IDX(nplanned, npts)] : 0;
+        int len = 0;
+
+        for (int k = nplanned, i = npts; k > 0; k--) {
+            sizes[k-1] = pts[i-1].size;
+            i = choice[PLAN_IDX(k, i)] - 1;
+        }
+        /* Spare classes grow by the factor past the largest size seen, so
+         * items that show up later don't all land in slab_chunk_max. */
+        while (nplanned < nclasses) {
+            uint32_t size = nplanned ? sizes[nplanned-1] * settings.factor : min_size;
+            if (size % CHUNK_ALIGN_BYTES)
+                size += CHUNK_ALIGN_BYTES - (size % CHUNK_ALIGN_BYTES);
+            if (nplanned && size <= sizes[nplanned-1] + CHUNK_ALIGN_BYTES)
+                size = sizes[nplanned-1] + CHUNK_ALIGN_BYTES * 2;
+            if (size >= settings.slab_chunk_size_max)
+                break;
+            sizes[nplanned++] = size;
+        }
+        nclasses = nplanned;
+        list[0] = '\0';
+        for (int k = 0; k < nclasses; k++) {
+            len += snprintf(list + len, sizeof(list) - len, "%s%u",
+                    k ? "-" : "", sizes[k]);
+        }
+
+        APPEND_STAT("sizes_status", "ok", "");
+        APPEND_STAT("items", "%llu", (unsigned long long)items);
+        APPEND_STAT("classes", "%d", nclasses);
+        APPEND_STAT("waste_current", "%llu", (unsigned long long)waste_current);
+        APPEND_STAT("waste_planned", "%llu", (unsigned long long)waste_planned);
+        APPEND_STAT("bytes_saved", "%lld", (long long)waste_current - (long long)waste_planned);
+        add_stats("slab_sizes", strlen("slab_sizes"), list, len, c);
+    }
+#undef PLAN_IDX
+
+    free(pts);
+    free(dp);
+    free(choice);
+    add_stats(NULL, 0, NULL, 0, c);
+    return;
+error:
+    free(pts);
+    free(dp);
+    free(choice);
+    APPEND_STAT("sizes_status", "error", "");
+    APPEND_STAT("sizes_error", "out of memory", "");
+    add_stats(NULL, 0, NULL, 0, c);
+}
+
 /** wrapper around assoc_find which does the lazy expiration logic */
 item *do_item_get(const char *key, const size_t nkey, const uint32_t hv, LIBEVENT_THREAD *t, const bool do_update) {
     item *it = assoc_find(key, nkey, hv);
@@ -1059,6 +1371,58 @@ item *do_item_get(const char *key, const size_t nkey, const uint32_t hv, LIBEVEN
     return it;
 }
 
+/* Whether a hit can be served as is, without the locked path expiring the
+ * item or bumping it in the LRU. ACTIVE items need no bump: do_item_bump()
+ * leaves them alone, it->time included, since the time was set when they
+ * turned ACTIVE. The LRU maintainer clears ACTIVE as it moves them off a
+ * tail, and the next hit takes the locked path and bumps them again. */
+static inline bool item_lockless_ok(item *it, const bool do_update) {
+    return (it->exptime == 0 || it->exptime > current_time)
+        && !item_is_flushed(it)
+        && (!do_update || (it->it_flags & ITEM_ACTIVE));
+}
+
+/*
+ * The lockless_get fast path: find and reference an item without the item
+ * lock. The hash chain is walked inside a read epoch, so nothing on it can
+ * be freed and reused under us. Returns NULL whenever the locked path has
+ * to decide instead: misses, items to expire or bump, a slab page move in
+ * progress, or an unlink racing with us.
+ */
+item *item_get_lockless(const char *key, const size_t nkey, const uint32_t hv, LIBEVENT_THREAD *t, const bool do_update) {
+    item *it;
+
+    read_epoch_enter(t);
+    /* The page mover waits out readers that got past this check. */
+    if (slab_rebalance_signal != 0 ||
+        (it = assoc_find(key, nkey, hv)) == NULL ||
+        !item_lockless_ok(it, do_update)) {
+        read_epoch_exit(t);
+        return NULL;
+    }
+    if (refcount_incr(it) == 1) {
+        /* Already on its way to being freed. */
+        refcount_decr(it);
+        read_epoch_exit(t);
+        return NULL;
+    }
+    read_epoch_exit(t);
+
+    /* Our reference keeps it from being freed; make sure it's still live. */
+    if ((it->it_flags & (ITEM_LINKED|ITEM_SLABBED)) != ITEM_LINKED ||
+        !item_lockless_ok(it, do_update)) {
+        item_remove(it);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&t->stats.mutex);
+    t->stats.get_lockless_hits++;
+    pthread_mutex_unlock(&t->stats.mutex);
+    LOGGER_LOG(t->l, LOG_FETCHERS, LOGGER_ITEM_GET, NULL, 1, key,
+               nkey, it->nbytes, ITEM_clsid(it), t->cur_sfd);
+    return it;
+}
+
 // Requires lock held for item.
 // Split out of do_item_get() to allow mget functions to look through header
 // data before losing state modified via the bump function.
@@ -1069,7 +1433,17 @@ void do_item_bump(LIBEVENT_THREAD *t, item *it, const uint32_t hv) {
      * afterward.
      * FETCHED tells if an item has ever been active.
      */
-    if (settings.lru_segmented) {
+    if (settings.eviction_policy == EVICTION_S3FIFO) {
+        /* No moves at all: ACTIVE is read when the item reaches a tail. */
+        if ((it->it_flags & ITEM_ACTIVE) == 0) {
+            if ((it->it_flags & ITEM_FETCHED) == 0) {
+                it->it_flags |= ITEM_FETCHED;
+            } else {
+                it->it_flags |= ITEM_ACTIVE;
+                it->time = current_time;
+            }
+        }
+    } else if (settings.lru_segmented) {
         if ((it->it_flags & ITEM_ACTIVE) == 0) {
             if ((it->it_flags & ITEM_FETCHED) == 0) {
                 it->it_flags |= ITEM_FETCHED;
@@ -1089,17 +1463,53 @@ void do_item_bump(LIBEVENT_THREAD *t, item *it, const uint32_t hv) {
     }
 }
 
+/* do_item_update() for worker threads, item lock held: a COLD to WARM move
+ * goes through the thread's bump log like a hit's would, instead of taking
+ * both LRU locks here. If the log is full the LRU maintainer still moves
+ * the item once it reaches the COLD tail, since it's active. */
+void do_item_update_async(LIBEVENT_THREAD *t, item *it, const uint32_t hv) {
+    if (settings.lru_segmented && (it->it_flags & ITEM_LINKED) != 0
+            && ITEM_lruid(it) == COLD_LRU && (it->it_flags & ITEM_ACTIVE)) {
+        it->time = current_time;
+        lru_bump_async(t->lru_bump_buf, it, hv);
+    } else {
+        do_item_update(it);
+    }
+}
+
 item *do_item_touch(const char *key, size_t nkey, uint32_t exptime,
                     const uint32_t hv, LIBEVENT_THREAD *t) {
     item *it = do_item_get(key, nkey, hv, t, DO_UPDATE);
     if (it != NULL) {
         it->exptime = exptime;
+        hotkey_invalidate(hv);
     }
     return it;
 }
 
 /*** LRU MAINTENANCE THREAD ***/
 
+/* Evicts the item off an LRU tail. LRU lock held, item locked and
+ * referenced by the caller. */
+static void do_lru_evict(const int id, item *search, const uint32_t hv) {
+    itemstats[id].evicted++;
+    itemstats[id].evicted_time = current_time - search->time;
+    if (search->exptime != 0)
+        itemstats[id].evicted_nonzero++;
+    if ((search->it_flags & ITEM_FETCHED) == 0) {
+        itemstats[id].evicted_unfetched++;
+    }
+    if ((search->it_flags & ITEM_ACTIVE)) {
+        itemstats[id].evicted_active++;
+    }
+    LOGGER_LOG(NULL, LOG_EVICTIONS, LOGGER_EVICTION, search);
+    STORAGE_delete(ext_storage, search);
+    do_item_unlink_nolock(search, hv);
+    if (settings.slab_automove == 2) {
+        slabs_reassign(-1, CLEAR_LRU(id));
+    }
+}
+
 /* Returns number of items remove, expired, or evicted.
  * Callable from worker threads or the LRU maintainer thread */
 int lru_pull_tail(const int orig_id, const int cur_lru,
@@ -1119,12 +1529,12 @@ int lru_pull_tail(const int orig_id, const int cur_lru,
     uint64_t limit = 0;
 
     id |= cur_lru;
-    pthread_mutex_lock(&lru_locks[id]);
+    lru_lock(id);
     search = tails[id];
     /* We walk up *only* for locked items, and if bottom is expired. */
     for (; tries > 0 && search != NULL; tries--, search=next_it) {
         /* we might relink search mid-loop, so search->prev isn't reliable */
-        next_it = search->prev;
+        next_it = ITEM_PTR(search->prev);
         if (search->nbytes == 0 && search->nkey == 0 && search->it_flags == 1) {
             /* We are a crawler, ignore it. */
             if (flags & LRU_PULL_CRAWL_BLOCKS) {
@@ -1223,23 +1633,8 @@ int lru_pull_tail(const int orig_id, const int cur_lru,
                         /* Don't think we need a counter for this. It'll OOM.  */
                         break;
                     }
-                    itemstats[id].evicted++;
-                    itemstats[id].evicted_time = current_time - search->time;
-                    if (search->exptime != 0)
-                        itemstats[id].evicted_nonzero++;
-                    if ((search->it_flags & ITEM_FETCHED) == 0) {
-                        itemstats[id].evicted_unfetched++;
-                    }
-                    if ((search->it_flags & ITEM_ACTIVE)) {
-                        itemstats[id].evicted_active++;
-                    }
-                    LOGGER_LOG(NULL, LOG_EVICTIONS, LOGGER_EVICTION, search);
-                    STORAGE_delete(ext_storage, search);
-                    do_item_unlink_nolock(search, hv);
+                    do_lru_evict(id, search, hv);
                     removed++;
-                    if (settings.slab_automove == 2) {
-                        slabs_reassign(-1, orig_id);
-                    }
                 } else if (flags & LRU_PULL_RETURN_ITEM) {
                     /* Keep a reference to this item and return it. */
                     ret_it->it = it;
@@ -1278,6 +1673,150 @@ int lru_pull_tail(const int orig_id, const int cur_lru,
     return removed;
 }
 
+/*** S3-FIFO EVICTION ***/
+
+/*
+ * -o eviction_policy=s3fifo: each slab class keeps new items in a small
+ * FIFO (HOT_LRU, sized by hot_lru_pct) and everything else in a main FIFO
+ * (COLD_LRU). Hits only set FETCHED, then ACTIVE, so nothing moves on a
+ * hit and no background thread has to juggle. When memory is needed:
+ *  - the small queue's tail goes to main if it's ACTIVE, else it's evicted
+ *    and its hash goes into the ghost table.
+ *  - main's tail goes back to main's head if it's ACTIVE (losing the bit),
+ *    else it's evicted.
+ * New items whose hash is in the ghost table go straight to main.
+ */
+#define S3FIFO_GHOST_POWER 18
+/* 64MB of ghosts at most, however large the hash table starts */
+#define S3FIFO_GHOST_POWER_MAX 24
+/* ACTIVE tail items passed over before one is evicted regardless */
+#define S3FIFO_MAX_MOVES 64
+
+static uint32_t *s3fifo_ghost = NULL;
+static uint32_t s3fifo_ghost_mask = 0;
+
+/* The ghost table is sized like the starting hash table, up to a cap. */
+void item_s3fifo_init(void) {
+    int power = settings.hashpower_init ? settings.hashpower_init : S3FIFO_GHOST_POWER;
+    if (power > S3FIFO_GHOST_POWER_MAX) {
+        power = S3FIFO_GHOST_POWER_MAX;
+    }
+    s3fifo_ghost = calloc((size_t)1 << power, sizeof(uint32_t));
+    if (s3fifo_ghost == NULL) {
+        fprintf(stderr, "Failed to allocate S3-FIFO ghost table\n");
+        exit(EXIT_FAILURE);
+    }
+    s3fifo_ghost_mask = ((uint32_t)1 << power) - 1;
+}
+
+/* Ghost slots hold a hash value each, and a newer eviction overwrites an
+ * older one in its slot. Slots are read and written under different locks;
+ * losing a race only costs a wrong guess. */
+static void s3fifo_ghost_add(const uint32_t hv) {
+    s3fifo_ghost[hv & s3fifo_ghost_mask] = hv;
+}
+
+static bool s3fifo_ghost_take(const uint32_t hv) {
+    uint32_t *slot = &s3fifo_ghost[hv & s3fifo_ghost_mask];
+    if (*slot != hv) {
+        return false;
+    }
+    *slot = 0;
+    return true;
+}
+
+/* Takes one item off the tail of a queue: reclaims it if expired, moves it
+ * if ACTIVE (unless force), else evicts it. Returns 1 if an item was freed,
+ * 0 if one was moved and -1 if there was nothing to take. */
+static int s3fifo_pull_tail(const int orig_id, const int cur_lru, const bool force) {
+    int id = orig_id | cur_lru;
+    int tries = 5;
+    int ret = -1;
+    item *it = NULL;
+    item *search;
+    item *next_it;
+    void *hold_lock = NULL;
+    bool to_main = false;
+
+    lru_lock(id);
+    for (search = tails[id]; tries > 0 && search != NULL; tries--, search = next_it) {
+        next_it = ITEM_PTR(search->prev);
+        if (search->nbytes == 0 && search->nkey == 0 && search->it_flags == 1) {
+            /* We are a crawler, ignore it. */
+            tries++;
+            continue;
+        }
+        uint32_t hv = hash(ITEM_key(search), search->nkey);
+        if ((hold_lock = item_trylock(hv)) == NULL)
+            continue;
+        if (refcount_incr(search) != 2) {
+            itemstats[id].lrutail_reflocked++;
+        }
+        it = search;
+
+        if ((search->exptime != 0 && search->exptime < current_time)
+            || item_is_flushed(search)) {
+            itemstats[id].reclaimed++;
+            if ((search->it_flags & ITEM_FETCHED) == 0) {
+                itemstats[id].expired_unfetched++;
+            }
+            do_item_unlink_nolock(search, hv);
+            STORAGE_delete(ext_storage, search);
+            ret = 1;
+        } else if ((search->it_flags & ITEM_ACTIVE) != 0 && !force) {
+            search->it_flags &= ~ITEM_ACTIVE;
+            do_item_unlink_q(search);
+            if (cur_lru == HOT_LRU) {
+                itemstats[id].moves_to_cold++;
+                to_main = true;
+            } else {
+                itemstats[id].moves_within_lru++;
+                do_item_link_q(search);
+            }
+            ret = 0;
+        } else if (settings.evict_to_free != 0) {
+            if (cur_lru == HOT_LRU) {
+                s3fifo_ghost_add(hv);
+            }
+            do_lru_evict(id, search, hv);
+            ret = 1;
+        }
+        break;
+    }
+    pthread_mutex_unlock(&lru_locks[id]);
+
+    if (it != NULL) {
+        if (to_main) {
+            it->slabs_clsid = ITEM_clsid(it) | COLD_LRU;
+            item_link_q(it);
+        }
+        do_item_remove(it);
+        item_trylock_unlock(hold_lock);
+    }
+    return ret;
+}
+
+/* Frees an item for an allocation in slab class id. Returns the number of
+ * items freed. */
+static int s3fifo_evict(const int id) {
+    for (int i = 0; i < S3FIFO_MAX_MOVES; i++) {
+        /* Read unlocked: the sizes only pick which queue to pull from. */
+        uint64_t small = sizes_bytes[id|HOT_LRU];
+        uint64_t main = sizes_bytes[id|COLD_LRU];
+        int cur_lru = main == 0 || small * 100 > (small + main) * settings.hot_lru_pct
+            ? HOT_LRU : COLD_LRU;
+        bool force = i == S3FIFO_MAX_MOVES - 1;
+        int ret = s3fifo_pull_tail(id, cur_lru, force);
+        if (ret < 0) {
+            ret = s3fifo_pull_tail(id, cur_lru == HOT_LRU ? COLD_LRU : HOT_LRU, force);
+        }
+        if (ret != 0) {
+            return ret > 0 ? 1 : 0;
+        }
+    }
+    return 0;
+}
+
 
 /* TODO: Third place this code needs to be deduped */
 static void lru_bump_buf_link_q(lru_bump_buf *b) {
@@ -1416,12 +1955,17 @@ static int lru_maintainer_juggle(const int slabs_clsid) {
         }
     }
 
+    /* S3-FIFO only moves items as it evicts. */
+    if (settings.eviction_policy == EVICTION_S3FIFO) {
+        return did_moves;
+    }
+
     rel_time_t cold_age = 0;
     rel_time_t hot_age = 0;
     rel_time_t warm_age = 0;
     /* If LRU is in flat mode, force items to drain into COLD via max age of 0 */
     if (settings.lru_segmented) {
-        pthread_mutex_lock(&lru_locks[slabs_clsid|COLD_LRU]);
+        lru_lock(slabs_clsid|COLD_LRU);
         if (tails[slabs_clsid|COLD_LRU]) {
             cold_age = current_time - tails[slabs_clsid|COLD_LRU]->time;
         }
@@ -1433,11 +1977,11 @@ static int lru_maintainer_juggle(const int slabs_clsid) {
         warm_age = cold_age * settings.warm_max_factor;
 
         // total_bytes doesn't have to be exact. cache it for the juggles.
-        pthread_mutex_lock(&lru_locks[slabs_clsid|HOT_LRU]);
+        lru_lock(slabs_clsid|HOT_LRU);
         total_bytes += sizes_bytes[slabs_clsid|HOT_LRU];
         pthread_mutex_unlock(&lru_locks[slabs_clsid|HOT_LRU]);
 
-        pthread_mutex_lock(&lru_locks[slabs_clsid|WARM_LRU]);
+        lru_lock(slabs_clsid|WARM_LRU);
         total_bytes += sizes_bytes[slabs_clsid|WARM_LRU];
         pthread_mutex_unlock(&lru_locks[slabs_clsid|WARM_LRU]);
     }
@@ -1549,7 +2093,7 @@ static void lru_maintainer_crawler_check(struct crawler_expired_data *cdata, log
             pthread_mutex_unlock(&cdata->lock);
         }
         if (current_time > next_crawls[i]) {
-            pthread_mutex_lock(&lru_locks[i]);
+            lru_lock(i);
             if (sizes[i] > tocrawl_limit) {
                 tocrawl_limit = sizes[i];
             }
@@ -1758,11 +2302,11 @@ void do_item_linktail_q(item *it) { /* item is the new tail */
     //assert(*tail != 0);
     assert(it != *tail);
     assert((*head && *tail) || (*head == 0 && *tail == 0));
-    it->prev = *tail;
+    it->prev = ITEM_REF(*tail);
     it->next = 0;
-    if (it->prev) {
-        assert(it->prev->next == 0);
-        it->prev->next = it;
+    if (*tail) {
+        assert((*tail)->next == 0);
+        (*tail)->next = ITEM_REF(it);
     }
     *tail = it;
     if (*head == 0) *head = it;
@@ -1776,17 +2320,17 @@ void do_item_unlinktail_q(item *it) {
 
     if (*head == it) {
         assert(it->prev == 0);
-        *head = it->next;
+        *head = ITEM_PTR(it->next);
     }
     if (*tail == it) {
         assert(it->next == 0);
-        *tail = it->prev;
+        *tail = ITEM_PTR(it->prev);
     }
-    assert(it->next != it);
-    assert(it->prev != it);
+    assert(ITEM_PTR(it->next) != it);
+    assert(ITEM_PTR(it->prev) != it);
 
-    if (it->next) it->next->prev = it->prev;
-    if (it->prev) it->prev->next = it->next;
+    if (it->next) ITEM_PTR(it->next)->prev = it->prev;
+    if (it->prev) ITEM_PTR(it->prev)->next = it->next;
     return;
 }
 
@@ -1794,54 +2338,54 @@ void do_item_unlinktail_q(item *it) {
  * more clearly. */
 item *do_item_crawl_q(item *it) {
     item **head, **tail;
+    item *prev = ITEM_PTR(it->prev);
+    item *next = ITEM_PTR(it->next);
     assert(it->it_flags == 1);
     assert(it->nbytes == 0);
     head = &heads[it->slabs_clsid];
     tail = &tails[it->slabs_clsid];
 
     /* We've hit the head, pop off */
-    if (it->prev == 0) {
+    if (prev == NULL) {
         assert(*head == it);
-        if (it->next) {
-            *head = it->next;
-            assert(it->next->prev == it);
-            it->next->prev = 0;
+        if (next) {
+            *head = next;
+            assert(ITEM_PTR(next->prev) == it);
+            next->prev = 0;
         }
         return NULL; /* Done */
     }
 
     /* Swing ourselves in front of the next item */
     /* NB: If there is a prev, we can't be the head */
-    assert(it->prev != it);
+    assert(prev != it);
+    if (*head == prev) {
+        /* Prev was the head, now we're the head */
+        *head = it;
+    }
+    if (*tail == it) {
+        /* We are the tail, now they are the tail */
+        *tail = prev;
+    }
+    assert(next != it);
+    if (next) {
+        assert(ITEM_PTR(prev->next) == it);
+        prev->next = it->next;
+        next->prev = it->prev;
+    } else {
+        /* Tail. Move this above? */
+        prev->next = 0;
+    }
+    /* prev->prev's next is it->prev */
+    it->next = ITEM_REF(prev);
+    it->prev = prev->prev;
+    prev->prev = ITEM_REF(it);
+    /* New it->prev now, if we're not at the head. */
     if (it->prev) {
-        if (*head == it->prev) {
-            /* Prev was the head, now we're the head */
-            *head = it;
-        }
-        if (*tail == it) {
-            /* We are the tail, now they are the tail */
-            *tail = it->prev;
-        }
-        assert(it->next != it);
-        if (it->next) {
-            assert(it->prev->next == it);
-            it->prev->next = it->next;
-            it->next->prev = it->prev;
-        } else {
-            /* Tail. Move this above? */
-            it->prev->next = 0;
-        }
-        /* prev->prev's next is it->prev */
-        it->next = it->prev;
-        it->prev = it->next->prev;
-        it->next->prev = it;
-        /* New it->prev now, if we're not at the head. */
-        if (it->prev) {
-            it->prev->next = it;
-        }
+        ITEM_PTR(it->prev)->next = ITEM_REF(it);
     }
-    assert(it->next != it);
-    assert(it->prev != it);
+    assert(ITEM_PTR(it->next) != it);
+    assert(ITEM_PTR(it->prev) != it);
 
-    return it->next; /* success */
+    return prev; /* success */
 }
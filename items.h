@@ -15,6 +15,7 @@ item *do_item_alloc(const char *key, const size_t nkey, const client_flags_t fla
 item_chunk *do_item_alloc_chunk(item_chunk *ch, const size_t bytes_remain);
 item *do_item_alloc_pull(const size_t ntotal, const unsigned int id);
 void item_free(item *it);
+void item_reclaim_deferred(void);
 bool item_size_ok(const size_t nkey, const client_flags_t flags, const int nbytes);
 
 int  do_item_link(item *it, const uint32_t hv, const uint64_t cas);     /** may fail if transgresses limits */
@@ -57,7 +58,9 @@ void do_item_stats_add_crawl(const int i, const uint64_t reclaimed,
 void item_stats_totals(ADD_STAT add_stats, void *c);
 /*@null@*/
 void item_stats_sizes(ADD_STAT add_stats, void *c);
+void item_stats_sizes_plan(ADD_STAT add_stats, void *c);
 void item_stats_sizes_init(void);
+void item_s3fifo_init(void);
 void item_stats_sizes_add(item *it);
 void item_stats_sizes_remove(item *it);
 bool item_stats_sizes_status(void);
@@ -71,10 +74,13 @@ typedef struct {
 void fill_item_stats_automove(item_stats_automove *am);
 
 item *do_item_get(const char *key, const size_t nkey, const uint32_t hv, LIBEVENT_THREAD *t, const bool do_update);
+item *item_get_lockless(const char *key, const size_t nkey, const uint32_t hv, LIBEVENT_THREAD *t, const bool do_update);
 item *do_item_touch(const char *key, const size_t nkey, uint32_t exptime, const uint32_t hv, LIBEVENT_THREAD *t);
 void do_item_bump(LIBEVENT_THREAD *t, item *it, const uint32_t hv);
+void do_item_update_async(LIBEVENT_THREAD *t, item *it, const uint32_t hv);
 void item_stats_reset(void);
 extern pthread_mutex_t lru_locks[POWER_LARGEST];
+void lru_lock(const unsigned int id);
 
 int start_lru_maintainer_thread(void *arg);
 int stop_lru_maintainer_thread(void);
@@ -272,6 +272,14 @@ static void settings_init(void) {
     settings.temporary_ttl = 61;
     settings.idle_timeout = 0; /* disabled */
     settings.hashpower_init = 0;
+    settings.hash_index = HASH_INDEX_CHAINED;
+    settings.hash_shrink = false;
+    settings.lockless_get = false;
+    settings.hot_keys = false;
+    settings.eviction_policy = EVICTION_LRU;
+    settings.slab_arena = SLAB_ARENA_NONE;
+    settings.slab_numa = SLAB_NUMA_NONE;
+    settings.slab_magazines = false;
     settings.slab_reassign = true;
     settings.slab_automove = 1;
     settings.slab_automove_ratio = 0.8;
@@ -1627,7 +1635,7 @@ enum store_item_type do_store_item(item *it, int comm, LIBEVENT_THREAD *t, const
         switch (comm) {
             case NREAD_ADD:
                 /* add only adds a nonexistent item, but promote to head of LRU */
-                do_item_update(old_it);
+                do_item_update_async(t, old_it, hv);
                 break;
             case NREAD_CAS:
                 if (cas_res == CAS_MATCH) {
@@ -1860,6 +1868,8 @@ void server_stats(ADD_STAT add_stats, void *c) {
     APPEND_STAT("get_misses", "%llu", (unsigned long long)thread_stats.get_misses);
     APPEND_STAT("get_expired", "%llu", (unsigned long long)thread_stats.get_expired);
     APPEND_STAT("get_flushed", "%llu", (unsigned long long)thread_stats.get_flushed);
+    APPEND_STAT("get_lockless_hits", "%llu", (unsigned long long)thread_stats.get_lockless_hits);
+    APPEND_STAT("get_hot_hits", "%llu", (unsigned long long)thread_stats.get_hot_hits);
 #ifdef EXTSTORE
     if (ext_storage) {
         APPEND_STAT("get_extstore", "%llu", (unsigned long long)thread_stats.get_extstore);
@@ -1898,6 +1908,7 @@ void server_stats(ADD_STAT add_stats, void *c) {
     APPEND_STAT("conn_yields", "%llu", (unsigned long long)thread_stats.conn_yields);
     APPEND_STAT("hash_power_level", "%u", stats_state.hash_power_level);
     APPEND_STAT("hash_bytes", "%llu", (unsigned long long)stats_state.hash_bytes);
+    APPEND_STAT("hash_buckets", "%llu", (unsigned long long)stats_state.hash_buckets);
     APPEND_STAT("hash_is_expanding", "%u", stats_state.hash_is_expanding);
     if (settings.slab_reassign) {
         APPEND_STAT("slab_reassign_rescues", "%llu", stats.slab_reassign_rescues);
@@ -1943,6 +1954,16 @@ void server_stats(ADD_STAT add_stats, void *c) {
     APPEND_STAT("round_robin_fallback", "%llu", (unsigned long long)stats.round_robin_fallback);
 }
 
+static const char *slab_arena_name(enum slab_arena_mode mode) {
+    switch (mode) {
+    case SLAB_ARENA_MMAP: return "mmap";
+    case SLAB_ARENA_THP: return "thp";
+    case SLAB_ARENA_HUGETLB: return "hugetlb";
+    case SLAB_ARENA_HUGETLB_1G: return "hugetlb_1g";
+    default: return "none";
+    }
+}
+
 void process_stat_settings(ADD_STAT add_stats, void *c) {
     assert(add_stats);
     APPEND_STAT("maxbytes", "%llu", (unsigned long long)settings.maxbytes);
@@ -1987,8 +2008,22 @@ void process_stat_settings(ADD_STAT add_stats, void *c) {
     APPEND_STAT("flush_enabled", "%s", settings.flush_enabled ? "yes" : "no");
     APPEND_STAT("dump_enabled", "%s", settings.dump_enabled ? "yes" : "no");
     APPEND_STAT("hash_algorithm", "%s", settings.hash_algorithm);
+    APPEND_STAT("hash_index", "%s", settings.hash_index == HASH_INDEX_BUCKETIZED ? "bucketized" : "chained");
+    APPEND_STAT("hash_shrink", "%s", settings.hash_shrink ? "yes" : "no");
+    APPEND_STAT("lockless_get", "%s", settings.lockless_get ? "yes" : "no");
+    APPEND_STAT("hot_keys", "%s", settings.hot_keys ? "yes" : "no");
     APPEND_STAT("lru_maintainer_thread", "%s", settings.lru_maintainer_thread ? "yes" : "no");
     APPEND_STAT("lru_segmented", "%s", settings.lru_segmented ? "yes" : "no");
+    APPEND_STAT("eviction_policy", "%s", settings.eviction_policy == EVICTION_S3FIFO ? "s3fifo" : "lru");
+    APPEND_STAT("slab_arena", "%s", slab_arena_name(settings.slab_arena));
+    APPEND_STAT("slab_numa", "%s", settings.slab_numa == SLAB_NUMA_LOCAL ? "local" :
+                (settings.slab_numa == SLAB_NUMA_INTERLEAVE ? "interleave" : "none"));
+    APPEND_STAT("slab_magazines", "%s", settings.slab_magazines ? "yes" : "no");
+#ifdef COMPACT_ITEMS
+    APPEND_STAT("compact_items", "%s", "yes");
+#else
+    APPEND_STAT("compact_items", "%s", "no");
+#endif
     APPEND_STAT("hot_lru_pct", "%d", settings.hot_lru_pct);
     APPEND_STAT("warm_lru_pct", "%d", settings.warm_lru_pct);
     APPEND_STAT("hot_max_factor", "%.2f", settings.hot_max_factor);
@@ -2061,8 +2096,14 @@ bool get_stats(const char *stat_type, int nkey, ADD_STAT add_stats, void *c) {
             item_stats(add_stats, c);
         } else if (nz_strcmp(nkey, stat_type, "slabs") == 0) {
             slabs_stats(add_stats, c);
+        } else if (nz_strcmp(nkey, stat_type, "arena") == 0) {
+            slabs_arena_stats(add_stats, c);
         } else if (nz_strcmp(nkey, stat_type, "sizes") == 0) {
             item_stats_sizes(add_stats, c);
+        } else if (nz_strcmp(nkey, stat_type, "sizes_plan") == 0) {
+            item_stats_sizes_plan(add_stats, c);
+        } else if (nz_strcmp(nkey, stat_type, "hotkeys") == 0) {
+            hotkeys_stats(add_stats, c);
         } else {
             ret = false;
         }
@@ -2353,8 +2394,8 @@ enum delta_result_type do_add_delta(LIBEVENT_THREAD *t, const char *key, const s
     res = strlen(buf);
     /* refcount == 2 means we are the only ones holding the item, and it is
      * linked. We hold the item's lock in this function, so refcount cannot
-     * increase. */
-    if (res + 2 <= it->nbytes && it->refcount == 2) { /* replace in-place */
+     * increase; unless lockless_get readers can take references without it. */
+    if (res + 2 <= it->nbytes && it->refcount == 2 && !settings.lockless_get) { /* replace in-place */
         /* When changing the value without replacing the item, we
            need to update the CAS on the existing item. */
         /* We also need to fiddle it in the sizes tracker in case the tracking
@@ -2365,7 +2406,8 @@ enum delta_result_type do_add_delta(LIBEVENT_THREAD *t, const char *key, const s
         item_stats_sizes_add(it);
         memcpy(ITEM_data(it), buf, res);
         memset(ITEM_data(it) + res, ' ', it->nbytes - res - 2);
-        do_item_update(it);
+        hotkey_invalidate(hv);
+        do_item_update_async(t, it, hv);
     } else if (it->refcount > 1) {
         item *new_it;
         client_flags_t flags;
@@ -4004,9 +4046,13 @@ static void clock_handler(const evutil_socket_t fd, const short which, void *arg
         initialized = true;
     }
 
-    // While we're here, check for hash table expansion.
+    // While we're here, check whether the hash table needs resizing.
     // This function should be quick to avoid delaying the timer.
-    assoc_start_expand(stats_state.curr_items);
+    assoc_start_resize(stats_state.curr_items);
+    // Frees held back for lockless readers shouldn't wait on more frees.
+    if (settings.lockless_get) {
+        item_reclaim_deferred();
+    }
     // also, if HUP'ed we need to do some maintenance.
     // for now that's just the authfile reload.
     if (settings.sig_hup) {
@@ -4142,21 +4188,33 @@ static void usage(void) {
            "                          disabled by default; very dangerous option.\n"
            "   - hash_algorithm:      the hash table algorithm\n"
            "                          default is murmur3 hash. options: jenkins, murmur3, xxh3\n"
+           "   - hash_index:          hash table layout. chained (default) or bucketized:\n"
+           "                          cache line buckets of hash tags, faster lookups in\n"
+           "                          large tables for more hash memory\n"
+           "   - hash_shrink:         shrink the hash table again when the item count\n"
+           "                          drops well below what it was sized for (default: %s)\n"
+           "   - lockless_get:        serve hits on active items without the item lock\n"
+           "                          (default: %s)\n"
+           "   - hot_keys:            detect hot keys and serve their gets from per-thread\n"
+           "                          copies; see \"stats hotkeys\" (default: %s)\n"
            "   - no_lru_crawler:      disable LRU Crawler background thread.\n"
            "   - lru_crawler_sleep:   microseconds to sleep between items\n"
            "                          default is %d.\n"
            "   - lru_crawler_tocrawl: max items to crawl per slab per run\n"
            "                          default is %u (unlimited)\n",
            flag_enabled_disabled(settings.maxconns_fast), settings.hashpower_init,
-           settings.lru_crawler_sleep, settings.lru_crawler_tocrawl);
+           flag_enabled_disabled(settings.hash_shrink), flag_enabled_disabled(settings.lockless_get),
+           flag_enabled_disabled(settings.hot_keys), settings.lru_crawler_sleep, settings.lru_crawler_tocrawl);
     printf("   - read_buf_mem_limit:  limit in megabytes for connection read/response buffers.\n"
            "                          do not adjust unless you have high (20k+) conn. limits.\n"
            "                          0 means unlimited (default: %u)\n",
            settings.read_buf_mem_limit);
     verify_default("read_buf_mem_limit", settings.read_buf_mem_limit == 0);
     printf("   - no_lru_maintainer:   disable new LRU system + background thread.\n"
-           "   - hot_lru_pct:         pct of slab memory to reserve for hot lru.\n"
-           "                          (requires lru_maintainer, default pct: %d)\n"
+           "   - eviction_policy:     lru (default) or s3fifo: small and main FIFO queues,\n"
+           "                          hits only mark items, no LRU juggling. see doc/new_lru.txt\n"
+           "   - hot_lru_pct:         pct of slab memory to reserve for hot lru, or\n"
+           "                          for s3fifo's small queue. (default pct: %d)\n"
            "   - warm_lru_pct:        pct of slab memory to reserve for warm lru.\n"
            "                          (requires lru_maintainer, default pct: %d)\n"
            "   - hot_max_factor:      items idle > cold lru age * drop from hot lru. (default: %.2f)\n"
@@ -4167,6 +4225,15 @@ static void usage(void) {
            settings.hot_lru_pct, settings.warm_lru_pct, settings.hot_max_factor, settings.warm_max_factor,
            settings.temporary_ttl, settings.idle_timeout);
     printf("   - slab_chunk_max:      (EXPERIMENTAL) maximum slab size in kilobytes. use extreme care. (default: %d)\n"
+           "   - slab_arena:          take slab pages from one mapping: none (default), mmap,\n"
+           "                          thp (transparent huge pages), hugetlb or hugetlb_1g\n"
+           "                          (needs free pages in the hugetlb pool). memory limit\n"
+           "                          can't change at runtime with an arena.\n"
+           "   - slab_numa:           NUMA placement of the slab arena: none (default),\n"
+           "                          interleave, or local: pages from the node of the\n"
+           "                          thread that needs them. implies slab_arena=mmap\n"
+           "   - slab_magazines:      keep small per worker thread caches of free chunks, so\n"
+           "                          most sets and frees skip the global slab lock\n"
            "   - watcher_logbuf_size: size in kilobytes of per-watcher write buffer. (default: %u)\n"
            "   - worker_logbuf_size:  size in kilobytes of per-worker-thread buffer\n"
            "                          read by background thread, then written to watchers. (default: %u)\n"
@@ -4828,6 +4895,14 @@ int main (int argc, char **argv) {
         SLAB_AUTOMOVE_WINDOW,
         TAIL_REPAIR_TIME,
         HASH_ALGORITHM,
+        HASH_INDEX,
+        HASH_SHRINK,
+        LOCKLESS_GET,
+        HOT_KEYS,
+        EVICTION_POLICY,
+        SLAB_ARENA,
+        SLAB_NUMA,
+        SLAB_MAGAZINES,
         LRU_CRAWLER,
         LRU_CRAWLER_SLEEP,
         LRU_CRAWLER_TOCRAWL,
@@ -4892,6 +4967,14 @@ int main (int argc, char **argv) {
         [SLAB_AUTOMOVE_WINDOW] = "slab_automove_window",
         [TAIL_REPAIR_TIME] = "tail_repair_time",
         [HASH_ALGORITHM] = "hash_algorithm",
+        [HASH_INDEX] = "hash_index",
+        [HASH_SHRINK] = "hash_shrink",
+        [LOCKLESS_GET] = "lockless_get",
+        [HOT_KEYS] = "hot_keys",
+        [EVICTION_POLICY] = "eviction_policy",
+        [SLAB_ARENA] = "slab_arena",
+        [SLAB_NUMA] = "slab_numa",
+        [SLAB_MAGAZINES] = "slab_magazines",
         [LRU_CRAWLER] = "lru_crawler",
         [LRU_CRAWLER_SLEEP] = "lru_crawler_sleep",
         [LRU_CRAWLER_TOCRAWL] = "lru_crawler_tocrawl",
@@ -5377,6 +5460,87 @@ int main (int argc, char **argv) {
                     return 1;
                 }
                 break;
+            case HASH_INDEX:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing hash_index argument\n");
+                    return 1;
+                };
+                if (strcmp(subopts_value, "chained") == 0) {
+                    settings.hash_index = HASH_INDEX_CHAINED;
+                } else if (strcmp(subopts_value, "bucketized") == 0) {
+                    settings.hash_index = HASH_INDEX_BUCKETIZED;
+                } else {
+                    fprintf(stderr, "Unknown hash_index option (chained, bucketized)\n");
+                    return 1;
+                }
+                break;
+            case HASH_SHRINK:
+                settings.hash_shrink = true;
+                break;
+            case LOCKLESS_GET:
+#ifdef HAVE_GCC_ATOMICS
+                settings.lockless_get = true;
+#else
+                fprintf(stderr, "lockless_get needs atomic builtins\n");
+                return 1;
+#endif
+                break;
+            case HOT_KEYS:
+                settings.hot_keys = true;
+                break;
+            case EVICTION_POLICY:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing eviction_policy argument\n");
+                    return 1;
+                }
+                if (strcmp(subopts_value, "lru") == 0) {
+                    settings.eviction_policy = EVICTION_LRU;
+                } else if (strcmp(subopts_value, "s3fifo") == 0) {
+                    settings.eviction_policy = EVICTION_S3FIFO;
+                } else {
+                    fprintf(stderr, "Unknown eviction_policy option (lru, s3fifo)\n");
+                    return 1;
+                }
+                break;
+            case SLAB_ARENA:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing slab_arena argument\n");
+                    return 1;
+                }
+                if (strcmp(subopts_value, "none") == 0) {
+                    settings.slab_arena = SLAB_ARENA_NONE;
+                } else if (strcmp(subopts_value, "mmap") == 0) {
+                    settings.slab_arena = SLAB_ARENA_MMAP;
+                } else if (strcmp(subopts_value, "thp") == 0) {
+                    settings.slab_arena = SLAB_ARENA_THP;
+                } else if (strcmp(subopts_value, "hugetlb") == 0) {
+                    settings.slab_arena = SLAB_ARENA_HUGETLB;
+                } else if (strcmp(subopts_value, "hugetlb_1g") == 0) {
+                    settings.slab_arena = SLAB_ARENA_HUGETLB_1G;
+                } else {
+                    fprintf(stderr, "Unknown slab_arena option (none, mmap, thp, hugetlb, hugetlb_1g)\n");
+                    return 1;
+                }
+                break;
+            case SLAB_NUMA:
+                if (subopts_value == NULL) {
+                    fprintf(stderr, "Missing slab_numa argument\n");
+                    return 1;
+                }
+                if (strcmp(subopts_value, "none") == 0) {
+                    settings.slab_numa = SLAB_NUMA_NONE;
+                } else if (strcmp(subopts_value, "interleave") == 0) {
+                    settings.slab_numa = SLAB_NUMA_INTERLEAVE;
+                } else if (strcmp(subopts_value, "local") == 0) {
+                    settings.slab_numa = SLAB_NUMA_LOCAL;
+                } else {
+                    fprintf(stderr, "Unknown slab_numa option (none, interleave, local)\n");
+                    return 1;
+                }
+                break;
+            case SLAB_MAGAZINES:
+                settings.slab_magazines = true;
+                break;
             case LRU_CRAWLER:
                 start_lru_crawler = true;
                 break;
@@ -5794,6 +5958,27 @@ int main (int argc, char **argv) {
                 settings.slab_chunk_size_max, settings.slab_page_size);
         exit(EX_USAGE);
     }
+
+    if (settings.slab_numa != SLAB_NUMA_NONE && settings.slab_arena == SLAB_ARENA_NONE) {
+        settings.slab_arena = SLAB_ARENA_MMAP;
+    }
+    if (settings.slab_arena != SLAB_ARENA_NONE && settings.memory_file != NULL) {
+        fprintf(stderr, "slab_arena can't be used with a restartable cache (-e)\n");
+        exit(EX_USAGE);
+    }
+
+#ifdef COMPACT_ITEMS
+    if (settings.maxbytes + (size_t)MAX_NUMBER_OF_SLAB_CLASSES * settings.slab_page_size
+            > ITEM_ARENA_MAX) {
+        fprintf(stderr, "Cannot use more than %llu megabytes of memory with compact items.\n",
+                (unsigned long long)(ITEM_ARENA_MAX / (1024 * 1024)) - MAX_NUMBER_OF_SLAB_CLASSES);
+        exit(EX_USAGE);
+    }
+    if (settings.memory_file != NULL) {
+        fprintf(stderr, "Restartable cache (-e) isn't supported with compact items.\n");
+        exit(EX_USAGE);
+    }
+#endif
 #ifdef EXTSTORE
     switch (storage_check_config(storage_cf)) {
         case 0:
@@ -5837,6 +6022,17 @@ int main (int argc, char **argv) {
         exit(EX_USAGE);
     }
 
+    if (settings.lockless_get && settings.hash_index == HASH_INDEX_BUCKETIZED) {
+        fprintf(stderr, "lockless_get requires the chained hash_index\n");
+        exit(EX_USAGE);
+    }
+
+    /* S3-FIFO takes the place of the segmented LRU; the maintainer thread
+     * can still run for the crawler and slab automover. */
+    if (settings.eviction_policy == EVICTION_S3FIFO) {
+        settings.lru_segmented = false;
+    }
+
     if (hash_init(hash_type) != 0) {
         fprintf(stderr, "Failed to initialize hash_algorithm!\n");
         exit(EX_USAGE);
@@ -6127,6 +6323,12 @@ int main (int argc, char **argv) {
         perror("failed to ignore SIGPIPE; sigaction");
         exit(EX_OSERR);
     }
+    if (settings.hot_keys) {
+        hotkeys_init();
+    }
+    if (settings.eviction_policy == EVICTION_S3FIFO) {
+        item_s3fifo_init();
+    }
     /* start up worker threads if MT mode */
 #ifdef PROXY
     if (settings.proxy_enabled) {
@@ -6328,6 +6530,11 @@ int main (int argc, char **argv) {
 
     if (stop_main_loop == GRACE_STOP) {
         stop_threads();
+        if (settings.lockless_get) {
+            /* No readers left: pending, then waiting, back to the slabs. */
+            item_reclaim_deferred();
+            item_reclaim_deferred();
+        }
         if (settings.memory_file != NULL) {
             restart_mmap_close();
         }
@@ -100,6 +100,23 @@ typedef uint32_t client_flags_t;
 #define safe_strtoflags safe_strtoul
 #endif
 
+/* Links between items (LRU, hash chains, slab freelists). With compact items
+ * they're 32-bit offsets into the slab arena in CHUNK_ALIGN_BYTES units, off
+ * by one so 0 stays NULL, which caps the arena at 32GB. */
+#ifdef COMPACT_ITEMS
+typedef uint32_t item_ptr_t;
+extern char *item_arena;
+#define ITEM_ARENA_MAX ((uint64_t)UINT32_MAX * CHUNK_ALIGN_BYTES)
+#define ITEM_PTR(l) ((l) ? (struct _stritem *)(item_arena + \
+         (size_t)((l) - 1) * CHUNK_ALIGN_BYTES) : NULL)
+#define ITEM_REF(p) ((p) ? (item_ptr_t)(((char *)(p) - item_arena) \
+         / CHUNK_ALIGN_BYTES + 1) : 0)
+#else
+typedef struct _stritem *item_ptr_t;
+#define ITEM_PTR(l) (l)
+#define ITEM_REF(p) (p)
+#endif
+
 /*
  * We only reposition items in the LRU queue if they haven't been repositioned
  * in this many seconds. That saves us from churning on frequently-accessed
@@ -326,6 +343,8 @@ struct slab_stats {
     X(get_misses) \
     X(get_expired) \
     X(get_flushed) \
+    X(get_lockless_hits) /* hits served without the item lock */ \
+    X(get_hot_hits) /* hits served from a hot key replica */ \
     X(touch_cmds) \
     X(touch_misses) \
     X(delete_misses) \
@@ -435,11 +454,12 @@ struct stats_state {
     uint64_t      curr_bytes;
     uint64_t      curr_conns;
     uint64_t      hash_bytes;       /* size used for hash tables */
+    uint64_t      hash_buckets;     /* hash table buckets in use */
     unsigned int  conn_structs;
     unsigned int  reserved_fds;
     unsigned int  hash_power_level; /* Better hope it's not over 9000 */
     unsigned int  log_watchers; /* number of currently active watchers */
-    bool          hash_is_expanding; /* If the hash table is being expanded */
+    bool          hash_is_expanding; /* If the hash table is being resized */
     bool          accepting_conns;  /* whether we are currently accepting */
     bool          slab_reassign_running; /* slab reassign in progress */
     bool          lru_crawler_running; /* crawl in progress */
@@ -447,6 +467,34 @@ struct stats_state {
 
 #define MAX_VERBOSITY_LEVEL 2
 
+/* Layout of the hash index in assoc.c */
+enum hash_index_type {
+    HASH_INDEX_CHAINED = 0, /* one item pointer per bucket, chained via h_next */
+    HASH_INDEX_BUCKETIZED   /* cache line buckets of (hash tag, item pointer) slots */
+};
+
+/* How items.c picks what to evict */
+enum eviction_policy {
+    EVICTION_LRU = 0,   /* flat or segmented LRU */
+    EVICTION_S3FIFO     /* small and main FIFO queues plus a ghost table */
+};
+
+/* Where slabs.c gets slab pages from (-o slab_arena) */
+enum slab_arena_mode {
+    SLAB_ARENA_NONE = 0,    /* malloc per page, or -L */
+    SLAB_ARENA_MMAP,        /* one anonymous mapping */
+    SLAB_ARENA_THP,         /* ... with transparent huge pages */
+    SLAB_ARENA_HUGETLB,     /* ... from the default size hugetlb pool */
+    SLAB_ARENA_HUGETLB_1G   /* ... from the 1GB hugetlb pool */
+};
+
+/* How the arena is placed on NUMA nodes (-o slab_numa) */
+enum slab_numa_policy {
+    SLAB_NUMA_NONE = 0,     /* left to the kernel */
+    SLAB_NUMA_INTERLEAVE,   /* pages interleaved over all nodes */
+    SLAB_NUMA_LOCAL         /* split per node, pages from the caller's node */
+};
+
 /* When adding a setting, be sure to update process_stat_settings */
 /**
  * Globally accessible settings as derived from the commandline.
@@ -483,11 +531,19 @@ struct settings {
     bool lru_crawler;        /* Whether or not to enable the autocrawler thread */
     bool lru_maintainer_thread; /* LRU maintainer background thread */
     bool lru_segmented;     /* Use split or flat LRU's */
+    enum eviction_policy eviction_policy; /* LRU or S3-FIFO eviction */
+    enum slab_arena_mode slab_arena; /* mapping slab pages come from */
+    enum slab_numa_policy slab_numa; /* NUMA placement of the arena */
+    bool slab_magazines;    /* Per worker thread caches of free chunks */
     bool slab_reassign;     /* Whether or not slab reassignment is allowed */
     int slab_automove;     /* Whether or not to automatically move slabs */
     double slab_automove_ratio; /* youngest must be within pct of oldest */
     unsigned int slab_automove_window; /* window mover for algorithm */
     int hashpower_init;     /* Starting hash power level */
+    enum hash_index_type hash_index; /* Hash table layout */
+    bool hash_shrink;       /* Shrink the hash table when items go away */
+    bool lockless_get;      /* Serve GET hits without taking the item lock */
+    bool hot_keys;          /* Replicate hot keys' responses per worker thread */
     bool shutdown_command; /* allow shutdown command */
     int tail_repair_time;   /* LRU tail refcount leak repair time */
     bool flush_enabled;     /* flush_all enabled */
@@ -592,10 +648,10 @@ extern struct settings settings;
  */
 typedef struct _stritem {
     /* Protected by LRU locks */
-    struct _stritem *next;
-    struct _stritem *prev;
+    item_ptr_t      next;
+    item_ptr_t      prev;
     /* Rest are protected by an item lock */
-    struct _stritem *h_next;    /* hash chain next */
+    item_ptr_t      h_next;     /* hash chain next */
     rel_time_t      time;       /* least recent access */
     rel_time_t      exptime;    /* expire time */
     int             nbytes;     /* size of data */
@@ -621,9 +677,9 @@ enum crawler_run_type {
 };
 
 typedef struct {
-    struct _stritem *next;
-    struct _stritem *prev;
-    struct _stritem *h_next;    /* hash chain next */
+    item_ptr_t      next;
+    item_ptr_t      prev;
+    item_ptr_t      h_next;     /* hash chain next */
     rel_time_t      time;       /* least recent access */
     rel_time_t      exptime;    /* expire time */
     int             nbytes;     /* size of data */
@@ -638,6 +694,22 @@ typedef struct {
 } crawler;
 
 /* Header when an item is actually a chunk of another item. */
+#ifdef COMPACT_ITEMS
+/* refcount, it_flags and slabs_clsid have to line up with the item's. */
+typedef struct _strchunk {
+    struct _strchunk *next;     /* points within its own chain. */
+    struct _strchunk *prev;     /* can potentially point to the head. */
+    struct _stritem  *head;     /* always points to the owner chunk */
+    unsigned short   refcount;  /* used? */
+    uint16_t         it_flags;  /* ITEM_* above. */
+    uint8_t          slabs_clsid; /* Same as above. */
+    uint8_t          orig_clsid; /* For obj hdr chunks slabs_clsid is fake. */
+    int              size;      /* available chunk space in bytes */
+    int              used;      /* chunk space used */
+    int              nbytes;    /* used. */
+    char data[];
+} item_chunk;
+#else
 typedef struct _strchunk {
     struct _strchunk *next;     /* points within its own chain. */
     struct _strchunk *prev;     /* can potentially point to the head. */
@@ -651,6 +723,7 @@ typedef struct _strchunk {
     uint8_t          orig_clsid; /* For obj hdr chunks slabs_clsid is fake. */
     char data[];
 } item_chunk;
+#endif
 
 #ifdef NEED_ALIGN
 static inline char *ITEM_schunk(item *it) {
@@ -738,6 +811,8 @@ typedef struct {
 #endif
     logger *l;                  /* logger buffer */
     void *lru_bump_buf;         /* async LRU bump buffer */
+    uint64_t read_epoch;        /* lockless_get: epoch of the read in progress, 0 if none */
+    void *hotkeys;              /* hot key sketch and replicas */
 #ifdef TLS
     char   *ssl_wbuf;
 #endif
@@ -974,6 +1049,7 @@ extern int daemonize(int nochdir, int noclose);
 #include "slabs.h"
 #include "assoc.h"
 #include "items.h"
+#include "hotkeys.h"
 #include "crawler.h"
 #include "trace.h"
 #include "hash.h"
@@ -1021,8 +1097,19 @@ void item_unlock(uint32_t hv);
 void pause_threads(enum pause_thread_types type);
 void stop_threads(void);
 int stop_conn_timeout_thread(void);
+void read_epoch_enter(LIBEVENT_THREAD *t);
+void read_epoch_exit(LIBEVENT_THREAD *t);
+uint64_t read_epoch_advance(void);
+bool read_epoch_passed(const uint64_t epoch);
+void read_epoch_synchronize(void);
+/* lockless_get readers take references without the item lock. */
+#ifdef HAVE_GCC_ATOMICS
+#define refcount_incr(it) __sync_add_and_fetch(&(it)->refcount, 1)
+#define refcount_decr(it) __sync_sub_and_fetch(&(it)->refcount, 1)
+#else
 #define refcount_incr(it) ++(it->refcount)
 #define refcount_decr(it) --(it->refcount)
+#endif
 void STATS_LOCK(void);
 void STATS_UNLOCK(void);
 #define THR_STATS_LOCK(t) pthread_mutex_lock(&t->stats.mutex)
@@ -578,6 +578,23 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                 goto stop;
             }
 
+            /* Plain gets for hot keys may be answered from this thread's
+             * copy of the response. */
+            if (settings.hot_keys && !return_cas && !should_touch) {
+                int hot_clsid = hotkey_get(c->thread, key, nkey, resp);
+                if (hot_clsid != 0) {
+                    if (settings.detail_enabled) {
+                        stats_prefix_record_get(key, nkey, true);
+                    }
+                    pthread_mutex_lock(&c->thread->stats.mutex);
+                    c->thread->stats.lru_hits[hot_clsid]++;
+                    c->thread->stats.get_cmds++;
+                    c->thread->stats.get_hot_hits++;
+                    pthread_mutex_unlock(&c->thread->stats.mutex);
+                    goto next_key;
+                }
+            }
+
             it = limited_get(key, nkey, c->thread, exptime, should_touch, DO_UPDATE, &overflow);
             if (settings.detail_enabled) {
                 stats_prefix_record_get(key, nkey, NULL != it);
@@ -602,6 +619,9 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                   p += it->nkey;
                   p += make_ascii_get_suffix(p, it, return_cas, nbytes);
                   resp_add_iov(resp, resp->wbuf, p - resp->wbuf);
+                  if (settings.hot_keys && !return_cas && !should_touch) {
+                      hotkey_sample(c->thread, key, nkey, it, resp->wbuf, p - resp->wbuf);
+                  }
 
 #ifdef EXTSTORE
                   if (it->it_flags & ITEM_HDR) {
@@ -667,6 +687,7 @@ static inline void process_get_command(conn *c, token_t *tokens, size_t ntokens,
                 pthread_mutex_unlock(&c->thread->stats.mutex);
             }
 
+next_key:
             key_token++;
             if (key_token->length != 0) {
                 if (!resp_start(c)) {
@@ -1171,10 +1192,12 @@ static void process_mget_command(conn *c, token_t *tokens, const size_t ntokens)
                 case 'T':
                     ttl_set = true;
                     it->exptime = of.exptime;
+                    hotkey_invalidate(hv);
                     break;
                 case 'N':
                     if (item_created) {
                         it->exptime = of.autoviv_exptime;
+                        hotkey_invalidate(hv);
                         won_token = true;
                     }
                     break;
@@ -1706,6 +1729,7 @@ static void process_mdelete_command(conn *c, token_t *tokens, const size_t ntoke
         if (of.set_stale) {
             if (of.new_ttl) {
                 it->exptime = of.exptime;
+                hotkey_invalidate(hv);
             }
             it->it_flags |= ITEM_STALE;
             // Also need to remove TOKEN_SENT, so next client can win.
@@ -1923,10 +1947,12 @@ static void process_marithmetic_command(conn *c, token_t *tokens, const size_t n
                     break;
                 case 'T':
                     it->exptime = of.exptime;
+                    hotkey_invalidate(hv);
                     break;
                 case 'N':
                     if (item_created) {
                         it->exptime = of.autoviv_exptime;
+                        hotkey_invalidate(hv);
                     }
                     break;
                 // TODO: macro perhaps?
@@ -2459,7 +2485,8 @@ static void process_lru_command(conn *c, token_t *tokens, const size_t ntokens)
         if (strcmp(tokens[2].value, "flat") == 0) {
             settings.lru_segmented = false;
             out_string(c, "OK");
-        } else if (strcmp(tokens[2].value, "segmented") == 0) {
+        } else if (strcmp(tokens[2].value, "segmented") == 0 &&
+                   settings.eviction_policy == EVICTION_LRU) {
             settings.lru_segmented = true;
             out_string(c, "OK");
         } else {
@@ -381,6 +381,7 @@ unsigned int restart_fixup(void *orig_addr) {
         }
 
         if (it->it_flags & ITEM_LINKED) {
+#ifndef COMPACT_ITEMS
             // fixup next/prev links while on LRU.
             if (it->next) {
                 it->next = (item *)((mc_ptr_t)it->next - (mc_ptr_t)orig_addr);
@@ -390,6 +391,7 @@ unsigned int restart_fixup(void *orig_addr) {
                 it->prev = (item *)((mc_ptr_t)it->prev - (mc_ptr_t)orig_addr);
                 it->prev = (item *)((mc_ptr_t)it->prev + (mc_ptr_t)mmap_base);
             }
+#endif
 
             //fprintf(stderr, "item was linked\n");
             do_item_link_fixup(it);
@@ -22,6 +22,10 @@
 #include <signal.h>
 #include <assert.h>
 #include <pthread.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#endif
 
 //#define DEBUG_SLAB_MOVER
 /* powers-of-N allocation structures */
@@ -50,6 +54,60 @@ static int power_largest;
 static void *mem_base = NULL;
 static void *mem_current = NULL;
 static size_t mem_avail = 0;
+#ifdef COMPACT_ITEMS
+/* Items link by offset into here, see item_ptr_t. The end of it is kept for
+ * the few things that aren't slab chunks but get linked like items. */
+#define ITEM_ARENA_RESERVE (64 * 1024)
+char *item_arena = NULL;
+static char *arena_reserve = NULL;
+static size_t arena_reserve_avail = 0;
+#endif
+
+/* With -o slab_numa=local the arena is split into one part per NUMA node,
+ * and pages are carved from the part of the node the caller runs on. */
+#define ARENA_MAX_NODES 64
+typedef struct {
+    char *current;
+    size_t avail;
+} arena_part_t;
+
+static size_t arena_len = 0;        /* size of the slab arena mapping */
+static const char *arena_kind = NULL; /* what it ended up mapped as */
+static size_t arena_hugepage = 0;   /* its huge page size, 0 if none */
+static int arena_nparts = 0;        /* 0 unless pages come from per node parts */
+static arena_part_t arena_parts[ARENA_MAX_NODES];
+static int arena_part_of_node[ARENA_MAX_NODES];
+
+/* With -o slab_magazines every worker thread keeps a magazine of free chunks
+ * per slab class, so most allocations and frees only take the thread's own
+ * lock. Magazines refill from and flush to the class freelist half a
+ * magazine at a time, under slabs_lock.
+ *
+ * Chunks in a magazine are marked free (ITEM_SLABBED) but aren't on the
+ * freelist the slab mover walks, so the class a page is moving out of gets
+ * drained from every magazine first, and skips them until the move is done.
+ * Lock order is magazines_lock -> magazine lock -> slabs_lock. */
+#define SLAB_MAG_CHUNKS 32
+#define SLAB_MAG_BYTES (16 * 1024) /* per class and thread */
+
+typedef struct {
+    unsigned int count;
+    void *chunks[SLAB_MAG_CHUNKS];
+} slab_magazine;
+
+typedef struct _slab_magazines {
+    struct _slab_magazines *next;
+    pthread_mutex_t lock;
+    slab_magazine mags[MAX_NUMBER_OF_SLAB_CLASSES];
+} slab_magazines;
+
+static pthread_key_t magazines_key;
+static slab_magazines *magazines_head = NULL;
+static pthread_mutex_t magazines_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Chunks a magazine holds for each class, 0 if the class isn't cached. */
+static unsigned int mag_size[MAX_NUMBER_OF_SLAB_CLASSES];
+/* Class a page is being moved out of, 0 if none. */
+static unsigned int mag_bypass = 0;
 #ifdef EXTSTORE
 static void *storage  = NULL;
 #endif
@@ -66,6 +124,7 @@ static int grow_slab_list (const unsigned int id);
 static int do_slabs_newslab(const unsigned int id);
 static void *memory_allocate(size_t size);
 static void do_slabs_free(void *ptr, const size_t size, unsigned int id);
+static void magazines_count(unsigned int *cached);
 
 /* Preallocate as many slab pages as possible (called from slabs_init)
    on start-up, so users don't get confused out-of-memory errors when
@@ -163,6 +222,193 @@ static void * alloc_large_chunk(const size_t limit)
     return ptr;
 }
 
+/* Fills mask with the NUMA nodes that have memory, returns how many. */
+static int arena_nodes(unsigned long *mask) {
+    int count = 0;
+    *mask = 0;
+#if defined(__linux__) && defined(SYS_mbind)
+    for (int n = 0; n < ARENA_MAX_NODES; n++) {
+        char path[64];
+        struct stat st;
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d", n);
+        if (stat(path, &st) == 0) {
+            *mask |= 1UL << n;
+            count++;
+        }
+    }
+#endif
+    return count;
+}
+
+static int arena_mbind(void *addr, size_t len, int mode, unsigned long mask) {
+#if defined(__linux__) && defined(SYS_mbind)
+    return syscall(SYS_mbind, addr, len, mode, &mask, ARENA_MAX_NODES + 1, 0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+static int arena_current_node(void) {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned int cpu, node;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0 && node < ARENA_MAX_NODES)
+        return node;
+#endif
+    return 0;
+}
+
+/* Maps len bytes for slab pages the way mode asks. Huge page modes fall
+ * back to the next best one when the system won't give them. */
+static void *arena_map(enum slab_arena_mode mode, size_t len) {
+    void *ptr = MAP_FAILED;
+    size_t huge = 2 * 1024 * 1024;
+
+    switch (mode) {
+    case SLAB_ARENA_HUGETLB_1G:
+        huge = 1024 * 1024 * 1024;
+        /* fall through */
+    case SLAB_ARENA_HUGETLB:
+#if defined(MAP_HUGETLB)
+        {
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_1GB
+            if (mode == SLAB_ARENA_HUGETLB_1G)
+                flags |= MAP_HUGE_1GB;
+#endif
+            /* No MAP_NORESERVE: without enough free huge pages this should
+             * fail here, not SIGBUS when a page is first touched. */
+            size_t hlen = (len + huge - 1) / huge * huge;
+            ptr = mmap(NULL, hlen, PROT_READ | PROT_WRITE, flags, -1, 0);
+            if (ptr != MAP_FAILED) {
+                arena_len = hlen;
+                arena_hugepage = huge;
+                arena_kind = mode == SLAB_ARENA_HUGETLB_1G ? "hugetlb_1g" : "hugetlb";
+                return ptr;
+            }
+        }
+#endif
+        fprintf(stderr, "Warning: no hugetlb pages for the slab arena (%s),"
+                " trying transparent huge pages\n", strerror(errno));
+        /* fall through */
+    case SLAB_ARENA_THP:
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+        /* THP needs huge page aligned memory, so map a bit more. */
+        huge = 2 * 1024 * 1024;
+        ptr = mmap(NULL, len + huge, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (ptr != MAP_FAILED) {
+            char *aligned = (char *)(((uintptr_t)ptr + huge - 1) & ~(uintptr_t)(huge - 1));
+            if (madvise(aligned, len, MADV_HUGEPAGE) == 0) {
+                arena_len = len;
+                arena_hugepage = huge;
+                arena_kind = "thp";
+                return aligned;
+            }
+            fprintf(stderr, "Warning: failed to set transparent huge page hint"
+                    " on the slab arena: %s\n", strerror(errno));
+            munmap(ptr, len + huge);
+        }
+#endif
+        /* fall through */
+    default:
+        ptr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (ptr != MAP_FAILED) {
+            arena_len = len;
+            arena_hugepage = 0;
+            arena_kind = "mmap";
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+/* Places the arena on NUMA nodes. For slab_numa=local it's cut into one
+ * page aligned part per node, each bound to its node. */
+static void arena_place(char *base, size_t len) {
+    unsigned long nodes;
+    int count = arena_nodes(&nodes);
+    size_t align = arena_hugepage > settings.slab_page_size ?
+        arena_hugepage : settings.slab_page_size;
+
+    if (settings.slab_numa == SLAB_NUMA_NONE || count == 0)
+        return;
+
+    if (settings.slab_numa == SLAB_NUMA_INTERLEAVE) {
+        if (arena_mbind(base, len, MPOL_INTERLEAVE, nodes) != 0) {
+            fprintf(stderr, "Warning: failed to interleave the slab arena: %s\n",
+                    strerror(errno));
+        }
+        return;
+    }
+
+    size_t part = len / count / align * align;
+    if (part == 0) {
+        fprintf(stderr, "Warning: slab arena too small to split over %d NUMA nodes\n",
+                count);
+        return;
+    }
+    for (int n = 0, i = 0; n < ARENA_MAX_NODES; n++) {
+        arena_part_of_node[n] = -1;
+        if ((nodes & (1UL << n)) == 0)
+            continue;
+        arena_parts[i].current = base + part * i;
+        arena_parts[i].avail = i == count - 1 ? len - part * i : part;
+        if (arena_mbind(arena_parts[i].current, arena_parts[i].avail,
+                    MPOL_BIND, 1UL << n) != 0) {
+            fprintf(stderr, "Warning: failed to bind slab arena to NUMA node %d: %s\n",
+                    n, strerror(errno));
+        }
+        arena_part_of_node[n] = i++;
+    }
+    arena_nparts = count;
+}
+
+/* Carves size bytes from the caller's node part, or any other with room. */
+static void *arena_part_alloc(size_t size) {
+    int node = arena_current_node();
+    int first = arena_part_of_node[node] >= 0 ? arena_part_of_node[node] : 0;
+
+    for (int i = 0; i < arena_nparts; i++) {
+        arena_part_t *a = &arena_parts[(first + i) % arena_nparts];
+        if (size <= a->avail) {
+            void *ret = a->current;
+            a->current += size;
+            a->avail -= size;
+            return ret;
+        }
+    }
+    return NULL;
+}
+
+/* Huge page backed bytes of the arena, from /proc/self/smaps. */
+static uint64_t arena_huge_bytes(void) {
+    uint64_t total = 0;
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/smaps", "r");
+    char line[256];
+    bool in_arena = false;
+    uintptr_t start = (uintptr_t)mem_base;
+
+    if (f == NULL)
+        return 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long lo, hi;
+        unsigned long long kb;
+        if (sscanf(line, "%lx-%lx ", &lo, &hi) == 2) {
+            in_arena = start < hi && start + arena_len > lo;
+        } else if (in_arena &&
+                (sscanf(line, "AnonHugePages: %llu kB", &kb) == 1 ||
+                 sscanf(line, "Private_Hugetlb: %llu kB", &kb) == 1)) {
+            total += kb * 1024;
+        }
+    }
+    fclose(f);
+#endif
+    return total;
+}
+
 unsigned int slabs_fixup(char *chunk, const int border) {
     slabclass_t *p;
     item *it = (item *)chunk;
@@ -190,8 +436,8 @@ unsigned int slabs_fixup(char *chunk, const int border) {
         // if ITEM_SLABBED re-stack on freelist.
         // don't have to run pointer fixups.
         it->prev = 0;
-        it->next = p->slots;
-        if (it->next) it->next->prev = it;
+        it->next = ITEM_REF(p->slots);
+        if (it->next) ITEM_PTR(it->next)->prev = ITEM_REF(it);
         p->slots = it;
 
         p->sl_curr++;
@@ -208,6 +454,7 @@ unsigned int slabs_fixup(char *chunk, const int border) {
 void slabs_init(const size_t limit, const double factor, const bool prealloc, const uint32_t *slab_sizes, void *mem_base_external, bool reuse_mem) {
     int i = POWER_SMALLEST - 1;
     unsigned int size = sizeof(item) + settings.chunk_size;
+    enum slab_arena_mode arena_mode = settings.slab_arena;
 
     /* Some platforms use runtime transparent hugepages. If for any reason
      * the initial allocation fails, the required settings do not persist
@@ -217,7 +464,40 @@ void slabs_init(const size_t limit, const double factor, const bool prealloc, co
 
     mem_limit = limit;
 
-    if (prealloc && mem_base_external == NULL) {
+#ifdef COMPACT_ITEMS
+    /* Items link by offset, so every page has to come out of one arena. */
+    if (arena_mode == SLAB_ARENA_NONE)
+        arena_mode = prealloc ? SLAB_ARENA_THP : SLAB_ARENA_MMAP;
+#endif
+
+    if (arena_mode != SLAB_ARENA_NONE && mem_base_external == NULL) {
+        size_t len = mem_limit;
+        /* Unless preallocating, the arena is only reserved address space,
+         * with room for the first page of every class past the limit like
+         * malloc'd pages get. Not for hugetlb, which is reserved for real. */
+        if (!prealloc && arena_mode != SLAB_ARENA_HUGETLB
+                && arena_mode != SLAB_ARENA_HUGETLB_1G) {
+            len += MAX_NUMBER_OF_SLAB_CLASSES * settings.slab_page_size;
+        }
+#ifdef COMPACT_ITEMS
+        len += ITEM_ARENA_RESERVE;
+#endif
+        mem_base = arena_map(arena_mode, len);
+        if (mem_base == NULL) {
+            fprintf(stderr, "Failed to map %zu bytes for the slab arena: %s\n",
+                    len, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        do_slab_prealloc = prealloc;
+        mem_current = mem_base;
+        mem_avail = arena_len;
+#ifdef COMPACT_ITEMS
+        mem_avail -= ITEM_ARENA_RESERVE;
+        arena_reserve = (char *)mem_base + mem_avail;
+        arena_reserve_avail = ITEM_ARENA_RESERVE;
+#endif
+        arena_place(mem_base, mem_avail);
+    } else if (prealloc && mem_base_external == NULL) {
         mem_base = alloc_large_chunk(mem_limit);
         if (mem_base) {
             do_slab_prealloc = true;
@@ -244,6 +524,10 @@ void slabs_init(const size_t limit, const double factor, const bool prealloc, co
         }
     }
 
+#ifdef COMPACT_ITEMS
+    item_arena = mem_base;
+#endif
+
     memset(slabclass, 0, sizeof(slabclass));
 
     while (++i < MAX_NUMBER_OF_SLAB_CLASSES-1) {
@@ -288,6 +572,17 @@ void slabs_init(const size_t limit, const double factor, const bool prealloc, co
 
     }
 
+    if (settings.slab_magazines) {
+        pthread_key_create(&magazines_key, NULL);
+        /* Big chunks are left out; a few of them cached per thread would
+         * already hold on to a lot of memory. */
+        for (i = POWER_SMALLEST; i <= power_largest; i++) {
+            unsigned int n = SLAB_MAG_BYTES / slabclass[i].size;
+            if (n >= 4)
+                mag_size[i] = n < SLAB_MAG_CHUNKS ? n : SLAB_MAG_CHUNKS;
+        }
+    }
+
     if (do_slab_prealloc) {
         if (!reuse_mem) {
             slabs_preallocate(power_largest);
@@ -295,6 +590,26 @@ void slabs_init(const size_t limit, const double factor, const bool prealloc, co
     }
 }
 
+#ifdef COMPACT_ITEMS
+/* Hands out zeroed memory from the end of the item arena, for structures
+ * that get linked into the LRU next to items. */
+void *slabs_arena_reserve(size_t size) {
+    void *ret = NULL;
+
+    if (size % CHUNK_ALIGN_BYTES)
+        size += CHUNK_ALIGN_BYTES - (size % CHUNK_ALIGN_BYTES);
+    pthread_mutex_lock(&slabs_lock);
+    if (size <= arena_reserve_avail) {
+        ret = arena_reserve;
+        arena_reserve += size;
+        arena_reserve_avail -= size;
+        memset(ret, 0, size);
+    }
+    pthread_mutex_unlock(&slabs_lock);
+    return ret;
+}
+#endif
+
 void slabs_prefill_global(void) {
     void *ptr;
     slabclass_t *p = &slabclass[0];
@@ -426,8 +741,8 @@ static void *do_slabs_alloc(const size_t size, unsigned int id,
     if (p->sl_curr != 0) {
         /* return off our freelist */
         it = (item *)p->slots;
-        p->slots = it->next;
-        if (it->next) it->next->prev = 0;
+        p->slots = ITEM_PTR(it->next);
+        if (it->next) ITEM_PTR(it->next)->prev = 0;
         /* Kill flag and initialize refcount here for lock safety in slab
          * mover's freeness detection. */
         it->it_flags &= ~ITEM_SLABBED;
@@ -470,8 +785,8 @@ static void do_slabs_free_chunked(item *it, const size_t size) {
     // return the header object.
     // TODO: This is in three places, here and in do_slabs_free().
     it->prev = 0;
-    it->next = p->slots;
-    if (it->next) it->next->prev = it;
+    it->next = ITEM_REF(p->slots);
+    if (it->next) ITEM_PTR(it->next)->prev = ITEM_REF(it);
     p->slots = it;
     p->sl_curr++;
 
@@ -482,10 +797,12 @@ static void do_slabs_free_chunked(item *it, const size_t size) {
         p = &slabclass[chunk->slabs_clsid];
         next_chunk = chunk->next;
 
-        chunk->prev = 0;
-        chunk->next = p->slots;
-        if (chunk->next) chunk->next->prev = chunk;
-        p->slots = chunk;
+        /* Free chunks are linked like any other free item. */
+        it = (item *)chunk;
+        it->prev = 0;
+        it->next = ITEM_REF(p->slots);
+        if (it->next) ITEM_PTR(it->next)->prev = ITEM_REF(it);
+        p->slots = it;
         p->sl_curr++;
 
         chunk = next_chunk;
@@ -511,8 +828,8 @@ static void do_slabs_free(void *ptr, const size_t size, unsigned int id) {
         it->it_flags = ITEM_SLABBED;
         it->slabs_clsid = id;
         it->prev = 0;
-        it->next = p->slots;
-        if (it->next) it->next->prev = it;
+        it->next = ITEM_REF(p->slots);
+        if (it->next) ITEM_PTR(it->next)->prev = ITEM_REF(it);
         p->slots = it;
 
         p->sl_curr++;
@@ -526,13 +843,16 @@ static void do_slabs_free(void *ptr, const size_t size, unsigned int id) {
  * custom function here.
  */
 void fill_slab_stats_automove(slab_stats_automove *am) {
+    unsigned int cached[MAX_NUMBER_OF_SLAB_CLASSES];
     int n;
+    /* Chunks in magazines count as free: moving a page drains them. */
+    magazines_count(cached);
     pthread_mutex_lock(&slabs_lock);
     for (n = 0; n < MAX_NUMBER_OF_SLAB_CLASSES; n++) {
         slabclass_t *p = &slabclass[n];
         slab_stats_automove *cur = &am[n];
         cur->chunks_per_page = p->perslab;
-        cur->free_chunks = p->sl_curr;
+        cur->free_chunks = p->sl_curr + cached[n];
         cur->total_pages = p->slabs;
         cur->chunk_size = p->size;
     }
@@ -553,7 +873,7 @@ unsigned int global_page_pool_size(bool *mem_flag) {
 }
 
 /*@null@*/
-static void do_slabs_stats(ADD_STAT add_stats, void *c) {
+static void do_slabs_stats(ADD_STAT add_stats, void *c, const unsigned int *cached) {
     int i, total;
     /* Get the per-thread stats which contain some interesting aggregates */
     struct thread_stats thread_stats;
@@ -576,8 +896,11 @@ static void do_slabs_stats(ADD_STAT add_stats, void *c) {
             APPEND_NUM_STAT(i, "total_pages", "%u", slabs);
             APPEND_NUM_STAT(i, "total_chunks", "%u", slabs * perslab);
             APPEND_NUM_STAT(i, "used_chunks", "%u",
-                            slabs*perslab - p->sl_curr);
+                            slabs*perslab - p->sl_curr - cached[i]);
             APPEND_NUM_STAT(i, "free_chunks", "%u", p->sl_curr);
+            if (settings.slab_magazines) {
+                APPEND_NUM_STAT(i, "cached_chunks", "%u", cached[i]);
+            }
             /* Stat is dead, but displaying zero instead of removing it. */
             APPEND_NUM_STAT(i, "free_chunks_end", "%u", 0);
             APPEND_NUM_STAT(i, "get_hits", "%llu",
@@ -600,11 +923,70 @@ static void do_slabs_stats(ADD_STAT add_stats, void *c) {
         }
     }
 
-    /* add overall slab stats and append terminator */
+    /* add overall slab stats */
 
     APPEND_STAT("active_slabs", "%d", total);
     APPEND_STAT("total_malloced", "%llu", (unsigned long long)mem_malloced);
-    add_stats(NULL, 0, NULL, 0, c);
+}
+
+/* Lists the first address of every slab page, global pool included. */
+static void **do_slabs_pages(int *count) {
+    void **pages;
+    int n = 0;
+
+    for (int i = 0; i <= power_largest; i++)
+        n += slabclass[i].slabs;
+    pages = malloc(sizeof(void *) * (n + 1));
+    if (pages == NULL)
+        return NULL;
+    n = 0;
+    for (int i = 0; i <= power_largest; i++) {
+        for (unsigned int x = 0; x < slabclass[i].slabs; x++)
+            pages[n++] = slabclass[i].slab_list[x];
+    }
+    *count = n;
+    return pages;
+}
+
+/* How the arena is mapped. Cheap, so "stats slabs" includes it. */
+static void slabs_arena_mapping_stats(ADD_STAT add_stats, void *c) {
+    APPEND_STAT("arena_mode", "%s", arena_kind);
+    APPEND_STAT("arena_bytes", "%llu", (unsigned long long)arena_len);
+    APPEND_STAT("arena_hugepage_size", "%llu", (unsigned long long)arena_hugepage);
+}
+
+/* Arena stats: how much of it huge pages back, and which NUMA node each
+ * slab page landed on. Both walk the page tables of the whole arena, so
+ * they are only for "stats arena". They run without slabs_lock; arena
+ * pages never go away, so the list can't go stale. */
+static void arena_page_stats(ADD_STAT add_stats, void *c, void **pages, int count) {
+    char key_str[STAT_KEY_LEN];
+    char val_str[STAT_VAL_LEN];
+    int klen = 0, vlen = 0;
+
+    slabs_arena_mapping_stats(add_stats, c);
+    APPEND_STAT("arena_huge_bytes", "%llu", (unsigned long long)arena_huge_bytes());
+#if defined(__linux__) && defined(SYS_move_pages)
+    if (pages != NULL && count > 0) {
+        int *status = malloc(sizeof(int) * count);
+        uint64_t nodes[ARENA_MAX_NODES] = {0};
+        if (status != NULL &&
+                syscall(SYS_move_pages, 0, (unsigned long)count, pages, NULL, status, 0) == 0) {
+            for (int i = 0; i < count; i++) {
+                if (status[i] >= 0 && status[i] < ARENA_MAX_NODES)
+                    nodes[status[i]]++;
+            }
+            for (int n = 0; n < ARENA_MAX_NODES; n++) {
+                if (nodes[n] == 0)
+                    continue;
+                klen = snprintf(key_str, STAT_KEY_LEN, "arena_node%d_pages", n);
+                vlen = snprintf(val_str, STAT_VAL_LEN, "%llu", (unsigned long long)nodes[n]);
+                add_stats(key_str, klen, val_str, vlen, c);
+            }
+        }
+        free(status);
+    }
+#endif
 }
 
 static void *memory_allocate(size_t size) {
@@ -613,6 +995,14 @@ static void *memory_allocate(size_t size) {
     if (mem_base == NULL) {
         /* We are not using a preallocated large memory chunk */
         ret = malloc(size);
+    } else if (arena_nparts > 0) {
+        if (size % CHUNK_ALIGN_BYTES) {
+            size += CHUNK_ALIGN_BYTES - (size % CHUNK_ALIGN_BYTES);
+        }
+        ret = arena_part_alloc(size);
+        if (ret == NULL) {
+            return NULL;
+        }
     } else {
         ret = mem_current;
 
@@ -653,10 +1043,128 @@ static void memory_release(void) {
     }
 }
 
+/* Called by each worker thread as it starts. */
+int slabs_magazines_thread_init(void) {
+    slab_magazines *t = calloc(1, sizeof(slab_magazines));
+    if (t == NULL)
+        return -1;
+    pthread_mutex_init(&t->lock, NULL);
+
+    pthread_mutex_lock(&magazines_lock);
+    t->next = magazines_head;
+    magazines_head = t;
+    pthread_mutex_unlock(&magazines_lock);
+
+    pthread_setspecific(magazines_key, t);
+    return 0;
+}
+
+/* The calling thread's magazines, if it has some and the class is cached. */
+static inline slab_magazines *magazines_get(const unsigned int id) {
+    if (id >= MAX_NUMBER_OF_SLAB_CLASSES || mag_size[id] == 0)
+        return NULL;
+    return pthread_getspecific(magazines_key);
+}
+
+/* CALLED WITH the magazine lock HELD */
+static void *magazine_alloc(slab_magazine *m, const size_t size, unsigned int id) {
+    item *it;
+
+    if (m->count == 0) {
+        /* Refill half a magazine. Only the first chunk may carve a new page,
+         * as a single allocation would have. */
+        unsigned int want = mag_size[id] / 2;
+        pthread_mutex_lock(&slabs_lock);
+        while (m->count < want) {
+            it = do_slabs_alloc(size, id, m->count == 0 ? 0 : SLABS_ALLOC_NO_NEWPAGE);
+            if (it == NULL)
+                break;
+            it->it_flags = ITEM_SLABBED;
+            m->chunks[m->count++] = it;
+        }
+        pthread_mutex_unlock(&slabs_lock);
+        if (m->count == 0)
+            return NULL;
+    }
+
+    it = m->chunks[--m->count];
+    it->it_flags &= ~ITEM_SLABBED;
+    it->refcount = 1;
+    return it;
+}
+
+/* CALLED WITH the magazine lock HELD */
+static void magazine_free(slab_magazine *m, void *ptr, unsigned int id) {
+    item *it = ptr;
+
+    it->it_flags = ITEM_SLABBED;
+    it->slabs_clsid = id;
+    if (m->count == mag_size[id]) {
+        /* Full: the older half goes back to the freelist. */
+        unsigned int n = mag_size[id] / 2;
+        pthread_mutex_lock(&slabs_lock);
+        for (unsigned int x = 0; x < n; x++)
+            do_slabs_free(m->chunks[x], 0, id);
+        pthread_mutex_unlock(&slabs_lock);
+        m->count -= n;
+        memmove(m->chunks, m->chunks + n, m->count * sizeof(void *));
+    }
+    m->chunks[m->count++] = it;
+}
+
+/* Puts every magazine's chunks of a class back on its freelist, and keeps
+ * the class out of the magazines until magazines_bypass_end(). */
+static void magazines_drain(const unsigned int id) {
+    if (id >= MAX_NUMBER_OF_SLAB_CLASSES || mag_size[id] == 0)
+        return;
+    /* Threads check this under their own lock, which is taken below. */
+    __atomic_store_n(&mag_bypass, id, __ATOMIC_RELAXED);
+
+    pthread_mutex_lock(&magazines_lock);
+    for (slab_magazines *t = magazines_head; t != NULL; t = t->next) {
+        slab_magazine *m = &t->mags[id];
+        pthread_mutex_lock(&t->lock);
+        pthread_mutex_lock(&slabs_lock);
+        while (m->count > 0)
+            do_slabs_free(m->chunks[--m->count], 0, id);
+        pthread_mutex_unlock(&slabs_lock);
+        pthread_mutex_unlock(&t->lock);
+    }
+    pthread_mutex_unlock(&magazines_lock);
+}
+
+static void magazines_bypass_end(void) {
+    __atomic_store_n(&mag_bypass, 0, __ATOMIC_RELAXED);
+}
+
+/* Sums up the chunks sitting in magazines, per class. */
+static void magazines_count(unsigned int *cached) {
+    memset(cached, 0, sizeof(unsigned int) * MAX_NUMBER_OF_SLAB_CLASSES);
+    pthread_mutex_lock(&magazines_lock);
+    for (slab_magazines *t = magazines_head; t != NULL; t = t->next) {
+        pthread_mutex_lock(&t->lock);
+        for (int i = 0; i < MAX_NUMBER_OF_SLAB_CLASSES; i++)
+            cached[i] += t->mags[i].count;
+        pthread_mutex_unlock(&t->lock);
+    }
+    pthread_mutex_unlock(&magazines_lock);
+}
+
 void *slabs_alloc(size_t size, unsigned int id,
         unsigned int flags) {
+    slab_magazines *t = magazines_get(id);
     void *ret;
 
+    if (t != NULL && flags == 0) {
+        pthread_mutex_lock(&t->lock);
+        if (id != __atomic_load_n(&mag_bypass, __ATOMIC_RELAXED)) {
+            ret = magazine_alloc(&t->mags[id], size, id);
+            pthread_mutex_unlock(&t->lock);
+            return ret;
+        }
+        pthread_mutex_unlock(&t->lock);
+    }
+
     pthread_mutex_lock(&slabs_lock);
     ret = do_slabs_alloc(size, id, flags);
     pthread_mutex_unlock(&slabs_lock);
@@ -664,15 +1172,53 @@ void *slabs_alloc(size_t size, unsigned int id,
 }
 
 void slabs_free(void *ptr, size_t size, unsigned int id) {
+    slab_magazines *t = magazines_get(id);
+
+    /* Chunked items free into several classes; leave them to the lock. */
+    if (t != NULL && (((item *)ptr)->it_flags & ITEM_CHUNKED) == 0) {
+        pthread_mutex_lock(&t->lock);
+        if (id != __atomic_load_n(&mag_bypass, __ATOMIC_RELAXED)) {
+            magazine_free(&t->mags[id], ptr, id);
+            pthread_mutex_unlock(&t->lock);
+            return;
+        }
+        pthread_mutex_unlock(&t->lock);
+    }
+
     pthread_mutex_lock(&slabs_lock);
     do_slabs_free(ptr, size, id);
     pthread_mutex_unlock(&slabs_lock);
 }
 
 void slabs_stats(ADD_STAT add_stats, void *c) {
+    unsigned int cached[MAX_NUMBER_OF_SLAB_CLASSES];
+
+    magazines_count(cached);
+    pthread_mutex_lock(&slabs_lock);
+    do_slabs_stats(add_stats, c, cached);
+    pthread_mutex_unlock(&slabs_lock);
+
+    if (arena_len != 0)
+        slabs_arena_mapping_stats(add_stats, c);
+    add_stats(NULL, 0, NULL, 0, c);
+}
+
+void slabs_arena_stats(ADD_STAT add_stats, void *c) {
+    void **pages;
+    int count = 0;
+
+    if (arena_len == 0) {
+        APPEND_STAT("arena_mode", "%s", "none");
+        add_stats(NULL, 0, NULL, 0, c);
+        return;
+    }
     pthread_mutex_lock(&slabs_lock);
-    do_slabs_stats(add_stats, c);
+    pages = do_slabs_pages(&count);
     pthread_mutex_unlock(&slabs_lock);
+
+    arena_page_stats(add_stats, c, pages, count);
+    free(pages);
+    add_stats(NULL, 0, NULL, 0, c);
 }
 
 static bool do_slabs_adjust_mem_limit(size_t new_mem_limit) {
@@ -731,6 +1277,9 @@ static int slab_rebalance_start(void) {
     slabclass_t *s_cls;
     int no_go = 0;
 
+    /* Free chunks have to be on the freelist for the mover to find them. */
+    magazines_drain(slab_rebal.s_clsid);
+
     pthread_mutex_lock(&slabs_lock);
 
     if (slab_rebal.s_clsid < SLAB_GLOBAL_PAGE_POOL ||
@@ -750,6 +1299,7 @@ static int slab_rebalance_start(void) {
         no_go = -3;
 
     if (no_go != 0) {
+        magazines_bypass_end();
         pthread_mutex_unlock(&slabs_lock);
         return no_go; /* Should use a wrapper function... */
     }
@@ -823,10 +1373,10 @@ static void slab_rebalance_cut_free(slabclass_t *s_cls, item *it) {
     /* Ensure this was on the freelist and nothing else. */
     assert(it->it_flags == ITEM_SLABBED);
     if (s_cls->slots == it) {
-        s_cls->slots = it->next;
+        s_cls->slots = ITEM_PTR(it->next);
     }
-    if (it->next) it->next->prev = it->prev;
-    if (it->prev) it->prev->next = it->next;
+    if (it->next) ITEM_PTR(it->next)->prev = it->prev;
+    if (it->prev) ITEM_PTR(it->prev)->next = it->next;
     s_cls->sl_curr--;
 }
 
@@ -1177,6 +1727,7 @@ static void slab_rebalance_finish(void) {
     slab_rebal.busy_deletes = 0;
 
     slab_rebalance_signal = 0;
+    magazines_bypass_end();
 
     free(slab_rebal.completed);
     pthread_mutex_unlock(&slabs_lock);
@@ -1212,6 +1763,10 @@ static void *slab_rebalance_thread(void *arg) {
             if (slab_rebalance_start() < 0) {
                 /* Handle errors with more specificity as required. */
                 slab_rebalance_signal = 0;
+            } else if (settings.lockless_get) {
+                /* Lockless readers stay off the page once they see the
+                 * signal; wait out any that got in before it. */
+                read_epoch_synchronize();
             }
 
             was_busy = 0;
@@ -1224,6 +1779,10 @@ static void *slab_rebalance_thread(void *arg) {
         } else if (was_busy) {
             /* Stuck waiting for some items to unlock, so slow down a bit
              * to give them a chance to free up */
+            if (settings.lockless_get) {
+                /* Some may be freed items still waiting on readers. */
+                item_reclaim_deferred();
+            }
             usleep(backoff_timer);
             backoff_timer = backoff_timer * 2;
             if (backoff_timer > backoff_max)
@@ -12,6 +12,10 @@ void slabs_init(const size_t limit, const double factor, const bool prealloc, co
 
 /** Call only during init. Pre-allocates all available memory */
 void slabs_prefill_global(void);
+#ifdef COMPACT_ITEMS
+/** Memory for structures linked like items but not allocated as items */
+void *slabs_arena_reserve(size_t size);
+#endif
 
 /**
  * Given object size, return id to use when allocating/freeing memory for object
@@ -28,6 +32,9 @@ void *slabs_alloc(const size_t size, unsigned int id, unsigned int flags);
 /** Free previously allocated object */
 void slabs_free(void *ptr, size_t size, unsigned int id);
 
+/** Gives the calling worker thread its own caches of free chunks */
+int slabs_magazines_thread_init(void);
+
 /** Adjust global memory limit up or down */
 bool slabs_adjust_mem_limit(size_t new_mem_limit);
 
@@ -42,6 +49,8 @@ unsigned int global_page_pool_size(bool *mem_flag);
 
 /** Fill buffer with stats */ /*@null@*/
 void slabs_stats(ADD_STAT add_stats, void *c);
+/* "stats arena": huge page and NUMA node breakdown of the slab arena */
+void slabs_arena_stats(ADD_STAT add_stats, void *c);
 
 /* Hints as to freespace in slab class */
 unsigned int slabs_available_chunks(unsigned int id, bool *mem_flag, unsigned int *chunks_perslab);
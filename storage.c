@@ -441,7 +441,7 @@ static void recache_or_free(io_pending_t *pending) {
                 it->exptime = h_it->exptime;
                 it->it_flags &= ~ITEM_LINKED;
                 it->refcount = 0;
-                it->h_next = NULL; // might not be necessary.
+                it->h_next = 0; // might not be necessary.
                 STORAGE_delete(c->thread->storage, h_it);
                 item_replace(h_it, it, hv, ITEM_get_cas(h_it));
                 pthread_mutex_lock(&c->thread->stats.mutex);
@@ -0,0 +1,106 @@
+#!/usr/bin/env perl
+# The bucketized hash index: lookups, deletes that compact buckets and
+# overflow chains, online expansion and the hash table walk.
+
+use strict;
+use warnings;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached('-m 64 -o hash_index=bucketized,hashpower=13');
+my $sock = $server->sock;
+
+{
+    my $stats = mem_stats($sock, ' settings');
+    is($stats->{hash_index}, "bucketized", "bucketized hash index enabled");
+    $stats = mem_stats($sock);
+    is($stats->{hash_power_level}, 13, "starts at hashpower 13");
+    is($stats->{hash_bytes}, 8192 * 64, "one cache line per bucket");
+}
+
+# Three items per bucket is the expansion threshold; go past it.
+my $count = 30000;
+for (1 .. $count) {
+    print $sock "set hkey$_ 0 0 " . length("val$_") . " noreply\r\nval$_\r\n";
+}
+print $sock "version\r\n";
+like(scalar <$sock>, qr/^VERSION/, "bulk sets completed");
+
+my $expanded = 0;
+for (1 .. 20) {
+    my $stats = mem_stats($sock);
+    if ($stats->{hash_power_level} > 13 && !$stats->{hash_is_expanding}) {
+        $expanded = 1;
+        last;
+    }
+    sleep 0.5;
+}
+ok($expanded, "hash table expanded");
+
+sub check_keys {
+    my ($test, $want) = @_;
+    my $found = 0;
+    my $wrong = 0;
+    for my $n (1 .. $count) {
+        print $sock "get hkey$n\r\n";
+        my $line = <$sock>;
+        if ($line =~ /^VALUE hkey$n /) {
+            my $data = <$sock>;
+            <$sock>;
+            $found++;
+            $wrong++ unless $want->($n) && $data eq "val$n\r\n";
+        } else {
+            $wrong++ if $want->($n);
+        }
+    }
+    is($wrong, 0, $test);
+    return $found;
+}
+
+my $found = check_keys("every key found after expansion", sub { 1 });
+is($found, $count, "found all $count keys");
+
+# Deletes move the last entry of a bucket chain into the hole.
+for my $n (1 .. $count) {
+    next unless $n % 3 == 0;
+    print $sock "delete hkey$n noreply\r\n";
+}
+print $sock "version\r\n";
+like(scalar <$sock>, qr/^VERSION/, "bulk deletes completed");
+check_keys("deleted keys gone, others intact", sub { $_[0] % 3 != 0 });
+
+# Walk the table and see every remaining key exactly once.
+{
+    my %seen;
+    my $dups = 0;
+    print $sock "lru_crawler metadump hash\r\n";
+    while (<$sock>) {
+        last if /^(\.|END)/;
+        if (/^key=hkey(\d+)/) {
+            $dups++ if $seen{$1}++;
+        }
+    }
+    is($dups, 0, "hash walk returns each item once");
+    is(scalar(keys %seen), $count - int($count / 3), "hash walk found every item");
+}
+
+# Overwrites relink through the index.
+print $sock "set hkey1 0 0 3\r\nnew\r\n";
+is(scalar <$sock>, "STORED\r\n", "overwrite stored");
+mem_get_is($sock, "hkey1", "new");
+
+{
+    my $stats = mem_stats($sock);
+    is($stats->{curr_items}, $count - int($count / 3), "curr_items matches");
+}
+
+# The chained layout stays the default.
+{
+    my $chained = new_memcached('-m 64');
+    my $stats = mem_stats($chained->sock, ' settings');
+    is($stats->{hash_index}, "chained", "chained hash index by default");
+}
+
+done_testing();
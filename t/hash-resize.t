@@ -0,0 +1,84 @@
+#!/usr/bin/env perl
+# Incremental hash table resizing: growing a bucket at a time while keys
+# stay reachable, and shrinking back with -o hash_shrink.
+
+use strict;
+use warnings;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached('-m 64 -o hashpower=13,hash_shrink');
+my $sock = $server->sock;
+
+{
+    my $stats = mem_stats($sock, ' settings');
+    is($stats->{hash_shrink}, "yes", "hash_shrink enabled");
+    $stats = mem_stats($sock);
+    is($stats->{hash_buckets}, 8192, "starts with 8192 buckets");
+    is($stats->{hash_bytes}, 8192 * 8, "one pointer per bucket");
+}
+
+sub wait_resize {
+    my $done = shift;
+    for (1 .. 40) {
+        my $stats = mem_stats($sock);
+        return $stats if !$stats->{hash_is_expanding} && $done->($stats);
+        sleep 0.25;
+    }
+    return mem_stats($sock);
+}
+
+sub check_keys {
+    my ($from, $to) = @_;
+    my $wrong = 0;
+    for my $n ($from .. $to) {
+        print $sock "get rkey$n\r\n";
+        my $line = <$sock>;
+        if ($line =~ /^VALUE /) {
+            $wrong++ if <$sock> ne "val$n\r\n";
+            <$sock>;
+        } else {
+            $wrong++;
+        }
+    }
+    return $wrong;
+}
+
+# 1.5 items per bucket is the growth threshold; go well past it.
+my $count = 40000;
+for (1 .. $count) {
+    print $sock "set rkey$_ 0 0 " . length("val$_") . " noreply\r\nval$_\r\n";
+}
+print $sock "version\r\n";
+like(scalar <$sock>, qr/^VERSION/, "bulk sets completed");
+
+my $stats = wait_resize(sub { $_[0]->{hash_buckets} * 3 / 2 >= $count });
+cmp_ok($stats->{hash_buckets}, '>=', $count * 2 / 3, "table grew with the items");
+is($stats->{hash_power_level}, int(log($stats->{hash_buckets}) / log(2)),
+    "power level follows the bucket count");
+is(check_keys(1, $count), 0, "every key found after growing");
+
+# Leave a few keys behind and let the table shrink back.
+my $keep = 1000;
+for ($keep + 1 .. $count) {
+    print $sock "delete rkey$_ noreply\r\n";
+}
+print $sock "version\r\n";
+like(scalar <$sock>, qr/^VERSION/, "bulk deletes completed");
+
+$stats = wait_resize(sub { $_[0]->{hash_buckets} == 8192 });
+is($stats->{hash_buckets}, 8192, "table shrank back to its initial size");
+is($stats->{hash_power_level}, 13, "power level back to 13");
+is($stats->{hash_bytes}, 8192 * 8, "segments freed");
+is(check_keys(1, $keep), 0, "remaining keys found after shrinking");
+
+# Shrinking stays off by default.
+{
+    my $server = new_memcached('-m 64');
+    my $stats = mem_stats($server->sock, ' settings');
+    is($stats->{hash_shrink}, "no", "hash_shrink off by default");
+}
+
+done_testing();
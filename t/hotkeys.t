@@ -0,0 +1,149 @@
+#!/usr/bin/env perl
+# Hot key replication (-o hot_keys): detection through sampled hits,
+# "stats hotkeys", gets served from per-thread copies, and the copies
+# going away whenever the item changes.
+
+use strict;
+use warnings;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+# One worker thread, so every get lands on the same sketch.
+my $server = new_memcached('-m 64 -t 1 -o hot_keys');
+my $sock = $server->sock;
+
+{
+    my $stats = mem_stats($sock, ' settings');
+    is($stats->{hot_keys}, "yes", "hot_keys enabled");
+}
+
+sub hot_hits {
+    return mem_stats($sock)->{get_hot_hits};
+}
+
+sub get_many {
+    my ($key, $count) = @_;
+    my $wrong = 0;
+    for (1 .. $count) {
+        print $sock "get $key\r\n";
+        my $line = <$sock>;
+        if ($line =~ /^VALUE /) {
+            <$sock>;
+            $wrong++ if <$sock> ne "END\r\n";
+        } else {
+            $wrong++;
+        }
+    }
+    return $wrong;
+}
+
+print $sock "set hot 5 0 5\r\nhello\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored hot key");
+for my $n (1 .. 20) {
+    print $sock "set cold$n 0 0 4\r\ncold\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored cold$n");
+}
+
+# Mix in a spread of cold keys; only the hot one should stand out.
+for my $n (1 .. 20) {
+    is(get_many("cold$n", 5), 0, "cold$n fetched");
+}
+is(get_many("hot", 600), 0, "hot key fetched");
+
+{
+    my $stats = mem_stats($sock, ' hotkeys');
+    is($stats->{'0:key'}, "hot", "hot key detected");
+    cmp_ok($stats->{'0:gets'}, '>', 0, "with an estimate of its gets");
+    is($stats->{'0:threads'}, 1, "on one thread");
+    ok(!exists $stats->{'1:key'}, "cold keys not listed");
+}
+
+{
+    my $hits = hot_hits();
+    cmp_ok($hits, '>', 0, "gets served from the copy");
+    mem_get_is({ sock => $sock, flags => 5 }, "hot", "hello", "copy has the right value");
+    my $stats = mem_stats($sock);
+    is(hot_hits(), $hits + 1, "and counted as a hot hit");
+    cmp_ok($stats->{get_hits}, '>=', 700, "hot hits count as get hits");
+}
+
+# Flags come back from the copy as stored.
+print $sock "get hot\r\n";
+is(scalar <$sock>, "VALUE hot 5 5\r\n", "flags and length from the copy");
+is(scalar <$sock>, "hello\r\n", "value from the copy");
+is(scalar <$sock>, "END\r\n", "end from the copy");
+
+# gets always goes to the item, for its cas.
+{
+    my $hits = hot_hits();
+    print $sock "gets hot\r\n";
+    like(scalar <$sock>, qr/^VALUE hot 5 5 \d+\r\n/, "gets returns a cas");
+    is(scalar <$sock>, "hello\r\n", "gets value");
+    is(scalar <$sock>, "END\r\n", "gets end");
+    is(hot_hits(), $hits, "gets isn't served from the copy");
+}
+
+sub warm_and_check {
+    my ($want, $test) = @_;
+    get_many("hot", 300);
+    mem_get_is($sock, "hot", $want, $test);
+}
+
+print $sock "set hot 0 0 5\r\nworld\r\n";
+is(scalar <$sock>, "STORED\r\n", "overwrote hot key");
+mem_get_is($sock, "hot", "world", "overwrite visible right away");
+warm_and_check("world", "overwrite visible once copied again");
+
+print $sock "append hot 0 0 1\r\n!\r\n";
+is(scalar <$sock>, "STORED\r\n", "appended to hot key");
+mem_get_is($sock, "hot", "world!", "append visible");
+
+print $sock "set hotnum 0 0 2\r\n10\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored hot counter");
+get_many("hotnum", 300);
+print $sock "incr hotnum 5\r\n";
+is(scalar <$sock>, "15\r\n", "incremented hot counter");
+mem_get_is($sock, "hotnum", "15", "in-place incr visible");
+
+# Shortening the TTL has to reach the copy too.
+get_many("hot", 300);
+print $sock "touch hot 1\r\n";
+is(scalar <$sock>, "TOUCHED\r\n", "touched hot key");
+sleep 2.2;
+mem_get_is($sock, "hot", undef, "touched key expires");
+
+print $sock "set hot 0 0 3\r\nnew\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored hot key again");
+warm_and_check("new", "copied again");
+print $sock "mg hot T1\r\n";
+is(scalar <$sock>, "HD\r\n", "meta get set a TTL");
+sleep 2.2;
+mem_get_is($sock, "hot", undef, "meta TTL reaches the copy");
+
+print $sock "set hot 0 0 3\r\nnew\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored hot key again");
+warm_and_check("new", "copied again");
+print $sock "delete hot\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted hot key");
+mem_get_is($sock, "hot", undef, "delete visible");
+
+print $sock "set hot 0 0 3\r\nnew\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored hot key again");
+warm_and_check("new", "copied again");
+print $sock "flush_all\r\n";
+is(scalar <$sock>, "OK\r\n", "flushed");
+mem_get_is($sock, "hot", undef, "flush visible");
+
+# Off by default.
+{
+    my $server = new_memcached('-m 64');
+    my $sock = $server->sock;
+    my $stats = mem_stats($sock, ' settings');
+    is($stats->{hot_keys}, "no", "hot_keys off by default");
+    $stats = mem_stats($sock, ' hotkeys');
+    is($stats->{hotkeys_status}, "disabled", "stats hotkeys says so");
+}
+
+done_testing();
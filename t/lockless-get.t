@@ -0,0 +1,122 @@
+#!/usr/bin/env perl
+# GET hits served without the item lock (-o lockless_get): only active,
+# live items take the fast path, and overwrites, deletes, expiry and
+# flushes still show through it.
+
+use strict;
+use warnings;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached('-m 64 -o lockless_get');
+my $sock = $server->sock;
+
+sub lockless_hits {
+    return mem_stats($sock)->{get_lockless_hits};
+}
+
+{
+    my $stats = mem_stats($sock, ' settings');
+    is($stats->{lockless_get}, "yes", "lockless_get enabled");
+    is(lockless_hits(), 0, "no lockless hits yet");
+}
+
+print $sock "set hot 0 0 5\r\nhello\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored hot key");
+
+# The first two fetches mark the item fetched, then active, under the lock.
+mem_get_is($sock, "hot", "hello");
+mem_get_is($sock, "hot", "hello");
+is(lockless_hits(), 0, "inactive item fetched under the lock");
+
+for (1 .. 10) {
+    mem_get_is($sock, "hot", "hello");
+}
+is(lockless_hits(), 10, "active item fetched without the lock");
+
+print $sock "set hot 0 0 5\r\nworld\r\n";
+is(scalar <$sock>, "STORED\r\n", "overwrote hot key");
+mem_get_is($sock, "hot", "world", "overwrite visible");
+
+print $sock "delete hot\r\n";
+is(scalar <$sock>, "DELETED\r\n", "deleted hot key");
+mem_get_is($sock, "hot", undef, "delete visible");
+
+# Misses always go the locked way.
+my $hits = lockless_hits();
+mem_get_is($sock, "nothere", undef, "miss");
+is(lockless_hits(), $hits, "misses aren't lockless hits");
+
+print $sock "set short 0 2 5\r\nshort\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored expiring key");
+mem_get_is($sock, "short", "short") for 1 .. 3;
+sleep 3.2;
+$hits = lockless_hits();
+mem_get_is($sock, "short", undef, "expired item not served");
+is(lockless_hits(), $hits, "expired item left to the locked path");
+
+print $sock "set flushme 0 0 5\r\nflush\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored key to flush");
+mem_get_is($sock, "flushme", "flush") for 1 .. 3;
+print $sock "flush_all\r\n";
+is(scalar <$sock>, "OK\r\n", "flushed");
+mem_get_is($sock, "flushme", undef, "flushed item not served");
+
+# Churn through plenty of overwrites so freed items get recycled while the
+# same key keeps being read.
+for my $n (1 .. 2000) {
+    print $sock "set churn 0 0 " . length("v$n") . " noreply\r\nv$n\r\n";
+    print $sock "get churn\r\n";
+    my $line = <$sock>;
+    if ($line ne "VALUE churn 0 " . length("v$n") . "\r\n") {
+        fail("churn read $n: $line");
+        last;
+    }
+    my $data = <$sock>;
+    <$sock>;
+    if ($data ne "v$n\r\n") {
+        fail("churn value $n: $data");
+        last;
+    }
+}
+pass("overwrites always read back their own value");
+
+# Counters are replaced rather than rewritten under lockless readers.
+print $sock "set counter 0 0 2\r\n10\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored counter");
+mem_get_is($sock, "counter", "10") for 1 .. 3;
+print $sock "incr counter 5\r\n";
+is(scalar <$sock>, "15\r\n", "incremented counter");
+mem_get_is($sock, "counter", "15", "incremented value visible");
+
+# Lockless hits leave the last access time alone, as locked hits on an
+# active item do: it was bumped when the item turned active.
+for my $opts ('-o lockless_get', '') {
+    my $server = new_memcached("-m 64 $opts");
+    my $sock = $server->sock;
+    print $sock "set aging 0 0 5\r\naging\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored aging key ($opts)");
+    mem_get_is($sock, "aging", "aging") for 1 .. 2;
+    sleep 2.2;
+    mem_get_is($sock, "aging", "aging") for 1 .. 3;
+    print $sock "me aging\r\n";
+    like(scalar <$sock>, qr/^ME aging exp=-1 la=[2-9] /,
+         "active hits don't bump the access time ($opts)");
+    is(mem_stats($sock)->{get_lockless_hits}, $opts ? 3 : 0, "lockless hits ($opts)");
+}
+
+# Off by default, and not with the bucketized index.
+{
+    my $server = new_memcached('-m 64');
+    my $stats = mem_stats($server->sock, ' settings');
+    is($stats->{lockless_get}, "no", "lockless_get off by default");
+}
+
+eval {
+    my $server = new_memcached('-o lockless_get,hash_index=bucketized');
+};
+ok($@, "refused with the bucketized index");
+
+done_testing();
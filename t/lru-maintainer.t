@@ -2,7 +2,7 @@
 
 use strict;
 use warnings;
-use Test::More tests => 226;
+use Test::More tests => 229;
 use FindBin qw($Bin);
 use lib "$Bin/lib";
 use MemcachedTest;
@@ -117,3 +117,12 @@ for (my $key = 0; $key < 100; $key++) {
 # Canary should still exist, even unfetched, because it's protected by
 # temp LRU
 mem_get_is($sock, "canary", $value);
+
+# Contended LRU lock acquisitions are counted, overall and per class.
+{
+    my $stats = mem_stats($sock);
+    ok(defined $stats->{lru_lock_waits}, "lru_lock_waits reported");
+    ok(defined $stats->{lru_lock_wait_us}, "lru_lock_wait_us reported");
+    $stats = mem_stats($sock, "items");
+    ok(defined $stats->{"items:31:lru_lock_waits"}, "per class lru_lock_waits reported");
+}
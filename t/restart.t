@@ -12,6 +12,14 @@ use MemcachedTest;
 # /dev/shm.
 my $mem_path = "/tmp/mc_restart.$$";
 
+{
+    my $server = new_memcached();
+    if (mem_stats($server->sock, ' settings')->{compact_items} eq "yes") {
+        plan skip_all => 'Restartable cache not supported with compact items';
+        exit 0;
+    }
+}
+
 # read a invalid metadata file
 {
     my $meta_path = "$mem_path.meta";
@@ -0,0 +1,92 @@
+#!/usr/bin/env perl
+# S3-FIFO eviction (-o eviction_policy=s3fifo): new items start in the small
+# queue, items hit twice there move to main and stay while they keep being
+# hit, and keys evicted from the small queue come back straight into main.
+
+use strict;
+use warnings;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached('-m 6 -o eviction_policy=s3fifo -l 127.0.0.1');
+my $sock = $server->sock;
+
+{
+    my $stats = mem_stats($sock, ' settings');
+    is($stats->{eviction_policy}, "s3fifo", "s3fifo enabled");
+    is($stats->{lru_segmented}, "no", "replaces the segmented LRU");
+}
+
+print $sock "lru mode segmented\r\n";
+is(scalar <$sock>, "ERROR\r\n", "can't switch to the segmented LRU");
+
+my $value = "B"x66560;
+
+print $sock "set canary 0 0 66560\r\n$value\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored canary key");
+# Items need two fetches to become active
+mem_get_is($sock, "canary", $value);
+mem_get_is($sock, "canary", $value);
+
+# Flush the slab class with junk, fetching the canary now and then.
+for (my $key = 0; $key < 100; $key++) {
+    if ($key % 10 == 0) {
+        mem_get_is($sock, "canary", $value, "canary still there at key$key");
+    }
+    print $sock "set key$key 0 0 66560\r\n$value\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored key$key");
+}
+
+{
+    my $stats = mem_stats($sock);
+    isnt($stats->{evictions}, 0, "some evictions happened");
+    is($stats->{ghost_hits}, 0, "no ghost hits yet");
+    $stats = mem_stats($sock, "items");
+    isnt($stats->{"items:31:moves_to_cold"}, 0, "canary moved to the main queue");
+    isnt($stats->{"items:31:evicted_unfetched"}, 0, "unfetched junk evicted");
+    is($stats->{"items:31:number_warm"}, 0, "nothing in WARM");
+}
+
+mem_get_is($sock, "key0", undef, "key0 was evicted");
+print $sock "set key0 0 0 66560\r\n$value\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored key0 again");
+
+{
+    my $stats = mem_stats($sock);
+    is($stats->{ghost_hits}, 1, "key0 was in the ghost table");
+    $stats = mem_stats($sock, "items");
+    is($stats->{"items:31:ghost_hits"}, 1, "counted in its slab class");
+}
+
+# Works without the LRU maintainer thread.
+$server = new_memcached('-m 6 -o eviction_policy=s3fifo,no_lru_maintainer -l 127.0.0.1');
+$sock = $server->sock;
+for (my $key = 0; $key < 100; $key++) {
+    print $sock "set key$key 0 0 66560\r\n$value\r\n";
+    is(scalar <$sock>, "STORED\r\n", "stored key$key without the maintainer");
+}
+mem_get_is($sock, "key99", $value, "newest key kept");
+{
+    my $stats = mem_stats($sock, ' settings');
+    is($stats->{lru_maintainer_thread}, "no", "no maintainer thread");
+    $stats = mem_stats($sock);
+    isnt($stats->{evictions}, 0, "evicted without the maintainer");
+}
+
+# A large starting hash table doesn't make the ghost table as large.
+{
+    my $server = new_memcached('-m 6 -o eviction_policy=s3fifo,hashpower=26 -l 127.0.0.1');
+    my $sock = $server->sock;
+    print $sock "set big 0 0 5\r\nhello\r\n";
+    is(scalar <$sock>, "STORED\r\n", "started with hashpower 26");
+    mem_get_is($sock, "big", "hello");
+}
+
+eval {
+    my $server = new_memcached('-o eviction_policy=clock');
+};
+ok($@, "unknown eviction policy refused");
+
+done_testing();
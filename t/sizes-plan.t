@@ -0,0 +1,51 @@
+#!/usr/bin/env perl
+# "stats sizes_plan": slab class sizes planned from the item size histogram,
+# and what they'd save over the current classes.
+
+use strict;
+use warnings;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+sub fill {
+    my $sock = shift;
+    my $n = 0;
+    for my $len (50, 60, 300, 310, 1000, 4000) {
+        for (1 .. 50) {
+            $n++;
+            print $sock "set key$n 0 0 $len\r\n" . ("x" x $len) . "\r\n";
+            is(scalar <$sock>, "STORED\r\n", "stored key$n") if $n % 50 == 0;
+        }
+    }
+}
+
+my $server = new_memcached('-m 64 -o track_sizes');
+my $sock = $server->sock;
+fill($sock);
+
+my $plan = mem_stats($sock, ' sizes_plan');
+is($plan->{sizes_status}, "ok", "planned");
+is($plan->{items}, 300, "from all items");
+cmp_ok($plan->{waste_planned}, '<', $plan->{waste_current}, "plan wastes less");
+is($plan->{bytes_saved}, $plan->{waste_current} - $plan->{waste_planned},
+   "bytes saved is the difference");
+like($plan->{slab_sizes}, qr/^\d+(-\d+)+$/, "slab_sizes list");
+my @sizes = split /-/, $plan->{slab_sizes};
+is(scalar @sizes, $plan->{classes}, "one size per class");
+
+# Starting with the planned classes gets the planned waste.
+$server->stop;
+$server = new_memcached("-m 64 -o track_sizes,slab_sizes=$plan->{slab_sizes}");
+$sock = $server->sock;
+fill($sock);
+my $again = mem_stats($sock, ' sizes_plan');
+is($again->{waste_current}, $plan->{waste_planned}, "planned classes in use");
+is($again->{bytes_saved}, 0, "nothing left to save");
+
+$server = new_memcached('-m 64');
+is(mem_stats($server->sock, ' sizes_plan')->{sizes_status}, "disabled",
+   "needs track_sizes");
+
+done_testing();
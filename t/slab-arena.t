@@ -0,0 +1,94 @@
+#!/usr/bin/env perl
+# Slab arena (-o slab_arena, slab_numa): slab pages out of one mapping,
+# huge page backed where the system allows, with NUMA placement stats.
+
+use strict;
+use warnings;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $value = "x" x 500;
+
+sub fill_and_check {
+    my ($server, $what) = @_;
+    my $sock = $server->sock;
+    for my $n (1 .. 2000) {
+        print $sock "set key$n 0 0 500 noreply\r\n$value\r\n";
+    }
+    mem_get_is($sock, "key2000", $value, "$what: stored items");
+
+    my $stats = mem_stats($sock, ' slabs');
+    cmp_ok($stats->{arena_bytes}, '>=', 64 * 1024 * 1024, "$what: arena covers the memory limit");
+    ok(!defined $stats->{arena_huge_bytes}, "$what: no page table walk in stats slabs");
+    my $pages = 0;
+    for my $k (keys %$stats) {
+        $pages += $stats->{$k} if $k =~ /^\d+:total_pages$/;
+    }
+
+    my $arena = mem_stats($sock, ' arena');
+    is($arena->{arena_mode}, $stats->{arena_mode}, "$what: stats arena mode");
+    ok(defined $arena->{arena_huge_bytes}, "$what: huge page usage reported");
+    my $on_nodes = 0;
+    for my $k (keys %$arena) {
+        $on_nodes += $arena->{$k} if $k =~ /^arena_node\d+_pages$/;
+    }
+    cmp_ok($on_nodes, '>=', $pages, "$what: every page is on a node")
+        if $on_nodes;
+    return $stats;
+}
+
+{
+    my $server = new_memcached('-m 64 -o slab_arena=thp');
+    my $settings = mem_stats($server->sock, ' settings');
+    is($settings->{slab_arena}, "thp", "thp arena");
+    my $stats = fill_and_check($server, "thp");
+    like($stats->{arena_mode}, qr/^(thp|mmap)$/, "mapped with or without THP");
+}
+
+{
+    # Falls back to THP when the hugetlb pool is empty.
+    my $server = new_memcached('-m 64 -o slab_arena=hugetlb');
+    my $stats = fill_and_check($server, "hugetlb");
+    like($stats->{arena_mode}, qr/^(hugetlb|thp|mmap)$/, "hugetlb or a fallback");
+}
+
+{
+    my $server = new_memcached('-m 64 -o slab_numa=local');
+    my $settings = mem_stats($server->sock, ' settings');
+    is($settings->{slab_numa}, "local", "node local pages");
+    is($settings->{slab_arena}, "mmap", "implies an mmap arena");
+    fill_and_check($server, "numa local");
+}
+
+{
+    my $server = new_memcached('-m 64 -o slab_arena=mmap,slab_numa=interleave');
+    fill_and_check($server, "numa interleave");
+}
+
+{
+    my $server = new_memcached('-m 64');
+    my $settings = mem_stats($server->sock, ' settings');
+    my $stats = mem_stats($server->sock, ' slabs');
+    if ($settings->{compact_items} eq "yes") {
+        # Compact item links always need the arena.
+        ok(exists $stats->{arena_bytes}, "arena for compact items");
+    } else {
+        ok(!exists $stats->{arena_bytes}, "no arena by default");
+        is(mem_stats($server->sock, ' arena')->{arena_mode}, "none", "stats arena without one");
+    }
+}
+
+eval {
+    my $server = new_memcached('-o slab_arena=gigantic');
+};
+ok($@, "unknown slab_arena refused");
+
+eval {
+    my $server = new_memcached("-o slab_arena=mmap -e /tmp/mc_arena.$$");
+};
+ok($@, "refused with a restartable cache");
+unlink "/tmp/mc_arena.$$", "/tmp/mc_arena.$$.meta";
+
+done_testing();
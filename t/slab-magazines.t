@@ -0,0 +1,126 @@
+#!/usr/bin/env perl
+# Per worker thread magazines of free chunks (-o slab_magazines): chunks
+# cached per class, frees from other threads, page moves draining the
+# magazines, and evictions once memory runs out.
+
+use strict;
+use warnings;
+use Test::More;
+use FindBin qw($Bin);
+use lib "$Bin/lib";
+use MemcachedTest;
+
+my $server = new_memcached('-m 64 -t 4 -o slab_magazines,slab_reassign,no_slab_automove');
+my $sock = $server->sock;
+
+{
+    my $stats = mem_stats($sock, ' settings');
+    is($stats->{slab_magazines}, "yes", "slab_magazines enabled");
+}
+
+my $value = "m" x 500;
+
+print $sock "set first 0 0 500\r\n$value\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored first item");
+
+my $cls;
+{
+    my $stats = mem_stats($sock, ' slabs');
+    for my $k (keys %$stats) {
+        $cls = $1 if $k =~ /^(\d+):used_chunks$/ && $stats->{$k} == 1;
+    }
+    ok(defined $cls, "found the item's class");
+    cmp_ok($stats->{"$cls:cached_chunks"}, '>', 0, "magazine refilled");
+    is($stats->{"$cls:used_chunks"} + $stats->{"$cls:free_chunks"}
+       + $stats->{"$cls:cached_chunks"}, $stats->{"$cls:total_chunks"},
+       "cached chunks aren't counted as used");
+}
+
+# Overwrite keys from several connections, so chunks allocated by one
+# worker get freed by another.
+my @socks = map { $server->new_sock } 1 .. 4;
+for my $n (1 .. 6000) {
+    my $s = $socks[$n % 4];
+    my $key = "key" . ($n % 1500);
+    print $s "set $key 0 0 500 noreply\r\n$value\r\n";
+}
+sub read_back {
+    my ($s, $key) = @_;
+    print $s "get $key\r\n";
+    my $line = <$s>;
+    return undef if $line eq "END\r\n";
+    my $ok = $line eq "VALUE $key 0 500\r\n" && <$s> eq "$value\r\n";
+    <$s>;
+    return $ok ? 1 : 0;
+}
+
+{
+    my $wrong = 0;
+    for my $n (0 .. 1499) {
+        $wrong++ unless read_back($socks[$n % 4], "key$n");
+    }
+    is($wrong, 0, "overwrites from every connection read back");
+}
+
+for my $n (1 .. 5000) {
+    print $sock "set fill$n 0 0 500 noreply\r\n$value\r\n";
+}
+mem_get_is($sock, "fill5000", $value, "filled a few pages");
+
+# Moving a page out of the class drains the magazines first.
+{
+    my $before = mem_stats($sock, ' slabs');
+    cmp_ok($before->{"$cls:total_pages"}, '>', 1, "class has pages to spare");
+    print $sock "slabs reassign $cls 0\r\n";
+    is(scalar <$sock>, "OK\r\n", "page move started");
+
+    my $stats;
+    for (1 .. 20) {
+        $stats = mem_stats($sock, ' slabs');
+        last if $stats->{"$cls:total_pages"} < $before->{"$cls:total_pages"};
+        sleep 0.5;
+    }
+    is($stats->{"$cls:total_pages"}, $before->{"$cls:total_pages"} - 1, "page moved");
+    is($stats->{"$cls:cached_chunks"}, 0, "magazines drained");
+}
+
+{
+    my ($hits, $wrong) = (0, 0);
+    for my $n (1 .. 5000) {
+        my $ok = read_back($sock, "fill$n");
+        next unless defined $ok;
+        $ok ? $hits++ : $wrong++;
+    }
+    cmp_ok($hits, '>', 0, "items survived the move");
+    is($wrong, 0, "and read back intact");
+}
+
+print $sock "set after 0 0 500\r\n$value\r\n";
+is(scalar <$sock>, "STORED\r\n", "stored after the move");
+{
+    my $stats = mem_stats($sock, ' slabs');
+    cmp_ok($stats->{"$cls:cached_chunks"}, '>', 0, "magazines in use again");
+}
+
+# Runs out of memory and keeps evicting.
+{
+    my $server = new_memcached('-m 8 -t 4 -o slab_magazines');
+    my @socks = map { $server->new_sock } 1 .. 4;
+    for my $n (1 .. 40000) {
+        my $s = $socks[$n % 4];
+        print $s "set ev$n 0 0 500 noreply\r\n$value\r\n";
+    }
+    mem_get_is($socks[0], "ev40000", $value, "newest item stored");
+    my $stats = mem_stats($socks[0]);
+    cmp_ok($stats->{evictions}, '>', 0, "evicted to make room");
+}
+
+{
+    my $server = new_memcached('-m 64');
+    my $stats = mem_stats($server->sock, ' settings');
+    is($stats->{slab_magazines}, "no", "off by default");
+    $stats = mem_stats($server->sock, ' slabs');
+    ok(!grep(/cached_chunks/, keys %$stats), "no cached_chunks without magazines");
+}
+
+done_testing();
@@ -138,6 +138,51 @@ void item_unlock(uint32_t hv) {
     mutex_unlock(&item_locks[hv & hashmask(item_lock_hashpower)]);
 }
 
+/*
+ * Read epochs, for lockless_get.
+ *
+ * A worker reading the hash table without the item lock first publishes the
+ * current epoch in its thread struct and clears it when done. Whoever
+ * unlinks something the reader might still be looking at advances the epoch
+ * and waits until no worker is still reading in that epoch or an older one
+ * before the memory is reused.
+ */
+static uint64_t read_epoch = 1;
+
+void read_epoch_enter(LIBEVENT_THREAD *t) {
+    __atomic_store_n(&t->read_epoch, __atomic_load_n(&read_epoch, __ATOMIC_ACQUIRE), __ATOMIC_SEQ_CST);
+    /* Published before anything in the hash table is read. */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void read_epoch_exit(LIBEVENT_THREAD *t) {
+    __atomic_store_n(&t->read_epoch, 0, __ATOMIC_RELEASE);
+}
+
+/* Starts a new epoch, returning the one that just closed. */
+uint64_t read_epoch_advance(void) {
+    return __atomic_fetch_add(&read_epoch, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Whether every worker is done with reads begun in or before epoch. */
+bool read_epoch_passed(const uint64_t epoch) {
+    for (int i = 0; i < settings.num_threads; i++) {
+        uint64_t e = __atomic_load_n(&threads[i].read_epoch, __ATOMIC_SEQ_CST);
+        if (e != 0 && e <= epoch) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Waits out every read that was in progress when called. */
+void read_epoch_synchronize(void) {
+    uint64_t epoch = read_epoch_advance();
+    while (!read_epoch_passed(epoch)) {
+        usleep(10);
+    }
+}
+
 static void wait_for_thread_registration(int nthreads) {
     while (init_count < nthreads) {
         pthread_cond_wait(&init_cond, &init_lock);
@@ -519,6 +564,12 @@ static void *worker_libevent(void *arg) {
     if (me->l == NULL || me->lru_bump_buf == NULL) {
         abort();
     }
+    if (settings.hot_keys && (me->hotkeys = hotkeys_thread_create()) == NULL) {
+        abort();
+    }
+    if (settings.slab_magazines && slabs_magazines_thread_init() != 0) {
+        abort();
+    }
 
     if (settings.drop_privileges) {
         drop_worker_privileges();
@@ -885,6 +936,10 @@ item *item_get(const char *key, const size_t nkey, LIBEVENT_THREAD *t, const boo
     item *it;
     uint32_t hv;
     hv = hash(key, nkey);
+    if (settings.lockless_get &&
+        (it = item_get_lockless(key, nkey, hv, t, do_update)) != NULL) {
+        return it;
+    }
     item_lock(hv);
     it = do_item_get(key, nkey, hv, t, do_update);
     item_unlock(hv);